@@ -2,14 +2,22 @@
 #include <Scripts/ScriptEngine.h>
 #include <Scripts/RegisterSystem.h>
 #include <Scripts/EngineGlobals.h>
+#include <Log/Log.h>
+#include <Memory/Memory.h>
+#include <Metrics/Metrics.h>
+#include <Profiler/Profiler.h>
 
-#include <iostream>
+#include <algorithm>
 #include <string>
 #include <vector>
+#include <deque>
+#include <mutex>
 #include <thread>
 #include <atomic>
 #include <filesystem>
 #include <chrono>
+#include <cstddef>
+#include <cstdio>
 
 #include <SDL3/SDL.h>
 
@@ -79,7 +87,430 @@ static bool SDLEventWatch(void* userdata, SDL_Event* event)
 
 void EngineLog(const char* msg)
 {
-    std::cout << "[Stela] " << msg << std::endl;
+    STELA_LOG_INFO(Engine, "%s", msg);
+}
+
+// Console panel: fed by a log sink on the logging thread, drawn on the main thread
+
+struct ConsoleState
+{
+    std::mutex Mutex;
+    std::deque<Log::Record> Records;
+    size_t MaxRecords = 2000;
+    int MinLevel = (int)Log::Level::Info;
+    bool ShowCategory[(int)Log::Category::Count];
+    bool AutoScroll = true;
+
+    ConsoleState()
+    {
+        for (bool& show : ShowCategory)
+            show = true;
+    }
+};
+
+static ConsoleState gConsole;
+
+static void ConsoleSink(const Log::Record& record)
+{
+    std::lock_guard<std::mutex> lock(gConsole.Mutex);
+    gConsole.Records.push_back(record);
+    while (gConsole.Records.size() > gConsole.MaxRecords)
+        gConsole.Records.pop_front();
+}
+
+static void DrawConsoleWindow(bool* open)
+{
+    if (!ImGui::Begin("Console", open)) {
+        ImGui::End();
+        return;
+    }
+
+    if (ImGui::Button("Clear")) {
+        std::lock_guard<std::mutex> lock(gConsole.Mutex);
+        gConsole.Records.clear();
+    }
+    ImGui::SameLine();
+
+    const char* levels[] = { "Trace", "Debug", "Info", "Warning", "Error" };
+    ImGui::SetNextItemWidth(100.0f);
+    ImGui::Combo("Level", &gConsole.MinLevel, levels, IM_ARRAYSIZE(levels));
+
+    for (int i = 0; i < (int)Log::Category::Count; i++) {
+        ImGui::SameLine();
+        ImGui::Checkbox(Log::CategoryName((Log::Category)i), &gConsole.ShowCategory[i]);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto-scroll", &gConsole.AutoScroll);
+
+    if (Log::DroppedCount() > 0) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(%llu dropped)", (unsigned long long)Log::DroppedCount());
+    }
+
+    ImGui::Separator();
+    ImGui::BeginChild("ConsoleScroll", ImVec2(0, 0), ImGuiChildFlags_None, ImGuiWindowFlags_HorizontalScrollbar);
+    {
+        std::lock_guard<std::mutex> lock(gConsole.Mutex);
+        for (const Log::Record& record : gConsole.Records) {
+            if ((int)record.Severity < gConsole.MinLevel || !gConsole.ShowCategory[(int)record.Channel])
+                continue;
+
+            ImVec4 color = ImGui::GetStyleColorVec4(ImGuiCol_Text);
+            if (record.Severity == Log::Level::Error)
+                color = ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+            else if (record.Severity == Log::Level::Warning)
+                color = ImVec4(1.0f, 0.8f, 0.3f, 1.0f);
+            else if (record.Severity <= Log::Level::Debug)
+                color = ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled);
+
+            ImGui::TextColored(color, "[%s] %s", Log::CategoryName(record.Channel), record.Message.c_str());
+        }
+    }
+    if (gConsole.AutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+        ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
+
+    ImGui::End();
+}
+
+// FPS panel: reads the metrics registry, refreshed twice a second so the numbers are readable.
+// Histograms show the distribution of the last interval rather than since startup.
+
+struct FrameStatsState
+{
+    std::vector<Metrics::Sample> Previous;
+    std::vector<Metrics::Sample> Interval;
+    double LastRefresh = -1.0;
+};
+
+static FrameStatsState gFrameStats;
+
+static void RefreshFrameStats()
+{
+    std::vector<Metrics::Sample> current = Metrics::Snapshot();
+    gFrameStats.Interval = current;
+    // The registry only ever appends, so equal indices are the same metric
+    for (size_t i = 0; i < current.size() && i < gFrameStats.Previous.size(); i++) {
+        if (current[i].Kind == Metrics::Type::Histogram)
+            gFrameStats.Interval[i].Distribution = current[i].Distribution.Delta(gFrameStats.Previous[i].Distribution);
+    }
+    gFrameStats.Previous = std::move(current);
+}
+
+static void DrawFPSWindow(bool* open)
+{
+    if (!ImGui::Begin("Debug: FPS", open)) {
+        ImGui::End();
+        return;
+    }
+
+    double now = ImGui::GetTime();
+    if (gFrameStats.LastRefresh < 0.0 || now - gFrameStats.LastRefresh >= 0.5) {
+        gFrameStats.LastRefresh = now;
+        RefreshFrameStats();
+    }
+
+    for (const Metrics::Sample& sample : gFrameStats.Interval) {
+        if (sample.Name == "stela_frame_time_us" && sample.Distribution.Count > 0) {
+            const Metrics::HistogramSnapshot& frame = sample.Distribution;
+            ImGui::Text("FPS: %.1f", 1000000.0 / frame.Mean());
+            ImGui::Text("Frame: p50 %.2f ms  p99 %.2f ms", frame.Percentile(50.0) / 1000.0, frame.Percentile(99.0) / 1000.0);
+        }
+    }
+
+    ImGui::Separator();
+    if (ImGui::BeginTable("Metrics", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Metric");
+        ImGui::TableSetupColumn("Value");
+        ImGui::TableHeadersRow();
+
+        for (const Metrics::Sample& sample : gFrameStats.Interval) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            if (sample.Labels.empty())
+                ImGui::TextUnformatted(sample.Name.c_str());
+            else
+                ImGui::Text("%s{%s}", sample.Name.c_str(), sample.Labels.c_str());
+            if (!sample.Help.empty() && ImGui::IsItemHovered())
+                ImGui::SetTooltip("%s", sample.Help.c_str());
+
+            ImGui::TableSetColumnIndex(1);
+            if (sample.Kind == Metrics::Type::Histogram) {
+                const Metrics::HistogramSnapshot& h = sample.Distribution;
+                ImGui::Text("n %llu  p50 %llu  p99 %llu",
+                    (unsigned long long)h.Count, (unsigned long long)h.Percentile(50.0), (unsigned long long)h.Percentile(99.0));
+            } else {
+                ImGui::Text("%.0f", sample.Value);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+#if !defined(__APPLE__)
+// GPU panel: per-pass GPU time from the renderer's timestamp queries, a couple of frames old,
+// plus the frame timeline recorder that writes chrome://tracing files.
+
+static void DrawGpuWindow(bool* open, Vulkan& vulkan)
+{
+    if (!ImGui::Begin("Debug: GPU", open)) {
+        ImGui::End();
+        return;
+    }
+
+    // Presentation: a new mode is applied by recreating the swapchain before the next frame
+    struct PresentModeOption { VkPresentModeKHR Mode; const char* Name; };
+    static const PresentModeOption presentModes[] = {
+        {VK_PRESENT_MODE_FIFO_KHR, "FIFO (vsync)"},
+        {VK_PRESENT_MODE_FIFO_RELAXED_KHR, "FIFO relaxed"},
+        {VK_PRESENT_MODE_MAILBOX_KHR, "Mailbox"},
+        {VK_PRESENT_MODE_IMMEDIATE_KHR, "Immediate"},
+    };
+    const char* current = "Other";
+    for (const PresentModeOption& option : presentModes) {
+        if (option.Mode == vulkan.PresentMode)
+            current = option.Name;
+    }
+    if (ImGui::BeginCombo("Present mode", current)) {
+        for (const PresentModeOption& option : presentModes) {
+            bool available = false;
+            for (VkPresentModeKHR mode : vulkan.AvailablePresentModes)
+                available |= mode == option.Mode;
+            if (ImGui::Selectable(option.Name, option.Mode == vulkan.PresentMode, available ? 0 : ImGuiSelectableFlags_Disabled))
+                vulkan.SetPresentMode(option.Mode);
+        }
+        ImGui::EndCombo();
+    }
+    if (vulkan.PresentWait) {
+        int queued = (int)vulkan.MaxQueuedPresents;
+        if (ImGui::SliderInt("Max queued presents", &queued, 0, 3, queued == 0 ? "off" : "%d"))
+            vulkan.MaxQueuedPresents = (uint32_t)queued;
+    }
+    ImGui::Text("%ux%u, %zu images, %u frames in flight", vulkan.SwapChainExtent.width, vulkan.SwapChainExtent.height,
+        vulkan.swapChainImages.size(), vulkan.FramesInFlight);
+    ImGui::Separator();
+
+    // Render scale: fixed, or driven by GPU frame time when a target is set
+    DynamicResolution& resolution = vulkan.Resolution;
+    if (!vulkan.ScaledRenderingSupported)
+        ImGui::BeginDisabled();
+    bool dynamic = resolution.IsDynamic();
+    if (ImGui::Checkbox("Dynamic resolution", &dynamic))
+        resolution.TargetMilliseconds = dynamic ? 16.0 : 0.0;
+    if (dynamic) {
+        float target = (float)resolution.TargetMilliseconds;
+        if (ImGui::SliderFloat("Target GPU ms", &target, 2.0f, 33.0f, "%.1f"))
+            resolution.TargetMilliseconds = target;
+    }
+    float scale = resolution.Scale();
+    if (dynamic)
+        ImGui::BeginDisabled();
+    if (ImGui::SliderFloat("Render scale", &scale, DynamicResolution::MinScale, DynamicResolution::MaxScale, "%.2f"))
+        resolution.SetScale(scale);
+    if (dynamic)
+        ImGui::EndDisabled();
+    if (!vulkan.ScaledRenderingSupported)
+        ImGui::EndDisabled();
+    ImGui::Text("Scene %ux%u", vulkan.SceneExtent.width, vulkan.SceneExtent.height);
+    ImGui::Separator();
+
+    // Frame capture: the viewport image is read back and written by a worker thread
+    static int captureFrames = 1;
+    static int captureFormat = 0;
+    ImGui::SetNextItemWidth(100.0f);
+    ImGui::InputInt("Frames", &captureFrames);
+    captureFrames = std::max(captureFrames, 1);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80.0f);
+    ImGui::Combo("##CaptureFormat", &captureFormat, "PNG\0YUV\0");
+    ImGui::SameLine();
+    bool capturing = vulkan.Capture.IsBusy();
+    if (capturing)
+        ImGui::BeginDisabled();
+    if (ImGui::Button(capturing ? "Capturing..." : "Capture"))
+        vulkan.Capture.Request((uint32_t)captureFrames, captureFormat == 0 ? CaptureFormat::Png : CaptureFormat::Yuv);
+    if (capturing)
+        ImGui::EndDisabled();
+
+    bool hotReload = vulkan.Shaders.IsHotReloadEnabled();
+    if (ImGui::Checkbox("Reload edited shaders", &hotReload))
+        vulkan.Shaders.SetHotReload(hotReload);
+    if (!ShaderSystem::CanCompile()) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(rebuild the .spv files; no shaderc)");
+    }
+    if (vulkan.Meshes.IsGpuDriven()) {
+        bool occlusion = vulkan.Meshes.IsOcclusionCulling();
+        if (ImGui::Checkbox("Occlusion culling", &occlusion))
+            vulkan.Meshes.SetOcclusionCulling(occlusion);
+    }
+    ImGui::Separator();
+
+    GpuProfiler& gpu = vulkan.GpuTimings;
+    if (!gpu.IsSupported()) {
+        ImGui::TextDisabled("The graphics queue does not support timestamps");
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("GPU frame: %.3f ms", gpu.FrameMilliseconds());
+    ImGui::TextDisabled(gpu.IsCalibrated() ? "Clocks calibrated (VK_EXT_calibrated_timestamps)" : "Clocks estimated from submit time");
+
+    bool statistics = gpu.IsStatisticsEnabled();
+    if (!gpu.StatisticsSupported())
+        ImGui::BeginDisabled();
+    if (ImGui::Checkbox("Pipeline statistics", &statistics))
+        gpu.SetStatisticsEnabled(statistics);
+    if (!gpu.StatisticsSupported())
+        ImGui::EndDisabled();
+
+    bool recording = Profiler::IsEnabled();
+    if (ImGui::Checkbox("Record timeline", &recording))
+        Profiler::SetEnabled(recording);
+    ImGui::SameLine();
+    if (ImGui::Button("Write trace")) {
+        if (Profiler::WriteTrace("frame_trace.json"))
+            STELA_LOG_INFO(Editor, "Wrote frame timeline to frame_trace.json");
+        else
+            STELA_LOG_ERROR(Editor, "Failed to write frame_trace.json");
+    }
+
+    ImGui::Separator();
+    int columns = gpu.IsStatisticsEnabled() ? 7 : 2;
+    if (ImGui::BeginTable("GpuPasses", columns, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("ms");
+        if (columns > 2) {
+            ImGui::TableSetupColumn("Primitives");
+            ImGui::TableSetupColumn("VS");
+            ImGui::TableSetupColumn("Clipped");
+            ImGui::TableSetupColumn("FS");
+            ImGui::TableSetupColumn("CS");
+        }
+        ImGui::TableHeadersRow();
+
+        for (const GpuZoneResult& zone : gpu.Results()) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(zone.Name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.3f", zone.Milliseconds);
+            for (int i = 2; i < columns; i++) {
+                ImGui::TableSetColumnIndex(i);
+                if (zone.HasStatistics)
+                    ImGui::Text("%llu", (unsigned long long)zone.Statistics[i - 2]);
+                else
+                    ImGui::TextDisabled("-");
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+#endif
+
+// Memory panel: live/peak bytes per tag from the tracking allocator, plus allocations made each frame.
+// Samples are taken once per editor frame, after the engine has closed the previous one.
+
+struct MemoryPanelState
+{
+    static constexpr int HistoryLength = 240;
+    float AllocationHistory[(size_t)Memory::Tag::Count][HistoryLength] = {};
+    int Head = 0;
+};
+
+static MemoryPanelState gMemoryPanel;
+
+static void SampleMemoryStats()
+{
+    for (size_t i = 0; i < (size_t)Memory::Tag::Count; i++)
+        gMemoryPanel.AllocationHistory[i][gMemoryPanel.Head] = (float)Memory::GetStats((Memory::Tag)i).FrameAllocations;
+    gMemoryPanel.Head = (gMemoryPanel.Head + 1) % MemoryPanelState::HistoryLength;
+}
+
+static void FormatBytes(char* out, size_t size, uint64_t bytes)
+{
+    if (bytes >= 1024ull * 1024 * 1024)
+        snprintf(out, size, "%.2f GB", bytes / (1024.0 * 1024.0 * 1024.0));
+    else if (bytes >= 1024 * 1024)
+        snprintf(out, size, "%.2f MB", bytes / (1024.0 * 1024.0));
+    else if (bytes >= 1024)
+        snprintf(out, size, "%.1f KB", bytes / 1024.0);
+    else
+        snprintf(out, size, "%llu B", (unsigned long long)bytes);
+}
+
+static void DrawMemoryWindow(bool* open)
+{
+    if (!ImGui::Begin("Debug: Memory", open)) {
+        ImGui::End();
+        return;
+    }
+
+    if (!Memory::NewHooksEnabled())
+        ImGui::TextDisabled("operator new is not tracked in this build; only tagged containers, arenas and Vulkan are counted");
+
+    if (ImGui::BeginTable("MemoryTags", 7, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Tag");
+        ImGui::TableSetupColumn("Live");
+        ImGui::TableSetupColumn("Peak");
+        ImGui::TableSetupColumn("Budget");
+        ImGui::TableSetupColumn("Blocks");
+        ImGui::TableSetupColumn("Allocs/frame");
+        ImGui::TableSetupColumn("Bytes/frame");
+        ImGui::TableHeadersRow();
+
+        char text[32];
+        for (size_t i = 0; i < (size_t)Memory::Tag::Count; i++) {
+            Memory::Tag tag = (Memory::Tag)i;
+            Memory::TagStats stats = Memory::GetStats(tag);
+            bool overBudget = stats.Budget && stats.LiveBytes > stats.Budget;
+
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(Memory::TagName(tag));
+
+            ImGui::TableSetColumnIndex(1);
+            FormatBytes(text, sizeof(text), stats.LiveBytes);
+            if (overBudget)
+                ImGui::TextColored(ImVec4(1.0f, 0.35f, 0.35f, 1.0f), "%s", text);
+            else
+                ImGui::TextUnformatted(text);
+
+            ImGui::TableSetColumnIndex(2);
+            FormatBytes(text, sizeof(text), stats.PeakBytes);
+            ImGui::TextUnformatted(text);
+
+            ImGui::TableSetColumnIndex(3);
+            if (stats.Budget) {
+                FormatBytes(text, sizeof(text), stats.Budget);
+                ImGui::TextUnformatted(text);
+            } else {
+                ImGui::TextDisabled("-");
+            }
+
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%llu", (unsigned long long)stats.LiveAllocations);
+            ImGui::TableSetColumnIndex(5);
+            ImGui::Text("%llu", (unsigned long long)stats.FrameAllocations);
+            ImGui::TableSetColumnIndex(6);
+            FormatBytes(text, sizeof(text), stats.FrameBytes);
+            ImGui::TextUnformatted(text);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Separator();
+    ImGui::TextUnformatted("Allocations per frame");
+    for (size_t i = 0; i < (size_t)Memory::Tag::Count; i++) {
+        ImGui::PlotLines(Memory::TagName((Memory::Tag)i), gMemoryPanel.AllocationHistory[i], MemoryPanelState::HistoryLength,
+            gMemoryPanel.Head, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+    }
+
+    ImGui::End();
 }
 
 // Script change detection
@@ -125,7 +556,7 @@ bool ScriptsChanged()
 
 bool ReloadScripts(Stela* engine)
 {
-    std::cout << "[Editor] Reloading Scripts...\n";
+    STELA_LOG_INFO(Editor, "Reloading Scripts...");
 
     // 1. Shutdown existing scripts
     RunShutdowns();
@@ -137,7 +568,7 @@ bool ReloadScripts(Stela* engine)
     // scriptFolder is exeDir / "Scripts"
     std::string buildCmd = "cd \"" + scriptFolder.string() + "\" && dotnet build -c Debug";
     
-    std::cout << "[Editor] Running: " << buildCmd << std::endl;
+    STELA_LOG_INFO(Editor, "Running: %s", buildCmd);
     if (system(buildCmd.c_str()) != 0)
     {
         SDL_ShowSimpleMessageBox(
@@ -157,7 +588,7 @@ bool ReloadScripts(Stela* engine)
     
     // Safety check: bin folder must exist
     if (!fs::exists(scriptFolder / "bin")) {
-        std::cerr << "[Editor] Build succeeded but 'bin' folder missing in " << scriptFolder << std::endl;
+        STELA_LOG_ERROR(Editor, "Build succeeded but 'bin' folder missing in %s", scriptFolder.string());
         return false;
     }
 
@@ -167,19 +598,19 @@ bool ReloadScripts(Stela* engine)
     }
 
     if (dllPath.empty()) {
-        std::cerr << "[Editor] Could not find built artifacts (UserScripts.dll) in " << scriptFolder << "/bin" << std::endl;
+        STELA_LOG_ERROR(Editor, "Could not find built artifacts (UserScripts.dll) in %s/bin", scriptFolder.string());
         return false;
     }
 
     try {
-        std::cout << "[Editor] Copying " << dllPath.filename() << " to " << exeDir << std::endl;
+        STELA_LOG_INFO(Editor, "Copying %s to %s", dllPath.filename().string(), exeDir.string());
         fs::copy_file(dllPath, exeDir / "UserScripts.dll", fs::copy_options::overwrite_existing);
         // We don't strictly need the runtimeconfig for UserScripts anymore since Loader handles it, but good to have.
         if (!configPath.empty()) {
              fs::copy_file(configPath, exeDir / "UserScripts.runtimeconfig.json", fs::copy_options::overwrite_existing);
         }
     } catch (std::exception& e) {
-        std::cerr << "[Editor] Failed to copy script artifacts: " << e.what() << std::endl;
+        STELA_LOG_ERROR(Editor, "Failed to copy script artifacts: %s", e.what());
         return false;
     }
 
@@ -195,10 +626,17 @@ bool ReloadScripts(Stela* engine)
 
 int main()
 {
+    exeDir = GetExeDir();
+    Log::OpenFile((exeDir / "Stela_EDITOR.log").string().c_str());
+    int consoleSink = Log::AddSink(ConsoleSink);
+
     Stela engine;
     engine.Init("Stela Editor", 1920, 1080);
 
-    // ImGui Initialization
+    // ImGui Initialization. Its heap (draw lists, fonts, windows) is charged to the Editor tag.
+    ImGui::SetAllocatorFunctions(
+        [](size_t size, void*) { return Memory::Allocate(size, alignof(std::max_align_t), Memory::Tag::Editor); },
+        [](void* ptr, void*) { Memory::Free(ptr); });
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
@@ -208,32 +646,24 @@ int main()
     // Initialize SDL3 platform backend
     ImGui_ImplSDL3_InitForVulkan(engine.Window);
 
-    // Create descriptor pool for ImGui
+    // Create descriptor pool for ImGui. Scene resources live in the renderer's bindless set, so
+    // ImGui only needs combined image samplers: its font atlas and the textures the panels show.
     VkDescriptorPoolSize pool_sizes[] = {
-        {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-        {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-        {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64}
     };
 
     VkDescriptorPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    pool_info.maxSets = 1000 * (uint32_t)(sizeof(pool_sizes) / sizeof(pool_sizes[0]));
+    pool_info.maxSets = 64;
     pool_info.poolSizeCount = (uint32_t)(sizeof(pool_sizes) / sizeof(pool_sizes[0]));
     pool_info.pPoolSizes = pool_sizes;
 
     VkDescriptorPool imguiDescriptorPool;
-    if (vkCreateDescriptorPool(engine.vulkan.Device, &pool_info, nullptr, &imguiDescriptorPool) != VK_SUCCESS)
+    if (vkCreateDescriptorPool(engine.vulkan.Device, &pool_info, engine.vulkan.pAllocator, &imguiDescriptorPool) != VK_SUCCESS)
     {
-        std::cerr << "Failed to create ImGui descriptor pool" << std::endl;
+        STELA_LOG_ERROR(Editor, "Failed to create ImGui descriptor pool");
+        Log::Shutdown();
         return 1;
     }
 
@@ -246,12 +676,13 @@ int main()
     auto qf = engine.vulkan.FindQueueFamilies(engine.vulkan.PhysicalDevice);
     init_info.QueueFamily = qf.graphicsFamily.value();
     init_info.Queue = engine.vulkan.GraphicsQueue;
-    init_info.PipelineCache = VK_NULL_HANDLE;
+    init_info.PipelineCache = engine.vulkan.PersistentCache.Handle();
     init_info.DescriptorPool = imguiDescriptorPool;
     init_info.DescriptorPoolSize = 0;
     init_info.MinImageCount = 2;
-    init_info.ImageCount = static_cast<uint32_t>(engine.vulkan.swapChainImages.size());
-    init_info.Allocator = nullptr;
+    // ImGui cycles its vertex buffers through ImageCount sets; one per frame in flight at least
+    init_info.ImageCount = std::max(static_cast<uint32_t>(engine.vulkan.swapChainImages.size()), engine.vulkan.FramesInFlight);
+    init_info.Allocator = engine.vulkan.pAllocator;
     init_info.CheckVkResultFn = nullptr;
 
     // Set the RenderPass in the PipelineInfoMain structure (newer API)
@@ -265,6 +696,10 @@ int main()
     // Event watch so Editor can receive SDL events before engine polls them
     SDL_AddEventWatch(SDLEventWatch, nullptr);
 
+    // Edited shaders are picked up while the Editor runs, unless STELA_SHADER_HOT_RELOAD says otherwise
+    if (!std::getenv("STELA_SHADER_HOT_RELOAD"))
+        engine.vulkan.Shaders.SetHotReload(true);
+
     // Set Vulkan command recording callback to render ImGui within engine render pass
     engine.vulkan.ImGuiRenderCallback = [&](VkCommandBuffer cmd)
     {
@@ -284,8 +719,6 @@ int main()
     SDL_AddEventWatch(SDLEventWatch, nullptr);
 #endif
 
-    exeDir = GetExeDir();
-    
     // Check for Dev Environment (Source Scripts)
     bool devEnv = false;
 #if defined(__APPLE__)
@@ -296,7 +729,7 @@ int main()
         if (fs::exists(sourceScripts) && fs::exists(sourceScripts / "UserScripts.csproj")) {
             scriptFolder = sourceScripts;
             devEnv = true;
-            std::cout << "[Editor] Development Environment Detected. Using Source Scripts at: " << scriptFolder << std::endl;
+            STELA_LOG_INFO(Editor, "Development Environment Detected. Using Source Scripts at: %s", scriptFolder.string());
         }
     }
 #endif
@@ -316,7 +749,7 @@ int main()
     }
 
     if (!fs::exists(scriptFolder)) {
-        std::cerr << "[Editor] Warning: 'Scripts' folder not found next to executable (" << scriptFolder << ")\n";
+        STELA_LOG_WARNING(Editor, "'Scripts' folder not found next to executable (%s)", scriptFolder.string());
     }
 
     // Initial Load
@@ -334,16 +767,16 @@ int main()
         // Check if we need to build
         if (!dllExists || ScriptsChanged()) {
             if (!ReloadScripts(&engine)) {
-                std::cerr << "[Editor] Initial script load failed.\n";
+                STELA_LOG_ERROR(Editor, "Initial script load failed.");
             }
         } else {
             // DLL exists and is newer than source, just load it
-            std::cout << "[Editor] Scripts up to date. Loading existing UserScripts.dll...\n";
+            STELA_LOG_INFO(Editor, "Scripts up to date. Loading existing UserScripts.dll...");
             ScriptEngine::Init(exeDir.string().c_str());
             RunStarts();
         }
     } else {
-        std::cerr << "[Editor] No scripts to load.\n";
+        STELA_LOG_WARNING(Editor, "No scripts to load.");
     }
 
     // Start watcher thread
@@ -374,6 +807,9 @@ int main()
     bool pendingReload = false;
     // Persistent UI toggles
     bool showFPSWindow = false;
+    bool showMemoryWindow = false;
+    bool showGpuWindow = false;
+    bool showConsoleWindow = true;
 
         while (!quit)
     {
@@ -389,6 +825,9 @@ int main()
             pendingReload = false;
         }
 
+        // Editor UI work below is charged to the Editor tag; the engine tags its own phases inside RunFrame
+        Memory::ScopedTag editorTag(Memory::Tag::Editor);
+
         // Begin ImGui frame (Editor-only)
         #if !defined(__APPLE__)
         ImGui_ImplVulkan_NewFrame();
@@ -435,6 +874,11 @@ int main()
             if (ImGui::BeginMenu("Debug")) {
                 // Toggle persistent FPS window instead of creating it transiently inside the menu
                 ImGui::MenuItem("FPS", nullptr, &showFPSWindow);
+                ImGui::MenuItem("Memory", nullptr, &showMemoryWindow);
+#if !defined(__APPLE__)
+                ImGui::MenuItem("GPU", nullptr, &showGpuWindow);
+#endif
+                ImGui::MenuItem("Console", nullptr, &showConsoleWindow);
                 ImGui::EndMenu();
             }
             ImGui::EndMainMenuBar();
@@ -450,7 +894,9 @@ int main()
             ImGui::DockBuilderSetNodeSize(dockspace_id, ImGui::GetMainViewport()->WorkSize);
             
             ImGuiID dock_main_id = dockspace_id;
+            ImGuiID dock_bottom_id = ImGui::DockBuilderSplitNode(dock_main_id, ImGuiDir_Down, 0.25f, nullptr, &dock_main_id);
             ImGui::DockBuilderDockWindow("Viewport", dock_main_id);
+            ImGui::DockBuilderDockWindow("Console", dock_bottom_id);
             
             ImGui::DockBuilderFinish(dockspace_id);
         }
@@ -460,9 +906,22 @@ int main()
         ImGui::Begin("Viewport");
         ImVec2 viewportSize = ImGui::GetContentRegionAvail();
 #if !defined(__APPLE__)
+        // The scene is rendered at the panel's pixel size; a resize swaps the image under the descriptor
+        ImVec2 framebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+        engine.vulkan.SetViewportExtent({(uint32_t)(viewportSize.x * framebufferScale.x), (uint32_t)(viewportSize.y * framebufferScale.y)});
         static VkDescriptorSet sceneDS = VK_NULL_HANDLE;
-        if (sceneDS == VK_NULL_HANDLE) {
-             sceneDS = ImGui_ImplVulkan_AddTexture(engine.vulkan.OffscreenSampler, engine.vulkan.OffscreenImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        static VkImageView sceneView = VK_NULL_HANDLE;
+        static std::vector<std::pair<VkDescriptorSet, uint64_t>> retiredSceneDS;
+        if (sceneView != engine.vulkan.Offscreen.View) {
+             if (sceneDS != VK_NULL_HANDLE)
+                 retiredSceneDS.push_back({sceneDS, engine.vulkan.FrameNumber});
+             sceneView = engine.vulkan.Offscreen.View;
+             sceneDS = ImGui_ImplVulkan_AddTexture(engine.vulkan.OffscreenSampler, sceneView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+        // Sets still referenced by frames in flight are freed once those frames complete
+        while (!retiredSceneDS.empty() && retiredSceneDS.front().second <= engine.vulkan.CompletedFrames) {
+             ImGui_ImplVulkan_RemoveTexture(retiredSceneDS.front().first);
+             retiredSceneDS.erase(retiredSceneDS.begin());
         }
         ImGui::Image((ImTextureID)sceneDS, viewportSize);
 #else
@@ -472,9 +931,22 @@ int main()
 
         // Persistent FPS window (stays open until user closes it)
         if (showFPSWindow) {
-            ImGui::Begin("Debug: FPS", &showFPSWindow);
-            ImGui::Text("FPS: %.1f", 1.0f / engine.deltaTime);
-            ImGui::End();
+            DrawFPSWindow(&showFPSWindow);
+        }
+
+        if (showConsoleWindow) {
+            DrawConsoleWindow(&showConsoleWindow);
+        }
+
+#if !defined(__APPLE__)
+        if (showGpuWindow) {
+            DrawGpuWindow(&showGpuWindow, engine.vulkan);
+        }
+#endif
+
+        SampleMemoryStats();
+        if (showMemoryWindow) {
+            DrawMemoryWindow(&showMemoryWindow);
         }
 
         ImGui::Render();
@@ -504,7 +976,7 @@ int main()
     // Destroy descriptor pool created for ImGui
     if (imguiDescriptorPool != VK_NULL_HANDLE)
     {
-        vkDestroyDescriptorPool(engine.vulkan.Device, imguiDescriptorPool, nullptr);
+        vkDestroyDescriptorPool(engine.vulkan.Device, imguiDescriptorPool, engine.vulkan.pAllocator);
         imguiDescriptorPool = VK_NULL_HANDLE;
     }
 #else
@@ -521,5 +993,8 @@ int main()
 
     RunShutdowns();
     ScriptEngine::Shutdown();
+
+    Log::RemoveSink(consoleSink);
+    Log::Shutdown();
     return 0;
 }
@@ -2,9 +2,17 @@
 #include <Scripts/ScriptEngine.h>
 #include <Scripts/RegisterSystem.h>
 #include <Scripts/EngineGlobals.h>
+#include <Log/Log.h>
+#if !defined(__APPLE__)
+#include <Render/Vulkan/MeshBenchmark.h>
+#include <Render/Vulkan/TextureCooker.h>
+#endif
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <string>
+#include <cstring>
 #include <filesystem>
 #include <vector>
 
@@ -39,45 +47,151 @@ static fs::path GetExeDir()
 
 void EngineLog(const char* msg)
 {
-    std::cout << "[Stela] " << msg << std::endl;
+    STELA_LOG_INFO(Engine, "%s", msg);
 }
 
-int main()
+static bool HasArg(int argc, char** argv, const char* flag)
 {
-    Stela engine;
-    engine.Init("Stela Runtime");
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], flag) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Value following `flag`, or null when the flag is absent or last
+static const char* ArgValue(int argc, char** argv, const char* flag)
+{
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], flag) == 0)
+            return argv[i + 1];
+    }
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    // --startup-benchmark: exit once the first frame has been presented and report time-to-first-frame
+    bool startupBenchmark = HasArg(argc, argv, "--startup-benchmark");
+    // --mesh-benchmark: draw 100k instanced meshes under 1024 lights for a fixed number of frames and report frame time
+    bool meshBenchmark = HasArg(argc, argv, "--mesh-benchmark");
+    // --capture <frames> [--capture-yuv]: write the first frames to disk (see FrameCapture) and exit once they are written
+    const char* captureArg = ArgValue(argc, argv, "--capture");
+    uint32_t captureFrames = captureArg ? (uint32_t)std::max(0, std::atoi(captureArg)) : 0;
+    bool captureYuv = HasArg(argc, argv, "--capture-yuv");
 
     auto exeDir = GetExeDir();
-    
+    Log::OpenFile((exeDir / "Stela_RUNTIME.log").string().c_str());
+
+#if !defined(__APPLE__)
+    // --cook-texture <source.tga> <destination.ktx2> [--texture-codec bc1|bc3|bc4|bc5|rgba8] [--linear] [--no-mips]:
+    // compress a texture for TextureStreamer and exit; relative paths are taken from the working directory
+    const char* cookSource = ArgValue(argc, argv, "--cook-texture");
+    if (cookSource) {
+        const char* cookDestination = ArgValue(argc, argv, cookSource);
+        if (!cookDestination) {
+            STELA_LOG_ERROR(Engine, "--cook-texture needs a source and a destination");
+            Log::Shutdown();
+            return 1;
+        }
+        TextureCookSettings settings;
+        settings.Srgb = !HasArg(argc, argv, "--linear");
+        settings.Mipmaps = !HasArg(argc, argv, "--no-mips");
+        if (const char* codec = ArgValue(argc, argv, "--texture-codec")) {
+            const std::pair<const char*, TextureCodec> codecs[] = {{"bc1", TextureCodec::BC1}, {"bc3", TextureCodec::BC3},
+                {"bc4", TextureCodec::BC4}, {"bc5", TextureCodec::BC5}, {"rgba8", TextureCodec::RGBA8}};
+            auto found = std::find_if(std::begin(codecs), std::end(codecs), [&](const auto& entry) { return std::strcmp(entry.first, codec) == 0; });
+            if (found == std::end(codecs)) {
+                STELA_LOG_ERROR(Engine, "Unknown texture codec %s", codec);
+                Log::Shutdown();
+                return 1;
+            }
+            settings.Codec = found->second;
+        }
+        bool cooked = TextureCooker::CookFile(cookSource, cookDestination, settings);
+        Log::Shutdown();
+        return cooked ? 0 : 1;
+    }
+#endif
+
     // Ensure we are working in the correct directory (fixes relative path issues)
     fs::current_path(exeDir);
     
     // Add common locations for dotnet to PATH (GUI apps often have limited PATH)
+    // Done before startup so no init task sees the environment change under it
     #if defined(__APPLE__) || defined(__linux__)
     std::string pathEnv = std::getenv("PATH");
     std::string newPath = pathEnv + ":/usr/local/bin:/usr/local/share/dotnet:/opt/homebrew/bin"; // Standard locations
     setenv("PATH", newPath.c_str(), 1);
     #endif
 
-    fs::path scriptFolder = exeDir / "Scripts";
-    
     // Runtime should not build scripts. It expects UserScripts.dll to be present.
     bool dllExists = fs::exists(exeDir / "UserScripts.dll");
 
     if (!dllExists) {
-        std::cerr << "[Runtime] Error: 'UserScripts.dll' not found. Please build the project using the Editor.\n";
+        STELA_LOG_ERROR(Engine, "'UserScripts.dll' not found. Please build the project using the Editor.");
     }
 
-    // Init Engine
-    ScriptEngine::Init(exeDir.string().c_str());
+    Stela engine;
+    StartupGraph startup;
+    engine.AddInitTasks(startup, "Stela Runtime");
+
+    // CLR hosting doesn't touch the renderer, so it overlaps with window and Vulkan setup
+    std::string assemblyDir = exeDir.string();
+    startup.Add("Scripts", {}, [&assemblyDir] { ScriptEngine::Init(assemblyDir.c_str()); });
+
+    engine.RunStartup(startup);
     RunStarts();
 
-    engine.Run();
+    if (startupBenchmark) {
+        while (!engine.bQuit && engine.FrameCount == 0)
+            engine.RunFrame();
+        engine.WaitIdle();
+
+        double firstFrameMs = StartupGraph::Now();
+        STELA_LOG_INFO(Engine, "Startup benchmark: startup graph %.1f ms, time to first frame %.1f ms", startup.WallMs(), firstFrameMs);
+        if (startup.WriteTrace((exeDir / "startup_trace.json").string()))
+            STELA_LOG_INFO(Engine, "Startup trace written to %s", (exeDir / "startup_trace.json").string());
+    }
+#if !defined(__APPLE__)
+    else if (meshBenchmark) {
+        MeshBenchmark scene;
+        scene.Init(engine.vulkan.Meshes, engine.vulkan.Lights);
+
+        const uint64_t frames = 600;
+        uint64_t firstFrame = engine.FrameCount;
+        auto start = std::chrono::steady_clock::now();
+        while (!engine.bQuit && engine.FrameCount - firstFrame < frames) {
+            float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            VkExtent2D extent = engine.vulkan.SwapChainExtent;
+            scene.Submit(time, (float)extent.width / (float)extent.height);
+            engine.RunFrame();
+        }
+        engine.WaitIdle();
+
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        uint64_t presented = engine.FrameCount - firstFrame;
+        STELA_LOG_INFO(Engine, "Mesh benchmark: %llu frames, %.2f ms/frame, %u instances in %u draws, %u lights",
+                       (unsigned long long)presented, presented ? elapsedMs / presented : 0.0,
+                       engine.vulkan.Meshes.InstanceCount(), engine.vulkan.Meshes.DrawCount(), engine.vulkan.Lights.LightCount());
+    }
+    else if (captureFrames) {
+        FrameCapture& capture = engine.vulkan.Capture;
+        capture.Request(captureFrames, captureYuv ? CaptureFormat::Yuv : CaptureFormat::Png);
+        while (!engine.bQuit && capture.IsBusy())
+            engine.RunFrame();
+        engine.WaitIdle();
+    }
+#endif
+    else {
+        engine.Run();
+    }
 
     engine.Cleanup();
     
     RunShutdowns();
     ScriptEngine::Shutdown();
 
+    Log::Shutdown();
     return 0;
 }
@@ -15,12 +15,16 @@ namespace Stela
         // Callbacks from C++
         private static IntPtr _logCallback;
         private static IntPtr _inputCallback;
+        private static IntPtr _reportGcCallback;
+        private static IntPtr _captureCallback;
 
         [UnmanagedCallersOnly]
-        public static void Init(IntPtr logCallback, IntPtr inputCallback)
+        public static void Init(IntPtr logCallback, IntPtr inputCallback, IntPtr reportGcCallback, IntPtr captureCallback)
         {
             _logCallback = logCallback;
             _inputCallback = inputCallback;
+            _reportGcCallback = reportGcCallback;
+            _captureCallback = captureCallback;
             Console.WriteLine("[Loader] Initialized.");
         }
 
@@ -78,7 +82,7 @@ namespace Stela
 
                 if (initMethod != null)
                 {
-                    initMethod.Invoke(null, new object[] { _logCallback, _inputCallback });
+                    initMethod.Invoke(null, new object[] { _logCallback, _inputCallback, _reportGcCallback, _captureCallback });
                 }
 
                 return 0;
@@ -0,0 +1,29 @@
+using System;
+
+namespace Stela
+{
+    public enum CaptureFormat
+    {
+        Png, // one PNG per frame
+        Yuv  // all frames in one raw I420 file
+    }
+
+    public static class Capture
+    {
+        // Native entry point into the renderer's frame capture
+        private unsafe static delegate* unmanaged<int, int, bool> _request;
+
+        public static unsafe void Init(IntPtr requestCallback)
+        {
+            _request = (delegate* unmanaged<int, int, bool>)requestCallback;
+        }
+
+        // Writes the next `frames` rendered frames to the capture directory. Returns false while another
+        // capture is still running or when the renderer cannot capture.
+        public static unsafe bool Frames(int frames, CaptureFormat format = CaptureFormat.Png)
+        {
+            if (_request == null) return false;
+            return _request(frames, (int)format);
+        }
+    }
+}
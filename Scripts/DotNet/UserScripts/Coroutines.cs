@@ -0,0 +1,189 @@
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Runtime.CompilerServices;
+using System.Threading;
+
+namespace Stela
+{
+    // Runs async script continuations on the engine thread. ScriptManager pumps it once per frame,
+    // so `await` in a script never resumes in the middle of another script's update.
+    public sealed class ScriptSynchronizationContext : SynchronizationContext
+    {
+        private readonly ConcurrentQueue<(SendOrPostCallback Callback, object State)> _queue = new();
+
+        public override void Post(SendOrPostCallback d, object state)
+        {
+            _queue.Enqueue((d, state));
+        }
+
+        public override void Send(SendOrPostCallback d, object state)
+        {
+            if (Current == this)
+            {
+                d(state);
+                return;
+            }
+
+            using var done = new ManualResetEventSlim();
+            Post(s =>
+            {
+                try { d(s); }
+                finally { done.Set(); }
+            }, state);
+            done.Wait();
+        }
+
+        public override SynchronizationContext CreateCopy() => this;
+
+        // Runs what was queued before the call; anything posted meanwhile waits for the next frame
+        internal void Pump()
+        {
+            int count = _queue.Count;
+            for (int i = 0; i < count && _queue.TryDequeue(out var item); i++)
+            {
+                try
+                {
+                    item.Callback(item.State);
+                }
+                catch (Exception ex)
+                {
+                    // async void methods rethrow their exceptions here
+                    ScriptAPI.Log($"Error in async script: {ex.Message}");
+                }
+            }
+        }
+    }
+
+    // Frame-aware awaitables for async scripts. Waiting continuations are parked in a list or a
+    // timer queue and cost nothing until they are due:
+    //
+    //     async void OnStart()
+    //     {
+    //         await Coroutines.Delay(2.0);
+    //         await Coroutines.NextFrame();
+    //     }
+    public static class Coroutines
+    {
+        private static readonly object _lock = new();
+        private static List<Action> _nextFrame = new();
+        private static List<Action> _running = new();
+        private static readonly PriorityQueue<Action, double> _timers = new();
+        private static readonly List<(Func<bool> Condition, Action Continuation)> _conditions = new();
+
+        // Game time in seconds, advanced by the dt passed to script updates
+        public static double Time { get; private set; }
+
+        public static FrameAwaitable NextFrame() => new FrameAwaitable(0.0);
+        public static FrameAwaitable Delay(double seconds) => new FrameAwaitable(seconds);
+        // Polled once per frame; prefer an event or a Task when one exists
+        public static ConditionAwaitable WaitUntil(Func<bool> condition) => new ConditionAwaitable(condition);
+
+        public readonly struct FrameAwaitable
+        {
+            private readonly double _seconds;
+            internal FrameAwaitable(double seconds) { _seconds = seconds; }
+            public FrameAwaiter GetAwaiter() => new FrameAwaiter(_seconds);
+        }
+
+        public readonly struct FrameAwaiter : INotifyCompletion
+        {
+            private readonly double _seconds;
+            internal FrameAwaiter(double seconds) { _seconds = seconds; }
+
+            public bool IsCompleted => false;
+            public void GetResult() { }
+
+            public void OnCompleted(Action continuation)
+            {
+                lock (_lock)
+                {
+                    if (_seconds <= 0.0)
+                        _nextFrame.Add(continuation);
+                    else
+                        _timers.Enqueue(continuation, Time + _seconds);
+                }
+            }
+        }
+
+        public readonly struct ConditionAwaitable
+        {
+            private readonly Func<bool> _condition;
+            internal ConditionAwaitable(Func<bool> condition) { _condition = condition; }
+            public ConditionAwaiter GetAwaiter() => new ConditionAwaiter(_condition);
+        }
+
+        public readonly struct ConditionAwaiter : INotifyCompletion
+        {
+            private readonly Func<bool> _condition;
+            internal ConditionAwaiter(Func<bool> condition) { _condition = condition; }
+
+            public bool IsCompleted => _condition();
+            public void GetResult() { }
+
+            public void OnCompleted(Action continuation)
+            {
+                lock (_lock)
+                {
+                    _conditions.Add((_condition, continuation));
+                }
+            }
+        }
+
+        // Called by ScriptManager after the script updates, on the engine thread
+        internal static void Tick(float dt)
+        {
+            lock (_lock)
+            {
+                Time += dt;
+                (_running, _nextFrame) = (_nextFrame, _running);
+
+                while (_timers.TryPeek(out _, out double due) && due <= Time)
+                    _running.Add(_timers.Dequeue());
+
+                for (int i = _conditions.Count - 1; i >= 0; i--)
+                {
+                    bool ready;
+                    try { ready = _conditions[i].Condition(); }
+                    catch (Exception ex)
+                    {
+                        ScriptAPI.Log($"Error in WaitUntil condition: {ex.Message}");
+                        ready = true;
+                    }
+                    if (ready)
+                    {
+                        _running.Add(_conditions[i].Continuation);
+                        _conditions.RemoveAt(i);
+                    }
+                }
+            }
+
+            // Continuations run outside the lock; anything they await lands in the next frame
+            foreach (var continuation in _running)
+            {
+                try
+                {
+                    continuation();
+                }
+                catch (Exception ex)
+                {
+                    ScriptAPI.Log($"Error in async script: {ex.Message}");
+                }
+            }
+            _running.Clear();
+        }
+
+        // Drops every parked continuation (script reload); the abandoned state machines are collected
+        internal static void Reset()
+        {
+            lock (_lock)
+            {
+                _nextFrame.Clear();
+                _running.Clear();
+                _timers.Clear();
+                _conditions.Clear();
+                Time = 0.0;
+            }
+        }
+    }
+}
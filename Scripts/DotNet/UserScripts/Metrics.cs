@@ -0,0 +1,28 @@
+using System;
+
+namespace Stela
+{
+    public static class Metrics
+    {
+        // Native entry point that mirrors runtime counters into the engine's metrics registry
+        private unsafe static delegate* unmanaged<long, long, long, long, long, long, void> _reportGc;
+
+        public static unsafe void Init(IntPtr reportGcCallback)
+        {
+            _reportGc = (delegate* unmanaged<long, long, long, long, long, long, void>)reportGcCallback;
+        }
+
+        // Called by ScriptManager once per frame; every value is a cheap read of a runtime counter
+        internal static unsafe void ReportGc()
+        {
+            if (_reportGc == null) return;
+            _reportGc(
+                GC.CollectionCount(0),
+                GC.CollectionCount(1),
+                GC.CollectionCount(2),
+                GC.GetTotalAllocatedBytes(false),
+                GC.GetTotalMemory(false),
+                (long)GC.GetTotalPauseDuration().TotalMicroseconds);
+        }
+    }
+}
@@ -1,40 +1,51 @@
 using System;
+using System.Buffers;
 using System.Runtime.InteropServices;
+using System.Text;
 
 namespace Stela
 {
     public static class ScriptAPI
     {
-        private static IntPtr _logCallback;
+        // Native log entry point; resolved once instead of marshalling a delegate per call
+        private unsafe static delegate* unmanaged<byte*, void> _log;
 
         // C++ will call this to set up the API
-        public static void Init(IntPtr logCallback)
+        public static unsafe void Init(IntPtr logCallback)
         {
-            _logCallback = logCallback;
+            _log = (delegate* unmanaged<byte*, void>)logCallback;
         }
 
-        public static void Log(string message)
+        public static unsafe void Log(string message)
         {
-            if (_logCallback != IntPtr.Zero)
+            if (_log == null || message == null) return;
+
+            // The native side copies the message into its log ring, so the buffer only has to live for the call
+            int maxBytes = Encoding.UTF8.GetMaxByteCount(message.Length) + 1;
+            if (maxBytes <= 1024)
             {
-                // Simple string passing, assuming ASCII/UTF8 handling on C++ side
-                // We might need to marshal carefully. 
-                // For simplicity, let's assume C++ expects a const char*
-                NativeLog(_logCallback, message);
+                byte* buffer = stackalloc byte[maxBytes];
+                int length = Encoding.UTF8.GetBytes(message, new Span<byte>(buffer, maxBytes));
+                buffer[length] = 0;
+                _log(buffer);
+            }
+            else
+            {
+                byte[] rented = ArrayPool<byte>.Shared.Rent(maxBytes);
+                try
+                {
+                    int length = Encoding.UTF8.GetBytes(message, 0, message.Length, rented, 0);
+                    rented[length] = 0;
+                    fixed (byte* buffer = rented)
+                    {
+                        _log(buffer);
+                    }
+                }
+                finally
+                {
+                    ArrayPool<byte>.Shared.Return(rented);
+                }
             }
-        }
-
-        // Helper to invoke the function pointer
-        [DllImport("StelaNative", EntryPoint = "CallLog")] // Dummy name, we invoke pointer manually
-        private static extern void NativeLogStub(string msg);
-
-        private delegate void LogDelegate(string message);
-
-        private static void NativeLog(IntPtr fp, string message)
-        {
-            // Marshal delegate
-             var del = Marshal.GetDelegateForFunctionPointer<LogDelegate>(fp);
-             del(message);
         }
     }
 }
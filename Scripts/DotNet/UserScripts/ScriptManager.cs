@@ -2,6 +2,8 @@ using System;
 using System.Collections.Generic;
 using System.Reflection;
 using System.Runtime.InteropServices;
+using System.Threading;
+using System.Threading.Tasks;
 
 namespace Stela
 {
@@ -16,15 +18,20 @@ namespace Stela
         }
 
         private static List<ScriptRuntime> _runtimes = new List<ScriptRuntime>();
+        private static readonly ScriptSynchronizationContext _context = new ScriptSynchronizationContext();
 
         // Called by Loader (Managed)
-        public static void Init(IntPtr logCallback, IntPtr keyPressedCallback)
+        public static void Init(IntPtr logCallback, IntPtr keyPressedCallback, IntPtr reportGcCallback, IntPtr captureCallback)
         {
             try
             {
                 ScriptAPI.Init(logCallback);
                 Input.Init(keyPressedCallback);
+                Metrics.Init(reportGcCallback);
+                Capture.Init(captureCallback);
                 _runtimes.Clear();
+                // Init may run off the engine thread; continuations of async OnStart still come back to the frame loop
+                SynchronizationContext.SetSynchronizationContext(_context);
                 ScriptAPI.Log("C# ScriptManager Initialized.");
                 LoadScripts();
             }
@@ -44,7 +51,7 @@ namespace Stela
 
                 foreach (var type in types)
                 {
-                    if (type == typeof(ScriptManager) || type == typeof(ScriptAPI) || type == typeof(Input) || type.IsNestedPrivate) continue;
+                    if (type == typeof(ScriptManager) || type == typeof(ScriptAPI) || type == typeof(Input) || type == typeof(Metrics) || type == typeof(Capture) || type == typeof(Coroutines) || type.IsNestedPrivate) continue;
                     
                     // Simple heuristic: if it has OnStart or OnUpdate, it's a script
                     var onStart = type.GetMethod("OnStart", BindingFlags.Instance | BindingFlags.Public | BindingFlags.NonPublic);
@@ -61,7 +68,7 @@ namespace Stela
                             {
                                 try 
                                 {
-                                    onStart.Invoke(instance, null);
+                                    Observe(onStart.Invoke(instance, null), type.Name);
                                 }
                                 catch (Exception ex)
                                 {
@@ -107,8 +114,21 @@ namespace Stela
             }
         }
 
+        // async Task OnStart: report a failure whenever it happens instead of dropping it
+        private static void Observe(object result, string typeName)
+        {
+            if (result is Task task)
+            {
+                task.ContinueWith(t => ScriptAPI.Log($"Error in {typeName}.OnStart: {t.Exception?.InnerException?.Message}"),
+                    TaskContinuationOptions.OnlyOnFaulted);
+            }
+        }
+
         public static void Update(float dt)
         {
+            if (SynchronizationContext.Current != _context)
+                SynchronizationContext.SetSynchronizationContext(_context);
+
             object[] args = new object[] { dt };
             foreach (var runtime in _runtimes)
             {
@@ -127,6 +147,12 @@ namespace Stela
                     }
                 }
             }
+
+            // Latent script logic resumes after every script has updated
+            Coroutines.Tick(dt);
+            _context.Pump();
+
+            Metrics.ReportGc();
         }
 
         public static void Shutdown()
@@ -146,6 +172,7 @@ namespace Stela
                 }
             }
             _runtimes.Clear();
+            Coroutines.Reset();
         }
     }
 }
@@ -35,8 +35,8 @@ extern ScriptsAPI* gAPI;
 namespace DotNetHost {
 
     // Globals to hold delegates
-    // Init now takes: LogCallback, KeyPressedCallback
-    void (*csharp_init)(void (*)(const char*), bool (*)(int)) = nullptr;
+    // Init now takes: LogCallback, KeyPressedCallback, ReportGcCallback
+    void (*csharp_init)(void (*)(const char*), bool (*)(int), void*, void*) = nullptr;
     void (*csharp_update)(float) = nullptr;
     void (*csharp_shutdown)() = nullptr;
 
@@ -179,7 +179,7 @@ namespace DotNetHost {
         }
 
         if (csharp_init) {
-            csharp_init(LogCallback, DotNetInput_KeyPressed);
+            csharp_init(LogCallback, DotNetInput_KeyPressed, nullptr, nullptr); // GC metrics and frame capture are only wired up in the engine host
             return true;
         }
 
@@ -0,0 +1,49 @@
+// Clustered point and spot lights for the mesh fragment shaders (see ClusteredLighting). Set 3 is
+// filled each frame by light_cluster.comp; positions and directions are in view space.
+
+struct Light {
+    vec4 position;  // view space, radius
+    vec4 color;     // color * intensity, spot cone scale
+    vec4 direction; // view space, spot cone offset
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer Lights {
+    uvec4 grid;       // froxels per axis, light count
+    vec4 projection;  // P[0][0], P[1][1], near, far
+    vec4 slicing;     // depth slice = log(depth) * scale + bias, max lights per froxel
+    Light lights[];
+};
+
+layout(std430, set = 3, binding = 1) readonly buffer Clusters {
+    uint clusters[];
+};
+
+// Diffuse light reaching a surface at `position` facing `normal`, from the lights of its froxel
+vec3 ClusteredLighting(vec3 position, vec3 normal) {
+    float depth = -position.z;
+    if (grid.w == 0 || depth <= 0.0)
+        return vec3(0.0);
+
+    vec2 ndc = vec2(position.x * projection.x, position.y * projection.y) / depth;
+    uvec2 tile = uvec2(clamp(ivec2((ndc * 0.5 + 0.5) * vec2(grid.xy)), ivec2(0), ivec2(grid.xy) - 1));
+    uint slice = uint(clamp(int(log(depth) * slicing.x + slicing.y), 0, int(grid.z) - 1));
+    uint base = (tile.x + grid.x * (tile.y + grid.y * slice)) * (uint(slicing.z) + 1);
+
+    vec3 result = vec3(0.0);
+    uint count = clusters[base];
+    for (uint i = 0; i < count; i++) {
+        Light light = lights[clusters[base + 1 + i]];
+        vec3 toLight = light.position.xyz - position;
+        float distanceSquared = dot(toLight, toLight);
+        float radiusSquared = light.position.w * light.position.w;
+        if (distanceSquared >= radiusSquared)
+            continue;
+        vec3 direction = toLight * inversesqrt(max(distanceSquared, 1e-8));
+        // Inverse square, windowed to reach zero at the radius
+        float window = 1.0 - distanceSquared / radiusSquared;
+        float attenuation = window * window / (1.0 + distanceSquared);
+        float cone = clamp(dot(-direction, light.direction.xyz) * light.color.w + light.direction.w, 0.0, 1.0);
+        result += light.color.rgb * (max(dot(normal, direction), 0.0) * attenuation * cone * cone);
+    }
+    return result;
+}
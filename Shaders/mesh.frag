@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec4 fragColor;
+layout(location = 2) in vec2 fragUV;
+layout(location = 3) in vec3 fragViewPosition;
+layout(location = 4) in vec3 fragViewNormal;
+
+layout(location = 0) out vec4 outColor;
+
+#include "clustered_lighting.glsl"
+
+const vec3 lightDirection = normalize(vec3(0.4, 1.0, 0.3));
+
+void main() {
+    float diffuse = max(dot(normalize(fragNormal), lightDirection), 0.0);
+    vec3 lighting = 0.25 + 0.75 * diffuse + ClusteredLighting(fragViewPosition, normalize(fragViewNormal));
+    outColor = vec4(fragColor.rgb * lighting, fragColor.a);
+}
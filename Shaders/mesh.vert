@@ -0,0 +1,45 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+
+struct Instance {
+    mat4 model;
+    vec4 color;
+    uint draw;
+    uint id;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+// Instances that survived culling, grouped by draw; gl_InstanceIndex includes the draw's firstInstance
+layout(std430, set = 0, binding = 2) readonly buffer Visible {
+    uint visible[];
+};
+
+// Written to the constant ring once per frame (Vulkan::Constants), bound with a dynamic offset
+layout(set = 2, binding = 0) uniform Camera {
+    mat4 viewProjection;
+    mat4 view;
+} camera;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec4 fragColor;
+layout(location = 2) out vec2 fragUV;
+// View space, for the clustered lights
+layout(location = 3) out vec3 fragViewPosition;
+layout(location = 4) out vec3 fragViewNormal;
+
+void main() {
+    Instance instance = instances[visible[gl_InstanceIndex]];
+    vec4 position = instance.model * vec4(inPosition, 1.0);
+    gl_Position = camera.viewProjection * position;
+    fragNormal = mat3(instance.model) * inNormal;
+    fragViewPosition = (camera.view * position).xyz;
+    fragViewNormal = mat3(camera.view) * fragNormal;
+    fragColor = instance.color;
+    fragUV = inUV;
+}
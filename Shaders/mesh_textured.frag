@@ -0,0 +1,31 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec4 fragColor;
+layout(location = 2) in vec2 fragUV;
+layout(location = 3) in vec3 fragViewPosition;
+layout(location = 4) in vec3 fragViewNormal;
+
+layout(location = 0) out vec4 outColor;
+
+// The global bindless set (BindlessDescriptors); resources are picked by handle
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+
+layout(push_constant) uniform Material {
+    uint baseColor;
+    uint baseColorSampler;
+} material;
+
+#include "clustered_lighting.glsl"
+
+const vec3 lightDirection = normalize(vec3(0.4, 1.0, 0.3));
+
+void main() {
+    vec4 albedo = fragColor * texture(sampler2D(textures[material.baseColor], samplers[material.baseColorSampler]), fragUV);
+    float diffuse = max(dot(normalize(fragNormal), lightDirection), 0.0);
+    vec3 lighting = 0.25 + 0.75 * diffuse + ClusteredLighting(fragViewPosition, normalize(fragViewNormal));
+    outColor = vec4(albedo.rgb * lighting, albedo.a);
+}
@@ -1,8 +1,12 @@
 #include "Input.h"
+#include <Memory/Memory.h>
 #include <vector>
 
 namespace Input
 {
+    // Input state containers are charged to the Input memory tag
+    template <typename T>
+    using InputVector = std::vector<T, Memory::TaggedAllocator<T, Memory::Tag::Input>>;
 
     bool KeyPressed(Keys Key)
     {
@@ -12,7 +16,7 @@ namespace Input
         int numkeys = 0;
         const Uint8 *state = reinterpret_cast<const Uint8 *>(SDL_GetKeyboardState(&numkeys));
 
-        static std::vector<Uint8> prevState;
+        static InputVector<Uint8> prevState;
         if (prevState.size() != (size_t)numkeys)
         {
             prevState.assign(numkeys, 0);
@@ -201,7 +205,7 @@ namespace Input
         int numkeys = 0;
         const Uint8 *state = reinterpret_cast<const Uint8 *>(SDL_GetKeyboardState(&numkeys));
 
-        static std::vector<Uint8> prevState;
+        static InputVector<Uint8> prevState;
         if (prevState.size() != (size_t)numkeys)
         {
             prevState.assign(numkeys, 0);
@@ -370,8 +374,8 @@ namespace Input
     // Gamepad helpers
     using GamepadPtr = SDL_Gamepad *;
 
-    static std::vector<GamepadPtr> g_gamepads;
-    static std::vector<std::vector<Uint8>> g_prevGamepadButtons;
+    static InputVector<GamepadPtr> g_gamepads;
+    static InputVector<InputVector<Uint8>> g_prevGamepadButtons;
 
     static GamepadPtr GetGamepad(int index)
     {
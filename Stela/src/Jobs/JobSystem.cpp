@@ -0,0 +1,179 @@
+#include "JobSystem.h"
+#include <Log/Log.h>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace Jobs
+{
+    namespace
+    {
+        struct Pool
+        {
+            std::mutex Mutex;
+            std::condition_variable Wake;
+            std::deque<std::function<void()>> Queue;
+            std::vector<std::thread> Workers;
+            bool Running = false;
+        };
+
+        Pool gPool;
+        std::atomic<uint32_t> gWorkerCount{0};
+        thread_local uint32_t tWorkerIndex = 0;
+
+        void WorkerMain(uint32_t index)
+        {
+            tWorkerIndex = index;
+            for (;;)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(gPool.Mutex);
+                    gPool.Wake.wait(lock, [] { return !gPool.Queue.empty() || !gPool.Running; });
+                    if (gPool.Queue.empty())
+                        return;
+                    job = std::move(gPool.Queue.front());
+                    gPool.Queue.pop_front();
+                }
+                // Nobody waits on a submitted job to rethrow, so a failure is logged and the worker carries on
+                try
+                {
+                    job();
+                }
+                catch (const std::exception &e)
+                {
+                    STELA_LOG_ERROR(Engine, "Job on worker %u failed: %s", index, e.what());
+                }
+                catch (...)
+                {
+                    STELA_LOG_ERROR(Engine, "Job on worker %u failed with an unknown exception", index);
+                }
+            }
+        }
+    }
+
+    void Init(uint32_t threadCount)
+    {
+        std::lock_guard<std::mutex> lock(gPool.Mutex);
+        if (gPool.Running)
+            return;
+
+        if (threadCount == 0)
+        {
+            uint32_t hardware = std::thread::hardware_concurrency();
+            threadCount = hardware > 1 ? hardware - 1 : 1;
+        }
+
+        gPool.Running = true;
+        for (uint32_t i = 0; i < threadCount; i++)
+            gPool.Workers.emplace_back(WorkerMain, i + 1);
+        gWorkerCount = threadCount;
+
+        STELA_LOG_DEBUG(Engine, "Job system started with %u workers", threadCount);
+    }
+
+    void Shutdown()
+    {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(gPool.Mutex);
+            if (!gPool.Running)
+                return;
+            gPool.Running = false;
+            workers.swap(gPool.Workers);
+        }
+        gPool.Wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+        gWorkerCount = 0;
+    }
+
+    uint32_t WorkerCount()
+    {
+        return gWorkerCount.load(std::memory_order_relaxed);
+    }
+
+    uint32_t CurrentWorker()
+    {
+        return tWorkerIndex;
+    }
+
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(gPool.Mutex);
+            if (gPool.Running)
+            {
+                gPool.Queue.push_back(std::move(job));
+                gPool.Wake.notify_one();
+                return;
+            }
+        }
+        job();
+    }
+
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)> &body)
+    {
+        if (count == 0)
+            return;
+
+        uint32_t chunks = std::min(count, WorkerCount() + 1);
+        if (chunks <= 1)
+        {
+            body(0, count);
+            return;
+        }
+
+        // Chunks are claimed from a shared counter, by the caller as well as by helper jobs, so the caller
+        // never waits for a chunk that is still queued behind unrelated jobs; it only waits for the chunks
+        // already running. Helpers that start once every chunk is claimed return at once, which is why
+        // they share ownership of the state.
+        struct State
+        {
+            const std::function<void(uint32_t begin, uint32_t end)> *Body;
+            uint32_t Count;
+            uint32_t Chunks;
+            uint32_t ChunkSize;
+            std::atomic<uint32_t> Next{0};
+            WaitGroup Finished;
+            std::mutex ErrorMutex;
+            std::exception_ptr Error;
+        };
+        auto state = std::make_shared<State>();
+        state->Body = &body;
+        state->Count = count;
+        state->Chunks = chunks;
+        state->ChunkSize = (count + chunks - 1) / chunks;
+        state->Finished.Add(chunks);
+
+        auto run = [](State &shared)
+        {
+            for (uint32_t chunk; (chunk = shared.Next.fetch_add(1, std::memory_order_relaxed)) < shared.Chunks;)
+            {
+                uint32_t begin = chunk * shared.ChunkSize;
+                // A throwing chunk still counts as done, so the caller is never left waiting; it rethrows
+                try
+                {
+                    if (begin < shared.Count)
+                        (*shared.Body)(begin, std::min(begin + shared.ChunkSize, shared.Count));
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(shared.ErrorMutex);
+                    if (!shared.Error)
+                        shared.Error = std::current_exception();
+                }
+                shared.Finished.Done();
+            }
+        };
+        for (uint32_t i = 1; i < chunks; i++)
+            Submit([state, run] { run(*state); });
+        run(*state);
+        state->Finished.Wait();
+        if (state->Error)
+            std::rethrow_exception(state->Error);
+    }
+}
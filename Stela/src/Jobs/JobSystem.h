@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// Fixed pool of worker threads shared by the engine (startup tasks, background work).
+// Jobs are plain callables; anything that needs a result or a join point uses a WaitGroup.
+namespace Jobs
+{
+    // 0 picks hardware_concurrency - 1 (at least one worker). Calling Init again is a no-op.
+    void Init(uint32_t threadCount = 0);
+    // Finishes every queued job, then joins the workers
+    void Shutdown();
+
+    uint32_t WorkerCount();
+    // 1-based index of the calling worker, 0 on any thread outside the pool
+    uint32_t CurrentWorker();
+
+    // Runs inline when the pool has not been started, so callers never need a fallback path. On a worker an
+    // exception escaping the job is logged and dropped; jobs that signal completion must do so themselves.
+    void Submit(std::function<void()> job);
+
+    // Counts outstanding jobs; Wait blocks until every Add has been matched by a Done
+    class WaitGroup
+    {
+    public:
+        void Add(uint32_t count = 1) { Pending.fetch_add(count, std::memory_order_relaxed); }
+        void Done()
+        {
+            // Decrement under the lock so the waiter cannot return (and destroy the group) before we are done with it
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                Finished.notify_all();
+        }
+        void Wait()
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            Finished.wait(lock, [this] { return Pending.load(std::memory_order_acquire) == 0; });
+        }
+
+    private:
+        std::atomic<uint32_t> Pending{0};
+        std::mutex Mutex;
+        std::condition_variable Finished;
+    };
+
+    // Splits [0, count) into roughly one chunk per worker plus the caller, and blocks until all are done.
+    // The caller runs whatever chunks no worker has picked up yet. An exception thrown by `body` is
+    // rethrown here once every chunk has finished.
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)> &body);
+}
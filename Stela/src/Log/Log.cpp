@@ -0,0 +1,538 @@
+#include "Log.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdarg>
+
+namespace Log
+{
+    namespace
+    {
+        // Every entry starts with this header and is padded to a multiple of its size,
+        // so the space left before the end of the ring always fits at least a padding header.
+        struct EntryHeader
+        {
+            uint32_t Size; // whole entry including header and padding
+            Level Severity;
+            Category Channel;
+            uint16_t Reserved;
+            uint64_t Timestamp;
+            const char *Format;
+            Detail::DecodeFn Decode; // nullptr marks padding up to the end of the ring
+        };
+        static_assert(sizeof(EntryHeader) == 32, "EntryHeader must stay 32 bytes");
+
+        constexpr size_t RingCapacity = 256 * 1024;
+        constexpr size_t MaxEntrySize = RingCapacity / 4;
+
+        size_t AlignEntry(size_t size)
+        {
+            return (size + sizeof(EntryHeader) - 1) & ~(sizeof(EntryHeader) - 1);
+        }
+
+        // Single-producer/single-consumer byte ring owned by one logging thread
+        struct ThreadRing
+        {
+            alignas(64) std::atomic<uint64_t> Head{0}; // written by the producer
+            alignas(64) std::atomic<uint64_t> Tail{0}; // written by the consumer
+            alignas(64) uint64_t PendingSize = 0;
+            std::atomic<bool> Alive{true};
+            uint32_t ThreadId = 0;
+            std::unique_ptr<uint8_t[]> Data{new uint8_t[RingCapacity]};
+        };
+
+        struct State
+        {
+            std::mutex RingsMutex;
+            std::vector<std::unique_ptr<ThreadRing>> Rings;
+            std::atomic<uint32_t> NextThreadId{1};
+
+            std::mutex SinksMutex;
+            std::vector<std::pair<int, Sink>> Sinks;
+            int NextSinkId = 1;
+            FILE *File = nullptr;
+            std::atomic<bool> Console{true};
+
+            std::atomic<int> MinLevel{static_cast<int>(Level::Trace)};
+            std::atomic<uint32_t> CategoryMask{~0u};
+            std::atomic<uint64_t> Dropped{0};
+
+            std::thread Worker;
+            std::mutex WakeMutex;
+            std::condition_variable Wake;
+            std::condition_variable Drained;
+            std::atomic<bool> Running{false};
+            std::atomic<bool> Stopped{false};
+            std::atomic<uint64_t> FlushRequests{0};
+            uint64_t FlushesServed = 0;
+
+            std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        };
+
+        // Intentionally leaked so logging stays valid during static destruction
+        State &GetState()
+        {
+            static State *state = new State();
+            return *state;
+        }
+
+        uint64_t Now()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - GetState().Start;
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+        // Marks the thread's ring as abandoned on thread exit so the writer can reclaim it
+        struct RingOwner
+        {
+            ThreadRing *Ring = nullptr;
+            ~RingOwner()
+            {
+                if (Ring)
+                    Ring->Alive.store(false, std::memory_order_release);
+            }
+        };
+
+        ThreadRing *GetThreadRing()
+        {
+            thread_local RingOwner owner;
+            if (!owner.Ring)
+            {
+                State &state = GetState();
+                auto ring = std::make_unique<ThreadRing>();
+                ring->ThreadId = state.NextThreadId.fetch_add(1);
+                owner.Ring = ring.get();
+
+                std::lock_guard<std::mutex> lock(state.RingsMutex);
+                state.Rings.push_back(std::move(ring));
+            }
+            return owner.Ring;
+        }
+
+        // Used once the writer has stopped: messages are formatted and written on the spot
+        struct DirectEntry
+        {
+            EntryHeader Header;
+            std::vector<uint8_t> Payload;
+        };
+
+        thread_local DirectEntry tDirectEntry;
+        thread_local bool tDirect = false;
+
+        void Emit(State &state, const std::vector<Record> &records)
+        {
+            if (records.empty())
+                return;
+
+            std::lock_guard<std::mutex> lock(state.SinksMutex);
+            bool console = state.Console.load(std::memory_order_relaxed);
+            bool wroteOut = false;
+            bool wroteErr = false;
+            std::string line;
+
+            for (const Record &record : records)
+            {
+                line.clear();
+                line += '[';
+                line += CategoryName(record.Channel);
+                line += "] ";
+                if (record.Severity >= Level::Warning)
+                {
+                    line += LevelName(record.Severity);
+                    line += ": ";
+                }
+                line += record.Message;
+                line += '\n';
+
+                if (console)
+                {
+                    FILE *stream = record.Severity >= Level::Warning ? stderr : stdout;
+                    std::fwrite(line.data(), 1, line.size(), stream);
+                    (stream == stderr ? wroteErr : wroteOut) = true;
+                }
+
+                if (state.File)
+                {
+                    char stamp[32];
+                    std::snprintf(stamp, sizeof(stamp), "%10.4f T%-3u ", record.Timestamp / 1e9, record.ThreadId);
+                    std::fputs(stamp, state.File);
+                    std::fwrite(line.data(), 1, line.size(), state.File);
+                }
+
+                for (auto &sink : state.Sinks)
+                {
+                    sink.second(record);
+                }
+            }
+
+            // One flush per batch instead of one per line
+            if (wroteOut)
+                std::fflush(stdout);
+            if (wroteErr)
+                std::fflush(stderr);
+            if (state.File)
+                std::fflush(state.File);
+        }
+
+        // Pulls every committed entry out of all rings, orders them by time and hands them to the sinks
+        void Drain(State &state, std::vector<Record> &records)
+        {
+            records.clear();
+
+            std::lock_guard<std::mutex> ringsLock(state.RingsMutex);
+            for (auto &ring : state.Rings)
+            {
+                uint64_t tail = ring->Tail.load(std::memory_order_relaxed);
+                uint64_t head = ring->Head.load(std::memory_order_acquire);
+
+                while (tail < head)
+                {
+                    const EntryHeader *header = reinterpret_cast<const EntryHeader *>(ring->Data.get() + (tail % RingCapacity));
+                    if (header->Decode)
+                    {
+                        Record record;
+                        record.Timestamp = header->Timestamp;
+                        record.ThreadId = ring->ThreadId;
+                        record.Severity = header->Severity;
+                        record.Channel = header->Channel;
+                        header->Decode(header->Format, reinterpret_cast<const uint8_t *>(header + 1), record.Message);
+                        records.push_back(std::move(record));
+                    }
+                    tail += header->Size;
+                }
+
+                ring->Tail.store(tail, std::memory_order_release);
+            }
+
+            // Reclaim rings whose threads have exited and that are fully drained
+            state.Rings.erase(
+                std::remove_if(state.Rings.begin(), state.Rings.end(), [](const std::unique_ptr<ThreadRing> &ring)
+                               { return !ring->Alive.load(std::memory_order_acquire) &&
+                                        ring->Tail.load(std::memory_order_relaxed) == ring->Head.load(std::memory_order_acquire); }),
+                state.Rings.end());
+
+            std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b)
+                             { return a.Timestamp < b.Timestamp; });
+        }
+
+        void WorkerMain()
+        {
+            State &state = GetState();
+            std::vector<Record> records;
+
+            while (true)
+            {
+                uint64_t flushTarget = state.FlushRequests.load(std::memory_order_acquire);
+                bool running = state.Running.load(std::memory_order_acquire);
+
+                Drain(state, records);
+                Emit(state, records);
+
+                {
+                    std::unique_lock<std::mutex> lock(state.WakeMutex);
+                    state.FlushesServed = flushTarget;
+                    state.Drained.notify_all();
+
+                    if (!running)
+                        break;
+
+                    state.Wake.wait_for(lock, std::chrono::milliseconds(4), [&]
+                                        { return !state.Running.load() || state.FlushRequests.load() != state.FlushesServed; });
+                }
+            }
+        }
+    }
+
+    void Init(const char *filePath)
+    {
+        State &state = GetState();
+        if (filePath)
+            OpenFile(filePath);
+
+        if (state.Running.exchange(true))
+            return;
+
+        state.Stopped = false;
+        state.Worker = std::thread(WorkerMain);
+    }
+
+    void Shutdown()
+    {
+        State &state = GetState();
+        if (!state.Running.exchange(false))
+            return;
+
+        state.Wake.notify_all();
+        if (state.Worker.joinable())
+            state.Worker.join();
+
+        // From here on producers write synchronously; drain whatever raced with the worker's last pass
+        state.Stopped = true;
+        std::vector<Record> records;
+        Drain(state, records);
+        Emit(state, records);
+
+        CloseFile();
+    }
+
+    void Flush()
+    {
+        State &state = GetState();
+        if (!state.Running.load())
+            return;
+
+        std::unique_lock<std::mutex> lock(state.WakeMutex);
+        uint64_t target = state.FlushRequests.fetch_add(1) + 1;
+        state.Wake.notify_all();
+        state.Drained.wait(lock, [&]
+                           { return state.FlushesServed >= target || !state.Running.load(); });
+    }
+
+    bool OpenFile(const char *filePath)
+    {
+        State &state = GetState();
+        FILE *file = std::fopen(filePath, "w");
+        if (!file)
+            return false;
+
+        std::lock_guard<std::mutex> lock(state.SinksMutex);
+        if (state.File)
+            std::fclose(state.File);
+        state.File = file;
+        return true;
+    }
+
+    void CloseFile()
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.SinksMutex);
+        if (state.File)
+        {
+            std::fclose(state.File);
+            state.File = nullptr;
+        }
+    }
+
+    void SetConsoleEnabled(bool enabled)
+    {
+        GetState().Console = enabled;
+    }
+
+    int AddSink(Sink sink)
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.SinksMutex);
+        int id = state.NextSinkId++;
+        state.Sinks.emplace_back(id, std::move(sink));
+        return id;
+    }
+
+    void RemoveSink(int id)
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.SinksMutex);
+        state.Sinks.erase(
+            std::remove_if(state.Sinks.begin(), state.Sinks.end(), [id](const auto &sink)
+                           { return sink.first == id; }),
+            state.Sinks.end());
+    }
+
+    void SetLevel(Level level)
+    {
+        GetState().MinLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    Level GetLevel()
+    {
+        return static_cast<Level>(GetState().MinLevel.load(std::memory_order_relaxed));
+    }
+
+    void SetCategoryEnabled(Category category, bool enabled)
+    {
+        uint32_t bit = 1u << static_cast<uint32_t>(category);
+        if (enabled)
+            GetState().CategoryMask.fetch_or(bit, std::memory_order_relaxed);
+        else
+            GetState().CategoryMask.fetch_and(~bit, std::memory_order_relaxed);
+    }
+
+    bool IsCategoryEnabled(Category category)
+    {
+        return (GetState().CategoryMask.load(std::memory_order_relaxed) >> static_cast<uint32_t>(category)) & 1u;
+    }
+
+    bool IsEnabled(Level level, Category category)
+    {
+        State &state = GetState();
+        return static_cast<int>(level) >= state.MinLevel.load(std::memory_order_relaxed) &&
+               ((state.CategoryMask.load(std::memory_order_relaxed) >> static_cast<uint32_t>(category)) & 1u);
+    }
+
+    const char *LevelName(Level level)
+    {
+        switch (level)
+        {
+        case Level::Trace:
+            return "Trace";
+        case Level::Debug:
+            return "Debug";
+        case Level::Info:
+            return "Info";
+        case Level::Warning:
+            return "Warning";
+        case Level::Error:
+            return "Error";
+        default:
+            return "?";
+        }
+    }
+
+    const char *CategoryName(Category category)
+    {
+        switch (category)
+        {
+        case Category::Engine:
+            return "Stela";
+        case Category::Render:
+            return "Render";
+        case Category::Scripts:
+            return "Scripts";
+        case Category::DotNet:
+            return "DotNet";
+        case Category::Input:
+            return "Input";
+        case Category::Editor:
+            return "Editor";
+        default:
+            return "?";
+        }
+    }
+
+    uint64_t DroppedCount()
+    {
+        return GetState().Dropped.load(std::memory_order_relaxed);
+    }
+
+    namespace Detail
+    {
+        uint8_t *Reserve(size_t payloadSize, Level level, Category category, const char *fmt, DecodeFn decode)
+        {
+            State &state = GetState();
+
+            EntryHeader header{};
+            header.Severity = level;
+            header.Channel = category;
+            header.Timestamp = Now();
+            header.Format = fmt;
+            header.Decode = decode;
+
+            if (state.Stopped.load(std::memory_order_acquire))
+            {
+                tDirect = true;
+                tDirectEntry.Header = header;
+                // At least one byte: an empty vector may hand out null, which Write takes for a drop
+                tDirectEntry.Payload.resize(payloadSize > 0 ? payloadSize : 1);
+                return tDirectEntry.Payload.data();
+            }
+
+            size_t size = AlignEntry(sizeof(EntryHeader) + payloadSize);
+            if (size > MaxEntrySize)
+            {
+                state.Dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            ThreadRing *ring = GetThreadRing();
+            uint64_t head = ring->Head.load(std::memory_order_relaxed);
+            uint64_t tail = ring->Tail.load(std::memory_order_acquire);
+
+            size_t offset = head % RingCapacity;
+            size_t untilEnd = RingCapacity - offset;
+            size_t padding = untilEnd < size ? untilEnd : 0;
+
+            // Never block the producer: a full ring drops the message and counts it
+            if (RingCapacity - (head - tail) < padding + size)
+            {
+                state.Dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            if (padding)
+            {
+                EntryHeader *pad = reinterpret_cast<EntryHeader *>(ring->Data.get() + offset);
+                *pad = EntryHeader{};
+                pad->Size = static_cast<uint32_t>(padding);
+                head += padding;
+                offset = 0;
+            }
+
+            header.Size = static_cast<uint32_t>(size);
+            EntryHeader *entry = reinterpret_cast<EntryHeader *>(ring->Data.get() + offset);
+            *entry = header;
+
+            // Publish the padding now; the entry itself becomes visible on Commit
+            ring->Head.store(head, std::memory_order_release);
+            ring->PendingSize = size;
+            return reinterpret_cast<uint8_t *>(entry + 1);
+        }
+
+        void Commit()
+        {
+            if (tDirect)
+            {
+                tDirect = false;
+                Record record;
+                record.Timestamp = tDirectEntry.Header.Timestamp;
+                record.ThreadId = 0;
+                record.Severity = tDirectEntry.Header.Severity;
+                record.Channel = tDirectEntry.Header.Channel;
+                tDirectEntry.Header.Decode(tDirectEntry.Header.Format, tDirectEntry.Payload.data(), record.Message);
+                Emit(GetState(), {record});
+                return;
+            }
+
+            ThreadRing *ring = GetThreadRing();
+            uint64_t head = ring->Head.load(std::memory_order_relaxed);
+            ring->Head.store(head + ring->PendingSize, std::memory_order_release);
+
+            // Errors are rare and important enough to wake the writer immediately
+            State &state = GetState();
+            if (reinterpret_cast<const EntryHeader *>(ring->Data.get() + (head % RingCapacity))->Severity >= Level::Error)
+                state.Wake.notify_one();
+        }
+
+        void FormatTo(std::string &out, const char *fmt, ...)
+        {
+            char stackBuffer[512];
+
+            va_list args;
+            va_start(args, fmt);
+            va_list copy;
+            va_copy(copy, args);
+            int length = std::vsnprintf(stackBuffer, sizeof(stackBuffer), fmt, args);
+            va_end(args);
+
+            if (length < 0)
+            {
+                out = fmt;
+            }
+            else if (static_cast<size_t>(length) < sizeof(stackBuffer))
+            {
+                out.assign(stackBuffer, static_cast<size_t>(length));
+            }
+            else
+            {
+                out.resize(static_cast<size_t>(length) + 1);
+                std::vsnprintf(out.data(), out.size(), fmt, copy);
+                out.resize(static_cast<size_t>(length));
+            }
+            va_end(copy);
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <functional>
+
+// Compile-time severity floor. Calls below this level are compiled out entirely.
+// 0 = Trace, 1 = Debug, 2 = Info, 3 = Warning, 4 = Error
+#ifndef STELA_LOG_LEVEL
+    #ifdef NDEBUG
+        #define STELA_LOG_LEVEL 2
+    #else
+        #define STELA_LOG_LEVEL 0
+    #endif
+#endif
+
+namespace Log
+{
+    enum class Level : uint8_t
+    {
+        Trace,
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Count
+    };
+
+    enum class Category : uint8_t
+    {
+        Engine,
+        Render,
+        Scripts,
+        DotNet,
+        Input,
+        Editor,
+        Count
+    };
+
+    // A fully formatted message, as handed to sinks on the logging thread
+    struct Record
+    {
+        uint64_t Timestamp; // nanoseconds since Log::Init
+        uint32_t ThreadId;
+        Level Severity;
+        Category Channel;
+        std::string Message;
+    };
+
+    using Sink = std::function<void(const Record &)>;
+
+    // Starts the background writer. Messages logged before Init are buffered and written once it runs.
+    void Init(const char *filePath = nullptr);
+    // Drains every queued message and stops the writer. Later messages are written synchronously.
+    void Shutdown();
+    // Blocks until everything queued so far has reached the sinks
+    void Flush();
+
+    bool OpenFile(const char *filePath);
+    void CloseFile();
+    void SetConsoleEnabled(bool enabled);
+
+    // Sinks run on the logging thread, never on the producer
+    int AddSink(Sink sink);
+    void RemoveSink(int id);
+
+    void SetLevel(Level level);
+    Level GetLevel();
+    void SetCategoryEnabled(Category category, bool enabled);
+    bool IsCategoryEnabled(Category category);
+    bool IsEnabled(Level level, Category category);
+
+    const char *LevelName(Level level);
+    const char *CategoryName(Category category);
+
+    // Messages discarded because a thread's ring was full
+    uint64_t DroppedCount();
+
+    namespace Detail
+    {
+        using DecodeFn = void (*)(const char *fmt, const uint8_t *payload, std::string &out);
+
+        // Reserves payload space in the calling thread's ring. Returns nullptr if the ring is full.
+        uint8_t *Reserve(size_t payloadSize, Level level, Category category, const char *fmt, DecodeFn decode);
+        void Commit();
+        void FormatTo(std::string &out, const char *fmt, ...);
+
+        constexpr bool CompiledIn(Level level)
+        {
+            return static_cast<int>(level) + 1 > STELA_LOG_LEVEL;
+        }
+
+        // Strings are copied into the ring; everything else is stored by value
+        constexpr size_t MaxStringBytes = 16 * 1024;
+
+        template <typename T, bool = std::is_enum_v<T>>
+        struct Underlying { using Type = T; };
+
+        template <typename T>
+        struct Underlying<T, true> { using Type = std::underlying_type_t<T>; };
+
+        template <typename T, typename = void>
+        struct Arg
+        {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>,
+                          "Log arguments must be arithmetic, enums, pointers or strings");
+
+            using Stored = std::conditional_t<std::is_floating_point_v<T>, double,
+                           std::conditional_t<std::is_same_v<T, bool>, int, typename Underlying<T>::Type>>;
+
+            static size_t Size(const T &) { return sizeof(Stored); }
+
+            static void Write(uint8_t *&dst, const T &value)
+            {
+                Stored stored = static_cast<Stored>(value);
+                std::memcpy(dst, &stored, sizeof(Stored));
+                dst += sizeof(Stored);
+            }
+
+            static Stored Read(const uint8_t *&src)
+            {
+                Stored stored;
+                std::memcpy(&stored, src, sizeof(Stored));
+                src += sizeof(Stored);
+                return stored;
+            }
+        };
+
+        struct StringArg
+        {
+            using Stored = const char *;
+
+            static size_t Length(std::string_view s) { return s.size() < MaxStringBytes ? s.size() : MaxStringBytes; }
+            static size_t Size(std::string_view s) { return sizeof(uint32_t) + Length(s) + 1; }
+
+            static void Write(uint8_t *&dst, std::string_view s)
+            {
+                uint32_t length = static_cast<uint32_t>(Length(s));
+                std::memcpy(dst, &length, sizeof(length));
+                dst += sizeof(length);
+                if (length)
+                    std::memcpy(dst, s.data(), length);
+                dst[length] = '\0';
+                dst += length + 1;
+            }
+
+            static Stored Read(const uint8_t *&src)
+            {
+                uint32_t length;
+                std::memcpy(&length, src, sizeof(length));
+                const char *str = reinterpret_cast<const char *>(src + sizeof(length));
+                src += sizeof(length) + length + 1;
+                return str;
+            }
+        };
+
+        template <typename T>
+        struct Arg<T, std::enable_if_t<std::is_same_v<T, const char *> || std::is_same_v<T, char *>>> : StringArg
+        {
+            static size_t Size(const char *s) { return StringArg::Size(s ? std::string_view(s) : std::string_view("(null)")); }
+            static void Write(uint8_t *&dst, const char *s) { StringArg::Write(dst, s ? std::string_view(s) : std::string_view("(null)")); }
+        };
+
+        template <>
+        struct Arg<std::string> : StringArg {};
+
+        template <>
+        struct Arg<std::string_view> : StringArg {};
+
+        template <typename... Args>
+        void Decode(const char *fmt, const uint8_t *payload, std::string &out)
+        {
+            const uint8_t *cursor = payload;
+            // Braced initialisation guarantees left-to-right evaluation of the reads
+            std::tuple<typename Arg<std::decay_t<Args>>::Stored...> values{Arg<std::decay_t<Args>>::Read(cursor)...};
+            (void)cursor;
+            std::apply([&](auto... v) { FormatTo(out, fmt, v...); }, values);
+        }
+    }
+
+    // printf-style logging with deferred formatting. `fmt` must be a string literal:
+    // only the pointer is stored, the arguments are copied and formatted on the logging thread.
+    template <typename... Args>
+    void Write(Level level, Category category, const char *fmt, const Args &...args)
+    {
+        size_t size = (Detail::Arg<std::decay_t<Args>>::Size(args) + ... + size_t(0));
+        uint8_t *dst = Detail::Reserve(size, level, category, fmt, &Detail::Decode<Args...>);
+        if (!dst)
+            return;
+        (Detail::Arg<std::decay_t<Args>>::Write(dst, args), ...);
+        Detail::Commit();
+    }
+}
+
+#define STELA_LOG(level, category, ...)                                                  \
+    do                                                                                   \
+    {                                                                                    \
+        if constexpr (::Log::Detail::CompiledIn(level))                                  \
+        {                                                                                \
+            if (::Log::IsEnabled(level, category))                                       \
+                ::Log::Write(level, category, __VA_ARGS__);                              \
+        }                                                                                \
+    } while (0)
+
+#define STELA_LOG_TRACE(category, ...) STELA_LOG(::Log::Level::Trace, ::Log::Category::category, __VA_ARGS__)
+#define STELA_LOG_DEBUG(category, ...) STELA_LOG(::Log::Level::Debug, ::Log::Category::category, __VA_ARGS__)
+#define STELA_LOG_INFO(category, ...) STELA_LOG(::Log::Level::Info, ::Log::Category::category, __VA_ARGS__)
+#define STELA_LOG_WARNING(category, ...) STELA_LOG(::Log::Level::Warning, ::Log::Category::category, __VA_ARGS__)
+#define STELA_LOG_ERROR(category, ...) STELA_LOG(::Log::Level::Error, ::Log::Category::category, __VA_ARGS__)
@@ -0,0 +1,143 @@
+#pragma once
+#include <cmath>
+
+// Minimal vector/matrix types for the renderer. Matrices are column-major (M[column][row]) to match
+// GLSL, and projections follow Vulkan conventions: depth in [0, 1], Y pointing down in clip space.
+namespace Math
+{
+    constexpr float Pi = 3.14159265358979323846f;
+
+    struct Vec3
+    {
+        float X = 0.0f, Y = 0.0f, Z = 0.0f;
+    };
+
+    struct Vec4
+    {
+        float X = 0.0f, Y = 0.0f, Z = 0.0f, W = 0.0f;
+    };
+
+    inline Vec3 operator+(Vec3 a, Vec3 b) { return {a.X + b.X, a.Y + b.Y, a.Z + b.Z}; }
+    inline Vec3 operator-(Vec3 a, Vec3 b) { return {a.X - b.X, a.Y - b.Y, a.Z - b.Z}; }
+    inline Vec3 operator*(Vec3 a, float s) { return {a.X * s, a.Y * s, a.Z * s}; }
+    inline float Dot(Vec3 a, Vec3 b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+    inline Vec3 Cross(Vec3 a, Vec3 b) { return {a.Y * b.Z - a.Z * b.Y, a.Z * b.X - a.X * b.Z, a.X * b.Y - a.Y * b.X}; }
+    inline float Length(Vec3 v) { return std::sqrt(Dot(v, v)); }
+    inline Vec3 Normalize(Vec3 v)
+    {
+        float length = Length(v);
+        return length > 0.0f ? v * (1.0f / length) : v;
+    }
+
+    struct Mat4
+    {
+        float M[4][4] = {};
+
+        static Mat4 Identity()
+        {
+            Mat4 result;
+            for (int i = 0; i < 4; i++)
+                result.M[i][i] = 1.0f;
+            return result;
+        }
+    };
+
+    inline Mat4 operator*(const Mat4 &a, const Mat4 &b)
+    {
+        Mat4 result;
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                    sum += a.M[k][row] * b.M[column][k];
+                result.M[column][row] = sum;
+            }
+        }
+        return result;
+    }
+
+    inline Vec4 operator*(const Mat4 &m, Vec4 v)
+    {
+        return {
+            m.M[0][0] * v.X + m.M[1][0] * v.Y + m.M[2][0] * v.Z + m.M[3][0] * v.W,
+            m.M[0][1] * v.X + m.M[1][1] * v.Y + m.M[2][1] * v.Z + m.M[3][1] * v.W,
+            m.M[0][2] * v.X + m.M[1][2] * v.Y + m.M[2][2] * v.Z + m.M[3][2] * v.W,
+            m.M[0][3] * v.X + m.M[1][3] * v.Y + m.M[2][3] * v.Z + m.M[3][3] * v.W,
+        };
+    }
+
+    inline Mat4 Translation(Vec3 t)
+    {
+        Mat4 result = Mat4::Identity();
+        result.M[3][0] = t.X;
+        result.M[3][1] = t.Y;
+        result.M[3][2] = t.Z;
+        return result;
+    }
+
+    inline Mat4 Scale(Vec3 s)
+    {
+        Mat4 result;
+        result.M[0][0] = s.X;
+        result.M[1][1] = s.Y;
+        result.M[2][2] = s.Z;
+        result.M[3][3] = 1.0f;
+        return result;
+    }
+
+    // Rotation around an arbitrary axis, angle in radians
+    inline Mat4 Rotation(Vec3 axis, float angle)
+    {
+        axis = Normalize(axis);
+        float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+        Mat4 result = Mat4::Identity();
+        result.M[0][0] = t * axis.X * axis.X + c;
+        result.M[0][1] = t * axis.X * axis.Y + s * axis.Z;
+        result.M[0][2] = t * axis.X * axis.Z - s * axis.Y;
+        result.M[1][0] = t * axis.X * axis.Y - s * axis.Z;
+        result.M[1][1] = t * axis.Y * axis.Y + c;
+        result.M[1][2] = t * axis.Y * axis.Z + s * axis.X;
+        result.M[2][0] = t * axis.X * axis.Z + s * axis.Y;
+        result.M[2][1] = t * axis.Y * axis.Z - s * axis.X;
+        result.M[2][2] = t * axis.Z * axis.Z + c;
+        return result;
+    }
+
+    // Right-handed view matrix looking down -Z
+    inline Mat4 LookAt(Vec3 eye, Vec3 target, Vec3 up)
+    {
+        Vec3 forward = Normalize(target - eye);
+        Vec3 right = Normalize(Cross(forward, up));
+        Vec3 cameraUp = Cross(right, forward);
+
+        Mat4 result = Mat4::Identity();
+        result.M[0][0] = right.X;
+        result.M[1][0] = right.Y;
+        result.M[2][0] = right.Z;
+        result.M[0][1] = cameraUp.X;
+        result.M[1][1] = cameraUp.Y;
+        result.M[2][1] = cameraUp.Z;
+        result.M[0][2] = -forward.X;
+        result.M[1][2] = -forward.Y;
+        result.M[2][2] = -forward.Z;
+        result.M[3][0] = -Dot(right, eye);
+        result.M[3][1] = -Dot(cameraUp, eye);
+        result.M[3][2] = Dot(forward, eye);
+        return result;
+    }
+
+    // Vulkan clip space: depth 0 at zNear, 1 at zFar, Y flipped so +Y is up on screen
+    inline Mat4 Perspective(float fovY, float aspect, float zNear, float zFar)
+    {
+        float f = 1.0f / std::tan(fovY * 0.5f);
+        Mat4 result;
+        result.M[0][0] = f / aspect;
+        result.M[1][1] = -f;
+        result.M[2][2] = zFar / (zNear - zFar);
+        result.M[2][3] = -1.0f;
+        result.M[3][2] = zNear * zFar / (zNear - zFar);
+        return result;
+    }
+}
@@ -0,0 +1,386 @@
+#include "Memory.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace Memory
+{
+    namespace
+    {
+        constexpr size_t TagCount = static_cast<size_t>(Tag::Count);
+        constexpr uint16_t HeaderMagic = 0x5E1A;
+
+        // Sits directly in front of every pointer handed out. 16 bytes keeps the default alignment intact.
+        struct Header
+        {
+            uint64_t Size;
+            uint32_t Offset; // from the start of the malloc block to the user pointer
+            uint8_t Owner;
+            uint8_t Reserved;
+            uint16_t Magic;
+        };
+        static_assert(sizeof(Header) == 16, "allocation header must keep 16-byte alignment");
+
+        // Plain arrays of atomics are constant-initialized, so allocations made during static
+        // initialization (including from the operator new hooks) are safe to count
+        struct Counters
+        {
+            std::atomic<uint64_t> LiveBytes{0};
+            std::atomic<uint64_t> PeakBytes{0};
+            std::atomic<uint64_t> LiveAllocations{0};
+            std::atomic<uint64_t> TotalAllocations{0};
+            std::atomic<uint64_t> TotalBytes{0};
+            std::atomic<uint64_t> Budget{0};
+            std::atomic<bool> OverBudget{false};
+
+            // Written by EndFrame only
+            uint64_t FrameStartAllocations = 0;
+            uint64_t FrameStartBytes = 0;
+            std::atomic<uint64_t> FrameAllocations{0};
+            std::atomic<uint64_t> FrameBytes{0};
+        };
+
+        Counters gCounters[TagCount];
+        thread_local Tag tCurrentTag = Tag::General;
+        // Set while the budget warning is being logged, which allocates itself
+        thread_local bool tReporting = false;
+
+        const char *const gTagNames[TagCount] = {"General", "Render", "Scripts", "Input", "Editor"};
+
+        Header *HeaderOf(const void *ptr)
+        {
+            return reinterpret_cast<Header *>(static_cast<char *>(const_cast<void *>(ptr)) - sizeof(Header));
+        }
+
+        void WarnOverBudget(Tag tag, uint64_t live, uint64_t budget)
+        {
+            if (tReporting)
+                return;
+            tReporting = true;
+            STELA_LOG_WARNING(Engine, "Memory budget exceeded for %s: %.2f MB live, budget %.2f MB", TagName(tag),
+                              live / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+            tReporting = false;
+        }
+
+        void Track(Tag tag, uint64_t size)
+        {
+            Counters &counters = gCounters[static_cast<size_t>(tag)];
+            uint64_t live = counters.LiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+            counters.LiveAllocations.fetch_add(1, std::memory_order_relaxed);
+            counters.TotalAllocations.fetch_add(1, std::memory_order_relaxed);
+            counters.TotalBytes.fetch_add(size, std::memory_order_relaxed);
+
+            uint64_t peak = counters.PeakBytes.load(std::memory_order_relaxed);
+            while (live > peak && !counters.PeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            {
+            }
+
+            uint64_t budget = counters.Budget.load(std::memory_order_relaxed);
+            if (budget && live > budget && !counters.OverBudget.exchange(true, std::memory_order_relaxed))
+                WarnOverBudget(tag, live, budget);
+        }
+
+        void Untrack(Tag tag, uint64_t size)
+        {
+            Counters &counters = gCounters[static_cast<size_t>(tag)];
+            counters.LiveBytes.fetch_sub(size, std::memory_order_relaxed);
+            counters.LiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void *Allocate(size_t size, size_t alignment, Tag tag)
+    {
+        if (alignment < alignof(Header))
+            alignment = alignof(Header);
+        // Over-aligned requests get enough slack to slide the user pointer forward
+        size_t slack = alignment > 16 ? alignment - 1 : 0;
+        char *raw = static_cast<char *>(std::malloc(size + sizeof(Header) + slack));
+        if (!raw)
+            return nullptr;
+
+        uintptr_t user = reinterpret_cast<uintptr_t>(raw) + sizeof(Header);
+        user = (user + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+        Header *header = HeaderOf(reinterpret_cast<void *>(user));
+        header->Size = size;
+        header->Offset = static_cast<uint32_t>(user - reinterpret_cast<uintptr_t>(raw));
+        header->Owner = static_cast<uint8_t>(tag);
+        header->Reserved = 0;
+        header->Magic = HeaderMagic;
+
+        Track(tag, size);
+        return reinterpret_cast<void *>(user);
+    }
+
+    void *Reallocate(void *ptr, size_t size, size_t alignment, Tag tag)
+    {
+        if (!ptr)
+            return Allocate(size, alignment, tag);
+        if (size == 0)
+        {
+            Free(ptr);
+            return nullptr;
+        }
+
+        Header *header = HeaderOf(ptr);
+        void *moved = Allocate(size, alignment, static_cast<Tag>(header->Owner));
+        if (!moved)
+            return nullptr;
+        std::memcpy(moved, ptr, size < header->Size ? size : static_cast<size_t>(header->Size));
+        Free(ptr);
+        return moved;
+    }
+
+    void Free(void *ptr)
+    {
+        if (!ptr)
+            return;
+
+        Header *header = HeaderOf(ptr);
+        if (header->Magic != HeaderMagic)
+        {
+            // Not ours: a block from plain malloc that reached a hooked operator delete
+            std::free(ptr);
+            return;
+        }
+
+        Untrack(static_cast<Tag>(header->Owner), header->Size);
+        header->Magic = 0;
+        std::free(static_cast<char *>(ptr) - header->Offset);
+    }
+
+    size_t SizeOf(const void *ptr)
+    {
+        return ptr ? static_cast<size_t>(HeaderOf(ptr)->Size) : 0;
+    }
+
+    TagStats GetStats(Tag tag)
+    {
+        const Counters &counters = gCounters[static_cast<size_t>(tag)];
+        TagStats stats;
+        stats.LiveBytes = counters.LiveBytes.load(std::memory_order_relaxed);
+        stats.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+        stats.LiveAllocations = counters.LiveAllocations.load(std::memory_order_relaxed);
+        stats.TotalAllocations = counters.TotalAllocations.load(std::memory_order_relaxed);
+        stats.TotalBytes = counters.TotalBytes.load(std::memory_order_relaxed);
+        stats.FrameAllocations = counters.FrameAllocations.load(std::memory_order_relaxed);
+        stats.FrameBytes = counters.FrameBytes.load(std::memory_order_relaxed);
+        stats.Budget = counters.Budget.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    const char *TagName(Tag tag)
+    {
+        size_t index = static_cast<size_t>(tag);
+        return index < TagCount ? gTagNames[index] : "Unknown";
+    }
+
+    void SetBudget(Tag tag, uint64_t bytes)
+    {
+        Counters &counters = gCounters[static_cast<size_t>(tag)];
+        counters.Budget.store(bytes, std::memory_order_relaxed);
+        counters.OverBudget.store(false, std::memory_order_relaxed);
+    }
+
+    void BudgetsFromEnvironment()
+    {
+        for (size_t i = 0; i < TagCount; i++)
+        {
+            std::string variable = "STELA_MEMORY_BUDGET_";
+            for (const char *c = gTagNames[i]; *c; c++)
+                variable += static_cast<char>(*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c);
+
+            const char *value = std::getenv(variable.c_str());
+            if (!value || !*value)
+                continue;
+
+            uint64_t megabytes = std::strtoull(value, nullptr, 10);
+            SetBudget(static_cast<Tag>(i), megabytes * 1024 * 1024);
+            STELA_LOG_INFO(Engine, "Memory budget for %s: %llu MB", gTagNames[i], static_cast<unsigned long long>(megabytes));
+        }
+    }
+
+    void EndFrame()
+    {
+        struct TagMetrics
+        {
+            Metrics::Gauge *Live;
+            Metrics::Gauge *Peak;
+            Metrics::Counter *Allocations;
+            Metrics::Gauge *FrameAllocations;
+            Metrics::Gauge *BytesPerSecond;
+        };
+        static TagMetrics metrics[TagCount] = {};
+        static auto lastFrame = std::chrono::steady_clock::now();
+
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - lastFrame).count();
+        lastFrame = now;
+
+        for (size_t i = 0; i < TagCount; i++)
+        {
+            Counters &counters = gCounters[i];
+            TagMetrics &tagMetrics = metrics[i];
+            if (!tagMetrics.Live)
+            {
+                std::string labels = std::string("tag=\"") + gTagNames[i] + "\"";
+                tagMetrics.Live = &Metrics::GetGauge("stela_memory_live_bytes", "CPU memory currently allocated, per subsystem", labels);
+                tagMetrics.Peak = &Metrics::GetGauge("stela_memory_peak_bytes", "Highest CPU memory allocated at once, per subsystem", labels);
+                tagMetrics.Allocations = &Metrics::GetCounter("stela_memory_allocations_total", "CPU allocations made, per subsystem", labels);
+                tagMetrics.FrameAllocations = &Metrics::GetGauge("stela_memory_frame_allocations", "CPU allocations made during the last frame, per subsystem", labels);
+                tagMetrics.BytesPerSecond = &Metrics::GetGauge("stela_memory_alloc_bytes_per_second", "CPU allocation rate over the last frame, per subsystem", labels);
+            }
+
+            uint64_t allocations = counters.TotalAllocations.load(std::memory_order_relaxed);
+            uint64_t bytes = counters.TotalBytes.load(std::memory_order_relaxed);
+            uint64_t frameAllocations = allocations - counters.FrameStartAllocations;
+            uint64_t frameBytes = bytes - counters.FrameStartBytes;
+            counters.FrameStartAllocations = allocations;
+            counters.FrameStartBytes = bytes;
+            counters.FrameAllocations.store(frameAllocations, std::memory_order_relaxed);
+            counters.FrameBytes.store(frameBytes, std::memory_order_relaxed);
+
+            uint64_t live = counters.LiveBytes.load(std::memory_order_relaxed);
+            uint64_t budget = counters.Budget.load(std::memory_order_relaxed);
+            // Re-arm the warning once usage has clearly dropped back under the budget
+            if (budget && live < budget - budget / 10)
+                counters.OverBudget.store(false, std::memory_order_relaxed);
+
+            tagMetrics.Live->Set(static_cast<double>(live));
+            tagMetrics.Peak->Set(static_cast<double>(counters.PeakBytes.load(std::memory_order_relaxed)));
+            tagMetrics.Allocations->Set(allocations);
+            tagMetrics.FrameAllocations->Set(static_cast<double>(frameAllocations));
+            tagMetrics.BytesPerSecond->Set(seconds > 0.0 ? frameBytes / seconds : 0.0);
+        }
+    }
+
+    Tag CurrentTag()
+    {
+        return tCurrentTag;
+    }
+
+    ScopedTag::ScopedTag(Tag tag) : Previous(tCurrentTag)
+    {
+        tCurrentTag = tag;
+    }
+
+    ScopedTag::~ScopedTag()
+    {
+        tCurrentTag = Previous;
+    }
+
+    Arena::Arena(Tag tag, size_t blockSize) : Owner(tag), BlockSize(blockSize)
+    {
+    }
+
+    Arena::~Arena()
+    {
+        while (Head)
+        {
+            Block *next = Head->Next;
+            Memory::Free(Head);
+            Head = next;
+        }
+    }
+
+    void *Arena::Allocate(size_t size, size_t alignment)
+    {
+        // Offsets only grow until Reset, so trying every block from Current onward is always safe
+        for (Block *block = Current; block; block = block->Next)
+        {
+            uintptr_t base = reinterpret_cast<uintptr_t>(block + 1);
+            uintptr_t aligned = (base + block->Offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+            size_t offset = aligned - base;
+            if (offset + size <= block->Size)
+            {
+                block->Offset = offset + size;
+                Current = block;
+                Used += size;
+                return reinterpret_cast<void *>(aligned);
+            }
+        }
+
+        size_t capacity = size + alignment > BlockSize ? size + alignment : BlockSize;
+        Block *block = static_cast<Block *>(Memory::Allocate(sizeof(Block) + capacity, alignof(std::max_align_t), Owner));
+        if (!block)
+            throw std::bad_alloc();
+        block->Next = Head;
+        block->Size = capacity;
+        block->Offset = 0;
+        Head = block;
+        Current = block;
+        return Allocate(size, alignment);
+    }
+
+    void Arena::Reset()
+    {
+        for (Block *block = Head; block; block = block->Next)
+            block->Offset = 0;
+        Current = Head;
+        Used = 0;
+    }
+
+    bool NewHooksEnabled()
+    {
+#if !defined(NDEBUG) && defined(__linux__) && !defined(STELA_NO_NEW_HOOKS)
+        return true;
+#else
+        return false;
+#endif
+    }
+}
+
+#if !defined(NDEBUG) && defined(__linux__) && !defined(STELA_NO_NEW_HOOKS)
+// Debug builds on Linux replace the global allocation functions for the whole process (symbol
+// interposition), charging every new to the calling thread's tag. Windows and macOS resolve new/delete
+// per module, so hooking there would mix allocators across the engine/host boundary.
+namespace
+{
+    void *HookedNew(size_t size, size_t alignment)
+    {
+        void *ptr = Memory::Allocate(size ? size : 1, alignment, Memory::CurrentTag());
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+}
+
+void *operator new(size_t size) { return HookedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void *operator new[](size_t size) { return HookedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void *operator new(size_t size, std::align_val_t alignment) { return HookedNew(size, static_cast<size_t>(alignment)); }
+void *operator new[](size_t size, std::align_val_t alignment) { return HookedNew(size, static_cast<size_t>(alignment)); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return Memory::Allocate(size ? size : 1, __STDCPP_DEFAULT_NEW_ALIGNMENT__, Memory::CurrentTag());
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return Memory::Allocate(size ? size : 1, __STDCPP_DEFAULT_NEW_ALIGNMENT__, Memory::CurrentTag());
+}
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return Memory::Allocate(size ? size : 1, static_cast<size_t>(alignment), Memory::CurrentTag());
+}
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return Memory::Allocate(size ? size : 1, static_cast<size_t>(alignment), Memory::CurrentTag());
+}
+
+void operator delete(void *ptr) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr) noexcept { Memory::Free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { Memory::Free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { Memory::Free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { Memory::Free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { Memory::Free(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { Memory::Free(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { Memory::Free(ptr); }
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Tracked CPU allocations. Every block carries a small header with its size and owning tag, so live
+// bytes, peak and allocation counts are kept per subsystem with relaxed atomics (no locks, no hashing).
+// In debug builds on Linux the global operator new/delete are routed through here as well, charged to
+// the calling thread's current tag (see ScopedTag).
+namespace Memory
+{
+    enum class Tag : uint8_t
+    {
+        General,
+        Render,
+        Scripts,
+        Input,
+        Editor,
+        Count
+    };
+
+    struct TagStats
+    {
+        uint64_t LiveBytes = 0;
+        uint64_t PeakBytes = 0;
+        uint64_t LiveAllocations = 0;
+        uint64_t TotalAllocations = 0; // since startup
+        uint64_t TotalBytes = 0;       // since startup
+        uint64_t FrameAllocations = 0; // during the last completed frame
+        uint64_t FrameBytes = 0;
+        uint64_t Budget = 0; // 0 = unlimited
+    };
+
+    void *Allocate(size_t size, size_t alignment, Tag tag);
+    // Vulkan-style realloc: null `ptr` allocates, zero `size` frees and returns null. The tag of an existing block is kept.
+    void *Reallocate(void *ptr, size_t size, size_t alignment, Tag tag);
+    void Free(void *ptr);
+    // Usable size of a block returned by Allocate
+    size_t SizeOf(const void *ptr);
+
+    TagStats GetStats(Tag tag);
+    const char *TagName(Tag tag);
+
+    // Crossing the budget logs a warning once; it re-arms after usage drops below 90% of the budget
+    void SetBudget(Tag tag, uint64_t bytes);
+    // Reads STELA_MEMORY_BUDGET_<TAG> (megabytes), e.g. STELA_MEMORY_BUDGET_RENDER=256
+    void BudgetsFromEnvironment();
+
+    // Closes the current frame: per-frame counts become readable and the metrics registry is updated
+    void EndFrame();
+
+    // Whether operator new/delete are routed through the tracker in this build
+    bool NewHooksEnabled();
+
+    Tag CurrentTag();
+
+    // Charges operator new on this thread to `tag` for the lifetime of the scope
+    class ScopedTag
+    {
+    public:
+        explicit ScopedTag(Tag tag);
+        ~ScopedTag();
+        ScopedTag(const ScopedTag &) = delete;
+        ScopedTag &operator=(const ScopedTag &) = delete;
+
+    private:
+        Tag Previous;
+    };
+
+    // Bump allocator for short-lived data, charged to one tag. Blocks are kept across Reset.
+    class Arena
+    {
+    public:
+        explicit Arena(Tag tag, size_t blockSize = 64 * 1024);
+        ~Arena();
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+        template <typename T>
+        T *AllocateArray(size_t count) { return static_cast<T *>(Allocate(sizeof(T) * count, alignof(T))); }
+
+        // Forgets every allocation; nothing is destructed
+        void Reset();
+        size_t UsedBytes() const { return Used; }
+
+    private:
+        struct Block
+        {
+            Block *Next;
+            size_t Size;
+            size_t Offset;
+        };
+
+        Tag Owner;
+        size_t BlockSize;
+        Block *Head = nullptr;    // every block, newest first
+        Block *Current = nullptr; // block being filled
+        size_t Used = 0;
+    };
+
+    // std::allocator replacement that charges a container to a tag
+    template <typename T, Tag OwnerTag>
+    struct TaggedAllocator
+    {
+        using value_type = T;
+
+        TaggedAllocator() noexcept = default;
+        template <typename U>
+        TaggedAllocator(const TaggedAllocator<U, OwnerTag> &) noexcept {}
+
+        template <typename U>
+        struct rebind
+        {
+            using other = TaggedAllocator<U, OwnerTag>;
+        };
+
+        T *allocate(size_t count)
+        {
+            void *ptr = Memory::Allocate(sizeof(T) * count, alignof(T), OwnerTag);
+            if (!ptr)
+                throw std::bad_alloc();
+            return static_cast<T *>(ptr);
+        }
+        void deallocate(T *ptr, size_t) noexcept { Memory::Free(ptr); }
+
+        template <typename U>
+        bool operator==(const TaggedAllocator<U, OwnerTag> &) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const TaggedAllocator<U, OwnerTag> &) const noexcept { return false; }
+    };
+}
@@ -0,0 +1,666 @@
+#include "Metrics.h"
+#include <Log/Log.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Metrics
+{
+    // Histogram
+
+    uint32_t Histogram::BucketIndex(uint64_t value)
+    {
+        if (value < SubBuckets)
+            return static_cast<uint32_t>(value);
+
+        uint32_t msb = 63;
+        while (!(value & (1ull << msb)))
+            msb--;
+
+        // Keep the top SubBucketBits bits; the leading one selects the upper half of the sub-buckets
+        uint32_t shift = msb - SubBucketBits + 1;
+        uint32_t sub = static_cast<uint32_t>(value >> shift);
+        return SubBuckets + (shift - 1) * HalfSubBuckets + (sub - HalfSubBuckets);
+    }
+
+    uint64_t Histogram::BucketUpperBound(uint32_t index)
+    {
+        if (index < SubBuckets)
+            return index;
+
+        uint32_t offset = index - SubBuckets;
+        uint32_t shift = offset / HalfSubBuckets + 1;
+        uint64_t sub = offset % HalfSubBuckets + HalfSubBuckets;
+        if (sub + 1 == SubBuckets && shift + SubBucketBits == 64)
+            return UINT64_MAX;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    void Histogram::Record(uint64_t value)
+    {
+        Buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        Count.fetch_add(1, std::memory_order_relaxed);
+        Sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t current = Min.load(std::memory_order_relaxed);
+        while (value < current && !Min.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+        current = Max.load(std::memory_order_relaxed);
+        while (value > current && !Max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    HistogramSnapshot Histogram::Snapshot() const
+    {
+        HistogramSnapshot snapshot;
+        snapshot.Buckets.resize(BucketCount);
+        // Count is derived from the buckets so that percentiles never see a mismatched total
+        for (uint32_t i = 0; i < BucketCount; i++)
+        {
+            snapshot.Buckets[i] = Buckets[i].load(std::memory_order_relaxed);
+            snapshot.Count += snapshot.Buckets[i];
+        }
+        snapshot.Sum = Sum.load(std::memory_order_relaxed);
+        snapshot.Min = snapshot.Count ? Min.load(std::memory_order_relaxed) : 0;
+        snapshot.Max = Max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    uint64_t HistogramSnapshot::Percentile(double percentile) const
+    {
+        if (Count == 0)
+            return 0;
+
+        percentile = std::clamp(percentile, 0.0, 100.0);
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(Count) + 0.5);
+        target = std::clamp<uint64_t>(target, 1, Count);
+
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < Buckets.size(); i++)
+        {
+            seen += Buckets[i];
+            if (seen >= target)
+            {
+                // A snapshot racing Record can count a value before Min and Max have seen it
+                uint64_t bound = Histogram::BucketUpperBound(i);
+                return Min <= Max ? std::clamp(bound, Min, Max) : bound;
+            }
+        }
+        return Max;
+    }
+
+    HistogramSnapshot HistogramSnapshot::Delta(const HistogramSnapshot &older) const
+    {
+        HistogramSnapshot delta;
+        delta.Buckets.resize(Buckets.size());
+        for (size_t i = 0; i < Buckets.size(); i++)
+        {
+            uint64_t previous = i < older.Buckets.size() ? older.Buckets[i] : 0;
+            delta.Buckets[i] = Buckets[i] >= previous ? Buckets[i] - previous : 0;
+            delta.Count += delta.Buckets[i];
+        }
+        delta.Sum = Sum >= older.Sum ? Sum - older.Sum : 0;
+        delta.Min = Min;
+        delta.Max = Max;
+        return delta;
+    }
+
+    // Registry
+
+    namespace
+    {
+        struct Entry
+        {
+            std::string Name;
+            std::string Labels;
+            std::string Help;
+            Type Kind;
+            std::unique_ptr<Counter> CounterValue;
+            std::unique_ptr<Gauge> GaugeValue;
+            std::unique_ptr<Histogram> HistogramValue;
+        };
+
+        struct Registry
+        {
+            std::mutex Mutex;
+            std::vector<std::unique_ptr<Entry>> Entries;
+        };
+
+        // Intentionally leaked: metrics can be touched from static destructors and detached threads
+        Registry &GetRegistry()
+        {
+            static Registry *registry = new Registry();
+            return *registry;
+        }
+
+        Entry &FindOrAdd(const std::string &name, const char *help, const std::string &labels, Type kind)
+        {
+            Registry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.Mutex);
+
+            for (auto &entry : registry.Entries)
+            {
+                if (entry->Name != name)
+                    continue;
+                if (entry->Kind != kind)
+                    throw std::runtime_error("metric '" + name + "' registered with a different type");
+                if (entry->Labels == labels)
+                    return *entry;
+            }
+
+            auto entry = std::make_unique<Entry>();
+            entry->Name = name;
+            entry->Labels = labels;
+            entry->Help = help ? help : "";
+            entry->Kind = kind;
+            if (kind == Type::Counter)
+                entry->CounterValue = std::make_unique<Counter>();
+            else if (kind == Type::Gauge)
+                entry->GaugeValue = std::make_unique<Gauge>();
+            else
+                entry->HistogramValue = std::make_unique<Histogram>();
+
+            registry.Entries.push_back(std::move(entry));
+            return *registry.Entries.back();
+        }
+    }
+
+    Counter &GetCounter(const std::string &name, const char *help, const std::string &labels)
+    {
+        return *FindOrAdd(name, help, labels, Type::Counter).CounterValue;
+    }
+
+    Gauge &GetGauge(const std::string &name, const char *help, const std::string &labels)
+    {
+        return *FindOrAdd(name, help, labels, Type::Gauge).GaugeValue;
+    }
+
+    Histogram &GetHistogram(const std::string &name, const char *help, const std::string &labels)
+    {
+        return *FindOrAdd(name, help, labels, Type::Histogram).HistogramValue;
+    }
+
+    std::vector<Sample> Snapshot()
+    {
+        Registry &registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.Mutex);
+
+        std::vector<Sample> samples;
+        samples.reserve(registry.Entries.size());
+        for (auto &entry : registry.Entries)
+        {
+            Sample sample;
+            sample.Name = entry->Name;
+            sample.Labels = entry->Labels;
+            sample.Help = entry->Help;
+            sample.Kind = entry->Kind;
+            if (entry->Kind == Type::Counter)
+                sample.Value = static_cast<double>(entry->CounterValue->Get());
+            else if (entry->Kind == Type::Gauge)
+                sample.Value = entry->GaugeValue->Get();
+            else
+                sample.Distribution = entry->HistogramValue->Snapshot();
+            samples.push_back(std::move(sample));
+        }
+        return samples;
+    }
+
+    // Formatting
+
+    namespace
+    {
+        constexpr double Quantiles[] = {50.0, 90.0, 99.0, 99.9};
+
+        void AppendValue(std::string &out, double value)
+        {
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+            out += buffer;
+        }
+
+        void AppendSeries(std::string &out, const std::string &name, const char *suffix, const std::string &labels, const std::string &extraLabel, double value)
+        {
+            out += name;
+            out += suffix;
+            if (!labels.empty() || !extraLabel.empty())
+            {
+                out += '{';
+                out += labels;
+                if (!labels.empty() && !extraLabel.empty())
+                    out += ',';
+                out += extraLabel;
+                out += '}';
+            }
+            out += ' ';
+            AppendValue(out, value);
+            out += '\n';
+        }
+
+        const char *TypeName(Type kind)
+        {
+            switch (kind)
+            {
+            case Type::Counter:
+                return "counter";
+            case Type::Gauge:
+                return "gauge";
+            default:
+                return "summary";
+            }
+        }
+
+        // CSV fields are quoted when they contain separators; label sets always contain quotes
+        void AppendCsvField(std::string &out, const std::string &field)
+        {
+            if (field.find_first_of(",\"\n") == std::string::npos)
+            {
+                out += field;
+                return;
+            }
+            out += '"';
+            for (char c : field)
+            {
+                if (c == '"')
+                    out += '"';
+                out += c;
+            }
+            out += '"';
+        }
+
+        void AppendCsvRow(std::string &out, const char *timestamp, const Sample &sample, const char *field, double value)
+        {
+            out += timestamp;
+            out += ',';
+            AppendCsvField(out, sample.Name);
+            out += ',';
+            AppendCsvField(out, sample.Labels);
+            out += ',';
+            out += field;
+            out += ',';
+            AppendValue(out, value);
+            out += '\n';
+        }
+
+        void FormatCsv(const std::vector<Sample> &samples, double seconds, std::string &out)
+        {
+            char timestamp[32];
+            std::snprintf(timestamp, sizeof(timestamp), "%.3f", seconds);
+
+            for (const Sample &sample : samples)
+            {
+                if (sample.Kind != Type::Histogram)
+                {
+                    AppendCsvRow(out, timestamp, sample, "value", sample.Value);
+                    continue;
+                }
+
+                const HistogramSnapshot &h = sample.Distribution;
+                AppendCsvRow(out, timestamp, sample, "count", static_cast<double>(h.Count));
+                AppendCsvRow(out, timestamp, sample, "sum", static_cast<double>(h.Sum));
+                AppendCsvRow(out, timestamp, sample, "min", static_cast<double>(h.Min));
+                AppendCsvRow(out, timestamp, sample, "max", static_cast<double>(h.Max));
+                AppendCsvRow(out, timestamp, sample, "p50", static_cast<double>(h.Percentile(50.0)));
+                AppendCsvRow(out, timestamp, sample, "p90", static_cast<double>(h.Percentile(90.0)));
+                AppendCsvRow(out, timestamp, sample, "p99", static_cast<double>(h.Percentile(99.0)));
+                AppendCsvRow(out, timestamp, sample, "p999", static_cast<double>(h.Percentile(99.9)));
+            }
+        }
+    }
+
+    void FormatPrometheus(const std::vector<Sample> &samples, std::string &out)
+    {
+        // Every series of a family has to follow its HELP/TYPE lines, so group by name in first-seen order
+        std::vector<const Sample *> ordered;
+        ordered.reserve(samples.size());
+        for (const Sample &sample : samples)
+            ordered.push_back(&sample);
+        std::stable_sort(ordered.begin(), ordered.end(), [&](const Sample *a, const Sample *b)
+        {
+            auto firstSeen = [&](const std::string &name)
+            {
+                for (size_t i = 0; i < samples.size(); i++)
+                    if (samples[i].Name == name)
+                        return i;
+                return samples.size();
+            };
+            return firstSeen(a->Name) < firstSeen(b->Name);
+        });
+
+        const std::string *family = nullptr;
+        for (const Sample *sample : ordered)
+        {
+            if (!family || *family != sample->Name)
+            {
+                family = &sample->Name;
+                if (!sample->Help.empty())
+                    out += "# HELP " + sample->Name + " " + sample->Help + "\n";
+                out += "# TYPE " + sample->Name + " " + TypeName(sample->Kind) + "\n";
+            }
+
+            if (sample->Kind != Type::Histogram)
+            {
+                AppendSeries(out, sample->Name, "", sample->Labels, "", sample->Value);
+                continue;
+            }
+
+            const HistogramSnapshot &h = sample->Distribution;
+            for (double q : Quantiles)
+            {
+                char quantile[32];
+                std::snprintf(quantile, sizeof(quantile), "quantile=\"%g\"", q / 100.0);
+                AppendSeries(out, sample->Name, "", sample->Labels, quantile, static_cast<double>(h.Percentile(q)));
+            }
+            AppendSeries(out, sample->Name, "_sum", sample->Labels, "", static_cast<double>(h.Sum));
+            AppendSeries(out, sample->Name, "_count", sample->Labels, "", static_cast<double>(h.Count));
+        }
+    }
+
+    // Exporter
+
+    namespace
+    {
+        constexpr const char *CsvHeader = "time_s,metric,labels,field,value\n";
+
+        struct Exporter
+        {
+            ExportConfig Config;
+            std::thread Worker;
+            std::mutex WakeMutex;
+            std::condition_variable Wake;
+            std::atomic<bool> Running{false};
+
+            FILE *Csv = nullptr;
+            uint64_t CsvBytes = 0;
+
+            int ListenSocket = -1;
+
+            std::chrono::steady_clock::time_point Start;
+        };
+
+        std::mutex gExporterMutex;
+        std::unique_ptr<Exporter> gExporter;
+
+        bool OpenCsv(Exporter &exporter)
+        {
+            exporter.Csv = std::fopen(exporter.Config.CsvPath.c_str(), "ab");
+            if (!exporter.Csv)
+                return false;
+
+            std::fseek(exporter.Csv, 0, SEEK_END);
+            long size = std::ftell(exporter.Csv);
+            exporter.CsvBytes = size > 0 ? static_cast<uint64_t>(size) : 0;
+            if (exporter.CsvBytes == 0)
+            {
+                std::fputs(CsvHeader, exporter.Csv);
+                exporter.CsvBytes = std::strlen(CsvHeader);
+            }
+            return true;
+        }
+
+        // metrics.csv -> metrics.csv.1 -> metrics.csv.2 ..., dropping the oldest
+        void RotateCsv(Exporter &exporter)
+        {
+            std::fclose(exporter.Csv);
+            exporter.Csv = nullptr;
+
+            const std::string &path = exporter.Config.CsvPath;
+            uint32_t keep = std::max<uint32_t>(exporter.Config.CsvMaxFiles, 1);
+            std::error_code ec;
+            fs::remove(path + "." + std::to_string(keep - 1), ec);
+            for (uint32_t i = keep - 1; i > 1; i--)
+                fs::rename(path + "." + std::to_string(i - 1), path + "." + std::to_string(i), ec);
+            if (keep > 1)
+                fs::rename(path, path + ".1", ec);
+            else
+                fs::remove(path, ec);
+
+            if (!OpenCsv(exporter))
+                STELA_LOG_ERROR(Engine, "Metrics: failed to reopen %s after rotation", path);
+        }
+
+        void WriteCsv(Exporter &exporter, const std::vector<Sample> &samples)
+        {
+            if (!exporter.Csv)
+                return;
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - exporter.Start).count();
+            std::string rows;
+            FormatCsv(samples, seconds, rows);
+            std::fwrite(rows.data(), 1, rows.size(), exporter.Csv);
+            std::fflush(exporter.Csv);
+
+            exporter.CsvBytes += rows.size();
+            if (exporter.CsvBytes >= exporter.Config.CsvMaxBytes)
+                RotateCsv(exporter);
+        }
+
+#if !defined(_WIN32)
+        bool OpenSocket(Exporter &exporter)
+        {
+            const std::string &path = exporter.Config.SocketPath;
+            sockaddr_un address{};
+            if (path.size() >= sizeof(address.sun_path))
+            {
+                STELA_LOG_ERROR(Engine, "Metrics: socket path too long: %s", path);
+                return false;
+            }
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            // A stale socket file from a crashed run would make bind fail
+            unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 4) != 0)
+            {
+                STELA_LOG_ERROR(Engine, "Metrics: failed to listen on %s", path);
+                close(fd);
+                return false;
+            }
+
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            exporter.ListenSocket = fd;
+            return true;
+        }
+
+        void CloseSocket(Exporter &exporter)
+        {
+            if (exporter.ListenSocket < 0)
+                return;
+            close(exporter.ListenSocket);
+            unlink(exporter.Config.SocketPath.c_str());
+            exporter.ListenSocket = -1;
+        }
+
+        // Answers every pending client with a fresh snapshot. Clients only need to read until EOF.
+        void ServeClients(Exporter &exporter)
+        {
+            for (;;)
+            {
+                int client = accept(exporter.ListenSocket, nullptr, nullptr);
+                if (client < 0)
+                    return;
+
+                // A stalled reader must not hold up the exporter thread (and StopExporter's join), and one
+                // that disconnects early must not raise SIGPIPE. Accepted sockets inherit O_NONBLOCK on
+                // some platforms, so blocking mode is set explicitly for the send timeout to apply.
+                int flags = fcntl(client, F_GETFL, 0);
+                if (flags >= 0)
+                    fcntl(client, F_SETFL, flags & ~O_NONBLOCK);
+                timeval timeout{1, 0};
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#if defined(SO_NOSIGPIPE)
+                int noSigPipe = 1;
+                setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+#if defined(MSG_NOSIGNAL)
+                const int sendFlags = MSG_NOSIGNAL;
+#else
+                const int sendFlags = 0;
+#endif
+
+                std::string body;
+                FormatPrometheus(Snapshot(), body);
+
+                // Each send waits at most the timeout above; the whole response gets a few of them
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+                size_t written = 0;
+                while (written < body.size() && std::chrono::steady_clock::now() < deadline)
+                {
+                    ssize_t result = send(client, body.data() + written, body.size() - written, sendFlags);
+                    if (result <= 0)
+                        break;
+                    written += static_cast<size_t>(result);
+                }
+                close(client);
+            }
+        }
+
+        // Sleeps until the next interval, serving clients as they connect
+        void WaitForNextInterval(Exporter &exporter, std::chrono::steady_clock::time_point deadline)
+        {
+            while (exporter.Running)
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (remaining.count() <= 0)
+                    return;
+
+                if (exporter.ListenSocket < 0)
+                {
+                    std::unique_lock<std::mutex> lock(exporter.WakeMutex);
+                    exporter.Wake.wait_until(lock, deadline, [&] { return !exporter.Running; });
+                    return;
+                }
+
+                // Short poll slices keep shutdown responsive without a wake-up pipe
+                pollfd fd{exporter.ListenSocket, POLLIN, 0};
+                int timeout = static_cast<int>(std::min<int64_t>(remaining.count(), 100));
+                if (poll(&fd, 1, timeout) > 0)
+                    ServeClients(exporter);
+            }
+        }
+#else
+        bool OpenSocket(Exporter &)
+        {
+            STELA_LOG_WARNING(Engine, "Metrics: Unix socket export is not supported on this platform");
+            return false;
+        }
+
+        void CloseSocket(Exporter &)
+        {
+        }
+
+        void WaitForNextInterval(Exporter &exporter, std::chrono::steady_clock::time_point deadline)
+        {
+            std::unique_lock<std::mutex> lock(exporter.WakeMutex);
+            exporter.Wake.wait_until(lock, deadline, [&] { return !exporter.Running; });
+        }
+#endif
+
+        void ExporterLoop(Exporter &exporter)
+        {
+            auto interval = std::chrono::milliseconds(std::max<uint32_t>(exporter.Config.IntervalMs, 10));
+            auto next = std::chrono::steady_clock::now() + interval;
+
+            while (exporter.Running)
+            {
+                WaitForNextInterval(exporter, next);
+                if (!exporter.Running)
+                    break;
+
+                next += interval;
+                WriteCsv(exporter, Snapshot());
+            }
+        }
+    }
+
+    bool StartExporter(const ExportConfig &config)
+    {
+        std::lock_guard<std::mutex> lock(gExporterMutex);
+        if (gExporter)
+            return true;
+
+        auto exporter = std::make_unique<Exporter>();
+        exporter->Config = config;
+        exporter->Start = std::chrono::steady_clock::now();
+
+        if (!config.CsvPath.empty())
+        {
+            if (OpenCsv(*exporter))
+                STELA_LOG_INFO(Engine, "Metrics: writing snapshots to %s", config.CsvPath);
+            else
+                STELA_LOG_ERROR(Engine, "Metrics: failed to open %s", config.CsvPath);
+        }
+
+        if (!config.SocketPath.empty() && OpenSocket(*exporter))
+            STELA_LOG_INFO(Engine, "Metrics: serving Prometheus text on %s", config.SocketPath);
+
+        if (!exporter->Csv && exporter->ListenSocket < 0)
+            return false;
+
+        exporter->Running = true;
+        Exporter *raw = exporter.get();
+        exporter->Worker = std::thread([raw] { ExporterLoop(*raw); });
+        gExporter = std::move(exporter);
+        return true;
+    }
+
+    void StopExporter()
+    {
+        std::lock_guard<std::mutex> lock(gExporterMutex);
+        if (!gExporter)
+            return;
+
+        {
+            std::lock_guard<std::mutex> wakeLock(gExporter->WakeMutex);
+            gExporter->Running = false;
+        }
+        gExporter->Wake.notify_all();
+        if (gExporter->Worker.joinable())
+            gExporter->Worker.join();
+
+        WriteCsv(*gExporter, Snapshot());
+        if (gExporter->Csv)
+            std::fclose(gExporter->Csv);
+        CloseSocket(*gExporter);
+        gExporter.reset();
+    }
+
+    bool ConfigFromEnvironment(ExportConfig &config)
+    {
+        if (const char *csv = std::getenv("STELA_METRICS_CSV"))
+            config.CsvPath = csv;
+        if (const char *socketPath = std::getenv("STELA_METRICS_SOCKET"))
+            config.SocketPath = socketPath;
+        if (const char *interval = std::getenv("STELA_METRICS_INTERVAL_MS"))
+        {
+            int value = std::atoi(interval);
+            if (value > 0)
+                config.IntervalMs = static_cast<uint32_t>(value);
+        }
+        return !config.CsvPath.empty() || !config.SocketPath.empty();
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Engine-wide counters, gauges and histograms.
+// Registration takes a lock and returns a reference that stays valid for the lifetime of the process;
+// updating a metric through that reference is lock-free and safe from any thread.
+namespace Metrics
+{
+    enum class Type : uint8_t
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    // Monotonically increasing value (frames rendered, GC collections, stalls...)
+    class Counter
+    {
+    public:
+        void Add(uint64_t amount = 1) { Value.fetch_add(amount, std::memory_order_relaxed); }
+        // For counters mirrored from another source that already keeps a running total
+        void Set(uint64_t total) { Value.store(total, std::memory_order_relaxed); }
+        uint64_t Get() const { return Value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> Value{0};
+    };
+
+    // Value that can go up and down (memory in use, FPS...)
+    class Gauge
+    {
+    public:
+        void Set(double value) { Value.store(value, std::memory_order_relaxed); }
+        void Add(double amount)
+        {
+            double current = Value.load(std::memory_order_relaxed);
+            while (!Value.compare_exchange_weak(current, current + amount, std::memory_order_relaxed))
+            {
+            }
+        }
+        double Get() const { return Value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> Value{0.0};
+    };
+
+    // Plain copy of a histogram's buckets. Subtracting an older snapshot gives the distribution for that interval.
+    struct HistogramSnapshot
+    {
+        std::vector<uint64_t> Buckets;
+        uint64_t Count = 0;
+        uint64_t Sum = 0;
+        uint64_t Min = 0;
+        uint64_t Max = 0;
+
+        // Highest value equivalent to the given percentile (0-100), within the histogram's precision
+        uint64_t Percentile(double percentile) const;
+        double Mean() const { return Count ? static_cast<double>(Sum) / static_cast<double>(Count) : 0.0; }
+        // Min/Max are not recoverable for an interval, so the newer snapshot's bounds are kept
+        HistogramSnapshot Delta(const HistogramSnapshot &older) const;
+    };
+
+    // HDR-style log-linear histogram over unsigned integers: every power of two is split into
+    // SubBuckets linear buckets, giving ~3% relative precision over the full 64-bit range.
+    class Histogram
+    {
+    public:
+        static constexpr uint32_t SubBucketBits = 5;
+        static constexpr uint32_t SubBuckets = 1u << SubBucketBits;
+        static constexpr uint32_t HalfSubBuckets = SubBuckets / 2;
+        static constexpr uint32_t BucketCount = SubBuckets + (64 - SubBucketBits) * HalfSubBuckets;
+
+        void Record(uint64_t value);
+        HistogramSnapshot Snapshot() const;
+
+        static uint32_t BucketIndex(uint64_t value);
+        // Largest value that maps to the given bucket
+        static uint64_t BucketUpperBound(uint32_t index);
+
+    private:
+        std::atomic<uint64_t> Buckets[BucketCount];
+        std::atomic<uint64_t> Count{0};
+        std::atomic<uint64_t> Sum{0};
+        std::atomic<uint64_t> Min{UINT64_MAX};
+        std::atomic<uint64_t> Max{0};
+    };
+
+    // Records the lifetime of the scope into a histogram, in microseconds
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Histogram &target) : Target(target), Start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - Start;
+            Target.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        }
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        Histogram &Target;
+        std::chrono::steady_clock::time_point Start;
+    };
+
+    // Names follow Prometheus conventions (snake_case, unit suffix, _total for counters).
+    // `labels` is the inner part of a label set, e.g. system="DotNetRuntime"; the same name and
+    // labels always return the same metric. Registering a name with a different type throws.
+    Counter &GetCounter(const std::string &name, const char *help = "", const std::string &labels = "");
+    Gauge &GetGauge(const std::string &name, const char *help = "", const std::string &labels = "");
+    Histogram &GetHistogram(const std::string &name, const char *help = "", const std::string &labels = "");
+
+    struct Sample
+    {
+        std::string Name;
+        std::string Labels;
+        std::string Help;
+        Type Kind;
+        double Value = 0.0; // counters and gauges
+        HistogramSnapshot Distribution; // histograms
+    };
+
+    // Consistent per metric, not across metrics: each value is read once, in registration order
+    std::vector<Sample> Snapshot();
+
+    // Prometheus text exposition format (version 0.0.4). Histograms are exported as summaries.
+    void FormatPrometheus(const std::vector<Sample> &samples, std::string &out);
+
+    struct ExportConfig
+    {
+        // Appends one CSV row per metric and field every interval. Rotated to .1, .2, ... once it grows past CsvMaxBytes.
+        std::string CsvPath;
+        uint64_t CsvMaxBytes = 16ull * 1024 * 1024;
+        uint32_t CsvMaxFiles = 4;
+
+        // Serves the Prometheus text format to every client that connects, then closes the connection
+        std::string SocketPath;
+
+        uint32_t IntervalMs = 1000;
+    };
+
+    // Starts the background exporter. Returns false if nothing could be opened.
+    bool StartExporter(const ExportConfig &config);
+    // Writes a final snapshot and joins the exporter thread
+    void StopExporter();
+    // Fills in the config from STELA_METRICS_CSV, STELA_METRICS_SOCKET and STELA_METRICS_INTERVAL_MS
+    bool ConfigFromEnvironment(ExportConfig &config);
+}
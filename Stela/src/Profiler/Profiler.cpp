@@ -0,0 +1,112 @@
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace Profiler
+{
+    namespace
+    {
+        constexpr size_t Capacity = 1u << 16;
+        constexpr uint32_t GpuTrack = 0; // threads are numbered from 1
+
+        struct Event
+        {
+            char Name[48];
+            uint64_t Start;
+            uint64_t End;
+            uint32_t Track;
+        };
+
+        std::atomic<bool> Enabled{false};
+        std::atomic<uint32_t> NextTrack{1};
+        std::mutex Mutex; // guards Events and Head
+        std::vector<Event> Events;
+        uint64_t Head = 0; // total events recorded
+
+        uint32_t ThreadTrack()
+        {
+            thread_local uint32_t track = NextTrack.fetch_add(1, std::memory_order_relaxed);
+            return track;
+        }
+
+        void Push(const char *name, uint64_t startNs, uint64_t endNs, uint32_t track)
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (Events.empty())
+                Events.resize(Capacity);
+            Event &event = Events[Head % Capacity];
+            std::strncpy(event.Name, name, sizeof(event.Name) - 1);
+            event.Name[sizeof(event.Name) - 1] = '\0';
+            event.Start = startNs;
+            event.End = endNs;
+            event.Track = track;
+            Head++;
+        }
+    }
+
+    uint64_t Now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        Enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool IsEnabled()
+    {
+        return Enabled.load(std::memory_order_relaxed);
+    }
+
+    void RecordCpu(const char *name, uint64_t startNs, uint64_t endNs)
+    {
+        if (IsEnabled())
+            Push(name, startNs, endNs, ThreadTrack());
+    }
+
+    void RecordGpu(const char *name, uint64_t startNs, uint64_t endNs)
+    {
+        if (IsEnabled())
+            Push(name, startNs, endNs, GpuTrack);
+    }
+
+    bool WriteTrace(const std::string &path)
+    {
+        std::vector<Event> events;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            uint64_t count = Head < Capacity ? Head : Capacity;
+            events.reserve((size_t)count);
+            for (uint64_t i = Head - count; i < Head; i++)
+                events.push_back(Events[i % Capacity]);
+        }
+
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        std::fputs("{\"traceEvents\":[\n", file);
+        std::fputs("  {\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}", file);
+        for (const Event &event : events)
+        {
+            std::string name;
+            for (const char *c = event.Name; *c; c++)
+            {
+                if (*c == '"' || *c == '\\')
+                    name += '\\';
+                name += *c;
+            }
+            std::fprintf(file, ",\n  {\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                         name.c_str(), event.Track == GpuTrack ? "gpu" : "cpu", event.Start / 1000.0,
+                         (event.End - event.Start) / 1000.0, event.Track);
+        }
+        std::fputs("\n]}\n", file);
+        std::fclose(file);
+        return true;
+    }
+}
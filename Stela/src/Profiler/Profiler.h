@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Frame timeline: CPU scopes per thread plus GPU zones on their own track, kept in a fixed ring of
+// the most recent events and written out as chrome://tracing / Perfetto JSON. Recording is off until
+// SetEnabled(true); a disabled scope costs one relaxed load.
+namespace Profiler
+{
+    // Timeline clock: steady_clock, in nanoseconds
+    uint64_t Now();
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // Thread-safe. Names longer than the event's buffer are truncated.
+    void RecordCpu(const char *name, uint64_t startNs, uint64_t endNs);
+    // A zone measured on the GPU, already converted to the timeline clock
+    void RecordGpu(const char *name, uint64_t startNs, uint64_t endNs);
+
+    // Most recent events, oldest first
+    bool WriteTrace(const std::string &path);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) : Name(name), Start(IsEnabled() ? Now() : 0) {}
+        ~Scope()
+        {
+            if (Start != 0)
+                RecordCpu(Name, Start, Now());
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *Name;
+        uint64_t Start;
+    };
+}
+
+#define STELA_PROFILE_CONCAT_INNER(a, b) a##b
+#define STELA_PROFILE_CONCAT(a, b) STELA_PROFILE_CONCAT_INNER(a, b)
+#define STELA_PROFILE_SCOPE(name) ::Profiler::Scope STELA_PROFILE_CONCAT(profileScope, __LINE__)(name)
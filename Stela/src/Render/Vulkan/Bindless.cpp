@@ -0,0 +1,231 @@
+#include "Bindless.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <stdexcept>
+
+// Wanted sizes; clamped to what the device allows
+static constexpr uint32_t MaxSampledImages = 16384;
+static constexpr uint32_t MaxSamplers = 64;
+static constexpr uint32_t MaxStorageBuffers = 8192;
+
+static const VkDescriptorType DescriptorTypes[] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+void BindlessDescriptors::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, bool descriptorIndexing)
+{
+    Device = device;
+    pAllocator = allocator;
+    if (!descriptorIndexing)
+    {
+        STELA_LOG_WARNING(Render, "Descriptor indexing unavailable; bindless resources disabled");
+        return;
+    }
+
+    VkPhysicalDeviceVulkan12Properties limits{};
+    limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &limits;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    Tables[(uint32_t)BindlessKind::SampledImage].Capacity = std::min({MaxSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSampledImages});
+    Tables[(uint32_t)BindlessKind::Sampler].Capacity = std::min({MaxSamplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers, limits.maxDescriptorSetUpdateAfterBindSamplers});
+    Tables[(uint32_t)BindlessKind::StorageBuffer].Capacity = std::min({MaxStorageBuffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers});
+
+    VkDescriptorSetLayoutBinding bindings[(uint32_t)BindlessKind::Count]{};
+    VkDescriptorBindingFlags bindingFlags[(uint32_t)BindlessKind::Count]{};
+    VkDescriptorPoolSize poolSizes[(uint32_t)BindlessKind::Count]{};
+    for (uint32_t i = 0; i < (uint32_t)BindlessKind::Count; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = DescriptorTypes[i];
+        bindings[i].descriptorCount = Tables[i].Capacity;
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+        // Unwritten slots are fine as long as shaders never index them
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        poolSizes[i] = {DescriptorTypes[i], Tables[i].Capacity};
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = (uint32_t)BindlessKind::Count;
+    flagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = (uint32_t)BindlessKind::Count;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(Device, &layoutInfo, pAllocator, &SetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = (uint32_t)BindlessKind::Count;
+    poolInfo.pPoolSizes = poolSizes;
+    if (vkCreateDescriptorPool(Device, &poolInfo, pAllocator, &Pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = Pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &SetLayout;
+    if (vkAllocateDescriptorSets(Device, &allocInfo, &Set) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(Device, &samplerInfo, pAllocator, &Linear) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create bindless default sampler!");
+    }
+    LinearSampler = AddSampler(Linear);
+
+    STELA_LOG_INFO(Render, "Bindless descriptors: %u images, %u samplers, %u storage buffers",
+                   Tables[0].Capacity, Tables[1].Capacity, Tables[2].Capacity);
+}
+
+void BindlessDescriptors::Destroy()
+{
+    vkDestroySampler(Device, Linear, pAllocator);
+    // Destroying the pool frees the set
+    vkDestroyDescriptorPool(Device, Pool, pAllocator);
+    vkDestroyDescriptorSetLayout(Device, SetLayout, pAllocator);
+    Linear = VK_NULL_HANDLE;
+    Pool = VK_NULL_HANDLE;
+    SetLayout = VK_NULL_HANDLE;
+    Set = VK_NULL_HANDLE;
+}
+
+BindlessHandle BindlessDescriptors::Allocate(BindlessKind kind)
+{
+    Table &table = Tables[(uint32_t)kind];
+    if (!table.Free.empty())
+    {
+        uint32_t index = table.Free.back();
+        table.Free.pop_back();
+        return {index};
+    }
+    if (table.Next == table.Capacity)
+    {
+        STELA_LOG_ERROR(Render, "Bindless table %u is full (%u slots)", (uint32_t)kind, table.Capacity);
+        return {};
+    }
+    return {table.Next++};
+}
+
+void BindlessDescriptors::Write(BindlessKind kind, uint32_t index, const VkDescriptorImageInfo *image, const VkDescriptorBufferInfo *buffer)
+{
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = Set;
+    write.dstBinding = (uint32_t)kind;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = DescriptorTypes[(uint32_t)kind];
+    write.pImageInfo = image;
+    write.pBufferInfo = buffer;
+    vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+}
+
+BindlessHandle BindlessDescriptors::AddImage(VkImageView view, VkImageLayout layout)
+{
+    if (!IsEnabled())
+        return {};
+    std::lock_guard<std::mutex> lock(Mutex);
+    BindlessHandle handle = Allocate(BindlessKind::SampledImage);
+    if (handle.Valid())
+    {
+        VkDescriptorImageInfo info{VK_NULL_HANDLE, view, layout};
+        Write(BindlessKind::SampledImage, handle.Index, &info, nullptr);
+    }
+    return handle;
+}
+
+BindlessHandle BindlessDescriptors::AddSampler(VkSampler sampler)
+{
+    if (!IsEnabled())
+        return {};
+    std::lock_guard<std::mutex> lock(Mutex);
+    BindlessHandle handle = Allocate(BindlessKind::Sampler);
+    if (handle.Valid())
+    {
+        VkDescriptorImageInfo info{sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+        Write(BindlessKind::Sampler, handle.Index, &info, nullptr);
+    }
+    return handle;
+}
+
+BindlessHandle BindlessDescriptors::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    if (!IsEnabled())
+        return {};
+    std::lock_guard<std::mutex> lock(Mutex);
+    BindlessHandle handle = Allocate(BindlessKind::StorageBuffer);
+    if (handle.Valid())
+    {
+        VkDescriptorBufferInfo info{buffer, offset, range};
+        Write(BindlessKind::StorageBuffer, handle.Index, nullptr, &info);
+    }
+    return handle;
+}
+
+void BindlessDescriptors::UpdateImage(BindlessHandle handle, VkImageView view, VkImageLayout layout)
+{
+    if (!IsEnabled() || !handle.Valid())
+        return;
+    std::lock_guard<std::mutex> lock(Mutex);
+    VkDescriptorImageInfo info{VK_NULL_HANDLE, view, layout};
+    Write(BindlessKind::SampledImage, handle.Index, &info, nullptr);
+}
+
+void BindlessDescriptors::Remove(BindlessKind kind, BindlessHandle handle)
+{
+    if (!IsEnabled() || !handle.Valid())
+        return;
+    std::lock_guard<std::mutex> lock(Mutex);
+    // The frame being recorded may read it too, so it is free once that frame has completed
+    Tables[(uint32_t)kind].Retired.push_back({Frame + 1, handle.Index});
+}
+
+void BindlessDescriptors::EndFrame(uint64_t frameNumber, uint64_t completedFrames)
+{
+    static Metrics::Gauge &images = Metrics::GetGauge("stela_bindless_images", "Sampled image slots in use in the bindless set");
+    static Metrics::Gauge &buffers = Metrics::GetGauge("stela_bindless_buffers", "Storage buffer slots in use in the bindless set");
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    Frame = frameNumber;
+    for (Table &table : Tables)
+    {
+        while (!table.Retired.empty() && table.Retired.front().first <= completedFrames)
+        {
+            table.Free.push_back(table.Retired.front().second);
+            table.Retired.pop_front();
+        }
+    }
+    const Table &imageTable = Tables[(uint32_t)BindlessKind::SampledImage];
+    const Table &bufferTable = Tables[(uint32_t)BindlessKind::StorageBuffer];
+    images.Set((double)(imageTable.Next - imageTable.Free.size()));
+    buffers.Set((double)(bufferTable.Next - bufferTable.Free.size()));
+}
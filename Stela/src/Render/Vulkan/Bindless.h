@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Index of a resource in one of the bindless arrays; stays valid until removed
+struct BindlessHandle
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+enum class BindlessKind : uint32_t
+{
+    SampledImage,
+    Sampler,
+    StorageBuffer,
+    Count,
+};
+
+// One global descriptor set holding every sampled image, sampler and storage buffer the renderer
+// uses, in large partially bound arrays (descriptor indexing, core in Vulkan 1.2). Shaders pick
+// resources by handle, usually passed through push constants, so draws never rebind descriptors
+// and materials that differ only in their resources can share a pipeline and a batch.
+//
+// Descriptors are written with update-after-bind, so adding resources never waits on the GPU.
+// A removed slot is recycled only once no frame in flight can still read it.
+//
+// Bindings: 0 `texture2D textures[]`, 1 `sampler samplers[]`, 2 storage buffers.
+class BindlessDescriptors
+{
+public:
+    static constexpr uint32_t PushConstantSize = 128; // the minimum every device guarantees
+
+    // Leaves the model disabled when the device lacks the descriptor indexing features
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, bool descriptorIndexing);
+    void Destroy();
+    bool IsEnabled() const { return Set != VK_NULL_HANDLE; }
+
+    // Thread-safe
+    BindlessHandle AddImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    BindlessHandle AddSampler(VkSampler sampler);
+    BindlessHandle AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+    // Repoints a handle no frame in flight reads; a slot pending command buffers use must not be rewritten,
+    // so replace it with AddImage and Remove instead
+    void UpdateImage(BindlessHandle handle, VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void Remove(BindlessKind kind, BindlessHandle handle);
+
+    // Linear filtering, repeat addressing; always slot 0
+    BindlessHandle DefaultSampler() const { return LinearSampler; }
+
+    // Once per frame, after the frame's submit. `frameNumber` is the next frame to be recorded
+    // (Vulkan::FrameNumber) and `completedFrames` is Vulkan::CompletedFrames.
+    void EndFrame(uint64_t frameNumber, uint64_t completedFrames);
+
+    VkDescriptorSetLayout GetSetLayout() const { return SetLayout; }
+    VkDescriptorSet GetSet() const { return Set; }
+    uint32_t Capacity(BindlessKind kind) const { return Tables[(uint32_t)kind].Capacity; }
+
+private:
+    struct Table
+    {
+        uint32_t Capacity = 0;
+        uint32_t Next = 0;
+        std::vector<uint32_t> Free;
+        std::deque<std::pair<uint64_t, uint32_t>> Retired; // CompletedFrames at which it becomes free, index
+    };
+
+    BindlessHandle Allocate(BindlessKind kind);
+    void Write(BindlessKind kind, uint32_t index, const VkDescriptorImageInfo *image, const VkDescriptorBufferInfo *buffer);
+
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool Pool = VK_NULL_HANDLE;
+    VkDescriptorSet Set = VK_NULL_HANDLE;
+    VkSampler Linear = VK_NULL_HANDLE;
+    BindlessHandle LinearSampler;
+
+    std::mutex Mutex;
+    Table Tables[(uint32_t)BindlessKind::Count];
+    uint64_t Frame = 0; // frame being recorded
+};
@@ -0,0 +1,396 @@
+#include "BlockCompression.h"
+#include <Jobs/JobSystem.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    uint16_t Pack565(const float color[3])
+    {
+        uint32_t r = (uint32_t)std::clamp(color[0] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f);
+        uint32_t g = (uint32_t)std::clamp(color[1] * 63.0f / 255.0f + 0.5f, 0.0f, 63.0f);
+        uint32_t b = (uint32_t)std::clamp(color[2] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f);
+        return (uint16_t)(r << 11 | g << 5 | b);
+    }
+
+    void Unpack565(uint16_t packed, int color[3])
+    {
+        int r = packed >> 11 & 31;
+        int g = packed >> 5 & 63;
+        int b = packed & 31;
+        color[0] = r << 3 | r >> 2;
+        color[1] = g << 2 | g >> 4;
+        color[2] = b << 3 | b >> 2;
+    }
+
+    // Always in four-color mode, the only one BC3's color half has
+    void EncodeColor(const uint8_t *rgba, uint8_t *block)
+    {
+        float mean[3] = {};
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+        }
+
+        // Principal axis of the texels by power iteration on their covariance
+        float covariance[6] = {}; // rr rg rb gg gb bb
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            float d[3] = {rgba[i * 4] - mean[0], rgba[i * 4 + 1] - mean[1], rgba[i * 4 + 2] - mean[2]};
+            covariance[0] += d[0] * d[0];
+            covariance[1] += d[0] * d[1];
+            covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1];
+            covariance[4] += d[1] * d[2];
+            covariance[5] += d[2] * d[2];
+        }
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (uint32_t iteration = 0; iteration < 6; iteration++)
+        {
+            float next[3] = {covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                             covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                             covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+            float length = std::max({std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2])});
+            if (length < 1e-6f)
+                break; // a flat block; any axis will do
+            for (uint32_t c = 0; c < 3; c++)
+                axis[c] = next[c] / length;
+        }
+        float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (float &component : axis)
+            component /= axisLength;
+
+        float lowest = 0.0f;
+        float highest = 0.0f;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            float t = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+            lowest = std::min(lowest, t);
+            highest = std::max(highest, t);
+        }
+        // Pull the endpoints in a little: the extremes are rarely worth a whole palette entry
+        float inset = (highest - lowest) / 16.0f;
+        lowest += inset;
+        highest -= inset;
+        float maximum[3];
+        float minimum[3];
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            maximum[c] = mean[c] + axis[c] * highest;
+            minimum[c] = mean[c] + axis[c] * lowest;
+        }
+
+        uint16_t color0 = Pack565(maximum);
+        uint16_t color1 = Pack565(minimum);
+        if (color0 < color1)
+            std::swap(color0, color1);
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            // color0 > color1 selects the four-color palette
+            int palette[4][3];
+            Unpack565(color0, palette[0]);
+            Unpack565(color1, palette[1]);
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t best = 0;
+                int bestError = INT32_MAX;
+                for (uint32_t entry = 0; entry < 4; entry++)
+                {
+                    int error = 0;
+                    for (uint32_t c = 0; c < 3; c++)
+                    {
+                        int d = rgba[i * 4 + c] - palette[entry][c];
+                        error += d * d;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = entry;
+                    }
+                }
+                indices |= best << (i * 2);
+            }
+        }
+
+        block[0] = (uint8_t)color0;
+        block[1] = (uint8_t)(color0 >> 8);
+        block[2] = (uint8_t)color1;
+        block[3] = (uint8_t)(color1 >> 8);
+        std::memcpy(block + 4, &indices, 4);
+    }
+
+    void DecodeColor(const uint8_t *block, bool fourColor, uint8_t *rgba)
+    {
+        uint16_t color0 = (uint16_t)(block[0] | block[1] << 8);
+        uint16_t color1 = (uint16_t)(block[2] | block[3] << 8);
+        int palette[4][4];
+        Unpack565(color0, palette[0]);
+        Unpack565(color1, palette[1]);
+        palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+        if (fourColor || color0 > color1)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+        }
+        else
+        {
+            // Three colors and transparent black
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+            palette[3][3] = 0;
+        }
+
+        uint32_t indices;
+        std::memcpy(&indices, block + 4, 4);
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            const int *color = palette[indices >> (i * 2) & 3];
+            for (uint32_t c = 0; c < 4; c++)
+                rgba[i * 4 + c] = (uint8_t)color[c];
+        }
+    }
+
+    // `values` are the 16 texels of one channel
+    void EncodeSingle(const uint8_t *values, uint8_t *block)
+    {
+        uint8_t highest = *std::max_element(values, values + 16);
+        uint8_t lowest = *std::min_element(values, values + 16);
+        block[0] = highest;
+        block[1] = lowest;
+        uint64_t indices = 0;
+        if (highest != lowest)
+        {
+            // highest > lowest selects the eight-value palette: 0 and 1 are the endpoints, 2-7 between
+            int palette[8] = {highest, lowest};
+            for (int entry = 2; entry < 8; entry++)
+                palette[entry] = ((8 - entry) * highest + (entry - 1) * lowest) / 7;
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint64_t best = 0;
+                int bestError = INT32_MAX;
+                for (uint32_t entry = 0; entry < 8; entry++)
+                {
+                    int error = std::abs(values[i] - palette[entry]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = entry;
+                    }
+                }
+                indices |= best << (i * 3);
+            }
+        }
+        for (uint32_t i = 0; i < 6; i++)
+            block[2 + i] = (uint8_t)(indices >> (i * 8));
+    }
+
+    // Writes the 16 values `stride` bytes apart
+    void DecodeSingle(const uint8_t *block, uint8_t *values, uint32_t stride)
+    {
+        int value0 = block[0];
+        int value1 = block[1];
+        int palette[8] = {value0, value1};
+        if (value0 > value1)
+        {
+            for (int entry = 2; entry < 8; entry++)
+                palette[entry] = ((8 - entry) * value0 + (entry - 1) * value1) / 7;
+        }
+        else
+        {
+            for (int entry = 2; entry < 6; entry++)
+                palette[entry] = ((6 - entry) * value0 + (entry - 1) * value1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (uint32_t i = 0; i < 6; i++)
+            indices |= (uint64_t)block[2 + i] << (i * 8);
+        for (uint32_t i = 0; i < 16; i++)
+            values[i * stride] = (uint8_t)palette[indices >> (i * 3) & 7];
+    }
+
+    void Channel(const uint8_t *rgba, uint32_t channel, uint8_t *values)
+    {
+        for (uint32_t i = 0; i < 16; i++)
+            values[i] = rgba[i * 4 + channel];
+    }
+}
+
+void BlockCompression::EncodeBC1(const uint8_t *rgba, uint8_t *block)
+{
+    EncodeColor(rgba, block);
+}
+
+void BlockCompression::EncodeBC3(const uint8_t *rgba, uint8_t *block)
+{
+    EncodeBC4(rgba, 3, block);
+    EncodeColor(rgba, block + 8);
+}
+
+void BlockCompression::EncodeBC4(const uint8_t *rgba, uint32_t channel, uint8_t *block)
+{
+    uint8_t values[16];
+    Channel(rgba, channel, values);
+    EncodeSingle(values, block);
+}
+
+void BlockCompression::EncodeBC5(const uint8_t *rgba, uint8_t *block)
+{
+    EncodeBC4(rgba, 0, block);
+    EncodeBC4(rgba, 1, block + 8);
+}
+
+uint32_t BlockCompression::BlockSize(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+std::vector<uint8_t> BlockCompression::EncodeImage(VkFormat format, const uint8_t *rgba, uint32_t width, uint32_t height)
+{
+    uint32_t blockSize = BlockSize(format);
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+    std::vector<uint8_t> blocks((size_t)blocksWide * blocksHigh * blockSize);
+    if (blockSize == 0)
+        return {};
+
+    Jobs::ParallelFor(blocksHigh, [&](uint32_t begin, uint32_t end)
+    {
+        uint8_t texels[64];
+        for (uint32_t by = begin; by < end; by++)
+        {
+            for (uint32_t bx = 0; bx < blocksWide; bx++)
+            {
+                for (uint32_t i = 0; i < 16; i++)
+                {
+                    uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, height - 1);
+                    std::memcpy(texels + i * 4, rgba + ((size_t)y * width + x) * 4, 4);
+                }
+
+                uint8_t *block = blocks.data() + ((size_t)by * blocksWide + bx) * blockSize;
+                switch (format)
+                {
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                    EncodeBC3(texels, block);
+                    break;
+                case VK_FORMAT_BC4_UNORM_BLOCK:
+                    EncodeBC4(texels, 0, block);
+                    break;
+                case VK_FORMAT_BC5_UNORM_BLOCK:
+                    EncodeBC5(texels, block);
+                    break;
+                default:
+                    EncodeBC1(texels, block);
+                    break;
+                }
+            }
+        }
+    });
+    return blocks;
+}
+
+VkFormat BlockCompression::DecodedFormat(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        return VK_FORMAT_R8_UNORM;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        return VK_FORMAT_R8G8_UNORM;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+bool BlockCompression::DecodeImage(VkFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *texels)
+{
+    uint32_t blockSize = BlockSize(format);
+    if (blockSize == 0)
+        return false;
+    uint32_t texelSize = DecodedFormat(format) == VK_FORMAT_R8_UNORM ? 1 : DecodedFormat(format) == VK_FORMAT_R8G8_UNORM ? 2 : 4;
+    bool opaque = format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+
+    uint8_t decoded[64];
+    for (uint32_t by = 0; by < blocksHigh; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksWide; bx++)
+        {
+            const uint8_t *block = blocks + ((size_t)by * blocksWide + bx) * blockSize;
+            switch (format)
+            {
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+                DecodeColor(block + 8, true, decoded);
+                DecodeSingle(block, decoded + 3, 4);
+                break;
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+                DecodeSingle(block, decoded, 1);
+                break;
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+                DecodeSingle(block, decoded, 2);
+                DecodeSingle(block + 8, decoded + 1, 2);
+                break;
+            default:
+                DecodeColor(block, false, decoded);
+                if (opaque)
+                {
+                    for (uint32_t i = 0; i < 16; i++)
+                        decoded[i * 4 + 3] = 255;
+                }
+                break;
+            }
+
+            // Texels past the image edge are dropped
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t x = bx * 4 + i % 4;
+                uint32_t y = by * 4 + i / 4;
+                if (x < width && y < height)
+                    std::memcpy(texels + ((size_t)y * width + x) * texelSize, decoded + i * texelSize, texelSize);
+            }
+        }
+    }
+    return true;
+}
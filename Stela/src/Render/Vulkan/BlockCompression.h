@@ -0,0 +1,29 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+// BC1, BC3, BC4 and BC5 block codecs for TextureCooker, and the decoder TextureStreamer falls back to
+// on devices that cannot sample them. Blocks cover 4x4 texels: 8 bytes for BC1 and BC4, 16 for BC3
+// and BC5. The encoders fit endpoints along the block's principal axis; they aim for reasonable
+// quality at cook time, not for the last fraction of a dB.
+namespace BlockCompression
+{
+    // `rgba` is a 4x4 block of 8-bit RGBA texels, row by row
+    void EncodeBC1(const uint8_t *rgba, uint8_t *block);
+    void EncodeBC3(const uint8_t *rgba, uint8_t *block);
+    // `channel` of each texel: 0 red ... 3 alpha
+    void EncodeBC4(const uint8_t *rgba, uint32_t channel, uint8_t *block);
+    // Red and green
+    void EncodeBC5(const uint8_t *rgba, uint8_t *block);
+
+    // Bytes per 4x4 block of one of the formats here (either color space), 0 for any other format
+    uint32_t BlockSize(VkFormat format);
+    // Compresses an 8-bit RGBA image to `format`; edge blocks repeat the last row and column
+    std::vector<uint8_t> EncodeImage(VkFormat format, const uint8_t *rgba, uint32_t width, uint32_t height);
+
+    // What DecodeImage produces for `format`: R8G8B8A8 (keeping sRGB), R8 for BC4 or R8G8 for BC5
+    VkFormat DecodedFormat(VkFormat format);
+    // Decodes a whole level into width * height texels of DecodedFormat; false for other formats
+    bool DecodeImage(VkFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *texels);
+}
@@ -0,0 +1,208 @@
+#include "ClusteredLighting.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+void ClusteredLighting::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    VkDevice device = vulkan.Device;
+
+    // The compute pass writes the lists and the mesh fragment shaders read both bindings, so the
+    // reflected compute layout is widened to the fragment stage and shared as set 3 of the mesh pipelines
+    ShaderCode cullShader = vulkan.Shaders.Get("light_cluster.comp");
+    ShaderReflection reflection = ShaderReflection::Reflect(*cullShader);
+    std::vector<VkDescriptorSetLayoutBinding> bindings = reflection.SetBindings(0);
+    for (VkDescriptorSetLayoutBinding &binding : bindings)
+        binding.stageFlags |= VK_SHADER_STAGE_FRAGMENT_BIT;
+    SetLayout = vulkan.Layouts.GetSetLayout(bindings);
+    Layout = vulkan.Layouts.GetPipelineLayout(reflection, {{0, SetLayout}});
+
+    uint32_t frameCount = vulkan.FramesInFlight;
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 2};
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.maxSets = frameCount;
+    descriptorPoolInfo.poolSizeCount = 1;
+    descriptorPoolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &descriptorPoolInfo, vulkan.pAllocator, &DescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create light descriptor pool!");
+    }
+
+    VkDeviceSize clusterSize = (VkDeviceSize)GridX * GridY * GridZ * (MaxLightsPerCluster + 1) * sizeof(uint32_t);
+    Frames.resize(frameCount);
+    for (FrameResources &frame : Frames)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = DescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &SetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &frame.DescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate light descriptor set!");
+        }
+        vulkan.CreateBuffer(clusterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::GpuOnly, frame.Clusters.Buffer, frame.Clusters.Allocation);
+        EnsureCapacity(frame, 256);
+    }
+
+    CreatePipeline(cullShader);
+    STELA_LOG_INFO(Render, "Clustered lighting: %ux%ux%u froxels, %u lights each", GridX, GridY, GridZ, MaxLightsPerCluster);
+}
+
+void ClusteredLighting::CreatePipeline(const ShaderCode &code)
+{
+    VkShaderModule module = Owner->CreateShaderModule(*code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = Layout;
+
+    VkResult result = vkCreateComputePipelines(Owner->Device, Owner->PersistentCache.Handle(), 1, &pipelineInfo, Owner->pAllocator, &Pipeline);
+    vkDestroyShaderModule(Owner->Device, module, Owner->pAllocator);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create light culling pipeline!");
+    }
+}
+
+void ClusteredLighting::Destroy()
+{
+    if (!Owner)
+        return;
+    for (FrameResources &frame : Frames)
+    {
+        Release(frame.Lights);
+        Release(frame.Clusters);
+    }
+    Frames.clear();
+    vkDestroyPipeline(Owner->Device, Pipeline, Owner->pAllocator);
+    vkDestroyDescriptorPool(Owner->Device, DescriptorPool, Owner->pAllocator);
+    Pipeline = VK_NULL_HANDLE;
+    DescriptorPool = VK_NULL_HANDLE;
+    Owner = nullptr;
+}
+
+void ClusteredLighting::Release(FrameBuffer &buffer)
+{
+    if (buffer.Buffer == VK_NULL_HANDLE)
+        return;
+    vkDestroyBuffer(Owner->Device, buffer.Buffer, Owner->pAllocator);
+    Owner->DeviceMemory.Free(buffer.Allocation);
+    buffer.Buffer = VK_NULL_HANDLE;
+}
+
+void ClusteredLighting::EnsureCapacity(FrameResources &frame, uint32_t lights)
+{
+    if (lights <= frame.LightCapacity)
+        return;
+
+    // Only called for a frame whose fence has signalled, so the old buffer is idle
+    frame.LightCapacity = std::max({lights, frame.LightCapacity * 2, 256u});
+    Release(frame.Lights);
+    Owner->CreateBuffer(sizeof(GpuParams) + (VkDeviceSize)frame.LightCapacity * sizeof(GpuLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        GpuMemoryUsage::Upload, frame.Lights.Buffer, frame.Lights.Allocation);
+
+    VkDescriptorBufferInfo bufferInfos[2] = {
+        {frame.Lights.Buffer, 0, VK_WHOLE_SIZE},
+        {frame.Clusters.Buffer, 0, VK_WHOLE_SIZE},
+    };
+    VkWriteDescriptorSet writes[2]{};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = frame.DescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(Owner->Device, 2, writes, 0, nullptr);
+}
+
+void ClusteredLighting::SubmitPointLight(const Math::Vec3 &position, float radius, const Math::Vec3 &color, float intensity)
+{
+    if (radius <= 0.0f)
+        return;
+    // A cone factor of saturate(dot * 0 + 1) lights every direction
+    Pending.push_back({{position.X, position.Y, position.Z, radius},
+                       {color.X * intensity, color.Y * intensity, color.Z * intensity, 0.0f},
+                       {0.0f, 0.0f, -1.0f, 1.0f}});
+}
+
+void ClusteredLighting::SubmitSpotLight(const Math::Vec3 &position, const Math::Vec3 &direction, float radius, float innerAngle, float outerAngle,
+                                        const Math::Vec3 &color, float intensity)
+{
+    if (radius <= 0.0f)
+        return;
+    // The cone factor is linear in the cosine: 0 at the outer angle, 1 at the inner one
+    float cosOuter = std::cos(outerAngle);
+    float cosInner = std::cos(std::min(innerAngle, outerAngle));
+    float scale = 1.0f / std::max(cosInner - cosOuter, 1e-4f);
+    Math::Vec3 axis = Math::Normalize(direction);
+    Pending.push_back({{position.X, position.Y, position.Z, radius},
+                       {color.X * intensity, color.Y * intensity, color.Z * intensity, scale},
+                       {axis.X, axis.Y, axis.Z, -cosOuter * scale}});
+}
+
+void ClusteredLighting::Prepare(uint32_t frameIndex, const Math::Mat4 &view, const Math::Mat4 &projection)
+{
+    static Metrics::Histogram &prepareTime = Metrics::GetHistogram("stela_light_prepare_us", "Time to transform and upload the frame's lights, in microseconds");
+    static Metrics::Gauge &lightCount = Metrics::GetGauge("stela_lights", "Point and spot lights submitted in the last frame");
+    Metrics::ScopedTimer timer(prepareTime);
+
+    CurrentFrame = frameIndex;
+    FrameResources &frame = Frames[frameIndex];
+    uint32_t count = static_cast<uint32_t>(Pending.size());
+    EnsureCapacity(frame, count);
+
+    // Math::Perspective stores near * far / (near - far) and far / (near - far) in the depth terms
+    float depthScale = projection.M[2][2];
+    float depthOffset = projection.M[3][2];
+    float zNear = depthScale != 0.0f ? depthOffset / depthScale : 0.1f;
+    float zFar = depthScale != -1.0f ? depthOffset / (depthScale + 1.0f) : 1000.0f;
+    zNear = std::max(zNear, 1e-3f);
+    zFar = std::max(zFar, zNear * 1.01f);
+    float sliceScale = GridZ / std::log(zFar / zNear);
+
+    GpuParams params = {{GridX, GridY, GridZ, count},
+                        {projection.M[0][0], projection.M[1][1], zNear, zFar},
+                        {sliceScale, -std::log(zNear) * sliceScale, (float)MaxLightsPerCluster, 0.0f}};
+    char *mapped = static_cast<char *>(frame.Lights.Allocation.Mapped);
+    std::memcpy(mapped, &params, sizeof(params));
+
+    GpuLight *lights = reinterpret_cast<GpuLight *>(mapped + sizeof(GpuParams));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const GpuLight &light = Pending[i];
+        Math::Vec4 position = view * Math::Vec4{light.Position[0], light.Position[1], light.Position[2], 1.0f};
+        Math::Vec4 direction = view * Math::Vec4{light.Direction[0], light.Direction[1], light.Direction[2], 0.0f};
+        lights[i] = {{position.X, position.Y, position.Z, light.Position[3]},
+                     {light.Color[0], light.Color[1], light.Color[2], light.Color[3]},
+                     {direction.X, direction.Y, direction.Z, light.Direction[3]}};
+    }
+
+    LastLightCount = count;
+    lightCount.Set((double)count);
+    Pending.clear();
+}
+
+void ClusteredLighting::RecordCulling(VkCommandBuffer commandBuffer)
+{
+    if (Pipeline == VK_NULL_HANDLE)
+        return;
+    // Runs with no lights too: the lists are per frame slot and would otherwise keep an old frame's
+    const FrameResources &frame = Frames[CurrentFrame];
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Layout, 0, 1, &frame.DescriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (GridX * GridY * GridZ + 63) / 64, 1, 1);
+}
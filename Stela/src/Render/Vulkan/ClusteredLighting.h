@@ -0,0 +1,100 @@
+#pragma once
+#include "GpuAllocator.h"
+#include "ShaderSystem.h"
+#include <Math/Math.h>
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+class Vulkan;
+
+// Clustered forward lighting for point and spot lights. The view frustum is cut into a grid of
+// froxels (GridX x GridY screen tiles, GridZ exponential depth slices); every frame a compute pass
+// (Shaders/light_cluster.comp) tests each light's bounding sphere against each froxel and writes the
+// froxel's light list, and the mesh fragment shaders (Shaders/clustered_lighting.glsl) shade with the
+// lights of their froxel only, so the cost per pixel follows the local light density rather than the
+// scene's light count.
+//
+// Lights are submitted every frame like mesh instances. Set 3 of the mesh pipelines is GetSet():
+// binding 0 holds the frame's parameters and view-space lights, binding 1 the froxel lists. A froxel
+// keeps at most MaxLightsPerCluster lights; the rest are dropped there.
+//
+// Submit* are main-thread only.
+class ClusteredLighting
+{
+public:
+    static constexpr uint32_t GridX = 16;
+    static constexpr uint32_t GridY = 9;
+    static constexpr uint32_t GridZ = 24;
+    static constexpr uint32_t MaxLightsPerCluster = 127;
+
+    // After Vulkan::Layouts and Vulkan::Shaders; before MeshRenderer, whose pipelines use the set layout
+    void Init(Vulkan &vulkan);
+    // Once the device is idle
+    void Destroy();
+
+    // World space; `radius` is where the light's contribution reaches zero
+    void SubmitPointLight(const Math::Vec3 &position, float radius, const Math::Vec3 &color, float intensity);
+    // Full intensity inside `innerAngle` of `direction`, fading out at `outerAngle` (half-angles, radians)
+    void SubmitSpotLight(const Math::Vec3 &position, const Math::Vec3 &direction, float radius, float innerAngle, float outerAngle,
+                         const Math::Vec3 &color, float intensity);
+
+    // Moves this frame's lights to view space and writes them to the frame's buffer. `projection`
+    // is a Math::Perspective matrix. Called by Vulkan::DrawFrame once the frame's fence has been waited on.
+    void Prepare(uint32_t frameIndex, const Math::Mat4 &view, const Math::Mat4 &projection);
+    // Builds the froxel lists; outside any render pass. Making them visible to the fragment shaders is
+    // the caller's job (the frame graph's LightCulling pass).
+    void RecordCulling(VkCommandBuffer commandBuffer);
+
+    // Owned by Vulkan::Layouts; pass it as set 3 when building mesh pipeline layouts
+    VkDescriptorSetLayout GetSetLayout() const { return SetLayout; }
+    // The prepared frame's set
+    VkDescriptorSet GetSet() const { return Frames[CurrentFrame].DescriptorSet; }
+    uint32_t LightCount() const { return LastLightCount; }
+
+private:
+    // std430 layout of `Light` in light_cluster.comp and clustered_lighting.glsl
+    struct GpuLight
+    {
+        float Position[4];  // view space, radius
+        float Color[4];     // color * intensity, spot cone scale
+        float Direction[4]; // view space, spot cone offset
+    };
+
+    // Header of the `Lights` buffer, followed by the GpuLight array
+    struct GpuParams
+    {
+        uint32_t Grid[4];    // froxels per axis, light count
+        float Projection[4]; // P[0][0], P[1][1], near, far
+        float Slicing[4];    // depth slice = log(depth) * scale + bias, max lights per froxel
+    };
+
+    struct FrameBuffer
+    {
+        VkBuffer Buffer = VK_NULL_HANDLE;
+        GpuAllocation Allocation;
+    };
+
+    struct FrameResources
+    {
+        FrameBuffer Lights;   // GpuParams then GpuLight, written by the CPU
+        uint32_t LightCapacity = 0;
+        FrameBuffer Clusters; // per froxel: count, then MaxLightsPerCluster indices
+        VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+    };
+
+    void EnsureCapacity(FrameResources &frame, uint32_t lights);
+    void Release(FrameBuffer &buffer);
+    void CreatePipeline(const ShaderCode &code);
+
+    Vulkan *Owner = nullptr;
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout Layout = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    VkPipeline Pipeline = VK_NULL_HANDLE;
+
+    std::vector<FrameResources> Frames;
+    uint32_t CurrentFrame = 0;
+    std::vector<GpuLight> Pending; // world space until Prepare
+    uint32_t LastLightCount = 0;
+};
@@ -0,0 +1,135 @@
+#include "CommandRecorder.h"
+#include <Jobs/JobSystem.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <stdexcept>
+
+void CommandRecorder::Init(VkDevice device, const VkAllocationCallbacks *allocator, uint32_t queueFamily, uint32_t framesInFlight)
+{
+    Device = device;
+    pAllocator = allocator;
+    // Workers are numbered from 1; slot 0 belongs to threads outside the pool (the main thread)
+    ThreadCount = Jobs::WorkerCount() + 1;
+    Pools.resize(framesInFlight * ThreadCount);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    for (ThreadPool &pool : Pools)
+    {
+        if (vkCreateCommandPool(Device, &poolInfo, pAllocator, &pool.Pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create recording command pool!");
+        }
+    }
+}
+
+void CommandRecorder::Destroy()
+{
+    // Destroying a pool frees its command buffers
+    for (ThreadPool &pool : Pools)
+        vkDestroyCommandPool(Device, pool.Pool, pAllocator);
+    Pools.clear();
+}
+
+void CommandRecorder::BeginFrame(uint32_t frameIndex)
+{
+    Frame = frameIndex;
+    for (uint32_t thread = 0; thread < ThreadCount; thread++)
+    {
+        ThreadPool &pool = Pools[Frame * ThreadCount + thread];
+        if (pool.Used == 0)
+            continue;
+        vkResetCommandPool(Device, pool.Pool, 0);
+        pool.Used = 0;
+    }
+}
+
+VkCommandBuffer CommandRecorder::BeginSecondary(const VkCommandBufferInheritanceInfo &inheritance)
+{
+    uint32_t thread = Jobs::CurrentWorker();
+    if (thread >= ThreadCount)
+        throw std::runtime_error("recording thread has no command pool!");
+
+    ThreadPool &pool = Pools[Frame * ThreadCount + thread];
+    if (pool.Used == pool.Secondaries.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool.Pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(Device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+        pool.Secondaries.push_back(commandBuffer);
+    }
+    VkCommandBuffer commandBuffer = pool.Secondaries[pool.Used++];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin secondary command buffer!");
+    }
+    return commandBuffer;
+}
+
+void CommandRecorder::Record(VkCommandBuffer primary, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer, VkExtent2D extent, const std::vector<const DrawList *> &lists)
+{
+    static Metrics::Histogram &recordTime = Metrics::GetHistogram("stela_command_recording_us", "Wall time to record the scene's secondary command buffers, in microseconds");
+    static Metrics::Gauge &secondaryCount = Metrics::GetGauge("stela_secondary_command_buffers", "Secondary command buffers executed in the last recorded pass");
+    Metrics::ScopedTimer timer(recordTime);
+
+    // Split every list into batches up front; their index is their place in the submission
+    struct Batch
+    {
+        const DrawList *List;
+        DrawBatch Range;
+    };
+    std::vector<Batch> batches;
+    for (const DrawList *list : lists)
+    {
+        if (!list || list->Count == 0 || !list->Record)
+            continue;
+        uint32_t batchCount = std::max(1u, std::min(ThreadCount, list->Count / std::max(1u, list->MinBatchSize)));
+        uint32_t batchSize = (list->Count + batchCount - 1) / batchCount;
+        for (uint32_t begin = 0; begin < list->Count; begin += batchSize)
+            batches.push_back({list, {begin, std::min(begin + batchSize, list->Count), renderPass, extent}});
+    }
+    if (batches.empty())
+        return;
+
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = subpass;
+    inheritance.framebuffer = framebuffer;
+    inheritance.pipelineStatistics = InheritedStatistics;
+
+    std::vector<VkCommandBuffer> secondaries(batches.size());
+    Jobs::ParallelFor(static_cast<uint32_t>(batches.size()), [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            VkCommandBuffer commandBuffer = BeginSecondary(inheritance);
+            batches[i].List->Record(commandBuffer, batches[i].Range);
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            secondaries[i] = commandBuffer;
+        }
+    });
+
+    vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    secondaryCount.Set((double)secondaries.size());
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// The slice of a draw list one secondary command buffer records
+struct DrawBatch
+{
+    uint32_t Begin;
+    uint32_t End;
+    VkRenderPass RenderPass;
+    VkExtent2D Extent;
+};
+
+// Independent draws recorded in batches. Record runs on any job-system thread and must set all the
+// state it needs (pipeline, viewport, scissor): secondary command buffers inherit none of it.
+struct DrawList
+{
+    uint32_t Count = 0;
+    uint32_t MinBatchSize = 512; // fewer draws than this are not worth a job
+    std::function<void(VkCommandBuffer, const DrawBatch &)> Record;
+};
+
+// Records draw lists into secondary command buffers on the job system. Every thread that records
+// gets its own command pool per frame in flight (pools are externally synchronized, so threads never
+// share one); pools are reset wholesale in BeginFrame. Secondaries execute in list order, then batch
+// order, so the submitted stream does not depend on which worker finished first.
+class CommandRecorder
+{
+public:
+    void Init(VkDevice device, const VkAllocationCallbacks *allocator, uint32_t queueFamily, uint32_t framesInFlight);
+    void Destroy();
+
+    // After the frame's fence has been waited on
+    void BeginFrame(uint32_t frameIndex);
+
+    // Records `lists` into the render pass instance begun on `primary` with
+    // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+    void Record(VkCommandBuffer primary, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer, VkExtent2D extent, const std::vector<const DrawList *> &lists);
+
+    // Pipeline statistics of the query active on the primary while secondaries execute
+    void SetInheritedStatistics(VkQueryPipelineStatisticFlags statistics) { InheritedStatistics = statistics; }
+
+    // A secondary from the calling thread's pool, begun for use inside `inheritance`'s render pass
+    VkCommandBuffer BeginSecondary(const VkCommandBufferInheritanceInfo &inheritance);
+
+private:
+    struct ThreadPool
+    {
+        VkCommandPool Pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> Secondaries;
+        uint32_t Used = 0;
+    };
+
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    uint32_t ThreadCount = 0;
+    uint32_t Frame = 0;
+    VkQueryPipelineStatisticFlags InheritedStatistics = 0;
+    std::vector<ThreadPool> Pools; // [frame * ThreadCount + thread]
+};
@@ -0,0 +1,104 @@
+#include "ConstantRing.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+void ConstantRing::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vulkan.PhysicalDevice, &properties);
+    Alignment = static_cast<uint32_t>(std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16));
+    Range = std::min<uint32_t>(properties.limits.maxUniformBufferRange, 65536);
+    if (const char *kilobytes = std::getenv("STELA_CONSTANT_RING_KB"))
+        RegionSize = std::max<VkDeviceSize>(std::atoll(kilobytes), 64) * 1024;
+    RegionSize = (RegionSize + Alignment - 1) / Alignment * Alignment;
+
+    // The binding's range reaches past the last allocation of the last region
+    VkDeviceSize size = RegionSize * vulkan.FramesInFlight + Range;
+    vulkan.CreateBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, GpuMemoryUsage::Upload, Buffer, Allocation);
+
+    SetLayout = vulkan.Layouts.GetSetLayout({{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_ALL, nullptr}});
+
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(Device, &poolInfo, pAllocator, &Pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create constant ring descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = Pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &SetLayout;
+    if (vkAllocateDescriptorSets(Device, &allocInfo, &Set) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate constant ring descriptor set!");
+    }
+
+    // Written once; allocations only move the dynamic offset
+    VkDescriptorBufferInfo bufferInfo{Buffer, 0, Range};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = Set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+
+    STELA_LOG_INFO(Render, "Constant ring: %llu KB per frame, %u byte alignment", (unsigned long long)(RegionSize / 1024), Alignment);
+}
+
+void ConstantRing::Destroy()
+{
+    if (!Owner)
+        return;
+    vkDestroyDescriptorPool(Device, Pool, pAllocator);
+    vkDestroyBuffer(Device, Buffer, pAllocator);
+    Owner->DeviceMemory.Free(Allocation);
+    Pool = VK_NULL_HANDLE;
+    Set = VK_NULL_HANDLE;
+    Buffer = VK_NULL_HANDLE;
+    Owner = nullptr;
+}
+
+void ConstantRing::BeginFrame(uint32_t frameIndex)
+{
+    static Metrics::Gauge &used = Metrics::GetGauge("stela_constant_ring_bytes", "Bytes of per-frame constants written in the last frame");
+    used.Set((double)std::min(Head.load(std::memory_order_relaxed), RegionSize));
+
+    RegionBase = RegionSize * frameIndex;
+    Head.store(0, std::memory_order_relaxed);
+}
+
+ConstantAllocation ConstantRing::Allocate(uint32_t size)
+{
+    static Metrics::Counter &overflows = Metrics::GetCounter("stela_constant_ring_overflows_total", "Constant allocations refused because the frame's region was full");
+
+    if (size == 0 || size > Range)
+        return {};
+    VkDeviceSize aligned = (size + Alignment - 1) / Alignment * Alignment;
+    VkDeviceSize offset = Head.fetch_add(aligned, std::memory_order_relaxed);
+    if (offset + aligned > RegionSize)
+    {
+        overflows.Add();
+        return {};
+    }
+
+    ConstantAllocation allocation;
+    allocation.Data = static_cast<char *>(Allocation.Mapped) + RegionBase + offset;
+    allocation.Offset = static_cast<uint32_t>(RegionBase + offset);
+    return allocation;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "GpuAllocator.h"
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+class Vulkan;
+
+// Constants written for the current frame. Bind GetSet() with `Offset` as the dynamic offset.
+struct ConstantAllocation
+{
+    void *Data = nullptr;
+    uint32_t Offset = 0;
+
+    explicit operator bool() const { return Data != nullptr; }
+};
+
+// Per-frame shader constants (camera, time, per-draw data). One persistently mapped, host-coherent
+// uniform buffer is split into a region per frame in flight; Allocate bumps an offset in the current
+// frame's region, so writing constants is an atomic add and a memcpy, with no allocation and no
+// descriptor update per draw. Shaders read an allocation as
+// `layout(set = N, binding = 0) uniform Block { ... }` with GetSet() bound at N and the allocation's
+// offset as the dynamic offset; one descriptor set serves every allocation of every frame.
+//
+// A region is rewritten only once the frame that used it has finished on the GPU. When a frame's
+// region is full Allocate returns an empty allocation (stela_constant_ring_overflows_total);
+// STELA_CONSTANT_RING_KB sets the region size, default 1024.
+class ConstantRing
+{
+public:
+    void Init(Vulkan &vulkan);
+    // Once the device is idle
+    void Destroy();
+
+    // Main thread, once the frame slot `frameIndex` is free again
+    void BeginFrame(uint32_t frameIndex);
+
+    // Thread-safe, so recording threads can allocate per-draw data. At most MaxBlockSize() bytes.
+    ConstantAllocation Allocate(uint32_t size);
+    template <typename T>
+    ConstantAllocation Push(const T &value)
+    {
+        ConstantAllocation allocation = Allocate(sizeof(T));
+        if (allocation)
+            std::memcpy(allocation.Data, &value, sizeof(T));
+        return allocation;
+    }
+
+    // Owned by Vulkan::Layouts; pass it as a fixed set when building pipeline layouts
+    VkDescriptorSetLayout GetSetLayout() const { return SetLayout; }
+    VkDescriptorSet GetSet() const { return Set; }
+    uint32_t MaxBlockSize() const { return Range; }
+
+private:
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    Vulkan *Owner = nullptr;
+
+    VkBuffer Buffer = VK_NULL_HANDLE;
+    GpuAllocation Allocation;
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool Pool = VK_NULL_HANDLE;
+    VkDescriptorSet Set = VK_NULL_HANDLE;
+
+    VkDeviceSize RegionSize = 1024 * 1024;
+    uint32_t Alignment = 256; // minUniformBufferOffsetAlignment
+    uint32_t Range = 16384;   // bytes one binding can see, from its dynamic offset
+
+    VkDeviceSize RegionBase = 0;
+    std::atomic<VkDeviceSize> Head{0};
+};
@@ -0,0 +1,267 @@
+#include "DepthPyramid.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <algorithm>
+#include <stdexcept>
+
+void DepthPyramid::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+
+    // Texels are read whole: nearest, one level at a time, never outside the image
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(Device, &samplerInfo, pAllocator, &Sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+
+    ShaderCode shader = vulkan.Shaders.Get("depth_pyramid.comp");
+    ShaderReflection reflection = ShaderReflection::Reflect(*shader);
+    BuildSetLayout = vulkan.Layouts.GetSetLayout(reflection.SetBindings(0));
+    Layout = vulkan.Layouts.GetPipelineLayout(reflection, {{0, BuildSetLayout}});
+    ReadSetLayout = vulkan.Layouts.GetSetLayout({{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr}});
+
+    uint32_t frameCount = vulkan.FramesInFlight;
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount * 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, frameCount * MaxLevels},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount},
+    };
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.maxSets = frameCount * 2;
+    descriptorPoolInfo.poolSizeCount = 3;
+    descriptorPoolInfo.pPoolSizes = poolSizes;
+    if (vkCreateDescriptorPool(Device, &descriptorPoolInfo, pAllocator, &DescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = DescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    Slots.resize(frameCount);
+    for (Slot &slot : Slots)
+    {
+        allocInfo.pSetLayouts = &ReadSetLayout;
+        if (vkAllocateDescriptorSets(Device, &allocInfo, &slot.ReadSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+        }
+        allocInfo.pSetLayouts = &BuildSetLayout;
+        if (vkAllocateDescriptorSets(Device, &allocInfo, &slot.BuildSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+        }
+    }
+
+    vulkan.CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly,
+                        Counter, CounterAllocation);
+
+    VkShaderModule module = vulkan.CreateShaderModule(*shader);
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = Layout;
+    VkResult result = vkCreateComputePipelines(Device, vulkan.PersistentCache.Handle(), 1, &pipelineInfo, pAllocator, &Pipeline);
+    vkDestroyShaderModule(Device, module, pAllocator);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid pipeline!");
+    }
+}
+
+void DepthPyramid::Destroy()
+{
+    if (!Owner)
+        return;
+    for (Slot &slot : Slots)
+        Release(slot, false);
+    vkDestroyBuffer(Device, Counter, pAllocator);
+    Owner->DeviceMemory.Free(CounterAllocation);
+    vkDestroyPipeline(Device, Pipeline, pAllocator);
+    vkDestroyDescriptorPool(Device, DescriptorPool, pAllocator);
+    vkDestroySampler(Device, Sampler, pAllocator);
+    Slots.clear();
+    Counter = VK_NULL_HANDLE;
+    Pipeline = VK_NULL_HANDLE;
+    DescriptorPool = VK_NULL_HANDLE;
+    Sampler = VK_NULL_HANDLE;
+    Owner = nullptr;
+}
+
+void DepthPyramid::Release(Slot &slot, bool retire)
+{
+    if (slot.Image == VK_NULL_HANDLE)
+        return;
+    if (retire)
+    {
+        slot.LevelViews.push_back(slot.View);
+        Owner->RetireImage(slot.Image, slot.Allocation, std::move(slot.LevelViews));
+    }
+    else
+    {
+        for (VkImageView view : slot.LevelViews)
+            vkDestroyImageView(Device, view, pAllocator);
+        vkDestroyImageView(Device, slot.View, pAllocator);
+        vkDestroyImage(Device, slot.Image, pAllocator);
+        Owner->DeviceMemory.Free(slot.Allocation);
+    }
+    slot.LevelViews.clear();
+    slot.Image = VK_NULL_HANDLE;
+    slot.View = VK_NULL_HANDLE;
+    slot.Extent = {0, 0};
+    slot.LevelCount = 0;
+}
+
+void DepthPyramid::Resize(uint32_t frameIndex, VkExtent2D extent)
+{
+    // Largest power of two that fits, so every level halves exactly and a texel never straddles two
+    auto floorPow2 = [](uint32_t value)
+    {
+        uint32_t result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    };
+    VkExtent2D size{floorPow2(std::max(extent.width, 1u)), floorPow2(std::max(extent.height, 1u))};
+    Slot &slot = Slots[frameIndex];
+    if (size.width == slot.Extent.width && size.height == slot.Extent.height)
+        return;
+
+    // The frames still in flight use the other slots, so this one's sets can be rewritten right away
+    Release(slot, true);
+
+    uint32_t levels = 1;
+    while (levels < MaxLevels && (std::max(size.width, size.height) >> levels) > 0)
+        levels++;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.extent = {size.width, size.height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(Device, &imageInfo, pAllocator, &slot.Image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid image!");
+    }
+    slot.Allocation = Owner->DeviceMemory.AllocateImage(slot.Image, GpuMemoryUsage::GpuOnly);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = slot.Image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    if (vkCreateImageView(Device, &viewInfo, pAllocator, &slot.View) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid view!");
+    }
+    slot.LevelViews.resize(levels);
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        if (vkCreateImageView(Device, &viewInfo, pAllocator, &slot.LevelViews[level]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+    }
+    slot.Extent = size;
+    slot.LevelCount = levels;
+    WriteSets(slot);
+    // Every slot follows within FramesInFlight frames; report the size once
+    if (frameIndex == 0)
+        STELA_LOG_INFO(Render, "Depth pyramid: %ux%u, %u levels", size.width, size.height, levels);
+}
+
+void DepthPyramid::WriteSets(Slot &slot)
+{
+    VkDescriptorImageInfo pyramidInfo{Sampler, slot.View, VK_IMAGE_LAYOUT_GENERAL};
+    // Every slot of the array must be valid; the ones past the last level repeat it
+    VkDescriptorImageInfo levels[MaxLevels];
+    for (uint32_t level = 0; level < MaxLevels; level++)
+        levels[level] = {VK_NULL_HANDLE, slot.LevelViews[std::min(level, slot.LevelCount - 1)], VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorBufferInfo counterInfo{Counter, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[3]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = slot.ReadSet;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &pyramidInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = slot.BuildSet;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = MaxLevels;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = levels;
+    writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[2].dstSet = slot.BuildSet;
+    writes[2].dstBinding = 2;
+    writes[2].descriptorCount = 1;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[2].pBufferInfo = &counterInfo;
+    vkUpdateDescriptorSets(Device, 3, writes, 0, nullptr);
+}
+
+void DepthPyramid::Record(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView depthView, VkExtent2D depthExtent)
+{
+    const Slot &slot = Slots[frameIndex];
+    if (slot.Image == VK_NULL_HANDLE || Pipeline == VK_NULL_HANDLE)
+        return;
+
+    // The frame's set is idle once its fence has signalled; the depth image follows the render
+    // targets, which can be recreated between any two frames
+    VkDescriptorSet set = slot.BuildSet;
+    VkDescriptorImageInfo depthInfo{Sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &depthInfo;
+    vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+
+    // From then on the last workgroup of every dispatch leaves it at zero
+    if (!CounterCleared)
+    {
+        vkCmdFillBuffer(commandBuffer, Counter, 0, VK_WHOLE_SIZE, 0);
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        CounterCleared = true;
+    }
+
+    uint32_t groupCount = ((slot.Extent.width + 31) / 32) * ((slot.Extent.height + 31) / 32);
+    BuildConstants constants{{depthExtent.width, depthExtent.height}, {slot.Extent.width, slot.Extent.height}, slot.LevelCount, groupCount};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, Layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, Layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+}
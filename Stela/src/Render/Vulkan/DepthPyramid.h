@@ -0,0 +1,87 @@
+#pragma once
+#include "GpuAllocator.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+class Vulkan;
+
+// Hierarchical depth (Hi-Z) for occlusion culling. Level 0 is the largest power of two no bigger
+// than the scene's output in each axis, and every texel of every level holds the farthest depth of
+// the scene pixels it covers, so a bounding box whose nearest depth is beyond it is hidden.
+//
+// Shaders/depth_pyramid.comp builds all levels in one dispatch: each workgroup reduces a 32x32 tile
+// of level 0 through shared memory down to level 5, and the last workgroup to finish reduces
+// level 5 to the top. The pyramid stays in VK_IMAGE_LAYOUT_GENERAL; readers sample GetSet() at set 1
+// with texelFetch.
+//
+// Every frame slot has its own pyramid, built and read within that slot's frame, so a resize only
+// touches the slot being recorded and the frames still in flight keep theirs.
+class DepthPyramid
+{
+public:
+    static constexpr uint32_t MaxLevels = 16;
+
+    // After Vulkan::Layouts and Vulkan::Shaders
+    void Init(Vulkan &vulkan);
+    // Once the device is idle
+    void Destroy();
+
+    // Sizes the pyramid of `frameIndex` for a scene output of `extent`, after that slot's wait. The
+    // old one is handed to Vulkan::RetireImage, so the size can change without waiting for the device.
+    void Resize(uint32_t frameIndex, VkExtent2D extent);
+    // Reduces the top-left `depthExtent` of `depthView` (in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    // into the pyramid, outside any render pass. Synchronization is the frame graph's job.
+    void Record(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView depthView, VkExtent2D depthExtent);
+
+    VkImage GetImage(uint32_t frameIndex) const { return Slots[frameIndex].Image; }
+    VkImageView GetView(uint32_t frameIndex) const { return Slots[frameIndex].View; }
+    VkExtent2D GetExtent(uint32_t frameIndex) const { return Slots[frameIndex].Extent; }
+    uint32_t GetLevelCount(uint32_t frameIndex) const { return Slots[frameIndex].LevelCount; }
+    // Owned by Vulkan::Layouts: one combined image sampler, the whole pyramid with a nearest sampler
+    VkDescriptorSetLayout GetSetLayout() const { return ReadSetLayout; }
+    VkDescriptorSet GetSet(uint32_t frameIndex) const { return Slots[frameIndex].ReadSet; }
+
+private:
+    // `Pyramid` push constant block in depth_pyramid.comp
+    struct BuildConstants
+    {
+        uint32_t DepthSize[2];
+        uint32_t Size[2];
+        uint32_t LevelCount;
+        uint32_t GroupCount;
+    };
+
+    struct Slot
+    {
+        VkImage Image = VK_NULL_HANDLE;
+        GpuAllocation Allocation;
+        VkImageView View = VK_NULL_HANDLE;
+        std::vector<VkImageView> LevelViews;
+        VkExtent2D Extent{0, 0};
+        uint32_t LevelCount = 0;
+        VkDescriptorSet ReadSet = VK_NULL_HANDLE;
+        VkDescriptorSet BuildSet = VK_NULL_HANDLE;
+    };
+
+    // Right away once the device is idle; otherwise through Vulkan::RetireImage
+    void Release(Slot &slot, bool retire);
+    void WriteSets(Slot &slot);
+
+    Vulkan *Owner = nullptr;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+
+    VkSampler Sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout BuildSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout ReadSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout Layout = VK_NULL_HANDLE;
+    VkPipeline Pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> Slots; // per frame in flight
+
+    // Workgroups finished this dispatch; the last one resets it
+    VkBuffer Counter = VK_NULL_HANDLE;
+    GpuAllocation CounterAllocation;
+    bool CounterCleared = false;
+};
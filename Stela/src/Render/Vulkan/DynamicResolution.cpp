@@ -0,0 +1,41 @@
+#include "DynamicResolution.h"
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::SetScale(float scale)
+{
+    Current = std::clamp(scale, MinScale, MaxScale);
+    Cooldown = CooldownFrames;
+}
+
+void DynamicResolution::Update(double gpuMilliseconds)
+{
+    static Metrics::Gauge &renderScale = Metrics::GetGauge("stela_render_scale", "Scene render scale per axis, from dynamic resolution");
+    renderScale.Set(Current);
+
+    if (!IsDynamic() || gpuMilliseconds <= 0.0)
+        return;
+
+    Smoothed = Smoothed == 0.0 ? gpuMilliseconds : Smoothed * 0.9 + gpuMilliseconds * 0.1;
+    if (Cooldown > 0)
+    {
+        Cooldown--;
+        return;
+    }
+
+    // Climbing back needs headroom; falling behind does not wait
+    bool over = Smoothed > TargetMilliseconds;
+    bool under = Smoothed < TargetMilliseconds * 0.85;
+    if (!over && !under)
+        return;
+
+    float wanted = Current * (float)std::sqrt(TargetMilliseconds / Smoothed);
+    float next = std::clamp(wanted, Current - MaxStep, Current + MaxStep);
+    next = std::clamp(std::round(next * 100.0f) / 100.0f, MinScale, MaxScale);
+    if (next != Current)
+    {
+        Current = next;
+        Cooldown = CooldownFrames;
+    }
+}
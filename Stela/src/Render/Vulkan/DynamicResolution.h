@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+// Picks the scene's render scale from measured GPU frame time. Cost is taken to grow with the pixel
+// count, so the scale moves by sqrt(target / measured), a few percent at a time: it drops as soon as
+// the smoothed time is over the target and only climbs back once it is well under, so it does not
+// oscillate around the budget. Measurements arrive frames late, hence the cooldown between steps.
+class DynamicResolution
+{
+public:
+    static constexpr float MinScale = 0.5f;
+    static constexpr float MaxScale = 1.0f;
+
+    // 0 turns the controller off and the scale stays where SetScale put it
+    double TargetMilliseconds = 0.0;
+
+    bool IsDynamic() const { return TargetMilliseconds > 0.0; }
+    float Scale() const { return Current; }
+    void SetScale(float scale);
+
+    // Once per frame with the latest GPU frame time (0 when there is none yet)
+    void Update(double gpuMilliseconds);
+
+private:
+    static constexpr float MaxStep = 0.05f;
+    static constexpr uint32_t CooldownFrames = 8;
+
+    float Current = MaxScale;
+    double Smoothed = 0.0;
+    uint32_t Cooldown = 0;
+};
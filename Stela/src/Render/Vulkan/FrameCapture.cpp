@@ -0,0 +1,435 @@
+#include "FrameCapture.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <Profiler/Profiler.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+FrameCapture *FrameCapture::Instance = nullptr;
+
+static uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static const std::vector<uint32_t> table = []
+    {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void PutBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+static void PutChunk(std::vector<uint8_t> &out, const char type[4], const std::vector<uint8_t> &data)
+{
+    PutBigEndian(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    PutBigEndian(out, Crc32(0, out.data() + start, out.size() - start));
+}
+
+// Stored (uncompressed) deflate blocks: encoding keeps up with capture rates, at the cost of file size
+static std::vector<uint8_t> ZlibStore(const std::vector<uint8_t> &raw)
+{
+    std::vector<uint8_t> out;
+    out.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    out.push_back(0x78);
+    out.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + length == raw.size();
+        out.push_back(last ? 1 : 0);
+        out.push_back((uint8_t)length);
+        out.push_back((uint8_t)(length >> 8));
+        out.push_back((uint8_t)~length);
+        out.push_back((uint8_t)(~length >> 8));
+        out.insert(out.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutBigEndian(out, (b << 16) | a);
+    return out;
+}
+
+void FrameCapture::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vulkan.PhysicalDevice, &properties);
+    NonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+    if (const char *directory = std::getenv("STELA_CAPTURE_DIR"))
+        Directory = directory;
+    if (const char *budget = std::getenv("STELA_CAPTURE_BUDGET_MB"))
+        BudgetBytes = (VkDeviceSize)std::max(1, std::atoi(budget)) * 1024 * 1024;
+
+    Instance = this;
+}
+
+void FrameCapture::Destroy()
+{
+    if (!Owner)
+        return;
+
+    // The device is idle, so every recorded copy has landed
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        for (Slot &slot : Slots)
+        {
+            if (slot.State == SlotState::Copying)
+                Submit(slot);
+        }
+        Stopping = true;
+    }
+    JobsChanged.notify_all();
+    if (Writer.joinable())
+        Writer.join();
+
+    FreeSlots();
+    if (Instance == this)
+        Instance = nullptr;
+    Owner = nullptr;
+}
+
+bool FrameCapture::Request(uint32_t frames, CaptureFormat format)
+{
+    if (frames == 0)
+        return false;
+    std::lock_guard<std::mutex> lock(Mutex);
+    if (Busy)
+        return false;
+    Busy = true;
+    PendingFrames = frames;
+    PendingFormat = format;
+    return true;
+}
+
+bool FrameCapture::IsBusy()
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    return Busy;
+}
+
+void FrameCapture::BeginFrame(uint64_t frame, uint64_t completedFrames, VkExtent2D extent, VkFormat format)
+{
+    static Metrics::Counter &dropped = Metrics::GetCounter("stela_capture_dropped_total", "Frames not captured because every readback buffer was in use");
+
+    FrameSlot = nullptr;
+    if (!Active)
+    {
+        uint32_t frames;
+        CaptureFormat requested;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            frames = PendingFrames;
+            requested = PendingFormat;
+            PendingFrames = 0;
+        }
+        if (frames == 0)
+            return;
+        if (!Start(frames, requested, extent, format))
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Busy = false;
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    // Oldest frame first: a YUV capture appends in the order the writer receives them
+    Slot *finished[MaxSlots];
+    uint32_t finishedCount = 0;
+    for (Slot &slot : Slots)
+    {
+        if (slot.State == SlotState::Copying && slot.Frame < completedFrames)
+            finished[finishedCount++] = &slot;
+    }
+    std::sort(finished, finished + finishedCount, [](const Slot *a, const Slot *b) { return a->Frame < b->Frame; });
+    for (uint32_t i = 0; i < finishedCount; i++)
+        Submit(*finished[i]);
+
+    bool idle = true;
+    Slot *free = nullptr;
+    for (Slot &slot : Slots)
+    {
+        idle &= slot.State == SlotState::Free;
+        if (slot.State == SlotState::Free && !free)
+            free = &slot;
+    }
+
+    if (Remaining == 0)
+    {
+        // Every frame is copied; the capture ends once the writer has given all buffers back
+        if (idle)
+        {
+            FreeSlots();
+            Active = false;
+            Busy = false;
+        }
+        return;
+    }
+
+    if (!free || (VkDeviceSize)extent.width * extent.height * 4 > SlotBytes)
+    {
+        dropped.Add();
+        return;
+    }
+    free->State = SlotState::Copying;
+    free->Extent = extent;
+    free->Frame = frame;
+    free->Sequence = Sequence++;
+    FrameSlot = free;
+    Remaining--;
+}
+
+void FrameCapture::RecordCopy(VkCommandBuffer commandBuffer, VkImage source)
+{
+    if (!FrameSlot)
+        return;
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {FrameSlot->Extent.width, FrameSlot->Extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, FrameSlot->Buffer, 1, &region);
+
+    // Made visible to the host once the frame is known to be finished
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = FrameSlot->Buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+bool FrameCapture::Start(uint32_t frames, CaptureFormat format, VkExtent2D extent, VkFormat imageFormat)
+{
+    static Metrics::Gauge &bufferBytes = Metrics::GetGauge("stela_capture_buffer_bytes", "Readback memory held by the running frame capture");
+
+    switch (imageFormat)
+    {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        Bgra = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        Bgra = false;
+        break;
+    default:
+        STELA_LOG_ERROR(Render, "Frame capture does not support image format %d", (int)imageFormat);
+        return false;
+    }
+
+    VkDeviceSize frameBytes = (VkDeviceSize)extent.width * extent.height * 4;
+    SlotBytes = (frameBytes + NonCoherentAtomSize - 1) / NonCoherentAtomSize * NonCoherentAtomSize;
+    uint32_t count = (uint32_t)std::min<VkDeviceSize>(MaxSlots, BudgetBytes / SlotBytes);
+    if (count == 0)
+    {
+        STELA_LOG_ERROR(Render, "Frame capture: a %ux%u frame does not fit the %llu MB budget", extent.width, extent.height,
+                        (unsigned long long)(BudgetBytes / (1024 * 1024)));
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(Directory, error);
+    if (error)
+    {
+        STELA_LOG_ERROR(Render, "Frame capture: cannot create %s: %s", Directory, error.message());
+        return false;
+    }
+
+    Slots.resize(count);
+    for (Slot &slot : Slots)
+        Owner->CreateBuffer(SlotBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::Readback, slot.Buffer, slot.Allocation);
+    bufferBytes.Set((double)(SlotBytes * count));
+
+    Active = true;
+    Format = format;
+    Remaining = frames;
+    Sequence = 0;
+    CaptureIndex++;
+    if (!Writer.joinable())
+        Writer = std::thread(&FrameCapture::WriterLoop, this);
+
+    STELA_LOG_INFO(Render, "Capturing %u frames at %ux%u to %s (%s, %u readback buffers)", frames, extent.width, extent.height,
+                   Directory, format == CaptureFormat::Png ? "PNG" : "I420", count);
+    return true;
+}
+
+void FrameCapture::FreeSlots()
+{
+    static Metrics::Gauge &bufferBytes = Metrics::GetGauge("stela_capture_buffer_bytes", "Readback memory held by the running frame capture");
+
+    for (Slot &slot : Slots)
+    {
+        vkDestroyBuffer(Device, slot.Buffer, pAllocator);
+        Owner->DeviceMemory.Free(slot.Allocation);
+    }
+    Slots.clear();
+    bufferBytes.Set(0.0);
+}
+
+void FrameCapture::Submit(Slot &slot)
+{
+    // Readback memory is cached, not necessarily coherent
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = slot.Allocation.Memory;
+    range.offset = slot.Allocation.Offset;
+    range.size = SlotBytes;
+    vkInvalidateMappedMemoryRanges(Device, 1, &range);
+
+    char name[64];
+    if (Format == CaptureFormat::Png)
+        std::snprintf(name, sizeof(name), "capture_%u_%05u.png", CaptureIndex, slot.Sequence);
+    else
+        std::snprintf(name, sizeof(name), "capture_%u_%ux%u.yuv", CaptureIndex, slot.Extent.width, slot.Extent.height);
+
+    slot.State = SlotState::Writing;
+    Jobs.push_back({&slot, Format, (std::filesystem::path(Directory) / name).string(), Bgra, slot.Sequence == 0});
+    JobsChanged.notify_one();
+}
+
+void FrameCapture::WriterLoop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            JobsChanged.wait(lock, [this] { return Stopping || !Jobs.empty(); });
+            if (Jobs.empty())
+                return;
+            job = Jobs.front();
+            Jobs.pop_front();
+        }
+        Write(job);
+        std::lock_guard<std::mutex> lock(Mutex);
+        job.Source->State = SlotState::Free;
+    }
+}
+
+void FrameCapture::Write(const Job &job)
+{
+    STELA_PROFILE_SCOPE("CaptureWrite");
+    static Metrics::Counter &captured = Metrics::GetCounter("stela_capture_frames_total", "Frames written to disk by frame capture");
+
+    const uint8_t *pixels = static_cast<const uint8_t *>(job.Source->Allocation.Mapped);
+    const uint32_t width = job.Source->Extent.width;
+    const uint32_t height = job.Source->Extent.height;
+    const int red = job.Bgra ? 2 : 0;
+    const int blue = job.Bgra ? 0 : 2;
+    std::vector<uint8_t> out;
+
+    if (job.Format == CaptureFormat::Png)
+    {
+        // RGB with filter type 0 on every row; alpha from the swapchain is meaningless
+        std::vector<uint8_t> raw((size_t)(width * 3 + 1) * height);
+        uint8_t *row = raw.data();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            *row++ = 0;
+            const uint8_t *source = pixels + (size_t)y * width * 4;
+            for (uint32_t x = 0; x < width; x++, source += 4)
+            {
+                *row++ = source[red];
+                *row++ = source[1];
+                *row++ = source[blue];
+            }
+        }
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        out.assign(signature, signature + 8);
+        std::vector<uint8_t> header;
+        PutBigEndian(header, width);
+        PutBigEndian(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, no filter method variants, no interlace
+        PutChunk(out, "IHDR", header);
+        PutChunk(out, "IDAT", ZlibStore(raw));
+        PutChunk(out, "IEND", {});
+    }
+    else
+    {
+        // BT.709 limited range in 8-bit fixed point; chroma is the average of each 2x2 block
+        const uint32_t chromaWidth = (width + 1) / 2;
+        const uint32_t chromaHeight = (height + 1) / 2;
+        out.resize((size_t)width * height + (size_t)chromaWidth * chromaHeight * 2);
+        uint8_t *luma = out.data();
+        uint8_t *cb = luma + (size_t)width * height;
+        uint8_t *cr = cb + (size_t)chromaWidth * chromaHeight;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t *source = pixels + (size_t)y * width * 4;
+            for (uint32_t x = 0; x < width; x++, source += 4)
+                *luma++ = (uint8_t)(16 + ((47 * source[red] + 157 * source[1] + 16 * source[blue] + 128) >> 8));
+        }
+        for (uint32_t y = 0; y < chromaHeight; y++)
+        {
+            for (uint32_t x = 0; x < chromaWidth; x++)
+            {
+                int r = 0, g = 0, b = 0;
+                for (uint32_t dy = 0; dy < 2; dy++)
+                {
+                    for (uint32_t dx = 0; dx < 2; dx++)
+                    {
+                        uint32_t px = std::min(x * 2 + dx, width - 1);
+                        uint32_t py = std::min(y * 2 + dy, height - 1);
+                        const uint8_t *source = pixels + ((size_t)py * width + px) * 4;
+                        r += source[red];
+                        g += source[1];
+                        b += source[blue];
+                    }
+                }
+                r /= 4;
+                g /= 4;
+                b /= 4;
+                *cb++ = (uint8_t)((-26 * r - 86 * g + 112 * b + 32896) >> 8);
+                *cr++ = (uint8_t)((112 * r - 102 * g - 10 * b + 32896) >> 8);
+            }
+        }
+    }
+
+    // PNGs are one file per frame; a YUV capture is appended frame after frame
+    FILE *file = std::fopen(job.Path.c_str(), job.Format == CaptureFormat::Png || job.First ? "wb" : "ab");
+    if (!file || std::fwrite(out.data(), 1, out.size(), file) != out.size())
+        STELA_LOG_ERROR(Render, "Frame capture: failed to write %s", job.Path);
+    else
+        captured.Add();
+    if (file)
+        std::fclose(file);
+}
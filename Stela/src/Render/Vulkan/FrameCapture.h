@@ -0,0 +1,114 @@
+#pragma once
+#include "GpuAllocator.h"
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Vulkan;
+
+enum class CaptureFormat
+{
+    Png, // one RGB PNG per frame
+    Yuv, // every frame appended to one raw I420 (yuv420p, BT.709 limited range) file
+};
+
+// Writes rendered frames to disk for visual regression and performance captures. A captured frame's
+// output image (the Editor viewport or the swapchain image) is copied into one of a ring of readback
+// buffers at the end of the frame; once a later frame start finds that frame finished, the buffer is
+// handed to a writer thread that encodes it and gives the buffer back. Nothing waits on the GPU: when
+// every buffer is still being copied or written, the frame is dropped (stela_capture_dropped_total).
+//
+// The ring holds as many output-sized buffers as fit the memory budget, up to MaxSlots
+// (STELA_CAPTURE_BUDGET_MB, default 256). Files go to STELA_CAPTURE_DIR, default "Captures".
+class FrameCapture
+{
+public:
+    static constexpr uint32_t MaxSlots = 8;
+
+    void Init(Vulkan &vulkan);
+    // Once the device is idle: writes every captured frame, then stops the writer
+    void Destroy();
+
+    // Thread-safe. Captures the next `frames` frames; false while another capture is running.
+    bool Request(uint32_t frames, CaptureFormat format);
+    // Thread-safe. A capture is queued, running or still being written.
+    bool IsBusy();
+    // The capture service of the running renderer, for requests that have no Vulkan at hand (scripts)
+    static FrameCapture *Get() { return Instance; }
+
+    // Main thread, at the start of frame `frame` once completedFrames is known. Hands finished copies
+    // to the writer, starts a queued request and decides whether this frame is captured.
+    void BeginFrame(uint64_t frame, uint64_t completedFrames, VkExtent2D extent, VkFormat format);
+    // The frame graph needs its capture pass (for the whole capture, so it is not rebuilt per frame)
+    bool IsActive() const { return Active; }
+    // Inside the capture pass, `source` in TRANSFER_SRC_OPTIMAL. Does nothing when the frame is not captured.
+    void RecordCopy(VkCommandBuffer commandBuffer, VkImage source);
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Copying,
+        Writing,
+    };
+
+    struct Slot
+    {
+        VkBuffer Buffer = VK_NULL_HANDLE;
+        GpuAllocation Allocation;
+        SlotState State = SlotState::Free;
+        VkExtent2D Extent{0, 0};
+        uint64_t Frame = 0;    // frame the copy was recorded in
+        uint32_t Sequence = 0; // index of the frame within its capture
+    };
+
+    struct Job
+    {
+        Slot *Source;
+        CaptureFormat Format;
+        std::string Path;
+        bool Bgra;
+        bool First; // starts the file instead of appending to it
+    };
+
+    bool Start(uint32_t frames, CaptureFormat format, VkExtent2D extent, VkFormat imageFormat);
+    void FreeSlots();
+    // With Mutex held
+    void Submit(Slot &slot);
+    void WriterLoop();
+    void Write(const Job &job);
+
+    static FrameCapture *Instance;
+
+    Vulkan *Owner = nullptr;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkDeviceSize NonCoherentAtomSize = 1;
+    VkDeviceSize BudgetBytes = 256ull * 1024 * 1024;
+    std::string Directory = "Captures";
+
+    // Main thread only
+    std::vector<Slot> Slots;
+    VkDeviceSize SlotBytes = 0;
+    bool Active = false;
+    CaptureFormat Format = CaptureFormat::Png;
+    bool Bgra = false;
+    uint32_t CaptureIndex = 0;
+    uint32_t Remaining = 0; // frames still to copy
+    uint32_t Sequence = 0;
+    Slot *FrameSlot = nullptr; // slot this frame copies into
+
+    std::mutex Mutex; // guards Busy, Pending*, Jobs, Stopping and slot states
+    std::condition_variable JobsChanged;
+    bool Busy = false;
+    uint32_t PendingFrames = 0;
+    CaptureFormat PendingFormat = CaptureFormat::Png;
+    std::deque<Job> Jobs;
+    bool Stopping = false;
+    std::thread Writer;
+};
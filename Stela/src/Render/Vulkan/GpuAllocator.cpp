@@ -0,0 +1,629 @@
+#include "GpuAllocator.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+    }
+
+    Metrics::Gauge &DeviceMemoryGauge()
+    {
+        static Metrics::Gauge &gauge = Metrics::GetGauge("stela_gpu_memory_bytes", "Device memory allocated by the renderer, in bytes");
+        return gauge;
+    }
+
+    Metrics::Gauge &AllocatedGauge()
+    {
+        static Metrics::Gauge &gauge = Metrics::GetGauge("stela_gpu_memory_allocated_bytes", "Device memory handed out to resources, in bytes");
+        return gauge;
+    }
+}
+
+// TlsfBlock
+
+TlsfBlock::TlsfBlock(VkDeviceSize size) : Capacity(size)
+{
+    for (auto &level : FreeHeads)
+        std::fill(std::begin(level), std::end(level), InvalidNode);
+
+    uint32_t root = NewNode();
+    Nodes[root] = {0, size, InvalidNode, InvalidNode, InvalidNode, InvalidNode, true};
+    InsertFree(root);
+}
+
+void TlsfBlock::Mapping(VkDeviceSize size, uint32_t &firstLevel, uint32_t &secondLevel)
+{
+    if (size < (VkDeviceSize(1) << SmallSizeBits))
+    {
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(size >> (SmallSizeBits - SecondLevelBits));
+        return;
+    }
+    uint32_t log2 = 63 - static_cast<uint32_t>(std::countl_zero(size));
+    firstLevel = log2 - SmallSizeBits + 1;
+    secondLevel = static_cast<uint32_t>(size >> (log2 - SecondLevelBits)) ^ SecondLevelCount;
+}
+
+uint32_t TlsfBlock::NewNode()
+{
+    if (!Recycled.empty())
+    {
+        uint32_t node = Recycled.back();
+        Recycled.pop_back();
+        return node;
+    }
+    Nodes.push_back({});
+    return static_cast<uint32_t>(Nodes.size() - 1);
+}
+
+void TlsfBlock::InsertFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    Mapping(Nodes[node].Size, firstLevel, secondLevel);
+
+    uint32_t &head = FreeHeads[firstLevel][secondLevel];
+    Nodes[node].IsFree = true;
+    Nodes[node].PrevFree = InvalidNode;
+    Nodes[node].NextFree = head;
+    if (head != InvalidNode)
+        Nodes[head].PrevFree = node;
+    head = node;
+
+    FirstLevelBitmap |= 1ull << firstLevel;
+    SecondLevelBitmap[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfBlock::RemoveFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    Mapping(Nodes[node].Size, firstLevel, secondLevel);
+
+    Node &n = Nodes[node];
+    if (n.PrevFree != InvalidNode)
+        Nodes[n.PrevFree].NextFree = n.NextFree;
+    else
+        FreeHeads[firstLevel][secondLevel] = n.NextFree;
+    if (n.NextFree != InvalidNode)
+        Nodes[n.NextFree].PrevFree = n.PrevFree;
+
+    if (FreeHeads[firstLevel][secondLevel] == InvalidNode)
+    {
+        SecondLevelBitmap[firstLevel] &= ~(1u << secondLevel);
+        if (SecondLevelBitmap[firstLevel] == 0)
+            FirstLevelBitmap &= ~(1ull << firstLevel);
+    }
+    n.IsFree = false;
+}
+
+uint32_t TlsfBlock::FindFree(VkDeviceSize size) const
+{
+    // Round up to the next size class so any range in the list found is big enough
+    if (size < (VkDeviceSize(1) << SmallSizeBits))
+    {
+        VkDeviceSize granularity = VkDeviceSize(1) << (SmallSizeBits - SecondLevelBits);
+        size = AlignUp(size, granularity);
+    }
+    else
+    {
+        uint32_t log2 = 63 - static_cast<uint32_t>(std::countl_zero(size));
+        size += (VkDeviceSize(1) << (log2 - SecondLevelBits)) - 1;
+    }
+
+    uint32_t firstLevel, secondLevel;
+    Mapping(size, firstLevel, secondLevel);
+    if (firstLevel >= FirstLevelCount)
+        return InvalidNode;
+
+    uint32_t secondMap = SecondLevelBitmap[firstLevel] & (~0u << secondLevel);
+    if (secondMap == 0)
+    {
+        uint64_t firstMap = firstLevel + 1 < 64 ? FirstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+        if (firstMap == 0)
+            return InvalidNode;
+        firstLevel = static_cast<uint32_t>(std::countr_zero(firstMap));
+        secondMap = SecondLevelBitmap[firstLevel];
+    }
+    secondLevel = static_cast<uint32_t>(std::countr_zero(secondMap));
+    return FreeHeads[firstLevel][secondLevel];
+}
+
+uint32_t TlsfBlock::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset)
+{
+    if (size == 0 || size > Capacity - Used)
+        return InvalidNode;
+
+    uint32_t node = FindFree(size + (alignment > 1 ? alignment - 1 : 0));
+    if (node == InvalidNode)
+        return InvalidNode;
+    RemoveFree(node);
+
+    // Alignment padding in front becomes its own free range
+    VkDeviceSize aligned = AlignUp(Nodes[node].Offset, alignment);
+    VkDeviceSize padding = aligned - Nodes[node].Offset;
+    if (padding > 0)
+    {
+        uint32_t front = NewNode();
+        Node &n = Nodes[node];
+        Nodes[front] = {n.Offset, padding, n.PrevPhysical, node, InvalidNode, InvalidNode, true};
+        if (n.PrevPhysical != InvalidNode)
+            Nodes[n.PrevPhysical].NextPhysical = front;
+        n.PrevPhysical = front;
+        n.Offset = aligned;
+        n.Size -= padding;
+        InsertFree(front);
+    }
+
+    if (Nodes[node].Size > size)
+    {
+        uint32_t back = NewNode();
+        Node &n = Nodes[node];
+        Nodes[back] = {n.Offset + size, n.Size - size, node, n.NextPhysical, InvalidNode, InvalidNode, true};
+        if (n.NextPhysical != InvalidNode)
+            Nodes[n.NextPhysical].PrevPhysical = back;
+        n.NextPhysical = back;
+        n.Size = size;
+        InsertFree(back);
+    }
+
+    Nodes[node].IsFree = false;
+    Used += size;
+    Allocations++;
+    offset = Nodes[node].Offset;
+    return node;
+}
+
+void TlsfBlock::Free(uint32_t node)
+{
+    Used -= Nodes[node].Size;
+    Allocations--;
+
+    // Merge with free neighbours so free ranges never touch
+    uint32_t prev = Nodes[node].PrevPhysical;
+    if (prev != InvalidNode && Nodes[prev].IsFree)
+    {
+        RemoveFree(prev);
+        Nodes[prev].Size += Nodes[node].Size;
+        Nodes[prev].NextPhysical = Nodes[node].NextPhysical;
+        if (Nodes[node].NextPhysical != InvalidNode)
+            Nodes[Nodes[node].NextPhysical].PrevPhysical = prev;
+        Recycled.push_back(node);
+        node = prev;
+    }
+
+    uint32_t next = Nodes[node].NextPhysical;
+    if (next != InvalidNode && Nodes[next].IsFree)
+    {
+        RemoveFree(next);
+        Nodes[node].Size += Nodes[next].Size;
+        Nodes[node].NextPhysical = Nodes[next].NextPhysical;
+        if (Nodes[next].NextPhysical != InvalidNode)
+            Nodes[Nodes[next].NextPhysical].PrevPhysical = node;
+        Recycled.push_back(next);
+    }
+
+    InsertFree(node);
+}
+
+// GpuAllocator
+
+void GpuAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, uint32_t apiVersion, bool memoryBudget, const Config &config)
+{
+    PhysicalDevice = physicalDevice;
+    Device = device;
+    HostAllocator = allocator;
+    ApiVersion = apiVersion;
+    MemoryBudget = memoryBudget;
+    Settings = config;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &Properties);
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    NonCoherentAtomSize = std::max<VkDeviceSize>(deviceProperties.limits.nonCoherentAtomSize, 1);
+
+    Pools.assign(Properties.memoryTypeCount * 4, {});
+    for (uint32_t type = 0; type < Properties.memoryTypeCount; type++)
+    {
+        // Small heaps (e.g. the 256 MB host-visible VRAM window) get proportionally smaller blocks
+        VkDeviceSize heapSize = Properties.memoryHeaps[Properties.memoryTypes[type].heapIndex].size;
+        VkDeviceSize heapLimit = std::max<VkDeviceSize>(heapSize / 8, 1024 * 1024);
+        for (uint32_t kind = 0; kind < 4; kind++)
+        {
+            Pool &pool = Pools[type * 4 + kind];
+            pool.MemoryType = type;
+            pool.BlockSize = std::min((kind & 2) ? Settings.LargeBlockSize : Settings.SmallBlockSize, heapLimit);
+        }
+    }
+
+    STELA_LOG_DEBUG(Render, "GPU allocator: %u memory types, %u heaps, memory budget %s", Properties.memoryTypeCount,
+                    Properties.memoryHeapCount, memoryBudget ? "enabled" : "estimated");
+}
+
+void GpuAllocator::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    if (LiveAllocations > 0)
+        STELA_LOG_WARNING(Render, "GPU allocator shut down with %u live allocations", LiveAllocations);
+
+    for (Pool &pool : Pools)
+    {
+        for (auto &block : pool.Blocks)
+            FreeMemory(block->Memory, block->Ranges.Size(), pool.MemoryType);
+        pool.Blocks.clear();
+    }
+    Pools.clear();
+    Device = VK_NULL_HANDLE;
+}
+
+bool GpuAllocator::HostVisible(uint32_t memoryType) const
+{
+    return (Properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+uint32_t GpuAllocator::FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+    uint32_t best = UINT32_MAX;
+    int bestScore = -1;
+    for (uint32_t i = 0; i < Properties.memoryTypeCount; i++)
+    {
+        VkMemoryPropertyFlags flags = Properties.memoryTypes[i].propertyFlags;
+        if (!(typeBits & (1u << i)) || (flags & required) != required)
+            continue;
+        int score = std::popcount(static_cast<uint32_t>(flags & preferred));
+        if (score > bestScore)
+        {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+uint32_t GpuAllocator::FindMemoryType(uint32_t typeBits, GpuMemoryUsage usage) const
+{
+    uint32_t type = UINT32_MAX;
+    switch (usage)
+    {
+    case GpuMemoryUsage::GpuOnly:
+        type = FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        if (type == UINT32_MAX)
+            type = FindMemoryType(typeBits, 0, 0);
+        break;
+    case GpuMemoryUsage::Upload:
+        type = FindMemoryType(typeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+        break;
+    case GpuMemoryUsage::Readback:
+        type = FindMemoryType(typeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        break;
+    }
+    if (type == UINT32_MAX)
+        throw std::runtime_error("failed to find suitable memory type!");
+    return type;
+}
+
+VkDeviceMemory GpuAllocator::AllocateMemory(VkDeviceSize size, uint32_t memoryType, const void *next, void **mapped)
+{
+    static Metrics::Counter &deviceAllocations = Metrics::GetCounter("stela_gpu_device_allocations_total", "vkAllocateMemory calls made by the renderer");
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = next;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(Device, &allocInfo, HostAllocator, &memory) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+
+    *mapped = nullptr;
+    if (HostVisible(memoryType) && vkMapMemory(Device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+    {
+        vkFreeMemory(Device, memory, HostAllocator);
+        return VK_NULL_HANDLE;
+    }
+
+    HeapBlockBytes[Properties.memoryTypes[memoryType].heapIndex] += size;
+    DeviceMemoryCount++;
+    deviceAllocations.Add();
+    DeviceMemoryGauge().Add(static_cast<double>(size));
+    return memory;
+}
+
+void GpuAllocator::FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryType)
+{
+    // Freeing implicitly unmaps
+    vkFreeMemory(Device, memory, HostAllocator);
+    HeapBlockBytes[Properties.memoryTypes[memoryType].heapIndex] -= size;
+    DeviceMemoryCount--;
+    DeviceMemoryGauge().Add(-static_cast<double>(size));
+}
+
+GpuAllocation GpuAllocator::AllocateDedicated(const VkMemoryRequirements &requirements, uint32_t memoryType, VkImage image, VkBuffer buffer)
+{
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = image;
+    dedicatedInfo.buffer = buffer;
+    bool useDedicatedInfo = ApiVersion >= VK_API_VERSION_1_1 && (image != VK_NULL_HANDLE || buffer != VK_NULL_HANDLE);
+
+    GpuAllocation allocation;
+    allocation.Memory = AllocateMemory(requirements.size, memoryType, useDedicatedInfo ? &dedicatedInfo : nullptr, &allocation.Mapped);
+    if (!allocation.Memory)
+        return {};
+    allocation.Size = requirements.size;
+    allocation.MemoryType = memoryType;
+    return allocation;
+}
+
+bool GpuAllocator::AllocateFromBlock(Block &block, const VkMemoryRequirements &requirements, GpuAllocation &allocation)
+{
+    VkDeviceSize alignment = requirements.alignment;
+    // Host-visible ranges are flushed in nonCoherentAtomSize units; keep neighbours out of each other's atoms
+    if (block.Mapped)
+        alignment = std::max(alignment, NonCoherentAtomSize);
+
+    VkDeviceSize offset = 0;
+    uint32_t node = block.Ranges.Allocate(requirements.size, alignment, offset);
+    if (node == TlsfBlock::InvalidNode)
+        return false;
+
+    allocation.Memory = block.Memory;
+    allocation.Offset = offset;
+    allocation.Size = requirements.size;
+    allocation.Mapped = block.Mapped ? static_cast<char *>(block.Mapped) + offset : nullptr;
+    allocation.MemoryType = Pools[block.Pool].MemoryType;
+    allocation.Block = &block;
+    allocation.Node = node;
+    return true;
+}
+
+GpuAllocation GpuAllocator::AllocateInternal(const VkMemoryRequirements &requirements, GpuMemoryUsage usage, bool linear, bool dedicated, VkImage image, VkBuffer buffer)
+{
+    uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, usage);
+    uint32_t heap = Properties.memoryTypes[memoryType].heapIndex;
+    bool large = requirements.size > Settings.SmallAllocationLimit;
+    uint32_t poolIndex = PoolIndex(memoryType, large, linear);
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    Pool &pool = Pools[poolIndex];
+
+    GpuAllocation allocation;
+    if (!dedicated && requirements.size <= pool.BlockSize / 2)
+    {
+        // Fullest blocks first keeps the emptier ones free to be released
+        std::vector<Block *> candidates;
+        candidates.reserve(pool.Blocks.size());
+        for (auto &block : pool.Blocks)
+            candidates.push_back(block.get());
+        std::sort(candidates.begin(), candidates.end(), [](Block *a, Block *b) { return a->Ranges.UsedBytes() > b->Ranges.UsedBytes(); });
+
+        bool found = false;
+        for (Block *block : candidates)
+        {
+            if (AllocateFromBlock(*block, requirements, allocation))
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            // New block, shrunk when the heap is close to its budget or the driver refuses the full size
+            VkDeviceSize blockSize = pool.BlockSize;
+            VkDeviceSize budget = Properties.memoryHeaps[heap].size * 8 / 10;
+            while (blockSize / 2 >= requirements.size * 2 && HeapBlockBytes[heap] + blockSize > budget)
+                blockSize /= 2;
+
+            for (; blockSize >= requirements.size; blockSize /= 2)
+            {
+                auto block = std::make_unique<Block>(blockSize);
+                block->Pool = poolIndex;
+                block->Memory = AllocateMemory(blockSize, memoryType, nullptr, &block->Mapped);
+                if (block->Memory)
+                {
+                    found = AllocateFromBlock(*block, requirements, allocation);
+                    pool.Blocks.push_back(std::move(block));
+                    break;
+                }
+            }
+        }
+
+        if (!found)
+            dedicated = true; // last resort: exactly the size asked for
+    }
+    else
+    {
+        dedicated = true;
+    }
+
+    if (dedicated)
+    {
+        allocation = AllocateDedicated(requirements, memoryType, image, buffer);
+        if (!allocation)
+            throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    HeapAllocatedBytes[heap] += allocation.Size;
+    LiveAllocations++;
+    AllocatedGauge().Add(static_cast<double>(allocation.Size));
+    return allocation;
+}
+
+GpuAllocation GpuAllocator::Allocate(const VkMemoryRequirements &requirements, GpuMemoryUsage usage, bool linear, bool dedicated)
+{
+    return AllocateInternal(requirements, usage, linear, dedicated, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+GpuAllocation GpuAllocator::AllocateImage(VkImage image, GpuMemoryUsage usage)
+{
+    VkMemoryRequirements requirements;
+    bool dedicated = false;
+    if (ApiVersion >= VK_API_VERSION_1_1)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicatedRequirements;
+        VkImageMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        info.image = image;
+        vkGetImageMemoryRequirements2(Device, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+    }
+    else
+    {
+        vkGetImageMemoryRequirements(Device, image, &requirements);
+    }
+
+    GpuAllocation allocation = AllocateInternal(requirements, usage, false, dedicated, image, VK_NULL_HANDLE);
+    vkBindImageMemory(Device, image, allocation.Memory, allocation.Offset);
+    return allocation;
+}
+
+GpuAllocation GpuAllocator::AllocateBuffer(VkBuffer buffer, GpuMemoryUsage usage)
+{
+    VkMemoryRequirements requirements;
+    bool dedicated = false;
+    if (ApiVersion >= VK_API_VERSION_1_1)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicatedRequirements;
+        VkBufferMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        info.buffer = buffer;
+        vkGetBufferMemoryRequirements2(Device, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+    }
+    else
+    {
+        vkGetBufferMemoryRequirements(Device, buffer, &requirements);
+    }
+
+    GpuAllocation allocation = AllocateInternal(requirements, usage, true, dedicated, VK_NULL_HANDLE, buffer);
+    vkBindBufferMemory(Device, buffer, allocation.Memory, allocation.Offset);
+    return allocation;
+}
+
+void GpuAllocator::ReleaseEmptyBlocks(Pool &pool, size_t keep)
+{
+    // Keeping a spare block avoids allocate/free churn when usage hovers around a block boundary
+    size_t empty = 0;
+    for (auto it = pool.Blocks.begin(); it != pool.Blocks.end();)
+    {
+        if ((*it)->Ranges.Empty() && ++empty > keep)
+        {
+            FreeMemory((*it)->Memory, (*it)->Ranges.Size(), pool.MemoryType);
+            it = pool.Blocks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void GpuAllocator::Free(GpuAllocation &allocation)
+{
+    if (!allocation)
+        return;
+    std::lock_guard<std::mutex> lock(Mutex);
+    uint32_t heap = Properties.memoryTypes[allocation.MemoryType].heapIndex;
+    HeapAllocatedBytes[heap] -= allocation.Size;
+    LiveAllocations--;
+    AllocatedGauge().Add(-static_cast<double>(allocation.Size));
+
+    if (allocation.Block)
+    {
+        Block *block = static_cast<Block *>(allocation.Block);
+        block->Ranges.Free(allocation.Node);
+        if (block->Ranges.Empty())
+            ReleaseEmptyBlocks(Pools[block->Pool], 1);
+    }
+    else
+    {
+        FreeMemory(allocation.Memory, allocation.Size, allocation.MemoryType);
+    }
+    allocation = {};
+}
+
+std::vector<GpuHeapBudget> GpuAllocator::QueryBudgets() const
+{
+    std::vector<GpuHeapBudget> budgets(Properties.memoryHeapCount);
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    if (MemoryBudget)
+    {
+        VkPhysicalDeviceMemoryProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties2.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(PhysicalDevice, &properties2);
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    for (uint32_t i = 0; i < Properties.memoryHeapCount; i++)
+    {
+        GpuHeapBudget &budget = budgets[i];
+        budget.HeapSize = Properties.memoryHeaps[i].size;
+        budget.DeviceLocal = (Properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        budget.BlockBytes = HeapBlockBytes[i];
+        budget.AllocatedBytes = HeapAllocatedBytes[i];
+        if (MemoryBudget)
+        {
+            budget.Budget = budgetProperties.heapBudget[i];
+            budget.Usage = budgetProperties.heapUsage[i];
+        }
+        else
+        {
+            budget.Budget = budget.HeapSize * 8 / 10;
+            budget.Usage = HeapBlockBytes[i];
+        }
+    }
+    return budgets;
+}
+
+void GpuAllocator::UpdateMetrics()
+{
+    // The budget query goes to the driver; twice a second at 60 fps is plenty
+    static uint32_t calls = 0;
+    if (calls++ % 30 != 0)
+        return;
+
+    static std::vector<Metrics::Gauge *> usageGauges, budgetGauges;
+    std::vector<GpuHeapBudget> budgets = QueryBudgets();
+    for (uint32_t i = 0; i < budgets.size(); i++)
+    {
+        if (usageGauges.size() <= i)
+        {
+            std::string labels = "heap=\"" + std::to_string(i) + "\"";
+            usageGauges.push_back(&Metrics::GetGauge("stela_gpu_heap_usage_bytes", "Device memory heap usage reported by the driver", labels));
+            budgetGauges.push_back(&Metrics::GetGauge("stela_gpu_heap_budget_bytes", "Device memory heap budget reported by the driver", labels));
+        }
+        usageGauges[i]->Set(static_cast<double>(budgets[i].Usage));
+        budgetGauges[i]->Set(static_cast<double>(budgets[i].Budget));
+
+        if (budgets[i].Usage > budgets[i].Budget && !OverBudgetReported[i])
+        {
+            OverBudgetReported[i] = true;
+            STELA_LOG_WARNING(Render, "GPU heap %u over budget: %.1f MB used, %.1f MB budget", i,
+                              budgets[i].Usage / (1024.0 * 1024.0), budgets[i].Budget / (1024.0 * 1024.0));
+        }
+        else if (budgets[i].Usage < budgets[i].Budget - budgets[i].Budget / 10)
+        {
+            OverBudgetReported[i] = false;
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Offset allocator over one VkDeviceMemory block (Two-Level Segregated Fit): O(1) allocate and free,
+// with neighbouring free ranges merged immediately. Bookkeeping lives on the CPU; the block itself is
+// never touched.
+class TlsfBlock
+{
+public:
+    static constexpr uint32_t InvalidNode = UINT32_MAX;
+
+    explicit TlsfBlock(VkDeviceSize size);
+
+    // Returns InvalidNode when no free range fits
+    uint32_t Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+    void Free(uint32_t node);
+
+    VkDeviceSize Size() const { return Capacity; }
+    VkDeviceSize UsedBytes() const { return Used; }
+    uint32_t AllocationCount() const { return Allocations; }
+    bool Empty() const { return Allocations == 0; }
+
+private:
+    static constexpr uint32_t SecondLevelBits = 4;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+    // Sizes below 2^SmallSizeBits share first level 0 and are split linearly
+    static constexpr uint32_t SmallSizeBits = 8;
+    static constexpr uint32_t FirstLevelCount = 64 - SmallSizeBits + 1;
+
+    struct Node
+    {
+        VkDeviceSize Offset;
+        VkDeviceSize Size;
+        uint32_t PrevPhysical;
+        uint32_t NextPhysical;
+        uint32_t PrevFree;
+        uint32_t NextFree;
+        bool IsFree;
+    };
+
+    static void Mapping(VkDeviceSize size, uint32_t &firstLevel, uint32_t &secondLevel);
+    uint32_t NewNode();
+    void InsertFree(uint32_t node);
+    void RemoveFree(uint32_t node);
+    uint32_t FindFree(VkDeviceSize size) const;
+
+    VkDeviceSize Capacity;
+    VkDeviceSize Used = 0;
+    uint32_t Allocations = 0;
+    std::vector<Node> Nodes;
+    std::vector<uint32_t> Recycled;
+    uint64_t FirstLevelBitmap = 0;
+    uint32_t SecondLevelBitmap[FirstLevelCount] = {};
+    uint32_t FreeHeads[FirstLevelCount][SecondLevelCount];
+};
+
+enum class GpuMemoryUsage
+{
+    GpuOnly,  // device local
+    Upload,   // host visible + coherent, persistently mapped
+    Readback, // host visible + cached, persistently mapped
+};
+
+// A range of device memory. Plain value: copy it around, hand it back to GpuAllocator::Free once.
+struct GpuAllocation
+{
+    VkDeviceMemory Memory = VK_NULL_HANDLE;
+    VkDeviceSize Offset = 0;
+    VkDeviceSize Size = 0;
+    void *Mapped = nullptr; // already offset; null unless host visible
+    uint32_t MemoryType = 0;
+
+    explicit operator bool() const { return Memory != VK_NULL_HANDLE; }
+
+private:
+    friend class GpuAllocator;
+    void *Block = nullptr; // owning pool block, null for dedicated allocations
+    uint32_t Node = TlsfBlock::InvalidNode;
+};
+
+// Per-heap usage and budget. Budget comes from VK_EXT_memory_budget when the device has it,
+// otherwise it is estimated as 80% of the heap.
+struct GpuHeapBudget
+{
+    VkDeviceSize HeapSize = 0;
+    VkDeviceSize Budget = 0;
+    VkDeviceSize Usage = 0;          // whole process according to the driver, or our blocks without the extension
+    VkDeviceSize BlockBytes = 0;     // VkDeviceMemory owned by this allocator
+    VkDeviceSize AllocatedBytes = 0; // handed out to resources
+    bool DeviceLocal = false;
+};
+
+// Device memory for the renderer. Resources are sub-allocated from large blocks kept in pools per
+// memory type, size class and resource kind (linear buffers and optimal images are never mixed, so
+// bufferImageGranularity never applies). Resources the driver wants on their own memory, and very
+// large ones, get a dedicated VkDeviceMemory.
+class GpuAllocator
+{
+public:
+    struct Config
+    {
+        VkDeviceSize SmallBlockSize = 16ull * 1024 * 1024;
+        VkDeviceSize LargeBlockSize = 128ull * 1024 * 1024;
+        VkDeviceSize SmallAllocationLimit = 1ull * 1024 * 1024; // larger requests use the large pools
+    };
+
+    // `apiVersion` is the version the device was created with; 1.1+ enables dedicated allocation queries.
+    // `memoryBudget` says whether VK_EXT_memory_budget was enabled on the device.
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, uint32_t apiVersion, bool memoryBudget, const Config &config);
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, uint32_t apiVersion, bool memoryBudget)
+    {
+        Init(physicalDevice, device, allocator, apiVersion, memoryBudget, Config{});
+    }
+    // Every allocation must have been freed; leaks are logged
+    void Shutdown();
+
+    // Allocate and bind in one go. Throws std::runtime_error when device memory is exhausted.
+    GpuAllocation AllocateImage(VkImage image, GpuMemoryUsage usage);
+    GpuAllocation AllocateBuffer(VkBuffer buffer, GpuMemoryUsage usage);
+    // Raw allocation for callers that bind themselves. `linear` is true for buffers and linear-tiled images.
+    GpuAllocation Allocate(const VkMemoryRequirements &requirements, GpuMemoryUsage usage, bool linear, bool dedicated = false);
+    void Free(GpuAllocation &allocation);
+
+    uint32_t FindMemoryType(uint32_t typeBits, GpuMemoryUsage usage) const;
+    uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const;
+    std::vector<GpuHeapBudget> QueryBudgets() const;
+    // Refreshes the stela_gpu_* gauges and logs when a heap goes over budget; call once per frame
+    void UpdateMetrics();
+
+private:
+    struct Block
+    {
+        VkDeviceMemory Memory = VK_NULL_HANDLE;
+        void *Mapped = nullptr;
+        uint32_t Pool = 0;
+        TlsfBlock Ranges;
+
+        explicit Block(VkDeviceSize size) : Ranges(size) {}
+    };
+
+    struct Pool
+    {
+        uint32_t MemoryType = 0;
+        VkDeviceSize BlockSize = 0;
+        std::vector<std::unique_ptr<Block>> Blocks;
+    };
+
+    // Pool index: memory type, then size class (small/large), then linear/optimal
+    static uint32_t PoolIndex(uint32_t memoryType, bool large, bool linear) { return memoryType * 4 + (large ? 2 : 0) + (linear ? 1 : 0); }
+
+    VkDeviceMemory AllocateMemory(VkDeviceSize size, uint32_t memoryType, const void *next, void **mapped);
+    void FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryType);
+    GpuAllocation AllocateDedicated(const VkMemoryRequirements &requirements, uint32_t memoryType, VkImage image, VkBuffer buffer);
+    bool AllocateFromBlock(Block &block, const VkMemoryRequirements &requirements, GpuAllocation &allocation);
+    GpuAllocation AllocateInternal(const VkMemoryRequirements &requirements, GpuMemoryUsage usage, bool linear, bool dedicated, VkImage image, VkBuffer buffer);
+    void ReleaseEmptyBlocks(Pool &pool, size_t keep);
+    bool HostVisible(uint32_t memoryType) const;
+
+    VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *HostAllocator = nullptr;
+    uint32_t ApiVersion = VK_API_VERSION_1_0;
+    bool MemoryBudget = false;
+    Config Settings;
+    VkPhysicalDeviceMemoryProperties Properties{};
+    VkDeviceSize NonCoherentAtomSize = 1;
+
+    mutable std::mutex Mutex;
+    std::vector<Pool> Pools;
+    VkDeviceSize HeapBlockBytes[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize HeapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+    uint32_t DeviceMemoryCount = 0;
+    uint32_t LiveAllocations = 0;
+    bool OverBudgetReported[VK_MAX_MEMORY_HEAPS] = {};
+};
@@ -0,0 +1,250 @@
+#include "GpuProfiler.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <Profiler/Profiler.h>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// The host clock steady_clock reads, so calibrated GPU times land on the Profiler timeline
+#ifdef _WIN32
+static constexpr VkTimeDomainEXT SteadyClockDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+static constexpr VkTimeDomainEXT SteadyClockDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+void GpuProfiler::Init(Vulkan &vulkan, uint32_t queueFamily, uint32_t framesInFlight)
+{
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vulkan.PhysicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vulkan.PhysicalDevice, &familyCount, families.data());
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+    if (validBits == 0)
+    {
+        STELA_LOG_WARNING(Render, "Graphics queue has no timestamps; GPU profiling disabled");
+        return;
+    }
+    TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vulkan.PhysicalDevice, &properties);
+    TimestampPeriod = properties.limits.timestampPeriod;
+    Statistics = vulkan.DeviceFeatures.pipelineStatisticsQuery && vulkan.DeviceFeatures.inheritedQueries;
+
+    Frames.resize(framesInFlight);
+    for (FrameQueries &frame : Frames)
+    {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = MaxZones * 2;
+        if (vkCreateQueryPool(Device, &poolInfo, pAllocator, &frame.Timestamps) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+        if (Statistics)
+        {
+            poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            poolInfo.queryCount = MaxZones;
+            poolInfo.pipelineStatistics = StatisticFlags;
+            if (vkCreateQueryPool(Device, &poolInfo, pAllocator, &frame.PipelineStatistics) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create pipeline statistics query pool!");
+            }
+        }
+        frame.Names.resize(MaxZones);
+    }
+
+    if (vulkan.IsDeviceExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+    {
+        auto getDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(vulkan.Instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+        uint32_t domainCount = 0;
+        std::vector<VkTimeDomainEXT> domains;
+        if (getDomains && getDomains(vulkan.PhysicalDevice, &domainCount, nullptr) == VK_SUCCESS)
+        {
+            domains.resize(domainCount);
+            getDomains(vulkan.PhysicalDevice, &domainCount, domains.data());
+        }
+        bool device = false;
+        bool host = false;
+        for (VkTimeDomainEXT domain : domains)
+        {
+            device |= domain == VK_TIME_DOMAIN_DEVICE_EXT;
+            host |= domain == SteadyClockDomain;
+        }
+        if (device && host)
+        {
+            HostDomain = SteadyClockDomain;
+            GetCalibratedTimestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(Device, "vkGetCalibratedTimestampsEXT");
+        }
+    }
+
+    STELA_LOG_INFO(Render, "GPU profiler: %u-bit timestamps, %.2f ns/tick, pipeline statistics %s, %s clocks",
+                   validBits, TimestampPeriod, Statistics ? "available" : "unavailable", IsCalibrated() ? "calibrated" : "estimated");
+}
+
+void GpuProfiler::Destroy()
+{
+    for (FrameQueries &frame : Frames)
+    {
+        vkDestroyQueryPool(Device, frame.Timestamps, pAllocator);
+        vkDestroyQueryPool(Device, frame.PipelineStatistics, pAllocator);
+    }
+    Frames.clear();
+    Current = nullptr;
+}
+
+void GpuProfiler::BeginFrame(uint32_t frameIndex)
+{
+    if (Frames.empty())
+        return;
+    Current = &Frames[frameIndex];
+    Resolve(*Current);
+    Current->Count = 0;
+}
+
+void GpuProfiler::RecordReset(VkCommandBuffer commandBuffer)
+{
+    if (!Current)
+        return;
+    vkCmdResetQueryPool(commandBuffer, Current->Timestamps, 0, MaxZones * 2);
+    Current->StatisticsRecorded = StatisticsEnabled;
+    if (Current->StatisticsRecorded)
+        vkCmdResetQueryPool(commandBuffer, Current->PipelineStatistics, 0, MaxZones);
+}
+
+uint32_t GpuProfiler::BeginZone(VkCommandBuffer commandBuffer, const std::string &name)
+{
+    if (!Current || Current->Count == MaxZones)
+        return UINT32_MAX;
+    uint32_t zone = Current->Count++;
+    Current->Names[zone] = name;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Current->Timestamps, zone * 2);
+    if (Current->StatisticsRecorded)
+        vkCmdBeginQuery(commandBuffer, Current->PipelineStatistics, zone, 0);
+    return zone;
+}
+
+void GpuProfiler::EndZone(VkCommandBuffer commandBuffer, uint32_t zone)
+{
+    if (zone == UINT32_MAX)
+        return;
+    if (Current->StatisticsRecorded)
+        vkCmdEndQuery(commandBuffer, Current->PipelineStatistics, zone);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Current->Timestamps, zone * 2 + 1);
+}
+
+void GpuProfiler::MarkSubmit()
+{
+    if (Current)
+        Current->SubmitNs = Profiler::Now();
+}
+
+bool GpuProfiler::Calibrate(uint64_t &gpuTicks, uint64_t &cpuNs)
+{
+    VkCalibratedTimestampInfoEXT infos[2]{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = HostDomain;
+    uint64_t values[2];
+    uint64_t maxDeviation = 0;
+    if (GetCalibratedTimestamps(Device, 2, infos, values, &maxDeviation) != VK_SUCCESS)
+        return false;
+
+    gpuTicks = values[0] & TimestampMask;
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    cpuNs = (uint64_t)((double)values[1] * 1e9 / (double)frequency.QuadPart);
+#else
+    cpuNs = values[1];
+#endif
+    return true;
+}
+
+void GpuProfiler::Resolve(FrameQueries &frame)
+{
+    static Metrics::Histogram &gpuFrameTime = Metrics::GetHistogram("stela_gpu_frame_us", "GPU time from the first to the last profiled pass of a frame, in microseconds");
+
+    if (frame.Count == 0)
+        return;
+
+    // Value then availability per query; the fence has signalled, so nothing here waits
+    Scratch.resize((size_t)frame.Count * 4);
+    if (vkGetQueryPoolResults(Device, frame.Timestamps, 0, frame.Count * 2, Scratch.size() * sizeof(uint64_t), Scratch.data(),
+                              2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) != VK_SUCCESS)
+        return;
+
+    uint64_t anchorTicks = 0;
+    uint64_t anchorNs = 0;
+    if (!IsCalibrated() || !Calibrate(anchorTicks, anchorNs))
+    {
+        anchorTicks = Scratch[0] & TimestampMask;
+        anchorNs = frame.SubmitNs;
+    }
+    // Tick differences wrap at the valid bit count
+    auto toNs = [&](uint64_t ticks)
+    {
+        int64_t delta = (int64_t)((ticks - anchorTicks) & TimestampMask);
+        if (TimestampMask != ~0ull && (uint64_t)delta > TimestampMask / 2)
+            delta -= (int64_t)(TimestampMask + 1);
+        return (uint64_t)((double)anchorNs + (double)delta * TimestampPeriod);
+    };
+
+    Latest.resize(frame.Count);
+    uint64_t frameBegin = 0;
+    uint64_t frameEnd = 0;
+    bool any = false;
+    for (uint32_t zone = 0; zone < frame.Count; zone++)
+    {
+        GpuZoneResult &result = Latest[zone];
+        result.Name = frame.Names[zone];
+        result.HasStatistics = false;
+        const uint64_t *query = &Scratch[zone * 4];
+        if (query[1] == 0 || query[3] == 0)
+        {
+            result.Milliseconds = 0.0;
+            continue;
+        }
+        uint64_t begin = toNs(query[0] & TimestampMask);
+        uint64_t end = toNs(query[2] & TimestampMask);
+        end = end < begin ? begin : end;
+        result.Milliseconds = (double)(end - begin) / 1e6;
+        Profiler::RecordGpu(result.Name.c_str(), begin, end);
+        frameBegin = any ? std::min(frameBegin, begin) : begin;
+        frameEnd = any ? std::max(frameEnd, end) : end;
+        any = true;
+    }
+    if (any)
+    {
+        LatestFrameMilliseconds = (double)(frameEnd - frameBegin) / 1e6;
+        gpuFrameTime.Record((frameEnd - frameBegin) / 1000);
+    }
+
+    if (frame.StatisticsRecorded)
+    {
+        const uint32_t stride = StatisticCount + 1;
+        Scratch.resize((size_t)frame.Count * stride);
+        if (vkGetQueryPoolResults(Device, frame.PipelineStatistics, 0, frame.Count, Scratch.size() * sizeof(uint64_t), Scratch.data(),
+                                  stride * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) == VK_SUCCESS)
+        {
+            for (uint32_t zone = 0; zone < frame.Count; zone++)
+            {
+                const uint64_t *query = &Scratch[zone * stride];
+                if (query[StatisticCount] == 0)
+                    continue;
+                for (uint32_t i = 0; i < StatisticCount; i++)
+                    Latest[zone].Statistics[i] = query[i];
+                Latest[zone].HasStatistics = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Vulkan;
+
+// One measured zone of a finished frame
+struct GpuZoneResult
+{
+    std::string Name;
+    double Milliseconds = 0.0;
+    // Input primitives, vertex invocations, clipped primitives, fragment invocations, compute invocations
+    uint64_t Statistics[5] = {};
+    bool HasStatistics = false;
+};
+
+// GPU time per render-graph pass. Every frame in flight owns a timestamp query pool (and a pipeline
+// statistics pool when the device supports it); a zone writes one timestamp before and one after its
+// commands. The pools of a frame are read back the next time that frame index comes round, after its
+// fence has been waited on, so reading never stalls and results are FramesInFlight frames old.
+//
+// Zones are also sent to the Profiler timeline. With VK_EXT_calibrated_timestamps the GPU clock is
+// mapped onto the CPU one exactly; without it a frame's first timestamp is pinned to its submit time.
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t MaxZones = 64;
+    static constexpr uint32_t StatisticCount = 5;
+
+    void Init(Vulkan &vulkan, uint32_t queueFamily, uint32_t framesInFlight);
+    void Destroy();
+    bool IsSupported() const { return !Frames.empty(); }
+
+    // After the frame's fence has been waited on: publishes that frame's previous results
+    void BeginFrame(uint32_t frameIndex);
+    // Before any zone, outside a render pass
+    void RecordReset(VkCommandBuffer commandBuffer);
+    // Outside render passes. Returns UINT32_MAX when unsupported or out of zones; EndZone ignores that.
+    uint32_t BeginZone(VkCommandBuffer commandBuffer, const std::string &name);
+    void EndZone(VkCommandBuffer commandBuffer, uint32_t zone);
+    // Right after the frame's submit
+    void MarkSubmit();
+
+    // Statistics queries stay active across vkCmdExecuteCommands, which needs inheritedQueries
+    bool StatisticsSupported() const { return Statistics; }
+    void SetStatisticsEnabled(bool enabled) { StatisticsEnabled = enabled && Statistics; }
+    bool IsStatisticsEnabled() const { return StatisticsEnabled; }
+    // What secondaries recorded during an active zone must inherit
+    VkQueryPipelineStatisticFlags InheritedStatistics() const { return StatisticsEnabled ? StatisticFlags : 0; }
+
+    bool IsCalibrated() const { return GetCalibratedTimestamps != nullptr; }
+    // Latest finished frame
+    const std::vector<GpuZoneResult> &Results() const { return Latest; }
+    double FrameMilliseconds() const { return LatestFrameMilliseconds; }
+
+private:
+    struct FrameQueries
+    {
+        VkQueryPool Timestamps = VK_NULL_HANDLE;
+        VkQueryPool PipelineStatistics = VK_NULL_HANDLE;
+        std::vector<std::string> Names;
+        uint32_t Count = 0;
+        bool StatisticsRecorded = false;
+        uint64_t SubmitNs = 0;
+    };
+
+    void Resolve(FrameQueries &frame);
+    // Returns false when the clocks cannot be correlated
+    bool Calibrate(uint64_t &gpuTicks, uint64_t &cpuNs);
+
+    static constexpr VkQueryPipelineStatisticFlags StatisticFlags =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    double TimestampPeriod = 1.0; // nanoseconds per tick
+    uint64_t TimestampMask = ~0ull;
+    bool Statistics = false;
+    bool StatisticsEnabled = false;
+    PFN_vkGetCalibratedTimestampsEXT GetCalibratedTimestamps = nullptr;
+    VkTimeDomainEXT HostDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+
+    std::vector<FrameQueries> Frames;
+    FrameQueries *Current = nullptr;
+    std::vector<GpuZoneResult> Latest;
+    double LatestFrameMilliseconds = 0.0;
+    std::vector<uint64_t> Scratch;
+};
@@ -0,0 +1,328 @@
+#include "Ktx2.h"
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+static constexpr uint32_t HeaderSize = 80; // identifier, nine header words and the index
+static constexpr uint32_t LevelIndexEntrySize = 24;
+
+namespace
+{
+    uint32_t ReadU32(const uint8_t *bytes)
+    {
+        uint32_t value;
+        std::memcpy(&value, bytes, 4);
+        return value;
+    }
+
+    uint64_t ReadU64(const uint8_t *bytes)
+    {
+        uint64_t value;
+        std::memcpy(&value, bytes, 8);
+        return value;
+    }
+
+    // Block width, height and bytes; uncompressed formats are 1x1 blocks of one texel
+    bool BlockLayout(VkFormat format, uint32_t &width, uint32_t &height, uint32_t &bytes)
+    {
+        // ASTC formats come in UNORM/SRGB pairs, in this order of block size
+        static const uint8_t AstcBlocks[][2] = {{4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+                                                {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+        if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+        {
+            const uint8_t *block = AstcBlocks[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+            width = block[0];
+            height = block[1];
+            bytes = 16;
+            return true;
+        }
+
+        width = height = 4;
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+            bytes = 8;
+            return true;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+            bytes = 16;
+            return true;
+        default:
+            break;
+        }
+
+        width = height = 1;
+        switch (format)
+        {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            bytes = 1;
+            return true;
+        case VK_FORMAT_R8G8_UNORM:
+            bytes = 2;
+            return true;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            bytes = 4;
+            return true;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            bytes = 8;
+            return true;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            bytes = 16;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void PutU32(std::vector<uint8_t> &out, uint32_t value)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+            out.push_back((uint8_t)(value >> (i * 8)));
+    }
+
+    void PutU64(std::vector<uint8_t> &out, uint64_t value)
+    {
+        for (uint32_t i = 0; i < 8; i++)
+            out.push_back((uint8_t)(value >> (i * 8)));
+    }
+
+    void SetU64(std::vector<uint8_t> &out, size_t offset, uint64_t value)
+    {
+        std::memcpy(out.data() + offset, &value, 8);
+    }
+
+    bool IsSrgb(VkFormat format)
+    {
+        return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK ||
+               format == VK_FORMAT_R8G8B8A8_SRGB;
+    }
+
+    // Basic data format descriptor block (KDFS section 5), the one a KTX2 file must carry
+    std::vector<uint8_t> DataFormatDescriptor(VkFormat format)
+    {
+        // Per sample: bit offset, bit length - 1, channel (with qualifier bits)
+        struct Sample
+        {
+            uint32_t Offset;
+            uint32_t Length;
+            uint32_t Channel;
+        };
+        std::vector<Sample> samples;
+        uint32_t model = 0;
+        uint32_t blockDimension = 3; // 4x4, stored minus one
+        uint32_t bytesPlane0 = BlockCompression::BlockSize(format);
+        uint32_t upper = UINT32_MAX;
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            model = 128; // KHR_DF_MODEL_BC1A
+            samples = {{0, 63, 0}};
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            model = 130; // KHR_DF_MODEL_BC3
+            samples = {{0, 63, 15 | 0x10}, {64, 63, 0}};
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            model = 131; // KHR_DF_MODEL_BC4
+            samples = {{0, 63, 0}};
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            model = 132; // KHR_DF_MODEL_BC5
+            samples = {{0, 63, 0}, {64, 63, 1}};
+            break;
+        default:
+            model = 1; // KHR_DF_MODEL_RGBSDA, 8-bit RGBA
+            blockDimension = 0;
+            bytesPlane0 = 4;
+            upper = 255;
+            samples = {{0, 7, 0}, {8, 7, 1}, {16, 7, 2}, {24, 7, 15 | 0x10}};
+            break;
+        }
+
+        std::vector<uint8_t> descriptor;
+        uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+        PutU32(descriptor, 4 + blockSize); // total size
+        PutU32(descriptor, 0);             // vendor Khronos, basic descriptor type
+        PutU32(descriptor, 2 | blockSize << 16);
+        // Color model, BT.709 primaries, transfer function, straight alpha
+        PutU32(descriptor, model | 1 << 8 | (IsSrgb(format) ? 2 : 1) << 16);
+        PutU32(descriptor, blockDimension | blockDimension << 8);
+        PutU32(descriptor, bytesPlane0);
+        PutU32(descriptor, 0);
+        for (const Sample &sample : samples)
+        {
+            PutU32(descriptor, sample.Offset | sample.Length << 16 | sample.Channel << 24);
+            PutU32(descriptor, 0); // sample position
+            PutU32(descriptor, 0);
+            PutU32(descriptor, upper);
+        }
+        return descriptor;
+    }
+}
+
+bool Ktx2::ReadInfo(std::istream &file, Ktx2Info &info, std::string &error)
+{
+    uint8_t header[HeaderSize];
+    if (!file.read(reinterpret_cast<char *>(header), HeaderSize))
+    {
+        error = "file too short";
+        return false;
+    }
+    if (std::memcmp(header, Identifier, sizeof(Identifier)) != 0)
+    {
+        error = "not a KTX2 file";
+        return false;
+    }
+
+    info.Format = (VkFormat)ReadU32(header + 12);
+    info.Width = ReadU32(header + 20);
+    info.Height = ReadU32(header + 24);
+    uint32_t depth = ReadU32(header + 28);
+    uint32_t layers = ReadU32(header + 32);
+    uint32_t faces = ReadU32(header + 36);
+    uint32_t levelCount = std::max(ReadU32(header + 40), 1u); // 0 asks the loader to generate mips
+    uint32_t supercompression = ReadU32(header + 44);
+    if (info.Format == VK_FORMAT_UNDEFINED)
+    {
+        error = "Basis Universal data needs a transcoder";
+        return false;
+    }
+    if (supercompression != 0)
+    {
+        error = "supercompressed levels are not supported";
+        return false;
+    }
+    if (info.Width == 0 || info.Height == 0 || depth > 1 || layers > 1 || faces != 1)
+    {
+        error = "only single 2D images are supported";
+        return false;
+    }
+    if (LevelSize(info.Format, info.Width, info.Height, 0) == 0)
+    {
+        error = "unsupported format";
+        return false;
+    }
+    if (levelCount > 32 || ((info.Width >> (levelCount - 1)) == 0 && (info.Height >> (levelCount - 1)) == 0))
+    {
+        error = "more levels than the image has";
+        return false;
+    }
+
+    std::vector<uint8_t> index((size_t)levelCount * LevelIndexEntrySize);
+    if (!file.read(reinterpret_cast<char *>(index.data()), (std::streamsize)index.size()))
+    {
+        error = "truncated level index";
+        return false;
+    }
+    info.Levels.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        info.Levels[level].ByteOffset = ReadU64(index.data() + level * LevelIndexEntrySize);
+        info.Levels[level].ByteLength = ReadU64(index.data() + level * LevelIndexEntrySize + 8);
+        // Levels are uploaded as they are, so a short one would be copied past its end
+        if (info.Levels[level].ByteLength < LevelSize(info.Format, info.Width, info.Height, level))
+        {
+            error = "mip level shorter than its texels";
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t Ktx2::LevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level)
+{
+    uint32_t blockWidth, blockHeight, blockBytes;
+    if (!BlockLayout(format, blockWidth, blockHeight, blockBytes))
+        return 0;
+    uint64_t levelWidth = std::max(width >> level, 1u);
+    uint64_t levelHeight = std::max(height >> level, 1u);
+    return (levelWidth + blockWidth - 1) / blockWidth * ((levelHeight + blockHeight - 1) / blockHeight) * blockBytes;
+}
+
+std::vector<uint8_t> Ktx2::Write(VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>> &levels)
+{
+    uint32_t levelCount = (uint32_t)levels.size();
+    std::vector<uint8_t> descriptor = DataFormatDescriptor(format);
+
+    // A single KTXwriter entry: key and value, both NUL-terminated, after their combined length
+    static const char Key[] = "KTXwriter";
+    static const char Value[] = "Stela";
+    std::vector<uint8_t> keyValues;
+    PutU32(keyValues, sizeof(Key) + sizeof(Value));
+    keyValues.insert(keyValues.end(), Key, Key + sizeof(Key));
+    keyValues.insert(keyValues.end(), Value, Value + sizeof(Value));
+    while (keyValues.size() % 4 != 0)
+        keyValues.push_back(0);
+
+    std::vector<uint8_t> out(Identifier, Identifier + sizeof(Identifier));
+    PutU32(out, (uint32_t)format);
+    PutU32(out, 1); // type size: bytes for block-compressed and 8-bit formats
+    PutU32(out, width);
+    PutU32(out, height);
+    PutU32(out, 0); // depth
+    PutU32(out, 0); // array layers
+    PutU32(out, 1); // faces
+    PutU32(out, levelCount);
+    PutU32(out, 0); // supercompression
+
+    uint32_t descriptorOffset = HeaderSize + levelCount * LevelIndexEntrySize;
+    uint32_t keyValueOffset = descriptorOffset + (uint32_t)descriptor.size();
+    PutU32(out, descriptorOffset);
+    PutU32(out, (uint32_t)descriptor.size());
+    PutU32(out, keyValueOffset);
+    PutU32(out, (uint32_t)keyValues.size());
+    PutU64(out, 0); // supercompression global data
+    PutU64(out, 0);
+
+    size_t levelIndex = out.size();
+    out.resize(out.size() + (size_t)levelCount * LevelIndexEntrySize);
+    out.insert(out.end(), descriptor.begin(), descriptor.end());
+    out.insert(out.end(), keyValues.begin(), keyValues.end());
+
+    // Levels start on a multiple of the block size (and of 4); the smallest comes first, so a loader
+    // streaming the file in order can show something early
+    size_t alignment = std::max<size_t>(BlockCompression::BlockSize(format), 4);
+    for (uint32_t level = levelCount; level-- > 0;)
+    {
+        while (out.size() % alignment != 0)
+            out.push_back(0);
+        size_t entry = levelIndex + (size_t)level * LevelIndexEntrySize;
+        SetU64(out, entry, out.size());
+        SetU64(out, entry + 8, levels[level].size());
+        SetU64(out, entry + 16, levels[level].size()); // uncompressed length; no supercompression
+        out.insert(out.end(), levels[level].begin(), levels[level].end());
+    }
+    return out;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Where one mip level's data sits in a KTX2 file
+struct Ktx2Level
+{
+    uint64_t ByteOffset = 0;
+    uint64_t ByteLength = 0;
+};
+
+// What a KTX2 file holds, from its header and level index
+struct Ktx2Info
+{
+    VkFormat Format = VK_FORMAT_UNDEFINED;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<Ktx2Level> Levels; // level 0 (the largest) first
+};
+
+// KTX2 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html), the mip-chained container the
+// texture pipeline stores in. Only what it needs is supported: single 2D images without
+// supercompression, so any level can be read with one seek and one read of its bytes.
+namespace Ktx2
+{
+    // Reads the header and level index; false with `error` set for anything else than the above, for a
+    // format LevelSize does not know, or for a level shorter than its texels need
+    bool ReadInfo(std::istream &file, Ktx2Info &info, std::string &error);
+    // Bytes of `level` of a width x height image: whole blocks for BC, ETC2/EAC and ASTC, texels for
+    // common uncompressed formats; 0 for any other format
+    uint64_t LevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level);
+    // A whole file. `levels` are level 0 first; they are stored smallest first with a data format
+    // descriptor for `format`, which must be one TextureCooker produces.
+    std::vector<uint8_t> Write(VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>> &levels);
+}
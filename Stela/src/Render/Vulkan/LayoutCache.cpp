@@ -0,0 +1,140 @@
+#include "LayoutCache.h"
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    void Append(std::string &key, uint64_t value)
+    {
+        key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    Metrics::Counter &Hits()
+    {
+        static Metrics::Counter &hits = Metrics::GetCounter("stela_layout_cache_hits_total", "Descriptor set and pipeline layout requests served by an existing layout");
+        return hits;
+    }
+}
+
+void LayoutCache::Init(VkDevice device, const VkAllocationCallbacks *allocator)
+{
+    Device = device;
+    pAllocator = allocator;
+}
+
+void LayoutCache::Destroy()
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    for (auto &[key, layout] : PipelineLayouts)
+        vkDestroyPipelineLayout(Device, layout, pAllocator);
+    for (auto &[key, layout] : SetLayouts)
+        vkDestroyDescriptorSetLayout(Device, layout, pAllocator);
+    PipelineLayouts.clear();
+    SetLayouts.clear();
+}
+
+VkDescriptorSetLayout LayoutCache::GetSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags)
+{
+    static Metrics::Gauge &count = Metrics::GetGauge("stela_descriptor_set_layouts", "Distinct descriptor set layouts built from shader reflection");
+
+    std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) { return a.binding < b.binding; });
+    std::string key;
+    Append(key, flags);
+    for (const VkDescriptorSetLayoutBinding &binding : bindings)
+    {
+        if (binding.pImmutableSamplers)
+            throw std::runtime_error("immutable samplers cannot be shared through the layout cache!");
+        Append(key, binding.binding);
+        Append(key, binding.descriptorType);
+        Append(key, binding.descriptorCount);
+        Append(key, binding.stageFlags);
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto it = SetLayouts.find(key);
+    if (it != SetLayouts.end())
+    {
+        Hits().Add();
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.flags = flags;
+    createInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    createInfo.pBindings = bindings.data();
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(Device, &createInfo, pAllocator, &layout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    SetLayouts.emplace(std::move(key), layout);
+    count.Set((double)SetLayouts.size());
+    return layout;
+}
+
+VkPipelineLayout LayoutCache::GetPipelineLayout(const std::vector<VkDescriptorSetLayout> &sets, std::vector<VkPushConstantRange> ranges)
+{
+    static Metrics::Gauge &count = Metrics::GetGauge("stela_pipeline_layouts", "Distinct pipeline layouts built from shader reflection");
+
+    std::sort(ranges.begin(), ranges.end(), [](const VkPushConstantRange &a, const VkPushConstantRange &b) { return a.stageFlags < b.stageFlags; });
+    std::string key;
+    for (VkDescriptorSetLayout set : sets)
+        Append(key, (uint64_t)set);
+    Append(key, UINT64_MAX); // separates the sets from the ranges
+    for (const VkPushConstantRange &range : ranges)
+    {
+        Append(key, range.stageFlags);
+        Append(key, range.offset);
+        Append(key, range.size);
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto it = PipelineLayouts.find(key);
+    if (it != PipelineLayouts.end())
+    {
+        Hits().Add();
+        return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    createInfo.setLayoutCount = static_cast<uint32_t>(sets.size());
+    createInfo.pSetLayouts = sets.data();
+    createInfo.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
+    createInfo.pPushConstantRanges = ranges.data();
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(Device, &createInfo, pAllocator, &layout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+    PipelineLayouts.emplace(std::move(key), layout);
+    count.Set((double)PipelineLayouts.size());
+    return layout;
+}
+
+VkPipelineLayout LayoutCache::GetPipelineLayout(const ShaderReflection &reflection,
+                                                const std::vector<std::pair<uint32_t, VkDescriptorSetLayout>> &fixedSets)
+{
+    uint32_t setCount = reflection.SetCount();
+    for (const auto &[index, layout] : fixedSets)
+        setCount = std::max(setCount, index + 1);
+
+    std::vector<VkDescriptorSetLayout> sets(setCount, VK_NULL_HANDLE);
+    for (const auto &[index, layout] : fixedSets)
+        sets[index] = layout;
+    for (uint32_t set = 0; set < setCount; set++)
+    {
+        if (sets[set])
+            continue;
+        std::vector<VkDescriptorSetLayoutBinding> bindings = reflection.SetBindings(set);
+        for (const VkDescriptorSetLayoutBinding &binding : bindings)
+        {
+            if (binding.descriptorCount == 0)
+                throw std::runtime_error("set " + std::to_string(set) + " has a runtime-sized array and needs a fixed layout!");
+        }
+        sets[set] = GetSetLayout(std::move(bindings));
+    }
+    return GetPipelineLayout(sets, reflection.PushConstants);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "ShaderReflection.h"
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Owns every descriptor set layout and pipeline layout built from shader reflection. Identical
+// layouts are created once and shared, so pipelines from different shaders with the same interface
+// get the same VkPipelineLayout: descriptor sets and push constants stay valid across their binds,
+// and the pipeline library shares compiled parts between them.
+class LayoutCache
+{
+public:
+    void Init(VkDevice device, const VkAllocationCallbacks *allocator);
+    // Once the device is idle and nothing uses the layouts
+    void Destroy();
+
+    // Thread-safe; returned layouts live until Destroy
+    VkDescriptorSetLayout GetSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
+    VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout> &sets, std::vector<VkPushConstantRange> ranges);
+
+    // Layout for everything `reflection` uses. `fixedSets` pairs a set index with a layout made
+    // elsewhere (the bindless set, say), used whether or not the shaders reference it; it is also
+    // how sets with runtime-sized arrays are provided. Sets in between that nothing uses are empty.
+    VkPipelineLayout GetPipelineLayout(const ShaderReflection &reflection,
+                                       const std::vector<std::pair<uint32_t, VkDescriptorSetLayout>> &fixedSets = {});
+
+private:
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+
+    std::mutex Mutex;
+    // Keyed by the create info's words, so equal keys are equal layouts
+    std::unordered_map<std::string, VkDescriptorSetLayout> SetLayouts;
+    std::unordered_map<std::string, VkPipelineLayout> PipelineLayouts;
+};
@@ -0,0 +1,90 @@
+#include "MeshBenchmark.h"
+#include <Log/Log.h>
+#include <cmath>
+
+void MeshBenchmark::Init(MeshRenderer &renderer, ClusteredLighting &lights, uint32_t instanceCount, uint32_t lightCount)
+{
+    Renderer = &renderer;
+    Lights = &lights;
+
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    MeshRenderer::BuildCube(vertices, indices);
+    Meshes.push_back(renderer.CreateMesh(vertices, indices));
+    MeshRenderer::BuildSphere(8, 12, vertices, indices);
+    Meshes.push_back(renderer.CreateMesh(vertices, indices));
+    MeshRenderer::BuildSphere(16, 24, vertices, indices);
+    Meshes.push_back(renderer.CreateMesh(vertices, indices));
+
+    // Same shaders, distinct pipelines: enough to exercise sorting by material
+    Materials.push_back(renderer.DefaultMaterial());
+    MaterialDesc doubleSided;
+    doubleSided.Name = "Benchmark.NoCull";
+    doubleSided.CullMode = VK_CULL_MODE_NONE;
+    Materials.push_back(renderer.CreateMaterial(doubleSided));
+    MaterialDesc blended;
+    blended.Name = "Benchmark.Blended";
+    blended.BlendEnable = true;
+    Materials.push_back(renderer.CreateMaterial(blended));
+
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt((float)instanceCount)));
+    Extent = side * 1.5f;
+    Instances.reserve(instanceCount);
+    uint32_t seed = 1;
+    auto random = [&seed]
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        Instance instance;
+        instance.Position = {(i % side) * 1.5f - Extent * 0.5f, 0.0f, (i / side) * 1.5f - Extent * 0.5f};
+        instance.Axis = {random() - 0.5f, random() - 0.5f, random() - 0.5f};
+        instance.Speed = 0.5f + random() * 2.0f;
+        instance.Mesh = i % static_cast<uint32_t>(Meshes.size());
+        instance.Material = (i / 7) % static_cast<uint32_t>(Materials.size());
+        instance.Color = {0.3f + random() * 0.7f, 0.3f + random() * 0.7f, 0.3f + random() * 0.7f, 1.0f};
+        Instances.push_back(instance);
+    }
+
+    // Small lights circling just above the grid; every eighth one a spot pointing down
+    LightList.reserve(lightCount);
+    for (uint32_t i = 0; i < lightCount; i++)
+    {
+        Light light;
+        light.Center = {(random() - 0.5f) * Extent, 1.0f + random() * 2.0f, (random() - 0.5f) * Extent};
+        light.Orbit = 1.0f + random() * 4.0f;
+        light.Speed = 0.2f + random();
+        light.Radius = 3.0f + random() * 5.0f;
+        light.Color = {random(), random(), random()};
+        light.Spot = i % 8 == 0;
+        LightList.push_back(light);
+    }
+
+    STELA_LOG_INFO(Render, "Mesh benchmark: %u instances, %zu meshes, %zu materials, %u lights", instanceCount, Meshes.size(), Materials.size(), lightCount);
+}
+
+void MeshBenchmark::Submit(float time, float aspect)
+{
+    float orbit = time * 0.1f;
+    Math::Vec3 eye{std::cos(orbit) * Extent * 0.6f, Extent * 0.35f, std::sin(orbit) * Extent * 0.6f};
+    Math::Mat4 view = Math::LookAt(eye, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f});
+    Renderer->SetCamera(view, Math::Perspective(Math::Pi / 3.0f, aspect, 0.1f, Extent * 4.0f));
+
+    for (const Light &light : LightList)
+    {
+        float angle = time * light.Speed;
+        Math::Vec3 position = light.Center + Math::Vec3{std::cos(angle), 0.0f, std::sin(angle)} * light.Orbit;
+        if (light.Spot)
+            Lights->SubmitSpotLight(position + Math::Vec3{0.0f, 2.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, light.Radius * 2.0f, 0.3f, 0.6f, light.Color, 8.0f);
+        else
+            Lights->SubmitPointLight(position, light.Radius, light.Color, 4.0f);
+    }
+
+    for (const Instance &instance : Instances)
+    {
+        Math::Mat4 model = Math::Translation(instance.Position) * Math::Rotation(instance.Axis, time * instance.Speed);
+        Renderer->Submit(Meshes[instance.Mesh], Materials[instance.Material], model, instance.Color);
+    }
+}
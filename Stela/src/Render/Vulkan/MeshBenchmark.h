@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ClusteredLighting.h"
+#include "MeshRenderer.h"
+
+// Stress scene for MeshRenderer: a grid of spinning cubes and spheres over a handful of materials,
+// lit by drifting point and spot lights, all resubmitted every frame. Driven by the Runtime's
+// --mesh-benchmark flag.
+class MeshBenchmark
+{
+public:
+    void Init(MeshRenderer &renderer, ClusteredLighting &lights, uint32_t instanceCount = 100000, uint32_t lightCount = 1024);
+    // Submits every instance and light and sets the camera for a frame at `time` seconds
+    void Submit(float time, float aspect);
+
+private:
+    struct Instance
+    {
+        Math::Vec3 Position;
+        Math::Vec3 Axis;
+        float Speed;
+        uint32_t Mesh;
+        uint32_t Material;
+        Math::Vec4 Color;
+    };
+
+    struct Light
+    {
+        Math::Vec3 Center;
+        float Orbit;
+        float Speed;
+        float Radius;
+        Math::Vec3 Color;
+        bool Spot;
+    };
+
+    MeshRenderer *Renderer = nullptr;
+    ClusteredLighting *Lights = nullptr;
+    std::vector<MeshHandle> Meshes;
+    std::vector<MaterialHandle> Materials;
+    std::vector<Instance> Instances;
+    std::vector<Light> LightList;
+    float Extent = 0.0f;
+};
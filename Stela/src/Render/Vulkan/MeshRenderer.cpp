@@ -0,0 +1,669 @@
+#include "MeshRenderer.h"
+#include "Vulkan.h"
+#include <Jobs/JobSystem.h>
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+void MeshRenderer::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    VkDevice device = vulkan.Device;
+
+    vulkan.CreateBuffer(VertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        GpuMemoryUsage::GpuOnly, VertexBuffer, VertexAllocation);
+    vulkan.CreateBuffer(IndexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        GpuMemoryUsage::GpuOnly, IndexBuffer, IndexAllocation);
+
+    // Culling needs per-draw firstInstance to find each draw's slice of the visible list
+    GpuDriven = vulkan.DeviceFeatures.multiDrawIndirect && vulkan.DeviceFeatures.drawIndirectFirstInstance;
+    IndirectCount = GpuDriven && vulkan.DrawIndirectCount;
+    if (const char *occlusion = std::getenv("STELA_OCCLUSION_CULLING"))
+        OcclusionCulling = std::atoi(occlusion) != 0;
+
+    // Layouts come from the shaders. The per-frame set 0 (0 instances, 1 draws, 2 visible, 3 counters,
+    // 4 indirect commands, 5 occlusion history) is bound for both culling and drawing, so it is built
+    // from both; set 1 is the bindless set the textured shader indexes, set 2 the constant ring holding
+    // the camera and set 3 the clustered lights. Culling binds the depth pyramid as set 1 instead.
+    Bindless = vulkan.Descriptors.IsEnabled();
+    DefaultVertexShader = vulkan.Shaders.Get("mesh.vert");
+    DefaultFragmentShader = vulkan.Shaders.Get("mesh.frag");
+    if (Bindless)
+        TexturedFragmentShader = vulkan.Shaders.Get("mesh_textured.frag");
+    ShaderCode cullShader = vulkan.Shaders.Get("mesh_cull.comp");
+    ShaderCode compactShader = vulkan.Shaders.Get("mesh_compact.comp");
+
+    ShaderReflection draw = ShaderReflection::Reflect(*DefaultVertexShader);
+    draw.Merge(ShaderReflection::Reflect(*(Bindless ? TexturedFragmentShader : DefaultFragmentShader)));
+    ShaderReflection cull = ShaderReflection::Reflect(*cullShader);
+    cull.Merge(ShaderReflection::Reflect(*compactShader));
+    ShaderReflection frameSet = draw;
+    frameSet.Merge(cull);
+    VertexInputs = draw.Inputs;
+
+    SetLayout = vulkan.Layouts.GetSetLayout(frameSet.SetBindings(0));
+    std::vector<std::pair<uint32_t, VkDescriptorSetLayout>> drawSets = {{0, SetLayout}, {2, vulkan.Constants.GetSetLayout()}, {3, vulkan.Lights.GetSetLayout()}};
+    if (Bindless)
+        drawSets.emplace_back(1, vulkan.Descriptors.GetSetLayout());
+    Layout = vulkan.Layouts.GetPipelineLayout(draw, drawSets);
+    CullLayout = vulkan.Layouts.GetPipelineLayout(cull, {{0, SetLayout}, {1, vulkan.Pyramid.GetSetLayout()}, {2, vulkan.Constants.GetSetLayout()}});
+
+    uint32_t frameCount = vulkan.FramesInFlight;
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 6};
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.maxSets = frameCount;
+    descriptorPoolInfo.poolSizeCount = 1;
+    descriptorPoolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &descriptorPoolInfo, vulkan.pAllocator, &DescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create mesh descriptor pool!");
+    }
+
+    EnsureHistory(1024);
+    Frames.resize(frameCount);
+    for (FrameResources &frame : Frames)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = DescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &SetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &frame.DescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate mesh descriptor set!");
+        }
+        EnsureCapacity(frame, 1024, 256);
+    }
+
+    CullPipeline = CreateCullPipeline(cullShader);
+    CompactPipeline = CreateCullPipeline(compactShader);
+    MaterialDesc desc;
+    desc.Name = "Default";
+    Default = CreateMaterial(desc);
+    // Materials keep their handles; Vulkan's listener has already queued their pipelines for rebuild
+    vulkan.Shaders.AddReloadListener([this](const ShaderCode &previous, const ShaderCode &replacement)
+    {
+        for (ShaderCode *code : {&DefaultVertexShader, &DefaultFragmentShader, &TexturedFragmentShader})
+        {
+            if (*code == previous)
+                *code = replacement;
+        }
+    });
+    STELA_LOG_INFO(Render, "Mesh draws: %s", IndirectCount ? "GPU culled, indirect count" : GpuDriven ? "GPU culled, multi-draw indirect" : "CPU recorded");
+
+    List.MinBatchSize = 64;
+    List.Record = [this](VkCommandBuffer commandBuffer, const DrawBatch &batch) { RecordDraws(commandBuffer, batch, 0); };
+    vulkan.SceneDrawLists.push_back(&List);
+    LateList.MinBatchSize = 64;
+    LateList.Record = [this](VkCommandBuffer commandBuffer, const DrawBatch &batch) { RecordDraws(commandBuffer, batch, 1); };
+    vulkan.LateSceneDrawLists.push_back(&LateList);
+}
+
+VkPipeline MeshRenderer::CreateCullPipeline(const ShaderCode &code)
+{
+    VkShaderModule module = Owner->CreateShaderModule(*code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = CullLayout;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(Owner->Device, Owner->PersistentCache.Handle(), 1, &pipelineInfo, Owner->pAllocator, &pipeline);
+    vkDestroyShaderModule(Owner->Device, module, Owner->pAllocator);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create mesh culling pipeline!");
+    }
+    return pipeline;
+}
+
+void MeshRenderer::Destroy()
+{
+    if (!Owner)
+        return;
+    VkDevice device = Owner->Device;
+    const VkAllocationCallbacks *allocator = Owner->pAllocator;
+
+    auto &lists = Owner->SceneDrawLists;
+    lists.erase(std::remove(lists.begin(), lists.end(), &List), lists.end());
+    auto &lateLists = Owner->LateSceneDrawLists;
+    lateLists.erase(std::remove(lateLists.begin(), lateLists.end(), &LateList), lateLists.end());
+
+    for (FrameResources &frame : Frames)
+    {
+        Release(frame.Instances);
+        Release(frame.Visible);
+        Release(frame.Draws);
+        Release(frame.Counters);
+        Release(frame.Indirect);
+    }
+    Frames.clear();
+    Release(History);
+    HistoryCapacity = 0;
+
+    vkDestroyPipeline(device, CullPipeline, allocator);
+    vkDestroyPipeline(device, CompactPipeline, allocator);
+    vkDestroyDescriptorPool(device, DescriptorPool, allocator);
+
+    vkDestroyBuffer(device, VertexBuffer, allocator);
+    vkDestroyBuffer(device, IndexBuffer, allocator);
+    Owner->DeviceMemory.Free(VertexAllocation);
+    Owner->DeviceMemory.Free(IndexAllocation);
+    Owner = nullptr;
+}
+
+void MeshRenderer::Release(FrameBuffer &buffer)
+{
+    if (buffer.Buffer == VK_NULL_HANDLE)
+        return;
+    vkDestroyBuffer(Owner->Device, buffer.Buffer, Owner->pAllocator);
+    Owner->DeviceMemory.Free(buffer.Allocation);
+    buffer.Buffer = VK_NULL_HANDLE;
+}
+
+void MeshRenderer::Reallocate(FrameBuffer &buffer, VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memoryUsage)
+{
+    Release(buffer);
+    Owner->CreateBuffer(size, usage, memoryUsage, buffer.Buffer, buffer.Allocation);
+}
+
+void MeshRenderer::EnsureCapacity(FrameResources &frame, uint32_t instances, uint32_t draws)
+{
+    if (instances <= frame.InstanceCapacity && draws <= frame.DrawCapacity)
+        return;
+
+    // Only called for a frame whose fence has signalled, so the old buffers are idle
+    if (instances > frame.InstanceCapacity)
+    {
+        frame.InstanceCapacity = std::max({instances, frame.InstanceCapacity * 2, 1024u});
+        Reallocate(frame.Instances, frame.InstanceCapacity * sizeof(InstanceData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::Upload);
+        Reallocate(frame.Visible, frame.InstanceCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+    }
+    if (draws > frame.DrawCapacity)
+    {
+        frame.DrawCapacity = std::max({draws, frame.DrawCapacity * 2, 256u});
+        Reallocate(frame.Draws, frame.DrawCapacity * sizeof(GpuDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::Upload);
+        Reallocate(frame.Counters, frame.DrawCapacity * 4 * sizeof(uint32_t),
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+        Reallocate(frame.Indirect, frame.DrawCapacity * 2 * sizeof(VkDrawIndexedIndirectCommand),
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+    }
+
+    VkDescriptorBufferInfo bufferInfos[6] = {
+        {frame.Instances.Buffer, 0, VK_WHOLE_SIZE},
+        {frame.Draws.Buffer, 0, VK_WHOLE_SIZE},
+        {frame.Visible.Buffer, 0, VK_WHOLE_SIZE},
+        {frame.Counters.Buffer, 0, VK_WHOLE_SIZE},
+        {frame.Indirect.Buffer, 0, VK_WHOLE_SIZE},
+        {History.Buffer, 0, VK_WHOLE_SIZE},
+    };
+    VkWriteDescriptorSet writes[6]{};
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = frame.DescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(Owner->Device, 6, writes, 0, nullptr);
+}
+
+void MeshRenderer::EnsureHistory(uint32_t instances)
+{
+    if (instances <= HistoryCapacity)
+        return;
+
+    // Every frame's set points at the one buffer, so frames in flight must finish first. Instances
+    // only grow that far a handful of times; the cleared history just means one frame culls less.
+    if (History.Buffer != VK_NULL_HANDLE)
+        vkDeviceWaitIdle(Owner->Device);
+    HistoryCapacity = std::max({instances, HistoryCapacity * 2, 1024u});
+    Reallocate(History, HistoryCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+    HistoryCleared = false;
+
+    VkDescriptorBufferInfo bufferInfo{History.Buffer, 0, VK_WHOLE_SIZE};
+    for (FrameResources &frame : Frames)
+    {
+        if (frame.DescriptorSet == VK_NULL_HANDLE)
+            continue;
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.DescriptorSet;
+        write.dstBinding = 5;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(Owner->Device, 1, &write, 0, nullptr);
+    }
+}
+
+MeshHandle MeshRenderer::CreateMesh(const std::vector<MeshVertex> &vertices, const std::vector<uint32_t> &indices)
+{
+    if (vertices.empty() || indices.empty())
+        return {};
+    if ((VertexCount + vertices.size()) * sizeof(MeshVertex) > VertexBufferSize || (IndexCount + indices.size()) * sizeof(uint32_t) > IndexBufferSize)
+    {
+        STELA_LOG_ERROR(Render, "Mesh buffers full, cannot add mesh with %zu vertices", vertices.size());
+        return {};
+    }
+
+    // Flushed before the next frame is recorded, so the mesh can be drawn straight away
+    Owner->Uploads.UploadBuffer(VertexBuffer, VertexCount * sizeof(MeshVertex), vertices.data(), vertices.size() * sizeof(MeshVertex));
+    Owner->Uploads.UploadBuffer(IndexBuffer, IndexCount * sizeof(uint32_t), indices.data(), indices.size() * sizeof(uint32_t));
+
+    // Bounding sphere around the box centre: loose, but one pass and good enough to cull with
+    Math::Vec3 lower{vertices[0].Position[0], vertices[0].Position[1], vertices[0].Position[2]};
+    Math::Vec3 upper = lower;
+    for (const MeshVertex &vertex : vertices)
+    {
+        lower = {std::min(lower.X, vertex.Position[0]), std::min(lower.Y, vertex.Position[1]), std::min(lower.Z, vertex.Position[2])};
+        upper = {std::max(upper.X, vertex.Position[0]), std::max(upper.Y, vertex.Position[1]), std::max(upper.Z, vertex.Position[2])};
+    }
+    Math::Vec3 center = (lower + upper) * 0.5f;
+    float radius = 0.0f;
+    for (const MeshVertex &vertex : vertices)
+        radius = std::max(radius, Math::Length(Math::Vec3{vertex.Position[0], vertex.Position[1], vertex.Position[2]} - center));
+
+    Meshes.push_back({static_cast<int32_t>(VertexCount), IndexCount, static_cast<uint32_t>(indices.size()), {center.X, center.Y, center.Z, radius}});
+    VertexCount += static_cast<uint32_t>(vertices.size());
+    IndexCount += static_cast<uint32_t>(indices.size());
+    return {static_cast<uint32_t>(Meshes.size() - 1)};
+}
+
+MaterialHandle MeshRenderer::CreateMaterial(const MaterialDesc &desc)
+{
+    GraphicsPipelineDesc pipeline;
+    pipeline.Name = desc.Name;
+    pipeline.VertexShader = desc.VertexShader ? desc.VertexShader : DefaultVertexShader;
+    bool textured = Bindless && (desc.BaseColor.Valid() || desc.BaseColorTexture.Valid()) && TexturedFragmentShader;
+    if (desc.FragmentShader)
+        pipeline.FragmentShader = desc.FragmentShader;
+    else
+        pipeline.FragmentShader = textured ? TexturedFragmentShader : DefaultFragmentShader;
+    if (!pipeline.VertexShader || !pipeline.FragmentShader)
+        return {};
+
+    // The vertex buffer layout is fixed by MeshVertex; only the attributes the shader reads are fetched
+    const VkVertexInputAttributeDescription meshAttributes[] = {
+        {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, Position)},
+        {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, Normal)},
+        {2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(MeshVertex, UV)}};
+    std::vector<ReflectedInput> inputs = desc.VertexShader ? ShaderReflection::Reflect(*desc.VertexShader).Inputs : VertexInputs;
+    for (const ReflectedInput &input : inputs)
+    {
+        const VkVertexInputAttributeDescription *attribute = nullptr;
+        for (const VkVertexInputAttributeDescription &candidate : meshAttributes)
+        {
+            if (candidate.location == input.Location && candidate.format == input.Format)
+                attribute = &candidate;
+        }
+        if (!attribute)
+        {
+            STELA_LOG_ERROR(Render, "Material '%s' reads vertex input %u, which MeshVertex does not provide", desc.Name.c_str(), input.Location);
+            return {};
+        }
+        pipeline.Attributes.push_back(*attribute);
+    }
+    pipeline.Bindings = {{0, sizeof(MeshVertex), VK_VERTEX_INPUT_RATE_VERTEX}};
+    pipeline.FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    pipeline.CullMode = desc.CullMode;
+    pipeline.BlendEnable = desc.BlendEnable;
+    // Blended materials are tested but leave the depth (and so the occlusion pyramid) to opaque ones
+    pipeline.DepthTest = true;
+    pipeline.DepthWrite = !desc.BlendEnable;
+    pipeline.Specialization = desc.Specialization;
+    pipeline.Layout = Layout;
+
+    // Until its own pipelines are ready a material draws with the default one
+    Material material;
+    if (textured)
+    {
+        material.Texture = desc.BaseColorTexture;
+        material.Constants.BaseColor = material.Texture.Valid() ? Owner->Textures.GetBindless(material.Texture).Index : desc.BaseColor.Index;
+        material.Constants.BaseColorSampler = desc.BaseColorSampler.Valid() ? desc.BaseColorSampler.Index : Owner->Descriptors.DefaultSampler().Index;
+    }
+    Material *fallback = Default.Valid() ? &Materials[Default.Index] : nullptr;
+    pipeline.RenderPass = Owner->OffscreenRenderPass;
+    material.Offscreen = Owner->Pipelines.Request(pipeline, fallback ? fallback->Offscreen : PipelineHandle{});
+    pipeline.RenderPass = Owner->RenderPass;
+    material.SwapChain = Owner->Pipelines.Request(pipeline, fallback ? fallback->SwapChain : PipelineHandle{});
+
+    Materials.push_back(material);
+    return {static_cast<uint32_t>(Materials.size() - 1)};
+}
+
+void MeshRenderer::Submit(MeshHandle mesh, MaterialHandle material, const Math::Mat4 &transform, const Math::Vec4 &color)
+{
+    if (!mesh.Valid() || !material.Valid())
+        return;
+    Submissions.push_back({(uint64_t)material.Index << 32 | mesh.Index, static_cast<uint32_t>(Pending.size())});
+    Pending.push_back({transform, color, 0, 0, {}});
+}
+
+void MeshRenderer::SetCamera(const Math::Mat4 &view, const Math::Mat4 &projection)
+{
+    View = view;
+    Projection = projection;
+    ViewProjection = projection * view;
+}
+
+void MeshRenderer::Prepare(uint32_t frameIndex)
+{
+    static Metrics::Histogram &prepareTime = Metrics::GetHistogram("stela_mesh_prepare_us", "Time to sort and upload mesh instances for a frame, in microseconds");
+    static Metrics::Gauge &drawCalls = Metrics::GetGauge("stela_mesh_draw_calls", "Instanced mesh draws before culling in the last frame");
+    static Metrics::Gauge &indirectCalls = Metrics::GetGauge("stela_mesh_recorded_draws", "Draw commands recorded per scene pass for meshes in the last frame");
+    static Metrics::Gauge &instances = Metrics::GetGauge("stela_mesh_instances", "Mesh instances submitted in the last frame");
+    Metrics::ScopedTimer timer(prepareTime);
+
+    CurrentFrame = frameIndex;
+    FrameResources &frame = Frames[frameIndex];
+    Camera = Owner->Constants.Push(CameraConstants{ViewProjection, View});
+    uint32_t count = static_cast<uint32_t>(Submissions.size());
+
+    // Material in the high bits: runs of one key share a pipeline and a mesh
+    std::sort(Submissions.begin(), Submissions.end(), [](const Submission &a, const Submission &b) { return a.Key < b.Key; });
+
+    Commands.clear();
+    Segments.clear();
+    for (uint32_t i = 0; i < count;)
+    {
+        uint32_t first = i;
+        uint64_t key = Submissions[i].Key;
+        while (i < count && Submissions[i].Key == key)
+            i++;
+        uint32_t material = static_cast<uint32_t>(key >> 32);
+        if (Segments.empty() || Segments.back().Material != material)
+        {
+            Segments.push_back({material, static_cast<uint32_t>(Commands.size()), 0});
+            // Textures.Update ran earlier this frame, so the slot read here is the one now resident
+            Material &drawn = Materials[material];
+            if (drawn.Texture.Valid())
+            {
+                Owner->Textures.Request(drawn.Texture);
+                drawn.Constants.BaseColor = Owner->Textures.GetBindless(drawn.Texture).Index;
+            }
+        }
+        Segments.back().DrawCount++;
+        Commands.push_back({material, static_cast<uint32_t>(key), first, i - first});
+    }
+    uint32_t drawCount = static_cast<uint32_t>(Commands.size());
+
+    EnsureHistory(count);
+    EnsureCapacity(frame, count, drawCount);
+    GpuDraw *draws = static_cast<GpuDraw *>(frame.Draws.Allocation.Mapped);
+    for (uint32_t segment = 0; segment < Segments.size(); segment++)
+    {
+        for (uint32_t i = Segments[segment].FirstDraw; i < Segments[segment].FirstDraw + Segments[segment].DrawCount; i++)
+        {
+            const DrawCommand &command = Commands[i];
+            const Mesh &mesh = Meshes[command.Mesh];
+            draws[i] = {mesh.IndexCount, mesh.FirstIndex, mesh.VertexOffset, command.FirstInstance, segment, Segments[segment].FirstDraw, {},
+                        {mesh.Bounds[0], mesh.Bounds[1], mesh.Bounds[2], mesh.Bounds[3]}};
+        }
+    }
+
+    InstanceData *destination = static_cast<InstanceData *>(frame.Instances.Allocation.Mapped);
+    Jobs::ParallelFor(drawCount, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t draw = begin; draw < end; draw++)
+        {
+            const DrawCommand &command = Commands[draw];
+            for (uint32_t i = command.FirstInstance; i < command.FirstInstance + command.InstanceCount; i++)
+            {
+                destination[i] = Pending[Submissions[i].Instance];
+                destination[i].Draw = draw;
+                destination[i].Id = Submissions[i].Instance;
+            }
+        }
+    });
+
+    // Frustum planes from the rows of the view-projection (Gribb/Hartmann), Vulkan's 0..w depth range
+    const Math::Mat4 &m = ViewProjection;
+    auto row = [&m](int r) { return Math::Vec4{m.M[0][r], m.M[1][r], m.M[2][r], m.M[3][r]}; };
+    Math::Vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+    Math::Vec4 planes[6] = {
+        {w.X + x.X, w.Y + x.Y, w.Z + x.Z, w.W + x.W},
+        {w.X - x.X, w.Y - x.Y, w.Z - x.Z, w.W - x.W},
+        {w.X + y.X, w.Y + y.Y, w.Z + y.Z, w.W + y.W},
+        {w.X - y.X, w.Y - y.Y, w.Z - y.Z, w.W - y.W},
+        z,
+        {w.X - z.X, w.Y - z.Y, w.Z - z.Z, w.W - z.W},
+    };
+    for (int i = 0; i < 6; i++)
+    {
+        float length = Math::Length({planes[i].X, planes[i].Y, planes[i].Z});
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        Cull.Planes[i][0] = planes[i].X * scale;
+        Cull.Planes[i][1] = planes[i].Y * scale;
+        Cull.Planes[i][2] = planes[i].Z * scale;
+        Cull.Planes[i][3] = planes[i].W * scale;
+    }
+    Cull.InstanceCount = count;
+    Cull.DrawCount = drawCount;
+    Cull.FrustumCull = GpuDriven && FrustumCulling;
+    Cull.Compact = IndirectCount;
+    Cull.OcclusionCull = IsOcclusionCulling();
+
+    List.Count = static_cast<uint32_t>(Segments.size());
+    LateList.Count = IsOcclusionCulling() ? List.Count : 0;
+    LastInstanceCount = count;
+    drawCalls.Set((double)drawCount);
+    indirectCalls.Set((double)(GpuDriven ? Segments.size() : drawCount));
+    instances.Set((double)count);
+
+    Submissions.clear();
+    Pending.clear();
+}
+
+void MeshRenderer::RecordCulling(VkCommandBuffer commandBuffer)
+{
+    if (Cull.InstanceCount == 0 || CullPipeline == VK_NULL_HANDLE)
+        return;
+    FrameResources &frame = Frames[CurrentFrame];
+
+    // Written here rather than in Prepare, which runs before the pyramid is sized for this frame
+    const DepthPyramid &pyramid = Owner->Pyramid;
+    float depthScale = Projection.M[2][2];
+    float depthOffset = Projection.M[3][2];
+    float zNear = depthScale != 0.0f ? depthOffset / depthScale : 0.1f;
+    Occlusion = Owner->Constants.Push(OcclusionConstants{View,
+                                                         {Projection.M[0][0], Projection.M[1][1], depthScale, depthOffset},
+                                                         {(float)pyramid.GetExtent(CurrentFrame).width, (float)pyramid.GetExtent(CurrentFrame).height, (float)pyramid.GetLevelCount(CurrentFrame), zNear}});
+    if (!Occlusion)
+        Cull.OcclusionCull = 0; // the constant ring overflowed: everything in the frustum is drawn in phase 0
+
+    vkCmdFillBuffer(commandBuffer, frame.Counters.Buffer, 0, VK_WHOLE_SIZE, 0);
+    if (!HistoryCleared)
+    {
+        vkCmdFillBuffer(commandBuffer, History.Buffer, 0, VK_WHOLE_SIZE, 0);
+        HistoryCleared = true;
+    }
+    // The history was last written by the previous frame's occlusion culling
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    RecordCullingPhase(commandBuffer, 0);
+}
+
+void MeshRenderer::RecordOcclusionCulling(VkCommandBuffer commandBuffer)
+{
+    if (Cull.InstanceCount == 0 || CullPipeline == VK_NULL_HANDLE || !IsOcclusionCulling())
+        return;
+    // Phase 1 still writes its (empty) commands when the constants overflowed; the late pass draws them
+    RecordCullingPhase(commandBuffer, 1);
+}
+
+void MeshRenderer::RecordCullingPhase(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+    FrameResources &frame = Frames[CurrentFrame];
+    CullConstants constants = Cull;
+    constants.Phase = phase;
+
+    VkDescriptorSet sets[3] = {frame.DescriptorSet, Owner->Pyramid.GetSet(CurrentFrame), Owner->Constants.GetSet()};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullLayout, 0, 3, sets, 1, &Occlusion.Offset);
+    vkCmdPushConstants(commandBuffer, CullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipeline);
+    vkCmdDispatch(commandBuffer, (Cull.InstanceCount + 63) / 64, 1, 1);
+
+    if (GpuDriven)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CompactPipeline);
+        vkCmdDispatch(commandBuffer, (Cull.DrawCount + 63) / 64, 1, 1);
+    }
+}
+
+void MeshRenderer::RecordDraws(VkCommandBuffer commandBuffer, const DrawBatch &batch, uint32_t phase)
+{
+    // The late pass's SceneLoadRenderPass is compatible with either variant
+    bool offscreen = batch.RenderPass != Owner->RenderPass;
+    const FrameResources &frame = Frames[CurrentFrame];
+    if (!Camera)
+        return; // the constant ring overflowed this frame
+
+    VkViewport viewport{0.0f, 0.0f, (float)batch.Extent.width, (float)batch.Extent.height, 0.0f, 1.0f};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor{{0, 0}, batch.Extent};
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &VertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 0, 1, &frame.DescriptorSet, 0, nullptr);
+    VkDescriptorSet constantSet = Owner->Constants.GetSet();
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 2, 1, &constantSet, 1, &Camera.Offset);
+    if (Bindless)
+    {
+        VkDescriptorSet bindlessSet = Owner->Descriptors.GetSet();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 1, 1, &bindlessSet, 0, nullptr);
+    }
+    VkDescriptorSet lightSet = Owner->Lights.GetSet();
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 3, 1, &lightSet, 0, nullptr);
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    for (uint32_t i = batch.Begin; i < batch.End; i++)
+    {
+        const Segment &segment = Segments[i];
+        const Material &material = Materials[segment.Material];
+        VkPipeline pipeline = Owner->Pipelines.Get(offscreen ? material.Offscreen : material.SwapChain);
+        if (pipeline == VK_NULL_HANDLE)
+            continue; // compiling, no fallback
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        // Resources are picked by handle, so changing material never rebinds descriptors
+        if (Bindless)
+            vkCmdPushConstants(commandBuffer, Layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MaterialConstants), &material.Constants);
+
+        VkDeviceSize commandOffset = (VkDeviceSize)(phase * Cull.DrawCount + segment.FirstDraw) * stride;
+        if (IndirectCount)
+        {
+            VkDeviceSize countOffset = (VkDeviceSize)((1 + phase) * Cull.DrawCount + i) * sizeof(uint32_t);
+            vkCmdDrawIndexedIndirectCount(commandBuffer, frame.Indirect.Buffer, commandOffset, frame.Counters.Buffer, countOffset, segment.DrawCount, stride);
+        }
+        else if (GpuDriven)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.Indirect.Buffer, commandOffset, segment.DrawCount, stride);
+        }
+        else
+        {
+            for (uint32_t draw = segment.FirstDraw; draw < segment.FirstDraw + segment.DrawCount; draw++)
+            {
+                const DrawCommand &command = Commands[draw];
+                const Mesh &mesh = Meshes[command.Mesh];
+                vkCmdDrawIndexed(commandBuffer, mesh.IndexCount, command.InstanceCount, mesh.FirstIndex, mesh.VertexOffset, command.FirstInstance);
+            }
+        }
+    }
+}
+
+void MeshRenderer::BuildCube(std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices)
+{
+    // Per face: normal, then two tangents with u x v == normal so the quad winds counter-clockwise from outside
+    const float faces[6][3][3] = {
+        {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+        {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+        {{0, 1, 0}, {0, 0, 1}, {1, 0, 0}},
+        {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+        {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+        {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},
+    };
+    const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+
+    vertices.clear();
+    indices.clear();
+    for (const auto &face : faces)
+    {
+        uint32_t base = static_cast<uint32_t>(vertices.size());
+        for (const auto &corner : corners)
+        {
+            MeshVertex vertex{};
+            for (int axis = 0; axis < 3; axis++)
+            {
+                vertex.Position[axis] = 0.5f * (face[0][axis] + corner[0] * face[1][axis] + corner[1] * face[2][axis]);
+                vertex.Normal[axis] = face[0][axis];
+            }
+            vertex.UV[0] = 0.5f * (corner[0] + 1.0f);
+            vertex.UV[1] = 0.5f * (corner[1] + 1.0f);
+            vertices.push_back(vertex);
+        }
+        indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+    }
+}
+
+void MeshRenderer::BuildSphere(uint32_t rings, uint32_t segments, std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices)
+{
+    vertices.clear();
+    indices.clear();
+    for (uint32_t ring = 0; ring <= rings; ring++)
+    {
+        float v = (float)ring / rings;
+        float phi = v * Math::Pi;
+        for (uint32_t segment = 0; segment <= segments; segment++)
+        {
+            float u = (float)segment / segments;
+            float theta = u * 2.0f * Math::Pi;
+            Math::Vec3 normal{std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)};
+
+            MeshVertex vertex{};
+            vertex.Position[0] = normal.X * 0.5f;
+            vertex.Position[1] = normal.Y * 0.5f;
+            vertex.Position[2] = normal.Z * 0.5f;
+            vertex.Normal[0] = normal.X;
+            vertex.Normal[1] = normal.Y;
+            vertex.Normal[2] = normal.Z;
+            vertex.UV[0] = u;
+            vertex.UV[1] = v;
+            vertices.push_back(vertex);
+        }
+    }
+
+    uint32_t stride = segments + 1;
+    for (uint32_t ring = 0; ring < rings; ring++)
+    {
+        for (uint32_t segment = 0; segment < segments; segment++)
+        {
+            uint32_t a = ring * stride + segment;
+            uint32_t b = a + stride;
+            indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+}
@@ -0,0 +1,294 @@
+#pragma once
+#include "Bindless.h"
+#include "CommandRecorder.h"
+#include "ConstantRing.h"
+#include "GpuAllocator.h"
+#include "PipelineLibrary.h"
+#include "ShaderReflection.h"
+#include "TextureStreamer.h"
+#include <Math/Math.h>
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Vulkan;
+
+struct MeshVertex
+{
+    float Position[3];
+    float Normal[3];
+    float UV[2];
+};
+
+struct MeshHandle
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+struct MaterialHandle
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+struct MaterialDesc
+{
+    std::string Name;
+    ShaderCode VertexShader; // SPIR-V (Vulkan::Shaders.Get); null uses Shaders/mesh.vert
+    ShaderCode FragmentShader;
+    // Per-material constants for `layout(constant_id)` in the shaders; one SPIR-V serves every variant
+    std::vector<SpecializationConstant> Specialization;
+    bool BlendEnable = false;
+    VkCullModeFlags CullMode = VK_CULL_MODE_BACK_BIT;
+    // Bindless base color texture, multiplied into the instance color by Shaders/mesh_textured.frag.
+    // Ignored when bindless descriptors are unavailable; the sampler defaults to linear/repeat.
+    BindlessHandle BaseColor;
+    BindlessHandle BaseColorSampler;
+    // Streamed base color (Vulkan::Textures) used instead of BaseColor. Drawing the material requests its
+    // finest mip, and its bindless slot, which changes with the resident mips, is looked up every frame.
+    TextureHandle BaseColorTexture;
+};
+
+// Draws game meshes. Geometry lives in two device-local mega-buffers (one vertex, one index) that
+// meshes are appended to; per-instance data goes to a per-frame storage buffer. Each frame the
+// submitted instances are sorted by material and mesh, and every run of equal keys becomes one draw.
+//
+// Culling and draw submission are GPU-driven: a compute pass tests every instance's bounding sphere
+// against the frustum, writes the survivors' indices per draw, and turns the counts into
+// VkDrawIndexedIndirectCommands compacted per material, so the scene pass records one
+// vkCmdDrawIndexedIndirectCount per material whatever the draw count. Without drawIndirectCount
+// every draw keeps its slot (culled ones draw zero instances); without multiDrawIndirect or
+// drawIndirectFirstInstance draws are recorded one by one on the CPU, unculled.
+//
+// GPU-driven culling is also occlusion culling, in two phases. The scene pass draws the instances that
+// were visible last frame; Vulkan::Pyramid is built from its depth; RecordOcclusionCulling tests every
+// instance in the frustum against the pyramid, keeps the result for the next frame and lists the
+// visible ones the first phase skipped, which LateDraws() draws in a second scene pass. Instances are
+// matched across frames by submission order, so a scene submitted in a stable order culls best; any
+// order is still drawn correctly. STELA_OCCLUSION_CULLING=0 turns it off.
+//
+// Shading adds the clustered point and spot lights of Vulkan::Lights (set 3) to a fixed sun.
+//
+// CreateMesh, CreateMaterial, Submit and SetCamera are main-thread only.
+class MeshRenderer
+{
+public:
+    void Init(Vulkan &vulkan);
+    // After Pipelines.Shutdown: compile jobs may still reference the pipeline layout until then
+    void Destroy();
+
+    // Goes through Vulkan::Uploads; never waits on the GPU
+    MeshHandle CreateMesh(const std::vector<MeshVertex> &vertices, const std::vector<uint32_t> &indices);
+    MaterialHandle CreateMaterial(const MaterialDesc &desc);
+    MaterialHandle DefaultMaterial() const { return Default; }
+
+    // Queues one instance for the next frame
+    void Submit(MeshHandle mesh, MaterialHandle material, const Math::Mat4 &transform, const Math::Vec4 &color);
+    // `projection` is a Math::Perspective matrix; the lights are binned in its view space
+    void SetCamera(const Math::Mat4 &view, const Math::Mat4 &projection);
+    const Math::Mat4 &GetView() const { return View; }
+    const Math::Mat4 &GetProjection() const { return Projection; }
+
+    // Sorts this frame's submissions, fills the frame's instance and draw buffers and builds the draw list.
+    // Called by Vulkan::DrawFrame once the frame's fence has been waited on.
+    void Prepare(uint32_t frameIndex);
+    // Culls the prepared frame into its indirect buffers; before the scene pass, outside any render pass.
+    // Making the results visible to the draws is the caller's job (the frame graph's MeshCulling pass).
+    void RecordCulling(VkCommandBuffer commandBuffer);
+    // Second phase, once Vulkan::Pyramid holds the depth of the first one's draws
+    void RecordOcclusionCulling(VkCommandBuffer commandBuffer);
+    void SetFrustumCulling(bool enabled) { FrustumCulling = enabled; }
+    // Takes effect from the next Prepare
+    void SetOcclusionCulling(bool enabled) { OcclusionCulling = enabled; }
+    bool IsOcclusionCulling() const { return GpuDriven && OcclusionCulling; }
+    bool IsGpuDriven() const { return GpuDriven; }
+
+    const DrawList &Draws() const { return List; }
+    const DrawList &LateDraws() const { return LateList; }
+    // Before culling: draws that may reach the GPU, and instances submitted
+    uint32_t DrawCount() const { return static_cast<uint32_t>(Commands.size()); }
+    uint32_t InstanceCount() const { return LastInstanceCount; }
+
+    // Cube and UV sphere centred on the origin, radius/half-extent 0.5
+    static void BuildCube(std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices);
+    static void BuildSphere(uint32_t rings, uint32_t segments, std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices);
+
+private:
+    // std430 layout of `Instance` in mesh.vert and mesh_cull.comp
+    struct InstanceData
+    {
+        Math::Mat4 Model;
+        Math::Vec4 Color;
+        uint32_t Draw;
+        uint32_t Id; // submission index, for the occlusion history
+        uint32_t Padding[2];
+    };
+
+    // std430 layout of `Draw` in mesh_cull.comp and mesh_compact.comp
+    struct GpuDraw
+    {
+        uint32_t IndexCount;
+        uint32_t FirstIndex;
+        int32_t VertexOffset;
+        uint32_t FirstInstance;
+        uint32_t Segment;
+        uint32_t SegmentBase;
+        uint32_t Padding[2];
+        float Bounds[4];
+    };
+
+    // Push constants shared by both culling shaders
+    struct CullConstants
+    {
+        float Planes[6][4];
+        uint32_t InstanceCount;
+        uint32_t DrawCount;
+        uint32_t FrustumCull;
+        uint32_t Compact;
+        uint32_t Phase;
+        uint32_t OcclusionCull;
+    };
+
+    // `Occlusion` uniform block in mesh_cull.comp
+    struct OcclusionConstants
+    {
+        Math::Mat4 View;
+        float Projection[4];  // P[0][0], P[1][1], P[2][2], P[3][2]
+        float PyramidSize[4]; // level 0 width and height, level count, near plane
+    };
+
+    struct Mesh
+    {
+        int32_t VertexOffset;
+        uint32_t FirstIndex;
+        uint32_t IndexCount;
+        float Bounds[4]; // object-space bounding sphere
+    };
+
+    // `Camera` uniform block in mesh.vert
+    struct CameraConstants
+    {
+        Math::Mat4 ViewProjection;
+        Math::Mat4 View;
+    };
+
+    // `Material` push constant block in mesh_textured.frag
+    struct MaterialConstants
+    {
+        uint32_t BaseColor = 0;
+        uint32_t BaseColorSampler = 0;
+    };
+
+    struct Material
+    {
+        PipelineHandle Offscreen; // Editor viewport pass
+        PipelineHandle SwapChain; // Runtime pass
+        MaterialConstants Constants;
+        TextureHandle Texture; // refreshes Constants.BaseColor in Prepare
+    };
+
+    struct Submission
+    {
+        uint64_t Key; // material << 32 | mesh
+        uint32_t Instance;
+    };
+
+    struct DrawCommand
+    {
+        uint32_t Material;
+        uint32_t Mesh;
+        uint32_t FirstInstance;
+        uint32_t InstanceCount;
+    };
+
+    // Consecutive draws sharing a material: one pipeline bind and one indirect draw
+    struct Segment
+    {
+        uint32_t Material;
+        uint32_t FirstDraw;
+        uint32_t DrawCount;
+    };
+
+    struct FrameBuffer
+    {
+        VkBuffer Buffer = VK_NULL_HANDLE;
+        GpuAllocation Allocation;
+    };
+
+    struct FrameResources
+    {
+        FrameBuffer Instances; // InstanceData, written by the CPU
+        FrameBuffer Visible;   // uint per instance, written by culling
+        uint32_t InstanceCapacity = 0;
+        FrameBuffer Draws;     // GpuDraw, written by the CPU
+        FrameBuffer Counters;  // uint per draw, per segment for each phase, then phase 0's count per draw
+        FrameBuffer Indirect;  // VkDrawIndexedIndirectCommand per draw for each phase
+        uint32_t DrawCapacity = 0;
+        VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+    };
+
+    void EnsureCapacity(FrameResources &frame, uint32_t instances, uint32_t draws);
+    void EnsureHistory(uint32_t instances);
+    void Reallocate(FrameBuffer &buffer, VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memoryUsage);
+    void Release(FrameBuffer &buffer);
+    VkPipeline CreateCullPipeline(const ShaderCode &code);
+    void RecordCullingPhase(VkCommandBuffer commandBuffer, uint32_t phase);
+    void RecordDraws(VkCommandBuffer commandBuffer, const DrawBatch &batch, uint32_t phase);
+
+    static constexpr VkDeviceSize VertexBufferSize = 64ull * 1024 * 1024;
+    static constexpr VkDeviceSize IndexBufferSize = 32ull * 1024 * 1024;
+
+    Vulkan *Owner = nullptr;
+    VkBuffer VertexBuffer = VK_NULL_HANDLE;
+    VkBuffer IndexBuffer = VK_NULL_HANDLE;
+    GpuAllocation VertexAllocation;
+    GpuAllocation IndexAllocation;
+    uint32_t VertexCount = 0;
+    uint32_t IndexCount = 0;
+
+    // Layouts are owned by Vulkan::Layouts
+    VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout Layout = VK_NULL_HANDLE;
+    VkPipelineLayout CullLayout = VK_NULL_HANDLE;
+    VkPipeline CullPipeline = VK_NULL_HANDLE;
+    VkPipeline CompactPipeline = VK_NULL_HANDLE;
+    bool GpuDriven = false;
+    bool IndirectCount = false;
+    bool FrustumCulling = true;
+    bool OcclusionCulling = true;
+    bool Bindless = false; // set 1 is Vulkan::Descriptors; set 3 is always Vulkan::Lights
+    ShaderCode DefaultVertexShader;
+    ShaderCode DefaultFragmentShader;
+    ShaderCode TexturedFragmentShader;
+    std::vector<ReflectedInput> VertexInputs; // of DefaultVertexShader
+
+    std::vector<Mesh> Meshes;
+    std::vector<Material> Materials;
+    MaterialHandle Default;
+
+    std::vector<FrameResources> Frames;
+    // uint per instance id: visible in the last occlusion test. Shared by all frames, which run in order.
+    FrameBuffer History;
+    uint32_t HistoryCapacity = 0;
+    bool HistoryCleared = false;
+    uint32_t CurrentFrame = 0;
+    std::vector<InstanceData> Pending;
+    std::vector<Submission> Submissions;
+    std::vector<DrawCommand> Commands;
+    std::vector<Segment> Segments;
+    CullConstants Cull{};
+    uint32_t LastInstanceCount = 0;
+    Math::Mat4 View = Math::Mat4::Identity();
+    Math::Mat4 Projection = Math::Mat4::Identity();
+    Math::Mat4 ViewProjection = Math::Mat4::Identity();
+    ConstantAllocation Camera; // CameraConstants in this frame's constant ring region
+    ConstantAllocation Occlusion; // OcclusionConstants, written when culling is recorded
+    DrawList List;
+    DrawList LateList;
+};
@@ -0,0 +1,241 @@
+#include "PipelineCache.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr uint32_t FileMagic = 0x43505453; // "STPC"
+    constexpr uint32_t FileVersion = 1;
+
+    // Precedes the driver's blob on disk. The driver validates its own header too, but not every
+    // driver survives a truncated or corrupted blob, so we check before handing it over.
+    struct FileHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t VendorID;
+        uint32_t DeviceID;
+        uint32_t DriverVersion;
+        uint8_t PipelineCacheUUID[VK_UUID_SIZE];
+        uint32_t Reserved;
+        uint64_t DataSize;
+        uint64_t Checksum;
+    };
+
+    uint64_t Fnv1a(const uint8_t *data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string CacheFileName(const VkPhysicalDeviceProperties &properties)
+    {
+        char name[128];
+        int length = std::snprintf(name, sizeof(name), "pipelines_%04x_%04x_", properties.vendorID, properties.deviceID);
+        for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+            length += std::snprintf(name + length, sizeof(name) - length, "%02x", properties.pipelineCacheUUID[i]);
+        return std::string(name) + ".bin";
+    }
+}
+
+void PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, const std::string &directory)
+{
+    Device = device;
+    pAllocator = allocator;
+    vkGetPhysicalDeviceProperties(physicalDevice, &Properties);
+    Path = (fs::path(directory) / CacheFileName(Properties)).string();
+    LastCheck = std::chrono::steady_clock::now();
+
+    std::string error;
+    if (Load(error))
+        return;
+
+    if (!error.empty())
+        STELA_LOG_WARNING(Render, "Ignoring pipeline cache %s: %s", Path.c_str(), error.c_str());
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(Device, &createInfo, pAllocator, &Cache) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+}
+
+bool PipelineCache::Load(std::string &error)
+{
+    static Metrics::Gauge &loadedBytes = Metrics::GetGauge("stela_pipeline_cache_loaded_bytes", "Size of the pipeline cache blob loaded at startup, in bytes");
+
+    std::ifstream file(Path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false; // first run on this device/driver
+
+    std::streamsize fileSize = file.tellg();
+    file.seekg(0);
+    FileHeader header{};
+    if (fileSize < (std::streamsize)sizeof(header) || !file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    {
+        error = "truncated header";
+        return false;
+    }
+    if (header.Magic != FileMagic || header.Version != FileVersion)
+    {
+        error = "unknown format";
+        return false;
+    }
+    if (header.VendorID != Properties.vendorID || header.DeviceID != Properties.deviceID || header.DriverVersion != Properties.driverVersion ||
+        std::memcmp(header.PipelineCacheUUID, Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        error = "written by a different device or driver";
+        return false;
+    }
+    if (header.DataSize != (uint64_t)(fileSize - (std::streamsize)sizeof(header)))
+    {
+        error = "size mismatch";
+        return false;
+    }
+
+    std::vector<uint8_t> data(header.DataSize);
+    if (!file.read(reinterpret_cast<char *>(data.data()), (std::streamsize)data.size()) || Fnv1a(data.data(), data.size()) != header.Checksum)
+    {
+        error = "checksum mismatch";
+        return false;
+    }
+
+    // The driver's own header (VkPipelineCacheHeaderVersionOne) must agree as well
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader))
+    {
+        error = "blob too small";
+        return false;
+    }
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerSize < sizeof(driverHeader) || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.vendorID != Properties.vendorID || driverHeader.deviceID != Properties.deviceID ||
+        std::memcmp(driverHeader.pipelineCacheUUID, Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        error = "driver header mismatch";
+        return false;
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+    if (vkCreatePipelineCache(Device, &createInfo, pAllocator, &Cache) != VK_SUCCESS)
+    {
+        Cache = VK_NULL_HANDLE;
+        error = "rejected by the driver";
+        return false;
+    }
+
+    SavedSize = data.size();
+    loadedBytes.Set((double)data.size());
+    STELA_LOG_INFO(Render, "Loaded pipeline cache (%zu KB)", data.size() / 1024);
+    return true;
+}
+
+bool PipelineCache::Save()
+{
+    static Metrics::Counter &saves = Metrics::GetCounter("stela_pipeline_cache_saves_total", "Pipeline cache blobs written to disk");
+
+    std::lock_guard<std::mutex> lock(SaveMutex);
+    if (!Cache)
+        return false;
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(Device, Cache, &size, nullptr) != VK_SUCCESS || size == 0 || size == SavedSize)
+        return false;
+
+    // The cache can grow between the two calls; VK_INCOMPLETE then just means a later save picks up the rest
+    std::vector<uint8_t> data(size);
+    VkResult result = vkGetPipelineCacheData(Device, Cache, &size, data.data());
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+        return false;
+    data.resize(size);
+
+    FileHeader header{};
+    header.Magic = FileMagic;
+    header.Version = FileVersion;
+    header.VendorID = Properties.vendorID;
+    header.DeviceID = Properties.deviceID;
+    header.DriverVersion = Properties.driverVersion;
+    std::memcpy(header.PipelineCacheUUID, Properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.DataSize = data.size();
+    header.Checksum = Fnv1a(data.data(), data.size());
+
+    std::error_code ec;
+    fs::create_directories(fs::path(Path).parent_path(), ec);
+
+    std::string temporary = Path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(data.data()), (std::streamsize)data.size());
+        file.flush();
+        if (!file.good())
+        {
+            STELA_LOG_WARNING(Render, "Failed to write pipeline cache %s", temporary.c_str());
+            file.close();
+            fs::remove(temporary, ec);
+            return false;
+        }
+    }
+
+    fs::rename(temporary, Path, ec);
+    if (ec)
+    {
+        STELA_LOG_WARNING(Render, "Failed to replace pipeline cache %s: %s", Path.c_str(), ec.message().c_str());
+        fs::remove(temporary, ec);
+        return false;
+    }
+
+    SavedSize = data.size();
+    saves.Add();
+    STELA_LOG_DEBUG(Render, "Saved pipeline cache (%zu KB)", data.size() / 1024);
+    return true;
+}
+
+void PipelineCache::Tick()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!Cache || now - LastCheck < SaveInterval)
+        return;
+    LastCheck = now;
+
+    bool expected = false;
+    if (!Saving.compare_exchange_strong(expected, true))
+        return;
+
+    PendingSave.Add();
+    Jobs::Submit([this]
+    {
+        Save();
+        Saving = false;
+        PendingSave.Done();
+    });
+}
+
+void PipelineCache::Destroy()
+{
+    if (!Cache)
+        return;
+
+    PendingSave.Wait();
+    Save();
+    vkDestroyPipelineCache(Device, Cache, pAllocator);
+    Cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <Jobs/JobSystem.h>
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// VkPipelineCache persisted across runs. The blob is stored per GPU and driver
+// (pipelines_<vendor>_<device>_<cacheUUID>.bin) behind a small header with a checksum; anything that
+// does not match the running device is ignored and the cache starts empty. One cache is shared by
+// every pipeline the engine and the Editor create.
+class PipelineCache
+{
+public:
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, const std::string &directory);
+    // Waits for a background save, writes the final blob and destroys the cache
+    void Destroy();
+
+    // Writes the blob if it grew since the last save. Write-then-rename, so a crash never leaves a torn file.
+    bool Save();
+    // Once per frame: saves on the job system every SaveInterval when new pipelines were compiled
+    void Tick();
+
+    VkPipelineCache Handle() const { return Cache; }
+
+    std::chrono::seconds SaveInterval{30};
+
+private:
+    bool Load(std::string &error);
+
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkPipelineCache Cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties Properties{};
+    std::string Path;
+
+    std::mutex SaveMutex;
+    size_t SavedSize = 0;
+    std::atomic<bool> Saving{false};
+    Jobs::WaitGroup PendingSave;
+    std::chrono::steady_clock::time_point LastCheck;
+};
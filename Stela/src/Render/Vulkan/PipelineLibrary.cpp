@@ -0,0 +1,637 @@
+#include "PipelineLibrary.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    struct Hasher
+    {
+        uint64_t Value = 14695981039346656037ull;
+
+        void Bytes(const void *data, size_t size)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                Value ^= bytes[i];
+                Value *= 1099511628211ull;
+            }
+        }
+
+        template <typename T>
+        void Add(const T &value) { Bytes(&value, sizeof(value)); }
+
+        void Code(const ShaderCode &code)
+        {
+            if (code)
+                Bytes(code->data(), code->size());
+            Add(code ? code->size() : 0);
+        }
+
+        void Specialization(const std::vector<SpecializationConstant> &constants)
+        {
+            for (const SpecializationConstant &constant : constants)
+                Add(constant);
+            Add(constants.size());
+        }
+    };
+
+    // Fixed-function state for one description; filled in place because the create infos point into it
+    struct FixedState
+    {
+        VkPipelineVertexInputStateCreateInfo VertexInput{};
+        VkPipelineInputAssemblyStateCreateInfo InputAssembly{};
+        VkPipelineViewportStateCreateInfo Viewport{};
+        VkPipelineRasterizationStateCreateInfo Rasterization{};
+        VkPipelineMultisampleStateCreateInfo Multisample{};
+        VkPipelineDepthStencilStateCreateInfo DepthStencil{};
+        VkPipelineColorBlendAttachmentState BlendAttachment{};
+        VkPipelineColorBlendStateCreateInfo ColorBlend{};
+        VkDynamicState DynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo Dynamic{};
+        std::vector<VkSpecializationMapEntry> SpecializationEntries;
+        std::vector<uint32_t> SpecializationData;
+        VkSpecializationInfo Specialization{};
+
+        explicit FixedState(const GraphicsPipelineDesc &desc)
+        {
+            for (const SpecializationConstant &constant : desc.Specialization)
+            {
+                uint32_t offset = static_cast<uint32_t>(SpecializationData.size() * sizeof(uint32_t));
+                SpecializationEntries.push_back({constant.Id, offset, sizeof(uint32_t)});
+                SpecializationData.push_back(constant.Value);
+            }
+            Specialization.mapEntryCount = static_cast<uint32_t>(SpecializationEntries.size());
+            Specialization.pMapEntries = SpecializationEntries.data();
+            Specialization.dataSize = SpecializationData.size() * sizeof(uint32_t);
+            Specialization.pData = SpecializationData.data();
+
+            VertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            VertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.Bindings.size());
+            VertexInput.pVertexBindingDescriptions = desc.Bindings.data();
+            VertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.Attributes.size());
+            VertexInput.pVertexAttributeDescriptions = desc.Attributes.data();
+
+            InputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+            InputAssembly.topology = desc.Topology;
+
+            Viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+            Viewport.viewportCount = 1;
+            Viewport.scissorCount = 1;
+
+            Rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+            Rasterization.polygonMode = desc.PolygonMode;
+            Rasterization.cullMode = desc.CullMode;
+            Rasterization.frontFace = desc.FrontFace;
+            Rasterization.lineWidth = 1.0f;
+
+            Multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+            Multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            DepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+            DepthStencil.depthTestEnable = desc.DepthTest ? VK_TRUE : VK_FALSE;
+            DepthStencil.depthWriteEnable = desc.DepthWrite ? VK_TRUE : VK_FALSE;
+            DepthStencil.depthCompareOp = desc.DepthCompare;
+            DepthStencil.maxDepthBounds = 1.0f;
+
+            BlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            if (desc.BlendEnable)
+            {
+                BlendAttachment.blendEnable = VK_TRUE;
+                BlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                BlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                BlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+                BlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                BlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                BlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+            }
+
+            ColorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+            ColorBlend.logicOp = VK_LOGIC_OP_COPY;
+            ColorBlend.attachmentCount = 1;
+            ColorBlend.pAttachments = &BlendAttachment;
+
+            Dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+            Dynamic.dynamicStateCount = 2;
+            Dynamic.pDynamicStates = DynamicStates;
+        }
+
+        const VkSpecializationInfo *SpecializationInfo() const { return SpecializationEntries.empty() ? nullptr : &Specialization; }
+    };
+
+    VkPipelineShaderStageCreateInfo ShaderStage(VkShaderStageFlagBits stage, VkShaderModule module, const VkSpecializationInfo *specialization)
+    {
+        VkPipelineShaderStageCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        info.stage = stage;
+        info.module = module;
+        info.pName = "main";
+        info.pSpecializationInfo = specialization;
+        return info;
+    }
+
+    bool SameCode(const ShaderCode &a, const ShaderCode &b)
+    {
+        return a == b || (a && b && *a == *b);
+    }
+
+    // Vulkan structs without padding or pointers, compared as the bytes Hash reads
+    template <typename T>
+    bool SameArray(const std::vector<T> &a, const std::vector<T> &b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+
+    Metrics::Histogram &CompileTime()
+    {
+        static Metrics::Histogram &histogram = Metrics::GetHistogram("stela_pipeline_compile_us", "Time to build a graphics pipeline on a worker, in microseconds");
+        return histogram;
+    }
+}
+
+uint64_t GraphicsPipelineDesc::Hash() const
+{
+    Hasher hasher;
+    hasher.Code(VertexShader);
+    hasher.Code(FragmentShader);
+    hasher.Specialization(Specialization);
+    for (const auto &binding : Bindings)
+        hasher.Add(binding);
+    for (const auto &attribute : Attributes)
+        hasher.Add(attribute);
+    hasher.Add(Bindings.size());
+    hasher.Add(Attributes.size());
+    hasher.Add(Topology);
+    hasher.Add(PolygonMode);
+    hasher.Add(CullMode);
+    hasher.Add(FrontFace);
+    hasher.Add(BlendEnable);
+    hasher.Add(DepthTest);
+    hasher.Add(DepthWrite);
+    hasher.Add(DepthCompare);
+    hasher.Add(Layout);
+    hasher.Add(RenderPass);
+    hasher.Add(Subpass);
+    return hasher.Value;
+}
+
+bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc &other) const
+{
+    return SameCode(VertexShader, other.VertexShader) && SameCode(FragmentShader, other.FragmentShader) &&
+           SameArray(Specialization, other.Specialization) && SameArray(Bindings, other.Bindings) && SameArray(Attributes, other.Attributes) &&
+           Topology == other.Topology && PolygonMode == other.PolygonMode && CullMode == other.CullMode && FrontFace == other.FrontFace &&
+           BlendEnable == other.BlendEnable && DepthTest == other.DepthTest && DepthWrite == other.DepthWrite && DepthCompare == other.DepthCompare &&
+           Layout == other.Layout && RenderPass == other.RenderPass && Subpass == other.Subpass;
+}
+
+void PipelineLibrary::Init(VkDevice device, const VkAllocationCallbacks *allocator, VkPipelineCache cache, bool graphicsPipelineLibrary)
+{
+    Device = device;
+    pAllocator = allocator;
+    Cache = cache;
+    GraphicsPipelineLibrary = graphicsPipelineLibrary;
+    if (graphicsPipelineLibrary)
+        STELA_LOG_INFO(Render, "Using VK_EXT_graphics_pipeline_library");
+}
+
+void PipelineLibrary::Shutdown()
+{
+    InFlight.Wait();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    for (uint32_t chunk = 0; chunk < MaxChunks; chunk++)
+    {
+        Entry *entries = Chunks[chunk].exchange(nullptr);
+        if (!entries)
+            continue;
+        for (uint32_t i = 0; i < ChunkSize; i++)
+        {
+            if (VkPipeline pipeline = entries[i].Pipeline.load())
+                vkDestroyPipeline(Device, pipeline, pAllocator);
+        }
+        delete[] entries;
+    }
+    Count = 0;
+    ByHash.clear();
+
+    for (auto &[pipeline, frame] : Retired)
+        vkDestroyPipeline(Device, pipeline, pAllocator);
+    Retired.clear();
+
+    std::lock_guard<std::mutex> partsLock(PartsMutex);
+    for (auto &[key, part] : Parts)
+    {
+        if (part->Pipeline)
+            vkDestroyPipeline(Device, part->Pipeline, pAllocator);
+    }
+    Parts.clear();
+}
+
+PipelineLibrary::Entry *PipelineLibrary::Find(PipelineHandle handle) const
+{
+    if (!handle.Valid())
+        return nullptr;
+    Entry *chunk = Chunks[handle.Index / ChunkSize].load(std::memory_order_acquire);
+    return chunk ? &chunk[handle.Index % ChunkSize] : nullptr;
+}
+
+PipelineHandle PipelineLibrary::Insert(const GraphicsPipelineDesc &desc, PipelineHandle fallback, bool &created)
+{
+    uint64_t hash = desc.Hash();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto [first, last] = ByHash.equal_range(hash);
+    for (auto it = first; it != last; ++it)
+    {
+        if (Find({it->second})->Desc == desc)
+        {
+            created = false;
+            return {it->second};
+        }
+    }
+
+    if (Count == ChunkSize * MaxChunks)
+        throw std::runtime_error("too many pipelines!");
+
+    uint32_t index = Count++;
+    Entry *chunk = Chunks[index / ChunkSize].load(std::memory_order_relaxed);
+    if (!chunk)
+    {
+        chunk = new Entry[ChunkSize];
+        Chunks[index / ChunkSize].store(chunk, std::memory_order_release);
+    }
+    chunk[index % ChunkSize].Desc = desc;
+    chunk[index % ChunkSize].Fallback = fallback;
+    ByHash.emplace(hash, index);
+
+    created = true;
+    return {index};
+}
+
+PipelineHandle PipelineLibrary::Request(const GraphicsPipelineDesc &desc, PipelineHandle fallback)
+{
+    bool created = false;
+    PipelineHandle handle = Insert(desc, fallback, created);
+    if (created)
+    {
+        Entry *entry = Find(handle);
+        Pending.fetch_add(1, std::memory_order_relaxed);
+        InFlight.Add();
+        Jobs::Submit([this, entry]
+        {
+            Compile(*entry);
+            InFlight.Done();
+        });
+    }
+    return handle;
+}
+
+PipelineHandle PipelineLibrary::RequestNow(const GraphicsPipelineDesc &desc, PipelineHandle fallback)
+{
+    // An identical request already compiling on a worker is not waited for
+    bool created = false;
+    PipelineHandle handle = Insert(desc, fallback, created);
+    if (created)
+    {
+        Pending.fetch_add(1, std::memory_order_relaxed);
+        Compile(*Find(handle));
+    }
+    return handle;
+}
+
+VkPipeline PipelineLibrary::Get(PipelineHandle handle) const
+{
+    static Metrics::Counter &fallbacks = Metrics::GetCounter("stela_pipeline_fallback_binds_total", "Draws that used a fallback pipeline or were skipped while theirs compiled");
+
+    Entry *entry = Find(handle);
+    if (!entry)
+        return VK_NULL_HANDLE;
+    if (VkPipeline pipeline = entry->Pipeline.load(std::memory_order_acquire))
+        return pipeline;
+
+    fallbacks.Add();
+    Entry *fallback = Find(entry->Fallback);
+    return fallback ? fallback->Pipeline.load(std::memory_order_acquire) : VK_NULL_HANDLE;
+}
+
+bool PipelineLibrary::IsReady(PipelineHandle handle) const
+{
+    Entry *entry = Find(handle);
+    return entry && entry->Status.load(std::memory_order_acquire) == State::Ready;
+}
+
+void PipelineLibrary::WaitIdle()
+{
+    InFlight.Wait();
+}
+
+void PipelineLibrary::ReplaceShader(const ShaderCode &previous, const ShaderCode &replacement)
+{
+    // Workers read descriptions while compiling
+    InFlight.Wait();
+
+    std::vector<Entry *> changed;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        for (uint32_t index = 0; index < Count; index++)
+        {
+            Entry &entry = *Find({index});
+            if (entry.Desc.VertexShader != previous && entry.Desc.FragmentShader != previous)
+                continue;
+
+            auto [first, last] = ByHash.equal_range(entry.Desc.Hash());
+            for (auto it = first; it != last; ++it)
+            {
+                if (it->second == index)
+                {
+                    ByHash.erase(it);
+                    break;
+                }
+            }
+            if (entry.Desc.VertexShader == previous)
+                entry.Desc.VertexShader = replacement;
+            if (entry.Desc.FragmentShader == previous)
+                entry.Desc.FragmentShader = replacement;
+            ByHash.emplace(entry.Desc.Hash(), index);
+            changed.push_back(&entry);
+        }
+    }
+
+    // The current pipeline stays published until Compile swaps in the new one and retires it
+    for (Entry *entry : changed)
+    {
+        Pending.fetch_add(1, std::memory_order_relaxed);
+        InFlight.Add();
+        Jobs::Submit([this, entry]
+        {
+            Compile(*entry);
+            InFlight.Done();
+        });
+    }
+    if (!changed.empty())
+        STELA_LOG_INFO(Render, "Rebuilding %zu pipelines for a reloaded shader", changed.size());
+}
+
+void PipelineLibrary::EndFrame(uint64_t frameNumber, uint64_t completedFrames)
+{
+    static Metrics::Gauge &pending = Metrics::GetGauge("stela_pipelines_pending", "Pipelines queued or compiling");
+    pending.Set((double)PendingCount());
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    Frame = frameNumber;
+    for (size_t i = 0; i < Retired.size();)
+    {
+        if (Retired[i].second <= completedFrames)
+        {
+            vkDestroyPipeline(Device, Retired[i].first, pAllocator);
+            Retired[i] = Retired.back();
+            Retired.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void PipelineLibrary::Publish(Entry &entry, VkPipeline pipeline)
+{
+    VkPipeline previous = entry.Pipeline.exchange(pipeline, std::memory_order_acq_rel);
+    entry.Status.store(State::Ready, std::memory_order_release);
+    if (previous)
+    {
+        // Command buffers still in flight, and the one being recorded, may reference the unoptimized link
+        std::lock_guard<std::mutex> lock(Mutex);
+        Retired.emplace_back(previous, Frame + 1);
+    }
+}
+
+VkShaderModule PipelineLibrary::CreateShaderModule(const std::vector<char> &code)
+{
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    if (vkCreateShaderModule(Device, &createInfo, pAllocator, &module) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return module;
+}
+
+void PipelineLibrary::Compile(Entry &entry)
+{
+    const GraphicsPipelineDesc &desc = entry.Desc;
+    bool published = false;
+    {
+        Metrics::ScopedTimer timer(CompileTime());
+
+        if (GraphicsPipelineLibrary)
+        {
+            Hasher vertexInput, preRaster, fragment, output;
+            for (const auto &binding : desc.Bindings)
+                vertexInput.Add(binding);
+            for (const auto &attribute : desc.Attributes)
+                vertexInput.Add(attribute);
+            vertexInput.Add(desc.Topology);
+
+            preRaster.Code(desc.VertexShader);
+            preRaster.Specialization(desc.Specialization);
+            preRaster.Add(desc.PolygonMode);
+            preRaster.Add(desc.CullMode);
+            preRaster.Add(desc.FrontFace);
+
+            fragment.Code(desc.FragmentShader);
+            fragment.Specialization(desc.Specialization);
+            fragment.Add(desc.DepthTest);
+            fragment.Add(desc.DepthWrite);
+            fragment.Add(desc.DepthCompare);
+
+            output.Add(desc.BlendEnable);
+
+            // Shader parts depend on the layout, every part on the render pass
+            for (Hasher *hasher : {&preRaster, &fragment})
+                hasher->Add(desc.Layout);
+            for (Hasher *hasher : {&vertexInput, &preRaster, &fragment, &output})
+            {
+                hasher->Add(desc.RenderPass);
+                hasher->Add(desc.Subpass);
+            }
+
+            VkPipeline parts[4] = {
+                GetPart(vertexInput.Value ^ 1, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, desc),
+                GetPart(preRaster.Value ^ 2, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, desc),
+                GetPart(fragment.Value ^ 3, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, desc),
+                GetPart(output.Value ^ 4, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, desc),
+            };
+
+            if (parts[0] && parts[1] && parts[2] && parts[3])
+            {
+                // Fast link first so draws can start, then swap in the optimized pipeline
+                if (VkPipeline fast = Link(parts, desc, false))
+                {
+                    Publish(entry, fast);
+                    published = true;
+                }
+                if (VkPipeline optimized = Link(parts, desc, true))
+                {
+                    Publish(entry, optimized);
+                    published = true;
+                }
+            }
+        }
+
+        if (!published)
+        {
+            if (VkPipeline pipeline = CreateMonolithic(desc))
+            {
+                Publish(entry, pipeline);
+                published = true;
+            }
+        }
+    }
+
+    if (!published)
+    {
+        entry.Status.store(State::Failed, std::memory_order_release);
+        STELA_LOG_ERROR(Render, "Failed to compile pipeline '%s'", desc.Name.c_str());
+    }
+    Pending.fetch_sub(1, std::memory_order_relaxed);
+}
+
+VkPipeline PipelineLibrary::CreateMonolithic(const GraphicsPipelineDesc &desc)
+{
+    if (!desc.VertexShader || !desc.FragmentShader)
+        return VK_NULL_HANDLE;
+
+    VkShaderModule vertexModule = CreateShaderModule(*desc.VertexShader);
+    VkShaderModule fragmentModule = CreateShaderModule(*desc.FragmentShader);
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    if (vertexModule && fragmentModule)
+    {
+        FixedState state(desc);
+        VkPipelineShaderStageCreateInfo stages[] = {
+            ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, vertexModule, state.SpecializationInfo()),
+            ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentModule, state.SpecializationInfo())};
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.basePipelineIndex = -1;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = &state.VertexInput;
+        pipelineInfo.pInputAssemblyState = &state.InputAssembly;
+        pipelineInfo.pViewportState = &state.Viewport;
+        pipelineInfo.pRasterizationState = &state.Rasterization;
+        pipelineInfo.pMultisampleState = &state.Multisample;
+        pipelineInfo.pDepthStencilState = &state.DepthStencil;
+        pipelineInfo.pColorBlendState = &state.ColorBlend;
+        pipelineInfo.pDynamicState = &state.Dynamic;
+        pipelineInfo.layout = desc.Layout;
+        pipelineInfo.renderPass = desc.RenderPass;
+        pipelineInfo.subpass = desc.Subpass;
+
+        if (vkCreateGraphicsPipelines(Device, Cache, 1, &pipelineInfo, pAllocator, &pipeline) != VK_SUCCESS)
+            pipeline = VK_NULL_HANDLE;
+    }
+
+    if (vertexModule)
+        vkDestroyShaderModule(Device, vertexModule, pAllocator);
+    if (fragmentModule)
+        vkDestroyShaderModule(Device, fragmentModule, pAllocator);
+    return pipeline;
+}
+
+VkPipeline PipelineLibrary::GetPart(uint64_t key, VkGraphicsPipelineLibraryFlagsEXT partFlags, const GraphicsPipelineDesc &desc)
+{
+    std::shared_ptr<LibraryPart> part;
+    {
+        std::lock_guard<std::mutex> lock(PartsMutex);
+        auto &slot = Parts[key];
+        if (!slot)
+            slot = std::make_shared<LibraryPart>();
+        part = slot;
+    }
+
+    // Other workers needing the same part wait here instead of compiling it twice
+    std::lock_guard<std::mutex> building(part->Building);
+    if (part->Pipeline)
+        return part->Pipeline;
+
+    FixedState state(desc);
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = partFlags;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    VkPipelineShaderStageCreateInfo stage{};
+    switch (partFlags)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        pipelineInfo.pVertexInputState = &state.VertexInput;
+        pipelineInfo.pInputAssemblyState = &state.InputAssembly;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        if (!desc.VertexShader || !(module = CreateShaderModule(*desc.VertexShader)))
+            return VK_NULL_HANDLE;
+        stage = ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, module, state.SpecializationInfo());
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &stage;
+        pipelineInfo.pViewportState = &state.Viewport;
+        pipelineInfo.pRasterizationState = &state.Rasterization;
+        pipelineInfo.pDynamicState = &state.Dynamic;
+        pipelineInfo.layout = desc.Layout;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        if (!desc.FragmentShader || !(module = CreateShaderModule(*desc.FragmentShader)))
+            return VK_NULL_HANDLE;
+        stage = ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, module, state.SpecializationInfo());
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &stage;
+        pipelineInfo.pMultisampleState = &state.Multisample;
+        pipelineInfo.pDepthStencilState = &state.DepthStencil;
+        pipelineInfo.layout = desc.Layout;
+        break;
+    default:
+        pipelineInfo.pMultisampleState = &state.Multisample;
+        pipelineInfo.pColorBlendState = &state.ColorBlend;
+        break;
+    }
+    pipelineInfo.renderPass = desc.RenderPass;
+    pipelineInfo.subpass = desc.Subpass;
+
+    if (vkCreateGraphicsPipelines(Device, Cache, 1, &pipelineInfo, pAllocator, &part->Pipeline) != VK_SUCCESS)
+        part->Pipeline = VK_NULL_HANDLE;
+    if (module)
+        vkDestroyShaderModule(Device, module, pAllocator);
+    return part->Pipeline;
+}
+
+VkPipeline PipelineLibrary::Link(const VkPipeline (&parts)[4], const GraphicsPipelineDesc &desc, bool optimize)
+{
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = 4;
+    linkInfo.pLibraries = parts;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = desc.Layout;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(Device, Cache, 1, &pipelineInfo, pAllocator, &pipeline) != VK_SUCCESS)
+        return VK_NULL_HANDLE;
+    return pipeline;
+}
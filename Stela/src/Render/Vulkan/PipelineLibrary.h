@@ -0,0 +1,141 @@
+#pragma once
+#include "ShaderSystem.h"
+#include <Jobs/JobSystem.h>
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A 32-bit `layout(constant_id = Id)` value, applied to both shader stages
+struct SpecializationConstant
+{
+    uint32_t Id;
+    uint32_t Value;
+};
+
+// Everything that decides a graphics pipeline. Viewport and scissor are always dynamic.
+struct GraphicsPipelineDesc
+{
+    std::string Name; // logs only, not hashed
+    ShaderCode VertexShader; // SPIR-V
+    ShaderCode FragmentShader;
+    std::vector<SpecializationConstant> Specialization;
+    std::vector<VkVertexInputBindingDescription> Bindings;
+    std::vector<VkVertexInputAttributeDescription> Attributes;
+    VkPrimitiveTopology Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode PolygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags CullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace FrontFace = VK_FRONT_FACE_CLOCKWISE;
+    bool BlendEnable = false;
+    bool DepthTest = false;
+    bool DepthWrite = false;
+    VkCompareOp DepthCompare = VK_COMPARE_OP_LESS_OR_EQUAL;
+    VkPipelineLayout Layout = VK_NULL_HANDLE;
+    VkRenderPass RenderPass = VK_NULL_HANDLE;
+    uint32_t Subpass = 0;
+
+    uint64_t Hash() const;
+    // Same fields as Hash, compared in full
+    bool operator==(const GraphicsPipelineDesc &other) const;
+};
+
+struct PipelineHandle
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+// Builds pipelines on the job system. Request returns a handle immediately; until the pipeline is
+// ready, Get returns the fallback's pipeline (a placeholder material, say) or VK_NULL_HANDLE, in which
+// case the draw is skipped. Identical descriptions share one pipeline.
+//
+// With VK_EXT_graphics_pipeline_library the four pipeline parts are compiled as libraries shared
+// between descriptions that have them in common; a fast unoptimized link is published first and
+// replaced by the link-time-optimized pipeline once that finishes. Without it, or when a part fails,
+// pipelines are created whole.
+class PipelineLibrary
+{
+public:
+    void Init(VkDevice device, const VkAllocationCallbacks *allocator, VkPipelineCache cache, bool graphicsPipelineLibrary);
+    // Waits for in-flight compiles, then destroys every pipeline. Layouts and render passes must outlive this.
+    void Shutdown();
+
+    PipelineHandle Request(const GraphicsPipelineDesc &desc, PipelineHandle fallback = {});
+    // Compiles on the calling thread (loading screens, pipelines needed this frame)
+    PipelineHandle RequestNow(const GraphicsPipelineDesc &desc, PipelineHandle fallback = {});
+
+    // Lock-free; safe from any recording thread
+    VkPipeline Get(PipelineHandle handle) const;
+    bool IsReady(PipelineHandle handle) const;
+    void WaitIdle();
+
+    // Main thread, for shader hot reload. Recompiles every pipeline built from `previous` with
+    // `replacement`, under the same handles; the old pipelines draw until the new ones are ready.
+    void ReplaceShader(const ShaderCode &previous, const ShaderCode &replacement);
+
+    // Destroys pipelines replaced by their optimized link once every frame that may have bound them has
+    // finished. `frameNumber` is the next frame to be recorded (Vulkan::FrameNumber) and
+    // `completedFrames` is Vulkan::CompletedFrames.
+    void EndFrame(uint64_t frameNumber, uint64_t completedFrames);
+
+    uint32_t PendingCount() const { return Pending.load(std::memory_order_relaxed); }
+
+private:
+    enum class State : uint8_t
+    {
+        Pending,
+        Ready,
+        Failed,
+    };
+
+    struct Entry
+    {
+        GraphicsPipelineDesc Desc;
+        PipelineHandle Fallback;
+        std::atomic<VkPipeline> Pipeline{VK_NULL_HANDLE};
+        std::atomic<State> Status{State::Pending};
+    };
+
+    // One part of a pipeline built with VK_EXT_graphics_pipeline_library, shared by hash
+    struct LibraryPart
+    {
+        std::mutex Building; // held while compiling, so other workers wait instead of compiling it twice
+        VkPipeline Pipeline = VK_NULL_HANDLE; // null until built; a failed build is retried by the next request
+    };
+
+    static constexpr uint32_t ChunkSize = 256;
+    static constexpr uint32_t MaxChunks = 256;
+
+    Entry *Find(PipelineHandle handle) const;
+    PipelineHandle Insert(const GraphicsPipelineDesc &desc, PipelineHandle fallback, bool &created);
+    void Compile(Entry &entry);
+    VkPipeline CreateMonolithic(const GraphicsPipelineDesc &desc);
+    VkPipeline GetPart(uint64_t key, VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineDesc &desc);
+    VkPipeline Link(const VkPipeline (&parts)[4], const GraphicsPipelineDesc &desc, bool optimize);
+    void Publish(Entry &entry, VkPipeline pipeline);
+    VkShaderModule CreateShaderModule(const std::vector<char> &code);
+
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkPipelineCache Cache = VK_NULL_HANDLE;
+    bool GraphicsPipelineLibrary = false;
+
+    std::mutex Mutex; // guards insertion, the hash map and Retired
+    std::atomic<Entry *> Chunks[MaxChunks] = {};
+    uint32_t Count = 0;
+    std::unordered_multimap<uint64_t, uint32_t> ByHash; // a hash hit is compared in full before sharing
+    std::vector<std::pair<VkPipeline, uint64_t>> Retired; // destroyed once CompletedFrames reaches the second
+    uint64_t Frame = 0;                                   // frame being recorded
+
+    std::mutex PartsMutex;
+    std::unordered_map<uint64_t, std::shared_ptr<LibraryPart>> Parts;
+
+    std::atomic<uint32_t> Pending{0};
+    Jobs::WaitGroup InFlight;
+};
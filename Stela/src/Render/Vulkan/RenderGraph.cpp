@@ -0,0 +1,539 @@
+#include "RenderGraph.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <Profiler/Profiler.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+struct AccessInfo
+{
+    VkPipelineStageFlags2 Stages;
+    VkAccessFlags2 Access;
+    VkImageLayout Layout;
+    bool Write;
+};
+
+// Only flags that exist in the original synchronization API, so the fallback can narrow them
+AccessInfo Describe(RenderGraphAccess access)
+{
+    switch (access)
+    {
+    case RenderGraphAccess::ColorAttachmentWrite:
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+    case RenderGraphAccess::DepthAttachmentWrite:
+        return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+    case RenderGraphAccess::DepthAttachmentRead:
+        return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false};
+    case RenderGraphAccess::FragmentSampled:
+        return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+    case RenderGraphAccess::ComputeSampled:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+    case RenderGraphAccess::ComputeStorageRead:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false};
+    case RenderGraphAccess::ComputeStorageWrite:
+        return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true};
+    case RenderGraphAccess::DrawIndirectRead:
+        return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false};
+    case RenderGraphAccess::FragmentStorageRead:
+        return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false};
+    case RenderGraphAccess::TransferRead:
+        return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+    case RenderGraphAccess::TransferWrite:
+        return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+    }
+    return {};
+}
+
+constexpr VkAccessFlags2 WriteAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+}
+
+void RenderGraph::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+    if (vulkan.Synchronization2)
+    {
+        const char *name = vulkan.ApiVersion >= VK_API_VERSION_1_3 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR";
+        CmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(Device, name);
+    }
+}
+
+void RenderGraph::Destroy()
+{
+    Reset();
+}
+
+void RenderGraph::Reset()
+{
+    ReleaseTransients();
+    Resources.clear();
+    Passes.clear();
+    Steps.clear();
+    Compiled = false;
+}
+
+RenderGraphResource RenderGraph::CreateImage(const std::string &name, const RenderGraphImageDesc &desc)
+{
+    Resource resource;
+    resource.Name = name;
+    resource.IsImage = true;
+    resource.Desc = desc;
+    Resources.push_back(resource);
+    Compiled = false;
+    return {static_cast<uint32_t>(Resources.size() - 1)};
+}
+
+RenderGraphResource RenderGraph::ImportImage(const std::string &name, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+                                             VkPipelineStageFlags2 initialStages, VkImageLayout finalLayout)
+{
+    Resource resource;
+    resource.Name = name;
+    resource.IsImage = true;
+    resource.Imported = true;
+    resource.Desc.Aspect = aspect;
+    resource.InitialLayout = initialLayout;
+    resource.InitialStages = initialStages;
+    resource.FinalLayout = finalLayout;
+    Resources.push_back(resource);
+    Compiled = false;
+    return {static_cast<uint32_t>(Resources.size() - 1)};
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(const std::string &name)
+{
+    Resource resource;
+    resource.Name = name;
+    resource.Imported = true;
+    Resources.push_back(resource);
+    Compiled = false;
+    return {static_cast<uint32_t>(Resources.size() - 1)};
+}
+
+void RenderGraph::AddPass(const std::string &name, std::vector<RenderGraphUse> uses, std::function<void(VkCommandBuffer)> execute, bool sideEffects)
+{
+    Pass pass;
+    pass.Name = name;
+    pass.Uses = std::move(uses);
+    pass.Run = std::move(execute);
+    pass.SideEffects = sideEffects;
+    Passes.push_back(std::move(pass));
+    Compiled = false;
+}
+
+void RenderGraph::MarkOutput(RenderGraphResource resource)
+{
+    Resources[resource.Index].Output = true;
+    Compiled = false;
+}
+
+void RenderGraph::SetExtent(VkExtent2D extent)
+{
+    if (extent.width == Extent.width && extent.height == Extent.height)
+        return;
+    Extent = extent;
+    Compiled = false;
+}
+
+void RenderGraph::SetImage(RenderGraphResource resource, VkImage image, VkImageView view)
+{
+    Resources[resource.Index].Image = image;
+    Resources[resource.Index].View = view;
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+    if (!Compiled)
+        Compile();
+
+    for (const Step &step : Steps)
+    {
+        RecordBarriers(commandBuffer, step.Barriers);
+        if (step.Pass == UINT32_MAX)
+            continue;
+        // Zones sit between the barriers, so a pass's time is its own work
+        const Pass &pass = Passes[step.Pass];
+        Profiler::Scope scope(pass.Name.c_str());
+        uint32_t zone = Owner->GpuTimings.BeginZone(commandBuffer, pass.Name);
+        pass.Run(commandBuffer);
+        Owner->GpuTimings.EndZone(commandBuffer, zone);
+    }
+}
+
+void RenderGraph::Compile()
+{
+    static Metrics::Gauge &passes = Metrics::GetGauge("stela_render_graph_passes", "Render graph passes that survived culling");
+    static Metrics::Gauge &barriers = Metrics::GetGauge("stela_render_graph_barriers", "Image and memory barriers the render graph records per frame");
+    static Metrics::Gauge &transientBytes = Metrics::GetGauge("stela_render_graph_transient_bytes", "Device memory backing render graph transient images, after aliasing");
+
+    Cull();
+    AllocateTransients();
+    BuildBarriers();
+    Compiled = true;
+
+    uint32_t alive = 0;
+    for (const Pass &pass : Passes)
+        alive += pass.Alive ? 1 : 0;
+    VkDeviceSize aliased = 0;
+    VkDeviceSize unaliased = 0;
+    for (const MemorySlot &slot : Slots)
+        aliased += slot.Requirements.size;
+    for (const Resource &resource : Resources)
+        unaliased += resource.Slot != UINT32_MAX ? resource.Requirements.size : 0;
+
+    passes.Set((double)alive);
+    barriers.Set((double)BarrierCount);
+    transientBytes.Set((double)aliased);
+    STELA_LOG_INFO(Render, "Render graph: %u of %zu passes, %u barriers, %llu KB transient memory (%llu KB unaliased)",
+                   alive, Passes.size(), BarrierCount, (unsigned long long)(aliased / 1024), (unsigned long long)(unaliased / 1024));
+}
+
+void RenderGraph::Cull()
+{
+    std::vector<bool> needed(Resources.size());
+    for (size_t i = 0; i < Resources.size(); i++)
+        needed[i] = Resources[i].Output;
+
+    // Backwards: a pass lives if something downstream needs what it writes. Writers keep earlier
+    // writers of the same resource alive, since a pass may load what they left behind.
+    for (size_t i = Passes.size(); i-- > 0;)
+    {
+        Pass &pass = Passes[i];
+        pass.Alive = pass.SideEffects;
+        for (const RenderGraphUse &use : pass.Uses)
+        {
+            if (Describe(use.Access).Write && needed[use.Resource.Index])
+                pass.Alive = true;
+        }
+        if (!pass.Alive)
+            continue;
+        for (const RenderGraphUse &use : pass.Uses)
+            needed[use.Resource.Index] = true;
+    }
+}
+
+void RenderGraph::AllocateTransients()
+{
+    ReleaseTransients();
+
+    for (Resource &resource : Resources)
+    {
+        resource.FirstUse = UINT32_MAX;
+        resource.LastUse = 0;
+    }
+    for (uint32_t i = 0; i < Passes.size(); i++)
+    {
+        if (!Passes[i].Alive)
+            continue;
+        for (const RenderGraphUse &use : Passes[i].Uses)
+        {
+            Resource &resource = Resources[use.Resource.Index];
+            AccessInfo info = Describe(use.Access);
+            resource.FirstUse = std::min(resource.FirstUse, i);
+            resource.LastUse = i;
+            resource.LastStages = info.Stages;
+            resource.LastWrites = info.Access & WriteAccess;
+        }
+    }
+
+    std::vector<uint32_t> transients;
+    for (uint32_t i = 0; i < Resources.size(); i++)
+    {
+        Resource &resource = Resources[i];
+        if (resource.Imported || !resource.IsImage || resource.FirstUse == UINT32_MAX)
+            continue;
+
+        VkExtent2D extent = resource.Desc.Extent.width != 0 ? resource.Desc.Extent : Extent;
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.Desc.Format;
+        imageInfo.extent = {extent.width, extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.Desc.Usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(Device, &imageInfo, pAllocator, &resource.Image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render graph image!");
+        }
+        vkGetImageMemoryRequirements(Device, resource.Image, &resource.Requirements);
+        transients.push_back(i);
+    }
+
+    // Largest first; each image joins the first slot of a compatible memory type none of whose
+    // occupants are alive during its passes
+    std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) { return Resources[a].Requirements.size > Resources[b].Requirements.size; });
+    for (uint32_t index : transients)
+    {
+        Resource &resource = Resources[index];
+        uint32_t chosen = UINT32_MAX;
+        for (uint32_t s = 0; s < Slots.size() && chosen == UINT32_MAX; s++)
+        {
+            if ((Slots[s].Requirements.memoryTypeBits & resource.Requirements.memoryTypeBits) == 0)
+                continue;
+            bool overlaps = false;
+            for (uint32_t occupant : Slots[s].Occupants)
+            {
+                const Resource &other = Resources[occupant];
+                overlaps |= resource.FirstUse <= other.LastUse && other.FirstUse <= resource.LastUse;
+            }
+            if (!overlaps)
+                chosen = s;
+        }
+        if (chosen == UINT32_MAX)
+        {
+            chosen = static_cast<uint32_t>(Slots.size());
+            Slots.emplace_back();
+            Slots.back().Requirements = resource.Requirements;
+        }
+
+        MemorySlot &slot = Slots[chosen];
+        slot.Requirements.size = std::max(slot.Requirements.size, resource.Requirements.size);
+        slot.Requirements.alignment = std::max(slot.Requirements.alignment, resource.Requirements.alignment);
+        slot.Requirements.memoryTypeBits &= resource.Requirements.memoryTypeBits;
+        slot.Occupants.push_back(index);
+        resource.Slot = chosen;
+    }
+
+    for (MemorySlot &slot : Slots)
+    {
+        std::sort(slot.Occupants.begin(), slot.Occupants.end(), [this](uint32_t a, uint32_t b) { return Resources[a].FirstUse < Resources[b].FirstUse; });
+        slot.Allocation = Owner->DeviceMemory.Allocate(slot.Requirements, GpuMemoryUsage::GpuOnly, false);
+        for (uint32_t occupant : slot.Occupants)
+        {
+            Resource &resource = Resources[occupant];
+            vkBindImageMemory(Device, resource.Image, slot.Allocation.Memory, slot.Allocation.Offset);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.Image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.Desc.Format;
+            viewInfo.subresourceRange = {resource.Desc.Aspect, 0, 1, 0, 1};
+            if (vkCreateImageView(Device, &viewInfo, pAllocator, &resource.View) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph image view!");
+            }
+        }
+    }
+}
+
+void RenderGraph::ReleaseTransients()
+{
+    bool allocated = !Slots.empty();
+    if (allocated)
+    {
+        // Frames in flight may still use them; topology changes are rare enough to wait
+        vkDeviceWaitIdle(Device);
+    }
+    for (Resource &resource : Resources)
+    {
+        if (resource.Imported || resource.Image == VK_NULL_HANDLE)
+            continue;
+        vkDestroyImageView(Device, resource.View, pAllocator);
+        vkDestroyImage(Device, resource.Image, pAllocator);
+        resource.View = VK_NULL_HANDLE;
+        resource.Image = VK_NULL_HANDLE;
+        resource.Slot = UINT32_MAX;
+    }
+    for (MemorySlot &slot : Slots)
+        Owner->DeviceMemory.Free(slot.Allocation);
+    Slots.clear();
+}
+
+void RenderGraph::BuildBarriers()
+{
+    // What the frame has done to a resource so far
+    struct State
+    {
+        VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 WriteStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 WriteAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 ReadStages = VK_PIPELINE_STAGE_2_NONE;
+        // Reads already ordered after the last write
+        VkPipelineStageFlags2 VisibleStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 VisibleAccess = VK_ACCESS_2_NONE;
+    };
+
+    std::vector<State> states(Resources.size());
+    for (uint32_t i = 0; i < Resources.size(); i++)
+    {
+        const Resource &resource = Resources[i];
+        State &state = states[i];
+        if (resource.Imported)
+        {
+            state.Layout = resource.InitialLayout;
+            state.WriteStages = resource.InitialStages;
+        }
+        else if (resource.Slot != UINT32_MAX)
+        {
+            // The memory was last used by the slot's previous occupant, or its last one in the previous frame
+            const std::vector<uint32_t> &occupants = Slots[resource.Slot].Occupants;
+            size_t position = std::find(occupants.begin(), occupants.end(), i) - occupants.begin();
+            const Resource &previous = Resources[occupants[(position + occupants.size() - 1) % occupants.size()]];
+            state.WriteStages = previous.LastStages;
+            state.WriteAccess = previous.LastWrites;
+        }
+    }
+
+    Steps.clear();
+    BarrierCount = 0;
+    for (uint32_t i = 0; i < Passes.size(); i++)
+    {
+        if (!Passes[i].Alive)
+            continue;
+        Step step{i, {}};
+        for (const RenderGraphUse &use : Passes[i].Uses)
+        {
+            const Resource &resource = Resources[use.Resource.Index];
+            State &state = states[use.Resource.Index];
+            AccessInfo info = Describe(use.Access);
+            VkImageLayout layout = resource.IsImage ? info.Layout : state.Layout;
+            bool transition = layout != state.Layout;
+
+            if (info.Write || transition)
+            {
+                // Wait for every earlier reader and writer; a fresh buffer needs nothing
+                VkPipelineStageFlags2 source = state.WriteStages | state.ReadStages;
+                if (source != VK_PIPELINE_STAGE_2_NONE || transition)
+                    step.Barriers.push_back({use.Resource.Index, source, state.WriteAccess, info.Stages, info.Access, state.Layout, layout});
+                state.Layout = layout;
+                state.WriteStages = info.Stages;
+                state.WriteAccess = info.Access & WriteAccess;
+                state.ReadStages = VK_PIPELINE_STAGE_2_NONE;
+                state.VisibleStages = info.Stages;
+                state.VisibleAccess = info.Access;
+            }
+            else
+            {
+                // Reads after reads are free; a new kind of reader needs the last write made visible to it
+                if (state.WriteStages != VK_PIPELINE_STAGE_2_NONE &&
+                    ((info.Stages & ~state.VisibleStages) != 0 || (info.Access & ~state.VisibleAccess) != 0))
+                {
+                    step.Barriers.push_back({use.Resource.Index, state.WriteStages, state.WriteAccess, info.Stages, info.Access, state.Layout, state.Layout});
+                    state.VisibleStages |= info.Stages;
+                    state.VisibleAccess |= info.Access;
+                }
+                state.ReadStages |= info.Stages;
+            }
+        }
+        Steps.push_back(std::move(step));
+    }
+
+    Step final{UINT32_MAX, {}};
+    for (uint32_t i = 0; i < Resources.size(); i++)
+    {
+        const Resource &resource = Resources[i];
+        const State &state = states[i];
+        if (resource.IsImage && resource.FinalLayout != VK_IMAGE_LAYOUT_UNDEFINED && resource.FinalLayout != state.Layout)
+            final.Barriers.push_back({i, state.WriteStages | state.ReadStages, state.WriteAccess, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, state.Layout, resource.FinalLayout});
+    }
+    Steps.push_back(std::move(final));
+
+    // Buffer hazards of one step share a single memory barrier
+    for (const Step &step : Steps)
+    {
+        bool memory = false;
+        for (const Barrier &barrier : step.Barriers)
+        {
+            if (Resources[barrier.Resource].IsImage)
+                BarrierCount++;
+            else
+                memory = true;
+        }
+        BarrierCount += memory ? 1 : 0;
+    }
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers)
+{
+    if (barriers.empty())
+        return;
+
+    std::vector<VkImageMemoryBarrier2> images;
+    VkMemoryBarrier2 memory{};
+    memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    bool hasMemory = false;
+    for (const Barrier &barrier : barriers)
+    {
+        const Resource &resource = Resources[barrier.Resource];
+        if (!resource.IsImage)
+        {
+            memory.srcStageMask |= barrier.SrcStages;
+            memory.srcAccessMask |= barrier.SrcAccess;
+            memory.dstStageMask |= barrier.DstStages;
+            memory.dstAccessMask |= barrier.DstAccess;
+            hasMemory = true;
+            continue;
+        }
+        VkImageMemoryBarrier2 image{};
+        image.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        image.srcStageMask = barrier.SrcStages;
+        image.srcAccessMask = barrier.SrcAccess;
+        image.dstStageMask = barrier.DstStages;
+        image.dstAccessMask = barrier.DstAccess;
+        image.oldLayout = barrier.OldLayout;
+        image.newLayout = barrier.NewLayout;
+        image.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image.image = resource.Image;
+        image.subresourceRange = {resource.Desc.Aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        images.push_back(image);
+    }
+
+    if (CmdPipelineBarrier2)
+    {
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.memoryBarrierCount = hasMemory ? 1 : 0;
+        dependency.pMemoryBarriers = &memory;
+        dependency.imageMemoryBarrierCount = static_cast<uint32_t>(images.size());
+        dependency.pImageMemoryBarriers = images.data();
+        CmdPipelineBarrier2(commandBuffer, &dependency);
+        return;
+    }
+
+    // One stage mask pair for the whole call; the flags used fit in the original 32-bit ones
+    VkPipelineStageFlags source = (VkPipelineStageFlags)memory.srcStageMask;
+    VkPipelineStageFlags destination = (VkPipelineStageFlags)memory.dstStageMask;
+    std::vector<VkImageMemoryBarrier> legacyImages;
+    for (const VkImageMemoryBarrier2 &image : images)
+    {
+        source |= (VkPipelineStageFlags)image.srcStageMask;
+        destination |= (VkPipelineStageFlags)image.dstStageMask;
+        VkImageMemoryBarrier legacy{};
+        legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        legacy.srcAccessMask = (VkAccessFlags)image.srcAccessMask;
+        legacy.dstAccessMask = (VkAccessFlags)image.dstAccessMask;
+        legacy.oldLayout = image.oldLayout;
+        legacy.newLayout = image.newLayout;
+        legacy.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        legacy.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        legacy.image = image.image;
+        legacy.subresourceRange = image.subresourceRange;
+        legacyImages.push_back(legacy);
+    }
+    VkMemoryBarrier legacyMemory{};
+    legacyMemory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    legacyMemory.srcAccessMask = (VkAccessFlags)memory.srcAccessMask;
+    legacyMemory.dstAccessMask = (VkAccessFlags)memory.dstAccessMask;
+    if (source == 0)
+        source = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    if (destination == 0)
+        destination = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, source, destination, 0, hasMemory ? 1 : 0, &legacyMemory, 0, nullptr,
+                         static_cast<uint32_t>(legacyImages.size()), legacyImages.data());
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include "GpuAllocator.h"
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Vulkan;
+
+struct RenderGraphResource
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+// How a pass touches a resource; each maps to pipeline stages, access flags and, for images, a layout
+enum class RenderGraphAccess
+{
+    ColorAttachmentWrite,
+    DepthAttachmentWrite,
+    DepthAttachmentRead,
+    FragmentSampled,
+    ComputeSampled,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    DrawIndirectRead, // indirect commands and counts, and storage reads in the vertex shader
+    FragmentStorageRead,
+    TransferRead,
+    TransferWrite,
+};
+
+struct RenderGraphUse
+{
+    RenderGraphResource Resource;
+    RenderGraphAccess Access;
+};
+
+// A graph-owned image that only lives within a frame
+struct RenderGraphImageDesc
+{
+    VkFormat Format = VK_FORMAT_UNDEFINED;
+    VkExtent2D Extent{0, 0}; // 0 follows SetExtent
+    VkImageUsageFlags Usage = 0;
+    VkImageAspectFlags Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+// The frame as a list of passes that declare what they read and write. Compiling the graph (once per
+// topology change, lazily from Execute) culls passes nothing consumes, turns every hazard and layout
+// change into one vkCmdPipelineBarrier2 per pass, and places transient images whose lifetimes do not
+// overlap in the same memory. Passes still begin their own render passes; those keep their
+// attachments in the attachment layout and leave every transition to the graph.
+//
+// Buffers are synchronized with global memory barriers, so an imported buffer is only a name: one
+// resource can stand for a set of per-frame buffers. Each resource may be used once per pass.
+//
+// Without synchronization2 the same barriers go through vkCmdPipelineBarrier.
+class RenderGraph
+{
+public:
+    void Init(Vulkan &vulkan);
+    // Once the device is idle
+    void Destroy();
+
+    // Topology: each of these invalidates the compiled graph
+    void Reset();
+    RenderGraphResource CreateImage(const std::string &name, const RenderGraphImageDesc &desc);
+    // `initialStages` is the last work touching the image before the frame (or a semaphore wait stage);
+    // it is moved to `finalLayout` after its last use, unless that is VK_IMAGE_LAYOUT_UNDEFINED
+    RenderGraphResource ImportImage(const std::string &name, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+                                    VkPipelineStageFlags2 initialStages, VkImageLayout finalLayout);
+    RenderGraphResource ImportBuffer(const std::string &name);
+    // Passes run in the order they are added; `sideEffects` keeps a pass that writes nothing the graph reads
+    void AddPass(const std::string &name, std::vector<RenderGraphUse> uses, std::function<void(VkCommandBuffer)> execute, bool sideEffects = false);
+    // Passes contributing to an output are never culled
+    void MarkOutput(RenderGraphResource resource);
+    // Size of transient images created without an extent
+    void SetExtent(VkExtent2D extent);
+
+    // Binds an imported image for this frame
+    void SetImage(RenderGraphResource resource, VkImage image, VkImageView view);
+    VkImage GetImage(RenderGraphResource resource) const { return Resources[resource.Index].Image; }
+    VkImageView GetImageView(RenderGraphResource resource) const { return Resources[resource.Index].View; }
+
+    void Execute(VkCommandBuffer commandBuffer);
+
+private:
+    struct Resource
+    {
+        std::string Name;
+        bool IsImage = false;
+        bool Imported = false;
+        bool Output = false;
+        RenderGraphImageDesc Desc;
+        VkImageLayout InitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 InitialStages = VK_PIPELINE_STAGE_2_NONE;
+        VkImageLayout FinalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage Image = VK_NULL_HANDLE;
+        VkImageView View = VK_NULL_HANDLE;
+        // Transients: alive pass range and memory slot
+        uint32_t FirstUse = UINT32_MAX;
+        uint32_t LastUse = 0;
+        uint32_t Slot = UINT32_MAX;
+        VkMemoryRequirements Requirements{};
+        VkPipelineStageFlags2 LastStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 LastWrites = VK_ACCESS_2_NONE;
+    };
+
+    struct Pass
+    {
+        std::string Name;
+        std::vector<RenderGraphUse> Uses;
+        std::function<void(VkCommandBuffer)> Run;
+        bool SideEffects = false;
+        bool Alive = false;
+    };
+
+    struct Barrier
+    {
+        uint32_t Resource;
+        VkPipelineStageFlags2 SrcStages;
+        VkAccessFlags2 SrcAccess;
+        VkPipelineStageFlags2 DstStages;
+        VkAccessFlags2 DstAccess;
+        VkImageLayout OldLayout;
+        VkImageLayout NewLayout;
+    };
+
+    // Barriers recorded before a pass; UINT32_MAX is the final transitions after the last pass
+    struct Step
+    {
+        uint32_t Pass;
+        std::vector<Barrier> Barriers;
+    };
+
+    struct MemorySlot
+    {
+        GpuAllocation Allocation;
+        VkMemoryRequirements Requirements{};
+        std::vector<uint32_t> Occupants; // by first use
+    };
+
+    void Compile();
+    void Cull();
+    void AllocateTransients();
+    void ReleaseTransients();
+    void BuildBarriers();
+    void RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers);
+
+    Vulkan *Owner = nullptr;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    PFN_vkCmdPipelineBarrier2 CmdPipelineBarrier2 = nullptr;
+
+    std::vector<Resource> Resources;
+    std::vector<Pass> Passes;
+    std::vector<Step> Steps;
+    std::vector<MemorySlot> Slots;
+    VkExtent2D Extent{0, 0};
+    bool Compiled = false;
+    uint32_t BarrierCount = 0;
+};
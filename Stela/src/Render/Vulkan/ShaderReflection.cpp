@@ -0,0 +1,457 @@
+#include "ShaderReflection.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    // The few opcodes, decorations and storage classes reflection needs (SPIR-V 1.6 specification)
+    enum : uint32_t
+    {
+        OpEntryPoint = 15,
+        OpTypeInt = 21,
+        OpTypeFloat = 22,
+        OpTypeVector = 23,
+        OpTypeMatrix = 24,
+        OpTypeImage = 25,
+        OpTypeSampler = 26,
+        OpTypeSampledImage = 27,
+        OpTypeArray = 28,
+        OpTypeRuntimeArray = 29,
+        OpTypeStruct = 30,
+        OpTypePointer = 32,
+        OpConstant = 43,
+        OpVariable = 59,
+        OpDecorate = 71,
+        OpMemberDecorate = 72,
+        OpTypeAccelerationStructureKHR = 5341,
+    };
+
+    enum : uint32_t
+    {
+        DecorationBufferBlock = 3,
+        DecorationArrayStride = 6,
+        DecorationBuiltIn = 11,
+        DecorationLocation = 30,
+        DecorationBinding = 33,
+        DecorationDescriptorSet = 34,
+        DecorationOffset = 35,
+    };
+
+    enum : uint32_t
+    {
+        StorageUniformConstant = 0,
+        StorageInput = 1,
+        StorageUniform = 2,
+        StoragePushConstant = 9,
+        StorageStorageBuffer = 12,
+    };
+
+    constexpr uint32_t ImageDimBuffer = 5;
+    constexpr uint32_t ImageDimSubpassData = 6;
+
+    // One result id: the instruction that defines it and the decorations applied to it
+    struct Id
+    {
+        uint32_t Op = 0;
+        uint32_t Word = 0; // index of the defining instruction's first word
+        uint32_t Set = UINT32_MAX;
+        uint32_t Binding = UINT32_MAX;
+        uint32_t Location = UINT32_MAX;
+        uint32_t ArrayStride = 0;
+        bool BuiltIn = false;
+        bool BufferBlock = false;
+        std::vector<uint32_t> MemberOffsets;
+    };
+
+    class Module
+    {
+    public:
+        explicit Module(const std::vector<char> &spirv)
+        {
+            if (spirv.size() < 20 || spirv.size() % 4 != 0)
+                throw std::runtime_error("shader is not SPIR-V!");
+            Words.resize(spirv.size() / 4);
+            std::copy(spirv.begin(), spirv.end(), reinterpret_cast<char *>(Words.data()));
+            if (Words[0] != 0x07230203)
+                throw std::runtime_error("shader is not SPIR-V!");
+
+            Ids.resize(Words[3]);
+            for (size_t word = 5; word < Words.size();)
+            {
+                uint32_t count = Words[word] >> 16;
+                uint32_t op = Words[word] & 0xFFFF;
+                if (count == 0 || word + count > Words.size())
+                    throw std::runtime_error("truncated SPIR-V instruction!");
+                Parse(op, static_cast<uint32_t>(word), count);
+                word += count;
+            }
+        }
+
+        uint32_t Operand(uint32_t id, uint32_t index) const { return Words[Ids[id].Word + 1 + index]; }
+        const Id &Get(uint32_t id) const
+        {
+            if (id >= Ids.size())
+                throw std::runtime_error("SPIR-V id out of bounds!");
+            return Ids[id];
+        }
+
+        std::vector<uint32_t> Words;
+        std::vector<Id> Ids;
+        std::vector<uint32_t> Variables;
+        uint32_t ExecutionModel = UINT32_MAX;
+
+    private:
+        void Define(uint32_t id, uint32_t op, uint32_t word)
+        {
+            Id &entry = Entry(id);
+            entry.Op = op;
+            entry.Word = word;
+        }
+
+        Id &Entry(uint32_t id)
+        {
+            if (id >= Ids.size())
+                throw std::runtime_error("SPIR-V id out of bounds!");
+            return Ids[id];
+        }
+
+        void Parse(uint32_t op, uint32_t word, uint32_t count)
+        {
+            const uint32_t *operands = &Words[word + 1];
+            switch (op)
+            {
+            case OpEntryPoint:
+                if (ExecutionModel == UINT32_MAX)
+                    ExecutionModel = operands[0];
+                break;
+            case OpTypeInt:
+            case OpTypeFloat:
+            case OpTypeVector:
+            case OpTypeMatrix:
+            case OpTypeImage:
+            case OpTypeSampler:
+            case OpTypeSampledImage:
+            case OpTypeArray:
+            case OpTypeRuntimeArray:
+            case OpTypeStruct:
+            case OpTypePointer:
+            case OpTypeAccelerationStructureKHR:
+                Define(operands[0], op, word);
+                break;
+            case OpConstant:
+                Define(operands[1], op, word);
+                break;
+            case OpVariable:
+                Define(operands[1], op, word);
+                Variables.push_back(operands[1]);
+                break;
+            case OpDecorate:
+            {
+                if (count < 3)
+                    break;
+                Id &target = Entry(operands[0]);
+                uint32_t value = count > 3 ? operands[2] : 0;
+                switch (operands[1])
+                {
+                case DecorationBufferBlock: target.BufferBlock = true; break;
+                case DecorationArrayStride: target.ArrayStride = value; break;
+                case DecorationBuiltIn: target.BuiltIn = true; break;
+                case DecorationLocation: target.Location = value; break;
+                case DecorationBinding: target.Binding = value; break;
+                case DecorationDescriptorSet: target.Set = value; break;
+                }
+                break;
+            }
+            case OpMemberDecorate:
+                if (count > 4 && operands[2] == DecorationOffset)
+                {
+                    Id &target = Entry(operands[0]);
+                    if (target.MemberOffsets.size() <= operands[1])
+                        target.MemberOffsets.resize(operands[1] + 1, 0);
+                    target.MemberOffsets[operands[1]] = operands[3];
+                }
+                else if (count > 3 && operands[2] == DecorationBuiltIn)
+                {
+                    Entry(operands[0]).BuiltIn = true;
+                }
+                break;
+            }
+        }
+    };
+
+    uint32_t ArrayLength(const Module &module, uint32_t type)
+    {
+        const Id &length = module.Get(module.Operand(type, 2));
+        return length.Op == OpConstant ? module.Words[length.Word + 3] : 1;
+    }
+
+    // Bytes a push constant member occupies, with the explicit layout the block was compiled with
+    uint32_t SizeOf(const Module &module, uint32_t type)
+    {
+        const Id &id = module.Get(type);
+        switch (id.Op)
+        {
+        case OpTypeInt:
+        case OpTypeFloat:
+            return module.Operand(type, 1) / 8;
+        case OpTypeVector:
+            return SizeOf(module, module.Operand(type, 1)) * module.Operand(type, 2);
+        case OpTypeMatrix:
+        {
+            // Columns are at least vec4-aligned except for two-component ones
+            uint32_t column = module.Operand(type, 1);
+            uint32_t components = module.Operand(column, 2);
+            uint32_t columnSize = SizeOf(module, module.Operand(column, 1)) * (components == 3 ? 4 : components);
+            return columnSize * module.Operand(type, 2);
+        }
+        case OpTypeArray:
+        {
+            uint32_t element = module.Operand(type, 1);
+            uint32_t stride = id.ArrayStride ? id.ArrayStride : SizeOf(module, element);
+            return stride * ArrayLength(module, type);
+        }
+        case OpTypeStruct:
+        {
+            uint32_t members = (module.Words[id.Word] >> 16) - 2;
+            uint32_t size = 0;
+            for (uint32_t i = 0; i < members; i++)
+            {
+                uint32_t offset = i < id.MemberOffsets.size() ? id.MemberOffsets[i] : 0;
+                size = std::max(size, offset + SizeOf(module, module.Operand(type, 1 + i)));
+            }
+            return size;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    VkDescriptorType DescriptorType(const Module &module, uint32_t type, uint32_t storage)
+    {
+        const Id &id = module.Get(type);
+        if (storage == StorageStorageBuffer)
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        if (storage == StorageUniform)
+            return id.BufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+        switch (id.Op)
+        {
+        case OpTypeSampler:
+            return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case OpTypeSampledImage:
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case OpTypeAccelerationStructureKHR:
+            return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        case OpTypeImage:
+        {
+            uint32_t dim = module.Operand(type, 2);
+            uint32_t sampled = module.Operand(type, 6);
+            if (dim == ImageDimBuffer)
+                return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            if (dim == ImageDimSubpassData)
+                return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        default:
+            throw std::runtime_error("unsupported descriptor type in shader!");
+        }
+    }
+
+    // 32-bit scalars and vectors only; that is all a vertex attribute fetched as float/int/uint needs
+    VkFormat InputFormat(const Module &module, uint32_t type)
+    {
+        static const VkFormat formats[3][4] = {
+            {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT},
+            {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT},
+            {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT}};
+
+        uint32_t components = 1;
+        if (module.Get(type).Op == OpTypeVector)
+        {
+            components = module.Operand(type, 2);
+            type = module.Operand(type, 1);
+        }
+        const Id &scalar = module.Get(type);
+        if ((scalar.Op != OpTypeFloat && scalar.Op != OpTypeInt) || module.Operand(type, 1) != 32 || components > 4)
+            throw std::runtime_error("unsupported vertex input type in shader!");
+        uint32_t kind = scalar.Op == OpTypeFloat ? 0 : module.Operand(type, 2) ? 1 : 2;
+        return formats[kind][components - 1];
+    }
+
+    uint32_t FormatSize(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32_UINT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32_UINT:
+            return 12;
+        default:
+            return 16;
+        }
+    }
+
+    VkShaderStageFlags Stage(uint32_t executionModel)
+    {
+        switch (executionModel)
+        {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default: throw std::runtime_error("unsupported shader stage!");
+        }
+    }
+}
+
+ShaderReflection ShaderReflection::Reflect(const std::vector<char> &spirv)
+{
+    Module module(spirv);
+    ShaderReflection reflection;
+    reflection.Stages = Stage(module.ExecutionModel);
+
+    for (uint32_t variable : module.Variables)
+    {
+        const Id &id = module.Get(variable);
+        uint32_t storage = module.Operand(variable, 2);
+        uint32_t pointer = module.Operand(variable, 0);
+        uint32_t type = module.Operand(pointer, 2);
+
+        switch (storage)
+        {
+        case StorageUniformConstant:
+        case StorageUniform:
+        case StorageStorageBuffer:
+        {
+            if (id.Binding == UINT32_MAX)
+                break;
+            uint32_t count = 1;
+            while (module.Get(type).Op == OpTypeArray || module.Get(type).Op == OpTypeRuntimeArray)
+            {
+                count = module.Get(type).Op == OpTypeArray ? count * ArrayLength(module, type) : 0;
+                type = module.Operand(type, 1);
+            }
+            uint32_t set = id.Set == UINT32_MAX ? 0 : id.Set;
+            reflection.Bindings.push_back({set, id.Binding, DescriptorType(module, type, storage), count, reflection.Stages});
+            break;
+        }
+        case StoragePushConstant:
+        {
+            const Id &block = module.Get(type);
+            uint32_t offset = block.MemberOffsets.empty() ? 0 : *std::min_element(block.MemberOffsets.begin(), block.MemberOffsets.end());
+            uint32_t end = SizeOf(module, type);
+            if (end > offset)
+                reflection.PushConstants.push_back({reflection.Stages, offset, end - offset});
+            break;
+        }
+        case StorageInput:
+        {
+            if (reflection.Stages != VK_SHADER_STAGE_VERTEX_BIT || id.BuiltIn || module.Get(type).BuiltIn || id.Location == UINT32_MAX)
+                break;
+            // A matrix input takes one location per column
+            uint32_t columns = 1;
+            if (module.Get(type).Op == OpTypeMatrix)
+            {
+                columns = module.Operand(type, 2);
+                type = module.Operand(type, 1);
+            }
+            for (uint32_t column = 0; column < columns; column++)
+                reflection.Inputs.push_back({id.Location + column, InputFormat(module, type)});
+            break;
+        }
+        }
+    }
+
+    std::sort(reflection.Bindings.begin(), reflection.Bindings.end(), [](const ReflectedBinding &a, const ReflectedBinding &b)
+    {
+        return a.Set != b.Set ? a.Set < b.Set : a.Binding < b.Binding;
+    });
+    std::sort(reflection.Inputs.begin(), reflection.Inputs.end(), [](const ReflectedInput &a, const ReflectedInput &b) { return a.Location < b.Location; });
+    return reflection;
+}
+
+void ShaderReflection::Merge(const ShaderReflection &other)
+{
+    Stages |= other.Stages;
+
+    for (const ReflectedBinding &binding : other.Bindings)
+    {
+        auto it = std::find_if(Bindings.begin(), Bindings.end(), [&](const ReflectedBinding &existing)
+        {
+            return existing.Set == binding.Set && existing.Binding == binding.Binding;
+        });
+        if (it == Bindings.end())
+        {
+            Bindings.push_back(binding);
+            continue;
+        }
+        if (it->Type != binding.Type)
+        {
+            throw std::runtime_error("shaders disagree on the type of set " + std::to_string(binding.Set) + " binding " +
+                                     std::to_string(binding.Binding) + "!");
+        }
+        it->Stages |= binding.Stages;
+        it->Count = it->Count == 0 || binding.Count == 0 ? 0 : std::max(it->Count, binding.Count);
+    }
+    std::sort(Bindings.begin(), Bindings.end(), [](const ReflectedBinding &a, const ReflectedBinding &b)
+    {
+        return a.Set != b.Set ? a.Set < b.Set : a.Binding < b.Binding;
+    });
+
+    // Vulkan allows one range per stage, so two shaders of one stage share a joined range
+    for (const VkPushConstantRange &range : other.PushConstants)
+    {
+        auto it = std::find_if(PushConstants.begin(), PushConstants.end(), [&](const VkPushConstantRange &existing)
+        {
+            return existing.stageFlags == range.stageFlags;
+        });
+        if (it == PushConstants.end())
+        {
+            PushConstants.push_back(range);
+            continue;
+        }
+        uint32_t end = std::max(it->offset + it->size, range.offset + range.size);
+        it->offset = std::min(it->offset, range.offset);
+        it->size = end - it->offset;
+    }
+
+    if (Inputs.empty())
+        Inputs = other.Inputs;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::SetBindings(uint32_t set) const
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    for (const ReflectedBinding &binding : Bindings)
+    {
+        if (binding.Set == set)
+            bindings.push_back({binding.Binding, binding.Type, binding.Count, binding.Stages, nullptr});
+    }
+    return bindings;
+}
+
+void ShaderReflection::PackedVertexInput(uint32_t binding, std::vector<VkVertexInputBindingDescription> &bindings,
+                                         std::vector<VkVertexInputAttributeDescription> &attributes) const
+{
+    bindings.clear();
+    attributes.clear();
+    uint32_t offset = 0;
+    for (const ReflectedInput &input : Inputs)
+    {
+        attributes.push_back({input.Location, binding, input.Format, offset});
+        offset += FormatSize(input.Format);
+    }
+    if (!attributes.empty())
+        bindings.push_back({binding, offset, VK_VERTEX_INPUT_RATE_VERTEX});
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+struct ReflectedBinding
+{
+    uint32_t Set;
+    uint32_t Binding;
+    VkDescriptorType Type;
+    uint32_t Count; // 0 for a runtime-sized array
+    VkShaderStageFlags Stages;
+};
+
+struct ReflectedInput
+{
+    uint32_t Location;
+    VkFormat Format;
+};
+
+// What a SPIR-V module (or several, once merged) needs from its pipeline layout: descriptor bindings
+// per set, push constant ranges per stage and, for vertex shaders, the vertex inputs. Read straight
+// from the module's decorations, so layouts follow the shaders instead of being written by hand.
+struct ShaderReflection
+{
+    VkShaderStageFlags Stages = 0;
+    std::vector<ReflectedBinding> Bindings; // sorted by set, then binding
+    std::vector<VkPushConstantRange> PushConstants; // at most one range per stage
+    std::vector<ReflectedInput> Inputs; // sorted by location
+
+    // Throws when the module is not valid SPIR-V
+    static ShaderReflection Reflect(const std::vector<char> &spirv);
+
+    // Adds another stage's needs: bindings used by both get both stages, a stage's ranges are joined.
+    // Throws when the two declare one binding with different types.
+    void Merge(const ShaderReflection &other);
+
+    uint32_t SetCount() const { return Bindings.empty() ? 0 : Bindings.back().Set + 1; }
+    std::vector<VkDescriptorSetLayoutBinding> SetBindings(uint32_t set) const;
+
+    // Inputs tightly packed into one interleaved binding, in location order
+    void PackedVertexInput(uint32_t binding, std::vector<VkVertexInputBindingDescription> &bindings,
+                           std::vector<VkVertexInputAttributeDescription> &attributes) const;
+};
@@ -0,0 +1,313 @@
+#include "ShaderSystem.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#if defined(STELA_HAS_SHADERC)
+#include <shaderc/shaderc.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Bumped when the compile options change, so cached SPIR-V from older builds is not reused
+    constexpr const char *CompilerTag = "shaderc-1";
+
+    uint64_t Fnv1a(uint64_t hash, const std::string &text)
+    {
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool ReadBinary(const fs::path &path, std::vector<char> &out)
+    {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open())
+            return false;
+        out.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(out.data(), (std::streamsize)out.size());
+        return file.good();
+    }
+
+    // Canonical define order, so {A, B} and {B, A} are one permutation
+    std::vector<ShaderDefine> Sorted(std::vector<ShaderDefine> defines)
+    {
+        std::sort(defines.begin(), defines.end(), [](const ShaderDefine &a, const ShaderDefine &b) { return a.Name < b.Name; });
+        return defines;
+    }
+
+    std::string PermutationKey(const std::string &path, const std::vector<ShaderDefine> &defines)
+    {
+        std::string key = path;
+        for (const ShaderDefine &define : defines)
+            key += "\n" + define.Name + "=" + define.Value;
+        return key;
+    }
+}
+
+void ShaderSystem::Init(const std::string &sourceDirectory, const std::string &cacheDirectory)
+{
+    const char *source = std::getenv("STELA_SHADER_DIR");
+    const char *cache = std::getenv("STELA_SHADER_CACHE_DIR");
+    SourceDirectory = source ? source : sourceDirectory;
+    CacheDirectory = cache ? cache : cacheDirectory;
+    STELA_LOG_INFO(Render, "Shaders: %s, %s", SourceDirectory.string(), CanCompile() ? "compiled at runtime" : "precompiled SPIR-V only");
+}
+
+void ShaderSystem::Shutdown()
+{
+#if defined(STELA_HAS_SHADERC)
+    if (Compiler)
+        shaderc_compiler_release(static_cast<shaderc_compiler_t>(Compiler));
+    Compiler = nullptr;
+#endif
+    std::lock_guard<std::mutex> lock(Mutex);
+    Permutations.clear();
+    Listeners.clear();
+}
+
+bool ShaderSystem::CanCompile()
+{
+#if defined(STELA_HAS_SHADERC)
+    return true;
+#else
+    return false;
+#endif
+}
+
+ShaderCode ShaderSystem::Get(const std::string &path, const std::vector<ShaderDefine> &unsortedDefines)
+{
+    std::vector<ShaderDefine> defines = Sorted(unsortedDefines);
+    std::string key = PermutationKey(path, defines);
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        auto it = Permutations.find(key);
+        if (it != Permutations.end())
+            return it->second.Code;
+    }
+
+    // Built outside the lock; if two threads race on a new permutation the first one in wins
+    std::vector<Dependency> dependencies;
+    ShaderCode code = Build(path, defines, dependencies);
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto [it, inserted] = Permutations.try_emplace(key, Permutation{path, defines, code, std::move(dependencies)});
+    return it->second.Code;
+}
+
+void ShaderSystem::AddReloadListener(ReloadListener listener)
+{
+    Listeners.push_back(std::move(listener));
+}
+
+void ShaderSystem::Poll()
+{
+    if (!HotReload)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (now - LastPoll < PollInterval)
+        return;
+    LastPoll = now;
+
+    std::vector<std::pair<ShaderCode, ShaderCode>> replaced;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        for (auto &[key, permutation] : Permutations)
+        {
+            bool changed = false;
+            for (Dependency &dependency : permutation.Dependencies)
+            {
+                std::error_code ec;
+                fs::file_time_type writeTime = fs::last_write_time(dependency.Path, ec);
+                if (!ec && writeTime != dependency.WriteTime)
+                {
+                    dependency.WriteTime = writeTime;
+                    changed = true;
+                }
+            }
+            if (!changed)
+                continue;
+
+            // A broken edit keeps the previous code; the next save is picked up again
+            try
+            {
+                std::vector<Dependency> dependencies;
+                ShaderCode code = Build(permutation.Path, permutation.Defines, dependencies);
+                replaced.emplace_back(permutation.Code, code);
+                permutation.Code = code;
+                permutation.Dependencies = std::move(dependencies);
+                STELA_LOG_INFO(Render, "Reloaded shader %s", permutation.Path);
+            }
+            catch (const std::exception &e)
+            {
+                STELA_LOG_ERROR(Render, "%s", e.what());
+            }
+        }
+    }
+
+    for (const auto &[previous, replacement] : replaced)
+    {
+        for (const ReloadListener &listener : Listeners)
+            listener(previous, replacement);
+    }
+}
+
+bool ShaderSystem::Expand(const fs::path &file, std::string &out, std::vector<Dependency> &dependencies,
+                          std::vector<fs::path> &stack, std::string &error)
+{
+    if (std::find(stack.begin(), stack.end(), file) != stack.end())
+    {
+        error = "shader include cycle at " + file.string();
+        return false;
+    }
+    std::ifstream input(file);
+    if (!input.is_open())
+    {
+        error = "failed to open shader " + file.string();
+        return false;
+    }
+    std::error_code ec;
+    dependencies.push_back({file, fs::last_write_time(file, ec)});
+    stack.push_back(file);
+
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+        {
+            out += line;
+            out += '\n';
+            continue;
+        }
+
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos)
+        {
+            error = file.string() + ":" + std::to_string(lineNumber) + ": malformed #include";
+            return false;
+        }
+        std::string name = line.substr(open + 1, close - open - 1);
+        fs::path included = file.parent_path() / name;
+        if (!fs::exists(included, ec))
+            included = SourceDirectory / name;
+        if (!Expand(included.lexically_normal(), out, dependencies, stack, error))
+            return false;
+        // Keeps compiler line numbers right for the rest of this file
+        out += "#line " + std::to_string(lineNumber + 1) + "\n";
+    }
+    stack.pop_back();
+    return true;
+}
+
+ShaderCode ShaderSystem::Build(const std::string &path, const std::vector<ShaderDefine> &defines, std::vector<Dependency> &dependencies)
+{
+#if defined(STELA_HAS_SHADERC)
+    static Metrics::Histogram &compileTime = Metrics::GetHistogram("stela_shader_compile_us", "Time to compile one shader permutation to SPIR-V, in microseconds");
+    static Metrics::Counter &cacheHits = Metrics::GetCounter("stela_shader_cache_hits_total", "Shader permutations loaded from the SPIR-V cache");
+    static Metrics::Counter &compiles = Metrics::GetCounter("stela_shader_compiles_total", "Shader permutations compiled at runtime");
+
+    std::string extension = fs::path(path).extension().string();
+    shaderc_shader_kind kind;
+    if (extension == ".vert")
+        kind = shaderc_vertex_shader;
+    else if (extension == ".frag")
+        kind = shaderc_fragment_shader;
+    else if (extension == ".comp")
+        kind = shaderc_compute_shader;
+    else
+        throw std::runtime_error("unknown shader stage for " + path);
+
+    std::string source;
+    std::vector<fs::path> stack;
+    std::string error;
+    if (!Expand((SourceDirectory / path).lexically_normal(), source, dependencies, stack, error))
+        throw std::runtime_error(error);
+
+    uint64_t hash = Fnv1a(14695981039346656037ull, CompilerTag);
+    hash = Fnv1a(hash, extension);
+    for (const ShaderDefine &define : defines)
+        hash = Fnv1a(hash, define.Name + "=" + define.Value + "\n");
+    hash = Fnv1a(hash, source);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)hash);
+    fs::path cached = CacheDirectory / name;
+
+    auto code = std::make_shared<std::vector<char>>();
+    if (!CacheDirectory.empty() && ReadBinary(cached, *code) && !code->empty() && code->size() % 4 == 0)
+    {
+        cacheHits.Add();
+        return code;
+    }
+
+    std::call_once(CompilerCreated, [this] { Compiler = shaderc_compiler_initialize(); });
+    if (!Compiler)
+        throw std::runtime_error("failed to create the shader compiler!");
+
+    shaderc_compilation_result_t result;
+    {
+        Metrics::ScopedTimer timer(compileTime);
+        shaderc_compile_options_t options = shaderc_compile_options_initialize();
+        shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+        for (const ShaderDefine &define : defines)
+            shaderc_compile_options_add_macro_definition(options, define.Name.data(), define.Name.size(), define.Value.data(), define.Value.size());
+        result = shaderc_compile_into_spv(static_cast<shaderc_compiler_t>(Compiler), source.data(), source.size(), kind, path.c_str(), "main", options);
+        shaderc_compile_options_release(options);
+    }
+    if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+    {
+        std::string message = "failed to compile shader " + path + ": " + shaderc_result_get_error_message(result);
+        shaderc_result_release(result);
+        throw std::runtime_error(message);
+    }
+    const char *bytes = shaderc_result_get_bytes(result);
+    code->assign(bytes, bytes + shaderc_result_get_length(result));
+    shaderc_result_release(result);
+    compiles.Add();
+
+    // Write-then-rename, so a concurrent reader or a crash never sees a torn file. Two threads can build
+    // the same permutation at once, so each write goes through its own temporary.
+    if (!CacheDirectory.empty())
+    {
+        static std::atomic<uint32_t> writes{0};
+        std::error_code ec;
+        fs::create_directories(CacheDirectory, ec);
+        fs::path temporary = cached;
+        temporary += "." + std::to_string(writes.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(code->data(), (std::streamsize)code->size());
+        }
+        fs::rename(temporary, cached, ec);
+        if (ec)
+        {
+            STELA_LOG_WARNING(Render, "Failed to cache shader %s: %s", path, ec.message());
+            fs::remove(temporary, ec);
+        }
+    }
+    return code;
+#else
+    if (!defines.empty())
+        throw std::runtime_error("shader permutations of " + path + " need runtime compilation (shaderc)");
+
+    fs::path file = SourceDirectory / (path + ".spv");
+    auto code = std::make_shared<std::vector<char>>();
+    if (!ReadBinary(file, *code))
+        throw std::runtime_error("failed to open shader " + file.string());
+    std::error_code ec;
+    dependencies.push_back({file, fs::last_write_time(file, ec)});
+    return code;
+#endif
+}
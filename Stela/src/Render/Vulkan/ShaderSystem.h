@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// SPIR-V words, shared by every pipeline description built from it
+using ShaderCode = std::shared_ptr<const std::vector<char>>;
+
+struct ShaderDefine
+{
+    std::string Name;
+    std::string Value = "1";
+};
+
+// GLSL to SPIR-V at runtime. Get returns one permutation of a shader (a source file in the shader
+// directory plus a set of defines), compiled the first time it is asked for, so permutations nobody
+// draws with cost nothing at startup. `#include "file"` is resolved against the including file, then
+// the shader directory.
+//
+// Compiled SPIR-V is kept in an on-disk cache keyed by a hash of the expanded source, stage and
+// defines, so an unchanged shader is compiled once per machine, not once per run. Variants that only
+// differ in constants should use specialization constants (GraphicsPipelineDesc::Specialization)
+// instead of defines: one SPIR-V then serves all of them.
+//
+// With hot reload on, Poll recompiles the permutations whose source or includes changed on disk and
+// tells the listeners (the pipeline library rebuilds just the pipelines that used the old code).
+//
+// Compilation needs shaderc (STELA_HAS_SHADERC, linked when the Vulkan SDK has it). Without it Get
+// loads the build-time "<path>.spv" next to the source, permutations with defines are unavailable and
+// hot reload watches the .spv files instead.
+class ShaderSystem
+{
+public:
+    using ReloadListener = std::function<void(const ShaderCode &previous, const ShaderCode &replacement)>;
+
+    // File system only, so it can run before the device exists. STELA_SHADER_DIR and
+    // STELA_SHADER_CACHE_DIR override the directories.
+    void Init(const std::string &sourceDirectory, const std::string &cacheDirectory);
+    void Shutdown();
+    static bool CanCompile();
+
+    // Thread-safe. `path` is relative to the shader directory ("mesh.frag"); the stage comes from the
+    // extension. Throws when the shader cannot be compiled or loaded.
+    ShaderCode Get(const std::string &path, const std::vector<ShaderDefine> &defines = {});
+
+    // Main thread; listeners run from Poll
+    void AddReloadListener(ReloadListener listener);
+    void SetHotReload(bool enabled) { HotReload = enabled; }
+    bool IsHotReloadEnabled() const { return HotReload; }
+    // Main thread, once per frame. Checks the files at most every PollInterval.
+    void Poll();
+
+    std::chrono::milliseconds PollInterval{500};
+
+private:
+    struct Dependency
+    {
+        std::filesystem::path Path;
+        std::filesystem::file_time_type WriteTime;
+    };
+
+    struct Permutation
+    {
+        std::string Path;
+        std::vector<ShaderDefine> Defines;
+        ShaderCode Code;
+        std::vector<Dependency> Dependencies;
+    };
+
+    // Compiles, or loads from the cache; throws on failure
+    ShaderCode Build(const std::string &path, const std::vector<ShaderDefine> &defines, std::vector<Dependency> &dependencies);
+    // Inlines #include directives; false with `error` set when a file is missing or includes itself
+    bool Expand(const std::filesystem::path &file, std::string &out, std::vector<Dependency> &dependencies,
+                std::vector<std::filesystem::path> &stack, std::string &error);
+
+    std::filesystem::path SourceDirectory = "Shaders";
+    std::filesystem::path CacheDirectory;
+    bool HotReload = false;
+    std::chrono::steady_clock::time_point LastPoll;
+
+    std::mutex Mutex; // guards Permutations
+    std::unordered_map<std::string, Permutation> Permutations;
+    std::vector<ReloadListener> Listeners;
+
+    std::once_flag CompilerCreated;
+    void *Compiler = nullptr; // shaderc_compiler_t, thread-safe for concurrent compiles
+};
@@ -0,0 +1,231 @@
+#include "TextureCooker.h"
+#include "BlockCompression.h"
+#include "Ktx2.h"
+#include <Log/Log.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    float SrgbToLinear(uint8_t value)
+    {
+        float c = value / 255.0f;
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    uint8_t LinearToSrgb(float c)
+    {
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return (uint8_t)std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f);
+    }
+
+    // Half the size (at least 1x1), each texel the average of the 2x2 below it
+    TextureImage Downsample(const TextureImage &source, bool srgb)
+    {
+        static float SrgbTable[256];
+        static bool tableReady = [] {
+            for (uint32_t i = 0; i < 256; i++)
+                SrgbTable[i] = SrgbToLinear((uint8_t)i);
+            return true;
+        }();
+        (void)tableReady;
+
+        TextureImage result;
+        result.Width = std::max(source.Width / 2, 1u);
+        result.Height = std::max(source.Height / 2, 1u);
+        result.Texels.resize((size_t)result.Width * result.Height * 4);
+        for (uint32_t y = 0; y < result.Height; y++)
+        {
+            for (uint32_t x = 0; x < result.Width; x++)
+            {
+                float sum[4] = {};
+                for (uint32_t i = 0; i < 4; i++)
+                {
+                    uint32_t sx = std::min(x * 2 + i % 2, source.Width - 1);
+                    uint32_t sy = std::min(y * 2 + i / 2, source.Height - 1);
+                    const uint8_t *texel = source.Texels.data() + ((size_t)sy * source.Width + sx) * 4;
+                    for (uint32_t c = 0; c < 4; c++)
+                        sum[c] += srgb && c < 3 ? SrgbTable[texel[c]] : texel[c] / 255.0f;
+                }
+                uint8_t *texel = result.Texels.data() + ((size_t)y * result.Width + x) * 4;
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    float average = sum[c] / 4.0f;
+                    texel[c] = srgb && c < 3 ? LinearToSrgb(average) : (uint8_t)std::clamp(average * 255.0f + 0.5f, 0.0f, 255.0f);
+                }
+            }
+        }
+        return result;
+    }
+}
+
+bool TextureCooker::ReadTga(const std::string &path, TextureImage &image, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open file";
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 18)
+    {
+        error = "file too short";
+        return false;
+    }
+
+    uint32_t idLength = data[0];
+    uint32_t colorMapType = data[1];
+    uint32_t imageType = data[2];
+    uint32_t colorMapLength = data[5] | data[6] << 8;
+    uint32_t colorMapEntryBits = data[7];
+    image.Width = data[12] | data[13] << 8;
+    image.Height = data[14] | data[15] << 8;
+    uint32_t bitsPerPixel = data[16];
+    bool topFirst = (data[17] & 0x20) != 0;
+    bool rle = imageType == 10 || imageType == 11;
+    bool gray = imageType == 3 || imageType == 11;
+    if (imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11)
+    {
+        error = "only true-color and grayscale TGAs are supported";
+        return false;
+    }
+    if (gray ? bitsPerPixel != 8 : (bitsPerPixel != 24 && bitsPerPixel != 32))
+    {
+        error = "unsupported bits per pixel";
+        return false;
+    }
+    if (image.Width == 0 || image.Height == 0)
+    {
+        error = "empty image";
+        return false;
+    }
+
+    size_t position = 18 + idLength + (colorMapType != 0 ? (size_t)colorMapLength * ((colorMapEntryBits + 7) / 8) : 0);
+    uint32_t bytesPerPixel = bitsPerPixel / 8;
+    size_t texelCount = (size_t)image.Width * image.Height;
+    image.Texels.assign(texelCount * 4, 255);
+
+    // Pixels are stored bottom row first unless the descriptor says otherwise, in BGR(A) order
+    auto store = [&](size_t index, const uint8_t *pixel)
+    {
+        size_t x = index % image.Width;
+        size_t y = index / image.Width;
+        if (!topFirst)
+            y = image.Height - 1 - y;
+        uint8_t *texel = image.Texels.data() + (y * image.Width + x) * 4;
+        if (gray)
+        {
+            texel[0] = texel[1] = texel[2] = pixel[0];
+            return;
+        }
+        texel[0] = pixel[2];
+        texel[1] = pixel[1];
+        texel[2] = pixel[0];
+        if (bytesPerPixel == 4)
+            texel[3] = pixel[3];
+    };
+
+    size_t index = 0;
+    while (index < texelCount)
+    {
+        uint32_t run = 1;
+        bool repeat = false;
+        if (rle)
+        {
+            if (position >= data.size())
+                break;
+            uint8_t packet = data[position++];
+            run = (packet & 0x7F) + 1u;
+            repeat = (packet & 0x80) != 0;
+        }
+        for (uint32_t i = 0; i < run && index < texelCount; i++)
+        {
+            if (position + bytesPerPixel > data.size())
+            {
+                error = "truncated pixel data";
+                return false;
+            }
+            store(index++, data.data() + position);
+            if (!repeat || i + 1 == run)
+                position += bytesPerPixel;
+        }
+    }
+    if (index < texelCount)
+    {
+        error = "truncated pixel data";
+        return false;
+    }
+    return true;
+}
+
+VkFormat TextureCooker::ChooseFormat(const TextureImage &image, const TextureCookSettings &settings)
+{
+    TextureCodec codec = settings.Codec;
+    if (codec == TextureCodec::Auto)
+    {
+        bool opaque = true;
+        for (size_t i = 3; i < image.Texels.size() && opaque; i += 4)
+            opaque = image.Texels[i] == 255;
+        codec = opaque ? TextureCodec::BC1 : TextureCodec::BC3;
+    }
+
+    switch (codec)
+    {
+    case TextureCodec::BC3:
+        return settings.Srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case TextureCodec::BC4:
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+    case TextureCodec::BC5:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TextureCodec::RGBA8:
+        return settings.Srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    default:
+        return settings.Srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    }
+}
+
+std::vector<uint8_t> TextureCooker::Cook(const TextureImage &image, const TextureCookSettings &settings)
+{
+    VkFormat format = ChooseFormat(image, settings);
+    bool srgb = settings.Srgb && format != VK_FORMAT_BC4_UNORM_BLOCK && format != VK_FORMAT_BC5_UNORM_BLOCK;
+    bool compressed = BlockCompression::BlockSize(format) != 0;
+
+    std::vector<std::vector<uint8_t>> levels;
+    TextureImage level = image;
+    while (true)
+    {
+        if (compressed)
+            levels.push_back(BlockCompression::EncodeImage(format, level.Texels.data(), level.Width, level.Height));
+        else
+            levels.push_back(level.Texels);
+        if (!settings.Mipmaps || (level.Width == 1 && level.Height == 1))
+            break;
+        level = Downsample(level, srgb);
+    }
+    return Ktx2::Write(format, image.Width, image.Height, levels);
+}
+
+bool TextureCooker::CookFile(const std::string &source, const std::string &destination, const TextureCookSettings &settings)
+{
+    TextureImage image;
+    std::string error;
+    if (!ReadTga(source, image, error))
+    {
+        STELA_LOG_ERROR(Render, "Cannot read %s: %s", source, error);
+        return false;
+    }
+
+    std::vector<uint8_t> file = Cook(image, settings);
+    std::ofstream out(destination, std::ios::binary);
+    if (!out.write(reinterpret_cast<const char *>(file.data()), (std::streamsize)file.size()))
+    {
+        STELA_LOG_ERROR(Render, "Cannot write %s", destination);
+        return false;
+    }
+    STELA_LOG_INFO(Render, "Cooked %s (%ux%u) to %s: %zu bytes, %.1f%% of RGBA8", source, image.Width, image.Height, destination,
+                   file.size(), 100.0 * (double)file.size() / (double)image.Texels.size());
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TextureCodec
+{
+    Auto,  // BC1, or BC3 when any texel is not opaque
+    BC1,
+    BC3,
+    BC4,   // red only: masks, roughness, height
+    BC5,   // red and green: tangent-space normal maps
+    RGBA8, // uncompressed, for the rare texture block compression ruins
+};
+
+struct TextureCookSettings
+{
+    TextureCodec Codec = TextureCodec::Auto;
+    // Color data in sRGB; ignored by BC4 and BC5, which are always linear
+    bool Srgb = true;
+    bool Mipmaps = true;
+};
+
+// 8-bit RGBA texels, top row first
+struct TextureImage
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<uint8_t> Texels;
+};
+
+// Offline half of the texture pipeline: turns a source image into a block-compressed KTX2 file with
+// its whole mip chain, which TextureStreamer loads a level at a time. Mips are box filtered, in
+// linear light for sRGB data. Run from the Runtime with --cook-texture.
+namespace TextureCooker
+{
+    // Uncompressed or run-length encoded 8, 24 or 32-bit TGA
+    bool ReadTga(const std::string &path, TextureImage &image, std::string &error);
+    VkFormat ChooseFormat(const TextureImage &image, const TextureCookSettings &settings);
+    // The KTX2 file contents
+    std::vector<uint8_t> Cook(const TextureImage &image, const TextureCookSettings &settings);
+    // Logs what went wrong and returns false on failure
+    bool CookFile(const std::string &source, const std::string &destination, const TextureCookSettings &settings);
+}
@@ -0,0 +1,455 @@
+#include "TextureStreamer.h"
+#include "BlockCompression.h"
+#include "Vulkan.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+// Frames without a Request before a texture may be dropped to its tail to make room for others
+static constexpr uint64_t IdleFrames = 120;
+// Textures whose levels are being read at once; each read is one job
+static constexpr uint32_t MaxConcurrentReads = 4;
+
+void TextureStreamer::Init(Vulkan &vulkan)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+
+    VkDeviceSize megabytes = 512;
+    if (const char *budget = std::getenv("STELA_TEXTURE_BUDGET_MB"))
+        megabytes = (VkDeviceSize)std::max(std::atoi(budget), 16);
+    Budget = megabytes * 1024 * 1024;
+    // Never plan on more than half of device-local memory; the rest of the renderer needs some too
+    VkDeviceSize deviceLocal = 0;
+    for (const GpuHeapBudget &heap : vulkan.DeviceMemory.QueryBudgets())
+    {
+        if (heap.DeviceLocal)
+            deviceLocal = std::max(deviceLocal, heap.Budget);
+    }
+    if (deviceLocal != 0)
+        Budget = std::min(Budget, deviceLocal / 2);
+    STELA_LOG_INFO(Render, "Texture budget: %llu MB", (unsigned long long)(Budget / (1024 * 1024)));
+}
+
+void TextureStreamer::Destroy()
+{
+    if (!Owner)
+        return;
+
+    // Jobs still reading hold pointers into Textures
+    Reads.Wait();
+    for (std::unique_ptr<Texture> &texture : Textures)
+    {
+        if (!texture)
+            continue;
+        DestroyResidency(texture->Resident);
+        DestroyResidency(texture->Streaming);
+    }
+    Textures.clear();
+    FreeSlots.clear();
+    for (RetiredResidency &retired : Retired)
+        DestroyResidency(retired.Images);
+    Retired.clear();
+    Owner = nullptr;
+}
+
+TextureHandle TextureStreamer::Load(const std::string &path)
+{
+    if (!Owner->Descriptors.IsEnabled())
+    {
+        STELA_LOG_ERROR(Render, "Cannot load %s: textures are sampled through bindless descriptors, which this device lacks", path);
+        return {};
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        STELA_LOG_ERROR(Render, "Cannot open texture %s", path);
+        return {};
+    }
+    auto texture = std::make_unique<Texture>();
+    texture->Path = path;
+    std::string error;
+    if (!Ktx2::ReadInfo(file, texture->Info, error))
+    {
+        STELA_LOG_ERROR(Render, "Cannot load %s: %s", path, error);
+        return {};
+    }
+    const Ktx2Info &info = texture->Info;
+
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(Owner->PhysicalDevice, info.Format, &properties);
+    texture->Format = info.Format;
+    if ((properties.optimalTilingFeatures & needed) != needed)
+    {
+        texture->Format = BlockCompression::DecodedFormat(info.Format);
+        texture->Decode = true;
+        if (texture->Format == VK_FORMAT_UNDEFINED)
+        {
+            STELA_LOG_ERROR(Render, "Cannot load %s: the device cannot sample format %u", path, (uint32_t)info.Format);
+            return {};
+        }
+    }
+
+    uint32_t levelCount = (uint32_t)info.Levels.size();
+    texture->TailMip = levelCount - 1;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        if (std::max(info.Width >> level, info.Height >> level) <= TailSize)
+        {
+            texture->TailMip = level;
+            break;
+        }
+    }
+    texture->Tail.resize(levelCount - texture->TailMip);
+    for (uint32_t level = texture->TailMip; level < levelCount; level++)
+    {
+        if (!ReadLevel(file, *texture, level, texture->Tail[level - texture->TailMip]))
+        {
+            STELA_LOG_ERROR(Render, "Cannot load %s: level %u is truncated", path, level);
+            return {};
+        }
+    }
+
+    CreateResidency(*texture, texture->TailMip, texture->Resident);
+    UploadTail(*texture, texture->Resident);
+    texture->Bindless = Owner->Descriptors.AddImage(texture->Resident.View);
+    if (!texture->Bindless.Valid())
+    {
+        Retire(texture->Resident); // its uploads are already queued
+        return {};
+    }
+    texture->WantedMip = texture->TailMip;
+
+    TextureHandle handle;
+    if (!FreeSlots.empty())
+    {
+        handle.Index = FreeSlots.back();
+        FreeSlots.pop_back();
+        Textures[handle.Index] = std::move(texture);
+    }
+    else
+    {
+        handle.Index = (uint32_t)Textures.size();
+        Textures.push_back(std::move(texture));
+    }
+    ResidentBytes += Textures[handle.Index]->Resident.Allocation.Size;
+    return handle;
+}
+
+void TextureStreamer::Unload(TextureHandle handle)
+{
+    if (!handle.Valid() || handle.Index >= Textures.size() || !Textures[handle.Index])
+        return;
+    Texture &texture = *Textures[handle.Index];
+    // The job reading it holds a pointer; this is rare enough to simply wait for it
+    if (texture.State.load(std::memory_order_acquire) == StreamState::Reading)
+        Reads.Wait();
+
+    ResidentBytes -= std::min(ResidentBytes, texture.Resident.Allocation.Size + texture.Streaming.Allocation.Size);
+    if (texture.Streaming.Image != VK_NULL_HANDLE)
+        Retire(texture.Streaming);
+    Retire(texture.Resident);
+    Owner->Descriptors.Remove(BindlessKind::SampledImage, texture.Bindless);
+    Textures[handle.Index].reset();
+    FreeSlots.push_back(handle.Index);
+}
+
+void TextureStreamer::Request(TextureHandle handle, uint32_t mip)
+{
+    if (!handle.Valid() || handle.Index >= Textures.size() || !Textures[handle.Index])
+        return;
+    Texture &texture = *Textures[handle.Index];
+    uint64_t frame = Owner->FrameNumber + 1;
+    mip = std::min(mip, texture.TailMip);
+    texture.WantedMip = texture.RequestFrame == frame ? std::min(texture.WantedMip, mip) : mip;
+    texture.RequestFrame = frame;
+}
+
+BindlessHandle TextureStreamer::GetBindless(TextureHandle handle) const
+{
+    if (!handle.Valid() || handle.Index >= Textures.size() || !Textures[handle.Index])
+        return {};
+    return Textures[handle.Index]->Bindless;
+}
+
+uint32_t TextureStreamer::GetResidentMip(TextureHandle handle) const
+{
+    if (!handle.Valid() || handle.Index >= Textures.size() || !Textures[handle.Index])
+        return 0;
+    return Textures[handle.Index]->Resident.FirstMip;
+}
+
+void TextureStreamer::CreateResidency(const Texture &texture, uint32_t firstMip, Residency &residency)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = texture.Format;
+    imageInfo.extent = {std::max(texture.Info.Width >> firstMip, 1u), std::max(texture.Info.Height >> firstMip, 1u), 1};
+    imageInfo.mipLevels = (uint32_t)texture.Info.Levels.size() - firstMip;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(Device, &imageInfo, pAllocator, &residency.Image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create texture image!");
+    }
+    residency.Allocation = Owner->DeviceMemory.AllocateImage(residency.Image, GpuMemoryUsage::GpuOnly);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = residency.Image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = texture.Format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels, 0, 1};
+    if (vkCreateImageView(Device, &viewInfo, pAllocator, &residency.View) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create texture image view!");
+    }
+    residency.FirstMip = firstMip;
+}
+
+void TextureStreamer::DestroyResidency(Residency &residency)
+{
+    vkDestroyImageView(Device, residency.View, pAllocator);
+    vkDestroyImage(Device, residency.Image, pAllocator);
+    if (residency.Allocation)
+        Owner->DeviceMemory.Free(residency.Allocation);
+    residency = {};
+}
+
+void TextureStreamer::Retire(Residency &residency)
+{
+    // This frame's uploads and commands may still use it, as may the frames in flight
+    Retired.push_back({residency, Owner->FrameNumber + 1});
+    residency = {};
+}
+
+void TextureStreamer::UploadTail(const Texture &texture, const Residency &residency)
+{
+    for (uint32_t level = texture.TailMip; level < texture.Info.Levels.size(); level++)
+    {
+        const std::vector<uint8_t> &data = texture.Tail[level - texture.TailMip];
+        UploadImageRegion region;
+        region.MipLevel = level - residency.FirstMip;
+        region.Extent = {std::max(texture.Info.Width >> level, 1u), std::max(texture.Info.Height >> level, 1u), 1};
+        Owner->Uploads.UploadImage(residency.Image, region, data.data(), data.size());
+    }
+}
+
+VkDeviceSize TextureStreamer::ChainSize(const Texture &texture, uint32_t firstMip) const
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = firstMip; level < texture.Info.Levels.size(); level++)
+        size += Ktx2::LevelSize(texture.Format, texture.Info.Width, texture.Info.Height, level);
+    return size;
+}
+
+bool TextureStreamer::ReadLevel(std::istream &file, const Texture &texture, uint32_t level, std::vector<uint8_t> &data) const
+{
+    const Ktx2Level &source = texture.Info.Levels[level];
+    std::vector<uint8_t> blocks;
+    std::vector<uint8_t> &destination = texture.Decode ? blocks : data;
+    // Only the bytes the level's texels need: ReadInfo checked ByteLength holds them, and anything past them is padding
+    destination.resize((size_t)Ktx2::LevelSize(texture.Info.Format, texture.Info.Width, texture.Info.Height, level));
+    file.clear();
+    file.seekg((std::streamoff)source.ByteOffset);
+    if (!file.read(reinterpret_cast<char *>(destination.data()), (std::streamsize)destination.size()))
+        return false;
+    if (!texture.Decode)
+        return true;
+
+    uint32_t width = std::max(texture.Info.Width >> level, 1u);
+    uint32_t height = std::max(texture.Info.Height >> level, 1u);
+    data.resize((size_t)Ktx2::LevelSize(texture.Format, texture.Info.Width, texture.Info.Height, level));
+    return BlockCompression::DecodeImage(texture.Info.Format, blocks.data(), width, height, data.data());
+}
+
+void TextureStreamer::StartStreaming(Texture &texture, uint32_t firstMip)
+{
+    static Metrics::Counter &streamedBytes = Metrics::GetCounter("stela_texture_streamed_bytes_total", "Texture level bytes read from disk and queued for upload");
+
+    CreateResidency(texture, firstMip, texture.Streaming);
+    texture.State.store(StreamState::Reading, std::memory_order_release);
+    Reads.Add();
+    Texture *target = &texture;
+    Jobs::Submit([this, target]
+    {
+        // Only this job touches Streaming until State leaves Reading; the rest of the texture is read-only
+        const Residency &residency = target->Streaming;
+        std::ifstream file(target->Path, std::ios::binary);
+        std::vector<std::vector<uint8_t>> levels(target->TailMip - residency.FirstMip);
+        bool read = (bool)file;
+        for (uint32_t level = residency.FirstMip; read && level < target->TailMip; level++)
+            read = ReadLevel(file, *target, level, levels[level - residency.FirstMip]);
+
+        // Nothing is queued unless every level was read, so a failed image can be destroyed right away
+        if (read)
+        {
+            for (uint32_t level = residency.FirstMip; level < target->TailMip; level++)
+            {
+                const std::vector<uint8_t> &data = levels[level - residency.FirstMip];
+                UploadImageRegion region;
+                region.MipLevel = level - residency.FirstMip;
+                region.Extent = {std::max(target->Info.Width >> level, 1u), std::max(target->Info.Height >> level, 1u), 1};
+                Owner->Uploads.UploadImage(residency.Image, region, data.data(), data.size());
+                streamedBytes.Add(data.size());
+            }
+            UploadTail(*target, residency);
+        }
+        target->State.store(read ? StreamState::Ready : StreamState::Failed, std::memory_order_release);
+        Reads.Done();
+    });
+}
+
+void TextureStreamer::FinishStreaming(Texture &texture)
+{
+    // Its uploads were queued before Ready was set, so the Flush after this Update submits them
+    if (!Replace(texture, texture.Streaming))
+    {
+        STELA_LOG_WARNING(Render, "Cannot stream %s: no bindless image slot is free; keeping mip %u", texture.Path, texture.Resident.FirstMip);
+        texture.Broken = true;
+    }
+    texture.State.store(StreamState::Idle, std::memory_order_release);
+}
+
+bool TextureStreamer::Replace(Texture &texture, Residency &replacement)
+{
+    // Frames in flight may still sample the old slot, so it is not rewritten but freed once they finish
+    BindlessHandle bindless = Owner->Descriptors.AddImage(replacement.View);
+    if (!bindless.Valid())
+    {
+        Retire(replacement);
+        return false;
+    }
+    Owner->Descriptors.Remove(BindlessKind::SampledImage, texture.Bindless);
+    texture.Bindless = bindless;
+    Retire(texture.Resident);
+    texture.Resident = replacement;
+    replacement = {};
+    return true;
+}
+
+void TextureStreamer::EvictToTail(Texture &texture)
+{
+    static Metrics::Counter &evictions = Metrics::GetCounter("stela_texture_evictions_total", "Textures dropped to their mip tail to stay within the texture budget");
+
+    Residency tail;
+    CreateResidency(texture, texture.TailMip, tail);
+    UploadTail(texture, tail);
+    VkDeviceSize before = texture.Resident.Allocation.Size;
+    VkDeviceSize after = tail.Allocation.Size;
+    if (!Replace(texture, tail))
+        return;
+    ResidentBytes -= std::min(ResidentBytes, before);
+    ResidentBytes += after;
+    evictions.Add();
+}
+
+bool TextureStreamer::MakeRoom(VkDeviceSize bytes, const Texture *keep)
+{
+    if (ResidentBytes + bytes <= Budget)
+        return true;
+
+    std::vector<Texture *> idle;
+    for (std::unique_ptr<Texture> &texture : Textures)
+    {
+        if (texture && texture.get() != keep && texture->State.load(std::memory_order_acquire) == StreamState::Idle &&
+            texture->Resident.FirstMip < texture->TailMip && texture->RequestFrame + IdleFrames <= Owner->FrameNumber)
+            idle.push_back(texture.get());
+    }
+    std::sort(idle.begin(), idle.end(), [](const Texture *a, const Texture *b) { return a->RequestFrame < b->RequestFrame; });
+    for (Texture *texture : idle)
+    {
+        EvictToTail(*texture);
+        if (ResidentBytes + bytes <= Budget)
+            return true;
+    }
+    return false;
+}
+
+void TextureStreamer::Update()
+{
+    static Metrics::Gauge &residentBytes = Metrics::GetGauge("stela_texture_resident_bytes", "Device memory held by texture images, including ones being streamed in");
+
+    while (!Retired.empty() && Retired.front().Frame <= Owner->CompletedFrames)
+    {
+        DestroyResidency(Retired.front().Images);
+        Retired.pop_front();
+    }
+
+    ResidentBytes = 0;
+    uint32_t reading = 0;
+    std::vector<Texture *> wanting;
+    for (std::unique_ptr<Texture> &texture : Textures)
+    {
+        if (!texture)
+            continue;
+        StreamState state = texture->State.load(std::memory_order_acquire);
+        if (state == StreamState::Ready)
+            FinishStreaming(*texture);
+        else if (state == StreamState::Failed)
+        {
+            STELA_LOG_WARNING(Render, "Cannot stream %s: reading its levels failed; keeping mip %u", texture->Path, texture->Resident.FirstMip);
+            DestroyResidency(texture->Streaming);
+            texture->Broken = true;
+            texture->State.store(StreamState::Idle, std::memory_order_release);
+        }
+        else if (state == StreamState::Reading)
+            reading++;
+
+        ResidentBytes += texture->Resident.Allocation.Size + texture->Streaming.Allocation.Size;
+        // Requested this frame or the last one
+        bool recent = texture->RequestFrame >= Owner->FrameNumber;
+        if (recent && !texture->Broken && texture->State.load(std::memory_order_relaxed) == StreamState::Idle && texture->WantedMip < texture->Resident.FirstMip)
+            wanting.push_back(texture.get());
+    }
+
+    // Over budget (it was lowered): drop the least recently requested, in use or not
+    if (ResidentBytes > Budget && !MakeRoom(0, nullptr))
+    {
+        std::vector<Texture *> resident;
+        for (std::unique_ptr<Texture> &texture : Textures)
+        {
+            if (texture && texture->State.load(std::memory_order_acquire) == StreamState::Idle && texture->Resident.FirstMip < texture->TailMip)
+                resident.push_back(texture.get());
+        }
+        std::sort(resident.begin(), resident.end(), [](const Texture *a, const Texture *b) { return a->RequestFrame < b->RequestFrame; });
+        for (size_t i = 0; i < resident.size() && ResidentBytes > Budget; i++)
+            EvictToTail(*resident[i]);
+    }
+
+    // Most recently requested first, then the ones furthest from what they want
+    std::sort(wanting.begin(), wanting.end(), [](const Texture *a, const Texture *b)
+    {
+        if (a->RequestFrame != b->RequestFrame)
+            return a->RequestFrame > b->RequestFrame;
+        return a->Resident.FirstMip - a->WantedMip > b->Resident.FirstMip - b->WantedMip;
+    });
+    for (Texture *texture : wanting)
+    {
+        if (reading >= MaxConcurrentReads)
+            break;
+        // The finest chain that fits; the new image lives beside the old one until it takes over
+        for (uint32_t mip = texture->WantedMip; mip < texture->Resident.FirstMip; mip++)
+        {
+            VkDeviceSize bytes = ChainSize(*texture, mip);
+            if (!MakeRoom(bytes, texture))
+                continue;
+            StartStreaming(*texture, mip);
+            ResidentBytes += bytes;
+            reading++;
+            break;
+        }
+    }
+    residentBytes.Set((double)ResidentBytes);
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "Bindless.h"
+#include "GpuAllocator.h"
+#include "Ktx2.h"
+#include <Jobs/JobSystem.h>
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Vulkan;
+
+// Index of a loaded texture; stays valid until unloaded
+struct TextureHandle
+{
+    uint32_t Index = UINT32_MAX;
+
+    bool Valid() const { return Index != UINT32_MAX; }
+};
+
+// KTX2 textures (see TextureCooker) sampled through the bindless set, with their mips streamed in
+// and out under a GPU memory budget (STELA_TEXTURE_BUDGET_MB).
+//
+// Load reads the mip tail (the levels 64 texels across or smaller), keeps it in CPU memory and makes
+// it resident, so a texture can be drawn the frame it is loaded. Request asks for finer levels; once
+// per frame Update picks the most recently requested textures that fit the budget, creates an image
+// holding the finer chain and has a job read and queue its levels, then gives the texture a new
+// bindless slot for it once they are; slots that frames in flight may sample are never rewritten,
+// only freed after those frames finish. When the budget runs short, textures nobody has requested
+// for a while drop back to their tail. There is no sparse residency: each step replaces the image, which
+// rewrites the levels kept but works on every device, MoltenVK included, and keeps memory exact.
+//
+// Formats the device cannot sample (BC on most mobile GPUs) are decoded to 8-bit when their levels
+// are read. Files in other formats, such as ASTC or ETC2 from other tools, load as they are where
+// supported. Main thread only.
+class TextureStreamer
+{
+public:
+    // Levels this size or smaller are always resident
+    static constexpr uint32_t TailSize = 64;
+
+    // After Vulkan::Uploads and Vulkan::Descriptors
+    void Init(Vulkan &vulkan);
+    // Once the device is idle
+    void Destroy();
+
+    // Invalid when the file cannot be read or the device cannot use it (or bindless is unavailable)
+    TextureHandle Load(const std::string &path);
+    void Unload(TextureHandle handle);
+    // The texture is drawn this frame and needs `mip` or finer; the finest level asked for wins
+    void Request(TextureHandle handle, uint32_t mip = 0);
+    // Changes whenever the resident mips do, so read it every frame after Update (MaterialDesc::BaseColorTexture does)
+    BindlessHandle GetBindless(TextureHandle handle) const;
+    // Finest level resident now
+    uint32_t GetResidentMip(TextureHandle handle) const;
+
+    // Once per frame, before MeshRenderer::Prepare and Uploader::Flush
+    void Update();
+
+    VkDeviceSize GetBudget() const { return Budget; }
+    void SetBudget(VkDeviceSize bytes) { Budget = bytes; }
+    VkDeviceSize GetResidentBytes() const { return ResidentBytes; }
+
+private:
+    // An image holding levels FirstMip.. of a texture
+    struct Residency
+    {
+        VkImage Image = VK_NULL_HANDLE;
+        GpuAllocation Allocation;
+        VkImageView View = VK_NULL_HANDLE;
+        uint32_t FirstMip = 0;
+    };
+
+    enum class StreamState : uint32_t
+    {
+        Idle,
+        Reading, // a job is reading levels into Texture::Streaming
+        Ready,   // every level is queued for upload
+        Failed,
+    };
+
+    struct Texture
+    {
+        std::string Path;
+        Ktx2Info Info;
+        VkFormat Format = VK_FORMAT_UNDEFINED; // of the image: the file's, or what it is decoded to
+        bool Decode = false;
+        uint32_t TailMip = 0;
+        std::vector<std::vector<uint8_t>> Tail; // levels TailMip.., as uploaded
+        Residency Resident;
+        Residency Streaming;
+        std::atomic<StreamState> State{StreamState::Idle};
+        uint32_t WantedMip = 0;
+        uint64_t RequestFrame = 0; // FrameNumber + 1 of the last Request, 0 before any
+        bool Broken = false;       // reading finer levels failed; it stays at what it has
+        BindlessHandle Bindless;
+    };
+
+    struct RetiredResidency
+    {
+        Residency Images;
+        uint64_t Frame;
+    };
+
+    void CreateResidency(const Texture &texture, uint32_t firstMip, Residency &residency);
+    void DestroyResidency(Residency &residency);
+    // Destroyed once the frames that may sample it have finished
+    void Retire(Residency &residency);
+    void UploadTail(const Texture &texture, const Residency &residency);
+    // Bytes of levels firstMip.. as the image stores them
+    VkDeviceSize ChainSize(const Texture &texture, uint32_t firstMip) const;
+    // One level as uploaded (decoded when needed); thread-safe
+    bool ReadLevel(std::istream &file, const Texture &texture, uint32_t level, std::vector<uint8_t> &data) const;
+    void StartStreaming(Texture &texture, uint32_t firstMip);
+    void FinishStreaming(Texture &texture);
+    // Makes `replacement` resident under a new bindless slot; false (and `replacement` retired) when no slot is free
+    bool Replace(Texture &texture, Residency &replacement);
+    // Drops idle textures to their tail until `bytes` more fit the budget
+    bool MakeRoom(VkDeviceSize bytes, const Texture *keep);
+    void EvictToTail(Texture &texture);
+
+    Vulkan *Owner = nullptr;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkDeviceSize Budget = 0;
+    VkDeviceSize ResidentBytes = 0;
+    std::vector<std::unique_ptr<Texture>> Textures;
+    std::vector<uint32_t> FreeSlots;
+    std::deque<RetiredResidency> Retired;
+    Jobs::WaitGroup Reads;
+};
@@ -0,0 +1,402 @@
+#include "Uploader.h"
+#include "Vulkan.h"
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Satisfies the bufferOffset rules of every format we copy from (texel block size, multiple of 4)
+static constexpr VkDeviceSize StagingAlignment = 16;
+
+void Uploader::Init(Vulkan &vulkan, VkDeviceSize ringSize)
+{
+    Owner = &vulkan;
+    Device = vulkan.Device;
+    pAllocator = vulkan.pAllocator;
+    GraphicsFamily = vulkan.FindQueueFamilies(vulkan.PhysicalDevice).graphicsFamily.value();
+
+    // Handing resources between queues needs the timeline; without it uploads share the graphics queue
+    Timelines = vulkan.TimelineSemaphores;
+    Dedicated = Timelines && vulkan.TransferQueue != VK_NULL_HANDLE;
+    Queue = Dedicated ? vulkan.TransferQueue : vulkan.GraphicsQueue;
+    QueueFamily = Dedicated ? vulkan.TransferQueueFamily : GraphicsFamily;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = QueueFamily;
+    if (vkCreateCommandPool(Device, &poolInfo, pAllocator, &Pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    if (Timelines)
+    {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(Device, &semaphoreInfo, pAllocator, &TimelineSemaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload timeline semaphore!");
+        }
+    }
+
+    RingSize = ringSize;
+    vulkan.CreateBuffer(RingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GpuMemoryUsage::Upload, Ring, RingAllocation);
+}
+
+void Uploader::Destroy()
+{
+    if (!Owner)
+        return;
+
+    // The device is idle, so every batch has finished
+    for (Batch &batch : InFlight)
+    {
+        if (batch.Fence != VK_NULL_HANDLE)
+            FreeFences.push_back(batch.Fence);
+        for (const TemporaryBuffer &temporary : batch.Temporaries)
+        {
+            vkDestroyBuffer(Device, temporary.Buffer, pAllocator);
+            Owner->DeviceMemory.Free(temporary.Allocation);
+        }
+    }
+    InFlight.clear();
+    for (const TemporaryBuffer &temporary : PendingTemporaries)
+    {
+        vkDestroyBuffer(Device, temporary.Buffer, pAllocator);
+        Owner->DeviceMemory.Free(temporary.Allocation);
+    }
+    PendingTemporaries.clear();
+    Pending.clear();
+
+    for (VkFence fence : FreeFences)
+        vkDestroyFence(Device, fence, pAllocator);
+    FreeFences.clear();
+    FreeCommandBuffers.clear();
+    vkDestroyCommandPool(Device, Pool, pAllocator);
+    vkDestroySemaphore(Device, TimelineSemaphore, pAllocator);
+
+    vkDestroyBuffer(Device, Ring, pAllocator);
+    Owner->DeviceMemory.Free(RingAllocation);
+    Owner = nullptr;
+}
+
+UploadTicket Uploader::UploadBuffer(VkBuffer destination, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+    PendingCopy copy{};
+    copy.DestinationBuffer = destination;
+    copy.DestinationOffset = offset;
+    copy.Size = size;
+    return Enqueue(copy, data);
+}
+
+UploadTicket Uploader::UploadImage(VkImage destination, const UploadImageRegion &region, const void *data, VkDeviceSize size, VkImageLayout finalLayout)
+{
+    PendingCopy copy{};
+    copy.DestinationImage = destination;
+    copy.Size = size;
+    copy.Region = region;
+    copy.FinalLayout = finalLayout;
+    return Enqueue(copy, data);
+}
+
+UploadTicket Uploader::Enqueue(PendingCopy copy, const void *data)
+{
+    static Metrics::Counter &uploadBytes = Metrics::GetCounter("stela_upload_bytes_total", "Bytes queued for upload to the GPU");
+    static Metrics::Counter &overflows = Metrics::GetCounter("stela_upload_ring_overflows_total", "Uploads that did not fit the staging ring and got a temporary buffer");
+    uploadBytes.Add(copy.Size);
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    uint64_t position = (Head + StagingAlignment - 1) & ~(StagingAlignment - 1);
+    if (position % RingSize + copy.Size > RingSize)
+        position = (position / RingSize + 1) * RingSize; // never straddle the end; skip to the start
+    if (copy.Size <= RingSize && position + copy.Size - Tail <= RingSize)
+    {
+        // Copied under the lock: a Flush in between would otherwise submit the range before it is written
+        Head = position + copy.Size;
+        copy.Source = Ring;
+        copy.SourceOffset = position % RingSize;
+        std::memcpy(static_cast<char *>(RingAllocation.Mapped) + copy.SourceOffset, data, copy.Size);
+        Pending.push_back(copy);
+        return NextValue;
+    }
+    lock.unlock();
+
+    overflows.Add();
+    TemporaryBuffer temporary;
+    Owner->CreateBuffer(copy.Size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GpuMemoryUsage::Upload, temporary.Buffer, temporary.Allocation);
+    std::memcpy(temporary.Allocation.Mapped, data, copy.Size);
+    copy.Source = temporary.Buffer;
+    copy.SourceOffset = 0;
+
+    lock.lock();
+    Pending.push_back(copy);
+    PendingTemporaries.push_back(temporary);
+    return NextValue;
+}
+
+void Uploader::Retire()
+{
+    uint64_t completed = 0;
+    if (Timelines)
+        vkGetSemaphoreCounterValue(Device, TimelineSemaphore, &completed);
+
+    while (!InFlight.empty())
+    {
+        Batch &batch = InFlight.front();
+        if (Timelines ? completed < batch.Value : vkGetFenceStatus(Device, batch.Fence) != VK_SUCCESS)
+            break;
+
+        for (const TemporaryBuffer &temporary : batch.Temporaries)
+        {
+            vkDestroyBuffer(Device, temporary.Buffer, pAllocator);
+            Owner->DeviceMemory.Free(temporary.Allocation);
+        }
+        FreeCommandBuffers.push_back(batch.CommandBuffer);
+        if (batch.Fence != VK_NULL_HANDLE)
+        {
+            vkResetFences(Device, 1, &batch.Fence);
+            FreeFences.push_back(batch.Fence);
+        }
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Tail = batch.RingEnd;
+        }
+        CompletedValue.store(batch.Value, std::memory_order_release);
+        InFlight.pop_front();
+    }
+}
+
+void Uploader::Flush()
+{
+    static Metrics::Gauge &ringUsed = Metrics::GetGauge("stela_upload_ring_used_bytes", "Staging ring bytes waiting for the GPU to finish copying them");
+    static Metrics::Counter &batches = Metrics::GetCounter("stela_upload_batches_total", "Upload command buffers submitted");
+
+    Retire();
+    WaitValue = 0;
+    ImageAcquires.clear();
+
+    std::vector<PendingCopy> copies;
+    Batch batch{};
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        ringUsed.Set((double)(Head - Tail));
+        if (Pending.empty())
+            return;
+        copies.swap(Pending);
+        batch.Temporaries.swap(PendingTemporaries);
+        batch.Value = NextValue++;
+        batch.RingEnd = Head;
+    }
+
+    if (FreeCommandBuffers.empty())
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = Pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(Device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+        FreeCommandBuffers.push_back(commandBuffer);
+    }
+    batch.CommandBuffer = FreeCommandBuffers.back();
+    FreeCommandBuffers.pop_back();
+    Record(batch.CommandBuffer, copies);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.CommandBuffer;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    if (Timelines)
+    {
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batch.Value;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &TimelineSemaphore;
+    }
+    else if (FreeFences.empty())
+    {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(Device, &fenceInfo, pAllocator, &batch.Fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+    }
+    else
+    {
+        batch.Fence = FreeFences.back();
+        FreeFences.pop_back();
+    }
+
+    if (vkQueueSubmit(Queue, 1, &submitInfo, batch.Fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit upload batch!");
+    }
+    batches.Add();
+
+    if (Dedicated)
+        WaitValue = batch.Value;
+    InFlight.push_back(std::move(batch));
+}
+
+void Uploader::Record(VkCommandBuffer commandBuffer, std::vector<PendingCopy> &copies)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin upload command buffer!");
+    }
+
+    // Group copies by source and destination so each pair is a single vkCmdCopyBuffer
+    std::stable_sort(copies.begin(), copies.end(), [](const PendingCopy &a, const PendingCopy &b)
+    {
+        if (a.DestinationImage != b.DestinationImage)
+            return a.DestinationImage < b.DestinationImage;
+        if (a.DestinationBuffer != b.DestinationBuffer)
+            return a.DestinationBuffer < b.DestinationBuffer;
+        return a.Source < b.Source;
+    });
+
+    auto subresource = [](const PendingCopy &copy)
+    {
+        return VkImageSubresourceRange{copy.Region.Aspect, copy.Region.MipLevel, 1, copy.Region.ArrayLayer, 1};
+    };
+
+    // Previous contents of an uploaded subresource are discarded
+    std::vector<VkImageMemoryBarrier> toTransfer;
+    for (const PendingCopy &copy : copies)
+    {
+        if (copy.DestinationImage == VK_NULL_HANDLE)
+            continue;
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = copy.DestinationImage;
+        barrier.subresourceRange = subresource(copy);
+        toTransfer.push_back(barrier);
+    }
+    if (!toTransfer.empty())
+    {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+    }
+
+    std::vector<VkBufferCopy> regions;
+    std::vector<VkBufferMemoryBarrier> bufferReleases;
+    std::vector<VkImageMemoryBarrier> imageReleases;
+    for (size_t i = 0; i < copies.size(); i++)
+    {
+        const PendingCopy &copy = copies[i];
+        if (copy.DestinationImage != VK_NULL_HANDLE)
+        {
+            VkBufferImageCopy region{};
+            region.bufferOffset = copy.SourceOffset;
+            region.imageSubresource = {copy.Region.Aspect, copy.Region.MipLevel, copy.Region.ArrayLayer, 1};
+            region.imageOffset = copy.Region.Offset;
+            region.imageExtent = copy.Region.Extent;
+            vkCmdCopyBufferToImage(commandBuffer, copy.Source, copy.DestinationImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = copy.FinalLayout;
+            barrier.image = copy.DestinationImage;
+            barrier.subresourceRange = subresource(copy);
+            imageReleases.push_back(barrier);
+            continue;
+        }
+
+        regions.push_back({copy.SourceOffset, copy.DestinationOffset, copy.Size});
+        bool last = i + 1 == copies.size() || copies[i + 1].DestinationBuffer != copy.DestinationBuffer || copies[i + 1].Source != copy.Source;
+        if (last)
+        {
+            vkCmdCopyBuffer(commandBuffer, copy.Source, copy.DestinationBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+            regions.clear();
+        }
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.buffer = copy.DestinationBuffer;
+        barrier.offset = copy.DestinationOffset;
+        barrier.size = copy.Size;
+        bufferReleases.push_back(barrier);
+    }
+
+    if (Dedicated)
+    {
+        // Buffers are CONCURRENT, so the timeline wait alone makes their writes visible to the graphics
+        // queue. Images are released to the graphics family, which records the same barriers as acquires;
+        // their old contents were discarded, so nothing is acquired from graphics first.
+        for (VkBufferMemoryBarrier &barrier : bufferReleases)
+        {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+        for (VkImageMemoryBarrier &barrier : imageReleases)
+        {
+            barrier.srcQueueFamilyIndex = QueueFamily;
+            barrier.dstQueueFamilyIndex = GraphicsFamily;
+            VkImageMemoryBarrier acquire = barrier;
+            acquire.srcAccessMask = 0;
+            acquire.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            ImageAcquires.push_back(acquire);
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                             0, nullptr, static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+                             static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+    }
+    else
+    {
+        // Same queue as the frame: a barrier here also orders every later submission
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        for (VkImageMemoryBarrier &image : imageReleases)
+        {
+            image.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            image.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                             1, &barrier, 0, nullptr, static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record upload command buffer!");
+    }
+}
+
+void Uploader::RecordAcquires(VkCommandBuffer commandBuffer)
+{
+    if (ImageAcquires.empty())
+        return;
+
+    // The submit waits on the timeline at ALL_COMMANDS, which this barrier's first scope chains to
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr, 0, nullptr, static_cast<uint32_t>(ImageAcquires.size()), ImageAcquires.data());
+    ImageAcquires.clear();
+}
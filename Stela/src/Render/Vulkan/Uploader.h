@@ -0,0 +1,130 @@
+#pragma once
+#include "GpuAllocator.h"
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class Vulkan;
+
+// Identifies the batch an upload was queued in; batches complete in order
+using UploadTicket = uint64_t;
+
+// Destination of an image upload: one mip level of one array layer
+struct UploadImageRegion
+{
+    uint32_t MipLevel = 0;
+    uint32_t ArrayLayer = 0;
+    VkOffset3D Offset{0, 0, 0};
+    VkExtent3D Extent{1, 1, 1};
+    VkImageAspectFlags Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+// Streams buffer and image data to the GPU without stalling the render thread. Upload* copies the
+// source into a persistently mapped staging ring (or a temporary staging buffer when the ring is
+// full) and queues the GPU copy; Flush, called once per frame, records every queued copy into one
+// command buffer and submits it.
+//
+// With a dedicated transfer queue family and timeline semaphores, copies run on the transfer queue:
+// each batch signals the timeline, and the next graphics submit waits on that value. Buffers are
+// written in place while the graphics queue keeps using the rest of them, so buffers the transfer
+// queue writes are created CONCURRENT between the two families (Vulkan::CreateBuffer does this for
+// TRANSFER_DST buffers) and need no ownership transfer. Image subresources are always uploaded from
+// UNDEFINED, discarding what they held, so the batch releases them to the graphics family and the
+// graphics submit records the matching acquires. Otherwise batches go to the graphics queue ahead of
+// the frame and a barrier makes them visible. Either way, anything uploaded before DrawFrame can be
+// used by that frame's commands.
+class Uploader
+{
+public:
+    void Init(Vulkan &vulkan, VkDeviceSize ringSize = 64ull * 1024 * 1024);
+    // Once the device is idle
+    void Destroy();
+
+    // Thread-safe. `data` is copied before returning. `destination` must come from Vulkan::CreateBuffer.
+    UploadTicket UploadBuffer(VkBuffer destination, VkDeviceSize offset, const void *data, VkDeviceSize size);
+    // Thread-safe. The region's subresource is taken from UNDEFINED to `finalLayout`; the rest of the
+    // image is left alone, so mips can be streamed one at a time.
+    UploadTicket UploadImage(VkImage destination, const UploadImageRegion &region, const void *data, VkDeviceSize size,
+                             VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Main thread, once per frame before the graphics command buffer is recorded
+    void Flush();
+    // Records this frame's queue family acquires at the start of the graphics command buffer
+    void RecordAcquires(VkCommandBuffer commandBuffer);
+    // Timeline value the frame's graphics submit waits on; 0 when it needs no wait
+    uint64_t GraphicsWaitValue() const { return WaitValue; }
+    VkSemaphore Timeline() const { return TimelineSemaphore; }
+
+    // The GPU has finished the ticket's copies
+    bool IsComplete(UploadTicket ticket) const { return ticket <= CompletedValue.load(std::memory_order_acquire); }
+    bool UsesTransferQueue() const { return Dedicated; }
+    // The families an upload destination is shared between when UsesTransferQueue
+    uint32_t GraphicsQueueFamily() const { return GraphicsFamily; }
+    uint32_t TransferQueueFamily() const { return QueueFamily; }
+
+private:
+    struct PendingCopy
+    {
+        VkBuffer Source;
+        VkDeviceSize SourceOffset;
+        VkBuffer DestinationBuffer; // or
+        VkImage DestinationImage;
+        VkDeviceSize DestinationOffset;
+        VkDeviceSize Size;
+        UploadImageRegion Region;
+        VkImageLayout FinalLayout;
+    };
+
+    struct TemporaryBuffer
+    {
+        VkBuffer Buffer;
+        GpuAllocation Allocation;
+    };
+
+    struct Batch
+    {
+        uint64_t Value;
+        uint64_t RingEnd; // ring head when the batch was submitted
+        VkCommandBuffer CommandBuffer;
+        VkFence Fence; // without timeline semaphores
+        std::vector<TemporaryBuffer> Temporaries;
+    };
+
+    // Stages `data` in the ring or, when it is full, a temporary buffer, and queues `copy`
+    UploadTicket Enqueue(PendingCopy copy, const void *data);
+    void Retire();
+    void Record(VkCommandBuffer commandBuffer, std::vector<PendingCopy> &copies);
+
+    Vulkan *Owner = nullptr;
+    VkDevice Device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *pAllocator = nullptr;
+    VkQueue Queue = VK_NULL_HANDLE;
+    uint32_t QueueFamily = 0;
+    uint32_t GraphicsFamily = 0;
+    bool Dedicated = false;
+    bool Timelines = false;
+    VkCommandPool Pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> FreeCommandBuffers;
+    std::vector<VkFence> FreeFences;
+    VkSemaphore TimelineSemaphore = VK_NULL_HANDLE;
+
+    VkBuffer Ring = VK_NULL_HANDLE;
+    GpuAllocation RingAllocation;
+    VkDeviceSize RingSize = 0;
+    // Monotonic positions; the ring offset is position % RingSize
+    uint64_t Head = 0;
+    uint64_t Tail = 0;
+
+    std::mutex Mutex; // guards Head, Tail, Pending, PendingTemporaries and NextValue
+    std::vector<PendingCopy> Pending;
+    std::vector<TemporaryBuffer> PendingTemporaries;
+    uint64_t NextValue = 1;
+
+    std::deque<Batch> InFlight;
+    std::atomic<uint64_t> CompletedValue{0};
+    uint64_t WaitValue = 0;
+    std::vector<VkImageMemoryBarrier> ImageAcquires;
+};
@@ -1,7 +1,13 @@
 #include "Vulkan.h"
+#include <Log/Log.h>
+#include <Memory/Memory.h>
+#include <Metrics/Metrics.h>
+#include <Profiler/Profiler.h>
+#include <Startup/StartupGraph.h>
 #include <stdexcept>
+#include <cstdlib>
 #include <vector>
-#include <iostream>
+#include <cstring>
 #include <map>
 #include <optional>
 #include <set>
@@ -9,13 +15,105 @@
 #include <limits>
 #include <algorithm>
 #include <fstream>
+#include <chrono>
 #include <SDL3/SDL.h>
 
 // File-scoped physical device used by PickPhysicalDevice and CreateLogicalDevice
 static VkPhysicalDevice gPhysicalDevice = VK_NULL_HANDLE;
 
+// A cache directory under the per-user data directory
+static std::string UserCacheDirectory(const char *name)
+{
+    std::string directory = ".";
+    if (char *prefPath = SDL_GetPrefPath("Stela", "Stela"))
+    {
+        directory = std::string(prefPath) + name;
+        SDL_free(prefPath);
+    }
+    return directory;
+}
+
+// STELA_PIPELINE_CACHE_DIR overrides the per-user data directory
+static std::string PipelineCacheDirectory()
+{
+    if (const char *directory = std::getenv("STELA_PIPELINE_CACHE_DIR"))
+        return directory;
+    return UserCacheDirectory("PipelineCache");
+}
+
+// Host memory the driver allocates on our behalf is charged to the Render tag
+static void *VKAPI_CALL TrackedAllocation(void *, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+    return Memory::Allocate(size, alignment, Memory::Tag::Render);
+}
+
+static void *VKAPI_CALL TrackedReallocation(void *, void *original, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+    return Memory::Reallocate(original, size, alignment, Memory::Tag::Render);
+}
+
+static void VKAPI_CALL TrackedFree(void *, void *memory)
+{
+    Memory::Free(memory);
+}
+
+static const VkAllocationCallbacks gTrackedAllocator = {nullptr, TrackedAllocation, TrackedReallocation, TrackedFree, nullptr, nullptr};
+
+static const char *PresentModeName(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo_relaxed";
+    default:
+        return "other";
+    }
+}
+
+void Vulkan::LoadDisplaySettings()
+{
+    if (const char *mode = std::getenv("STELA_PRESENT_MODE"))
+    {
+        const VkPresentModeKHR modes[] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+        bool known = false;
+        for (VkPresentModeKHR candidate : modes)
+        {
+            if (strcmp(mode, PresentModeName(candidate)) == 0)
+            {
+                RequestedPresentMode = candidate;
+                known = true;
+            }
+        }
+        if (!known)
+            STELA_LOG_WARNING(Render, "Unknown STELA_PRESENT_MODE '%s' (fifo, fifo_relaxed, mailbox, immediate)", mode);
+    }
+    if (const char *frames = std::getenv("STELA_FRAMES_IN_FLIGHT"))
+    {
+        int value = std::atoi(frames);
+        if (value > 0)
+            FramesInFlight = static_cast<uint32_t>(std::min(value, 3));
+    }
+    if (const char *queued = std::getenv("STELA_MAX_QUEUED_PRESENTS"))
+    {
+        int value = std::atoi(queued);
+        if (value >= 0)
+            MaxQueuedPresents = static_cast<uint32_t>(value);
+    }
+    if (const char *scale = std::getenv("STELA_RENDER_SCALE"))
+        Resolution.SetScale((float)std::atof(scale));
+    if (const char *target = std::getenv("STELA_TARGET_GPU_MS"))
+        Resolution.TargetMilliseconds = std::max(0.0, std::atof(target));
+}
+
 void Vulkan::Init(SDL_Window *window)
 {
+    LoadDisplaySettings();
     CreateInstance();
     SetupDebugMessenger();
     CreateSurface(window);
@@ -29,11 +127,67 @@ void Vulkan::Init(SDL_Window *window)
     CreateFramebuffers();
     CreateCommandPool();
     CreateCommandBuffer();
+    Lights.Init(*this);
+    Pyramid.Init(*this);
+    Meshes.Init(*this);
     CreateSyncObjects();
 }
 
+void Vulkan::AddInitTasks(StartupGraph &graph, SDL_Window *const &window, const std::string &sdlTask, const std::string &windowTask)
+{
+    using Affinity = StartupGraph::Affinity;
+    LoadDisplaySettings();
+
+    // Host memory allocated by any renderer task is charged to the Render tag, whichever thread runs it
+    auto add = [&graph](const std::string &name, std::vector<std::string> dependencies, std::function<void()> task, Affinity affinity = Affinity::Any)
+    {
+        graph.Add(name, std::move(dependencies), [task = std::move(task)]
+        {
+            Memory::ScopedTag tag(Memory::Tag::Render);
+            task();
+        }, affinity);
+    };
+
+    // SDL surface and window-size queries stay on the main thread; everything else only needs its inputs
+    add("Vulkan.LoadShaders", {}, [this] { LoadShaders(); });
+    // SDL_Vulkan_GetInstanceExtensions is not safe against SDL_CreateWindow loading the Vulkan library on
+    // the main thread, so the instance waits for the window
+    add("Vulkan.Instance", {sdlTask, windowTask}, [this]
+    {
+        CreateInstance();
+        SetupDebugMessenger();
+    });
+    add("Vulkan.Surface", {"Vulkan.Instance", windowTask}, [this, &window] { CreateSurface(window); }, Affinity::MainThread);
+    add("Vulkan.Device", {"Vulkan.Surface"}, [this]
+    {
+        PickPhysicalDevice();
+        CreateLogicalDevice();
+    });
+    add("Vulkan.SwapChain", {"Vulkan.Device"}, [this, &window]
+    {
+        CreateSwapChain(window);
+        CreateImageViews();
+    }, Affinity::MainThread);
+    add("Vulkan.CommandBuffers", {"Vulkan.Device"}, [this]
+    {
+        CreateCommandPool();
+        CreateCommandBuffer();
+    });
+    add("Vulkan.Offscreen", {"Vulkan.SwapChain"}, [this] { CreateOffscreenResources(); });
+    add("Vulkan.RenderPass", {"Vulkan.SwapChain"}, [this] { CreateRenderPass(); });
+    add("Vulkan.Framebuffers", {"Vulkan.RenderPass"}, [this] { CreateFramebuffers(); });
+    add("Vulkan.Pipelines", {"Vulkan.RenderPass", "Vulkan.Offscreen", "Vulkan.LoadShaders"}, [this] { CreateGraphicsPipeline(); });
+    add("Vulkan.Lights", {"Vulkan.Device", "Vulkan.LoadShaders"}, [this] { Lights.Init(*this); });
+    add("Vulkan.DepthPyramid", {"Vulkan.Device", "Vulkan.LoadShaders"}, [this] { Pyramid.Init(*this); });
+    add("Vulkan.Meshes", {"Vulkan.RenderPass", "Vulkan.Offscreen", "Vulkan.CommandBuffers", "Vulkan.Lights", "Vulkan.DepthPyramid"}, [this] { Meshes.Init(*this); });
+    add("Vulkan.SyncObjects", {"Vulkan.SwapChain"}, [this] { CreateSyncObjects(); });
+}
+
 void Vulkan::CreateInstance()
 {
+    if (!pAllocator)
+        pAllocator = &gTrackedAllocator;
+
     if (EnableValidationLayers && !CheckValidationLayerSupport())
     {
         throw std::runtime_error("validation layers requested, but not available!");
@@ -57,6 +211,7 @@ void Vulkan::CreateInstance()
     }
 
     AppInfo.apiVersion = apiVersion;
+    ApiVersion = apiVersion;
 
     VkInstanceCreateInfo CreateInfo{};
     CreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -84,7 +239,7 @@ void Vulkan::CreateInstance()
 
     for (const auto &extension : extensions)
     {
-        std::cout << '\t' << extension << '\n';
+        STELA_LOG_DEBUG(Render, "Instance extension: %s", extension);
     }
 
     VkResult Result = vkCreateInstance(
@@ -161,8 +316,16 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Vulkan::DebugCallBack(
     const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
     void *pUserData)
 {
+    Log::Level level = Log::Level::Trace;
+    if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+        level = Log::Level::Error;
+    else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+        level = Log::Level::Warning;
+    else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+        level = Log::Level::Debug;
 
-    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+    if (Log::IsEnabled(level, Log::Category::Render))
+        Log::Write(level, Log::Category::Render, "validation layer: %s", pCallbackData->pMessage);
 
     return VK_FALSE;
 }
@@ -224,6 +387,7 @@ void Vulkan::PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT
 
 void Vulkan::CreateSurface(SDL_Window *window)
 {
+    SurfaceWindow = window;
     if (!SDL_Vulkan_CreateSurface(window, Instance, pAllocator, &Surface))
     {
         throw std::runtime_error(
@@ -246,7 +410,7 @@ void Vulkan::PickPhysicalDevice()
 
     std::multimap<int, VkPhysicalDevice> candidates;
 
-    std::cout << "Detected Vulkan devices:\n";
+    STELA_LOG_INFO(Render, "Detected Vulkan devices:");
 
     for (const auto &device : devices)
     {
@@ -256,9 +420,7 @@ void Vulkan::PickPhysicalDevice()
         int score = RateDeviceSuitability(device);
         candidates.insert({score, device});
 
-        std::cout << "  - " << props.deviceName
-                  << " (type=" << props.deviceType
-                  << ", score=" << score << ")\n";
+        STELA_LOG_INFO(Render, "  - %s (type=%d, score=%d)", props.deviceName, props.deviceType, score);
     }
 
     // Pick the best scoring device
@@ -276,7 +438,7 @@ void Vulkan::PickPhysicalDevice()
     VkPhysicalDeviceProperties chosenProps;
     vkGetPhysicalDeviceProperties(gPhysicalDevice, &chosenProps);
 
-    std::cout << "Selected GPU: " << chosenProps.deviceName << std::endl;
+    STELA_LOG_INFO(Render, "Selected GPU: %s", chosenProps.deviceName);
 }
 
 int Vulkan::RateDeviceSuitability(VkPhysicalDevice device)
@@ -328,9 +490,7 @@ Vulkan::QueueFamilyIndices Vulkan::FindQueueFamilies(VkPhysicalDevice device)
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-    int i = 0;
-
-    for (uint32_t i = 0; i < queueFamilies.size(); i++)
+    for (uint32_t i = 0; i < queueFamilies.size() && !indices.IsComplete(); i++)
     {
         const auto &queueFamily = queueFamilies[i];
 
@@ -342,8 +502,17 @@ Vulkan::QueueFamilyIndices Vulkan::FindQueueFamilies(VkPhysicalDevice device)
 
         if (presentSupport)
             indices.presentFamly = i;
+    }
 
-        if (indices.IsComplete())
+    // Prefer a transfer-only family (DMA engine) over an async compute one
+    for (uint32_t i = 0; i < queueFamilies.size(); i++)
+    {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+            continue;
+        if (!indices.transferFamily || !(flags & VK_QUEUE_COMPUTE_BIT))
+            indices.transferFamily = i;
+        if (!(flags & VK_QUEUE_COMPUTE_BIT))
             break;
     }
 
@@ -389,8 +558,10 @@ void Vulkan::CreateLogicalDevice()
 {
     QueueFamilyIndices indices = FindQueueFamilies(gPhysicalDevice);
 
-    // Create a set of unique queue families we need (graphics + present)
+    // Create a set of unique queue families we need (graphics + present, transfer when there is one)
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamly.value()};
+    if (indices.transferFamily)
+        uniqueQueueFamilies.insert(indices.transferFamily.value());
 
     float queuePriority = 1.0f;
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -411,8 +582,93 @@ void Vulkan::CreateLogicalDevice()
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pEnabledFeatures = &DeviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(gPhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(gPhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    EnabledDeviceExtensions = deviceExtensions;
+    for (const char *extension : optionalDeviceExtensions)
+    {
+        for (const auto &available : availableExtensions)
+        {
+            if (strcmp(available.extensionName, extension) == 0)
+            {
+                EnabledDeviceExtensions.push_back(extension);
+                break;
+            }
+        }
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(EnabledDeviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = EnabledDeviceExtensions.data();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gPhysicalDevice, &properties);
+    ApiVersion = std::min(ApiVersion, properties.apiVersion);
+
+    // Optional features hang off VkPhysicalDeviceFeatures2 and are enabled exactly as reported
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+    pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    if (ApiVersion >= VK_API_VERSION_1_1)
+    {
+        void **next = &features2.pNext;
+        if (IsDeviceExtensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+        {
+            *next = &pipelineLibraryFeatures;
+            next = &pipelineLibraryFeatures.pNext;
+        }
+        if (ApiVersion >= VK_API_VERSION_1_2)
+        {
+            *next = &vulkan12Features;
+            next = &vulkan12Features.pNext;
+        }
+        if (ApiVersion >= VK_API_VERSION_1_3 || IsDeviceExtensionEnabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+        {
+            *next = &synchronization2Features;
+            next = &synchronization2Features.pNext;
+        }
+        if (IsDeviceExtensionEnabled(VK_KHR_PRESENT_ID_EXTENSION_NAME))
+        {
+            *next = &presentIdFeatures;
+            next = &presentIdFeatures.pNext;
+        }
+        if (IsDeviceExtensionEnabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+        {
+            *next = &presentWaitFeatures;
+            next = &presentWaitFeatures.pNext;
+        }
+        vkGetPhysicalDeviceFeatures2(gPhysicalDevice, &features2);
+        // Core features stay opt-in; only the ones the renderer uses are turned on
+        DeviceFeatures.multiDrawIndirect = features2.features.multiDrawIndirect;
+        DeviceFeatures.drawIndirectFirstInstance = features2.features.drawIndirectFirstInstance;
+        DeviceFeatures.pipelineStatisticsQuery = features2.features.pipelineStatisticsQuery;
+        DeviceFeatures.inheritedQueries = features2.features.inheritedQueries;
+        features2.features = DeviceFeatures;
+        createInfo.pEnabledFeatures = nullptr;
+        createInfo.pNext = &features2;
+    }
+    GraphicsPipelineLibrary = pipelineLibraryFeatures.graphicsPipelineLibrary == VK_TRUE;
+    TimelineSemaphores = vulkan12Features.timelineSemaphore == VK_TRUE;
+    DrawIndirectCount = vulkan12Features.drawIndirectCount == VK_TRUE;
+    Synchronization2 = synchronization2Features.synchronization2 == VK_TRUE;
+    PresentId = presentIdFeatures.presentId == VK_TRUE;
+    PresentWait = PresentId && presentWaitFeatures.presentWait == VK_TRUE;
+    DescriptorIndexing = vulkan12Features.descriptorIndexing && vulkan12Features.runtimeDescriptorArray &&
+                         vulkan12Features.descriptorBindingPartiallyBound &&
+                         vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+                         vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind &&
+                         vulkan12Features.shaderSampledImageArrayNonUniformIndexing;
 
     if (EnableValidationLayers)
     {
@@ -424,7 +680,7 @@ void Vulkan::CreateLogicalDevice()
         createInfo.enabledLayerCount = 0;
     }
 
-    if (vkCreateDevice(gPhysicalDevice, &createInfo, nullptr, &Device) != VK_SUCCESS)
+    if (vkCreateDevice(gPhysicalDevice, &createInfo, pAllocator, &Device) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create logical device!");
     }
@@ -432,6 +688,47 @@ void Vulkan::CreateLogicalDevice()
     // Retrieve queues from the created logical device
     vkGetDeviceQueue(Device, indices.graphicsFamily.value(), 0, &GraphicsQueue);
     vkGetDeviceQueue(Device, indices.presentFamly.value(), 0, &PresentQueue);
+    if (indices.transferFamily)
+    {
+        TransferQueueFamily = indices.transferFamily.value();
+        vkGetDeviceQueue(Device, TransferQueueFamily, 0, &TransferQueue);
+    }
+
+    if (PresentWait)
+        WaitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(Device, "vkWaitForPresentKHR");
+    PresentWait = WaitForPresent != nullptr;
+
+    // The budget query goes through vkGetPhysicalDeviceMemoryProperties2, core since 1.1
+    bool memoryBudget = ApiVersion >= VK_API_VERSION_1_1 && IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    DeviceMemory.Init(gPhysicalDevice, Device, pAllocator, ApiVersion, memoryBudget);
+
+    // Chosen here so the render pass and offscreen startup tasks, which both need it, cannot race.
+    // D16_UNORM is always renderable and sampleable; D32_SFLOAT is only guaranteed to be one of them.
+    VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    VkFormatProperties depthProperties;
+    vkGetPhysicalDeviceFormatProperties(gPhysicalDevice, VK_FORMAT_D32_SFLOAT, &depthProperties);
+    DepthFormat = (depthProperties.optimalTilingFeatures & depthFeatures) == depthFeatures ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_D16_UNORM;
+
+    PersistentCache.Init(gPhysicalDevice, Device, pAllocator, PipelineCacheDirectory());
+    Pipelines.Init(Device, pAllocator, PersistentCache.Handle(), GraphicsPipelineLibrary);
+    Layouts.Init(Device, pAllocator);
+    Uploads.Init(*this);
+    Descriptors.Init(gPhysicalDevice, Device, pAllocator, DescriptorIndexing);
+    Constants.Init(*this);
+    FrameGraph.Init(*this);
+    GpuTimings.Init(*this, indices.graphicsFamily.value(), FramesInFlight);
+    Capture.Init(*this);
+    Textures.Init(*this);
+}
+
+bool Vulkan::IsDeviceExtensionEnabled(const char *name) const
+{
+    for (const char *extension : EnabledDeviceExtensions)
+    {
+        if (strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
 }
 
 Vulkan::SwapChainSupportDetails Vulkan::querySwapChainSupport(VkPhysicalDevice Device)
@@ -478,15 +775,24 @@ VkPresentModeKHR Vulkan::ChooseSwapPresentMode(const std::vector<VkPresentModeKH
 {
     for (const auto &availablePresentMode : AvailablePresentModes)
     {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (availablePresentMode == RequestedPresentMode)
         {
             return availablePresentMode;
         }
     }
 
+    STELA_LOG_WARNING(Render, "Present mode %s is not supported, using fifo", PresentModeName(RequestedPresentMode));
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+void Vulkan::SetPresentMode(VkPresentModeKHR mode)
+{
+    if (mode == RequestedPresentMode)
+        return;
+    RequestedPresentMode = mode;
+    SwapChainDirty = true;
+}
+
 VkExtent2D Vulkan::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR &Capabilities, SDL_Window *Window)
 {
     if (Capabilities.currentExtent.width != UINT32_MAX)
@@ -513,8 +819,10 @@ void Vulkan::CreateSwapChain(SDL_Window *Window)
 {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(gPhysicalDevice);
 
+    // The format is picked again, but render passes and pipelines assume it never changes
     VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupport.presentModes);
+    AvailablePresentModes = swapChainSupport.presentModes;
     VkExtent2D extent = ChooseSwapExtent(swapChainSupport.capabilities, Window);
 
     uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
@@ -534,6 +842,12 @@ void Vulkan::CreateSwapChain(SDL_Window *Window)
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // The upscale pass blits into the swapchain image
+    if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    // Frame capture copies out of it
+    if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
     QueueFamilyIndices indices = FindQueueFamilies(gPhysicalDevice);
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamly.value()};
@@ -555,9 +869,10 @@ void Vulkan::CreateSwapChain(SDL_Window *Window)
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // On recreation the old swapchain hands its resources over; it is destroyed by the caller
+    createInfo.oldSwapchain = SwapChain;
 
-    if (vkCreateSwapchainKHR(Device, &createInfo, nullptr, &SwapChain) != VK_SUCCESS)
+    if (vkCreateSwapchainKHR(Device, &createInfo, pAllocator, &SwapChain) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create swap chain!");
     }
@@ -568,22 +883,97 @@ void Vulkan::CreateSwapChain(SDL_Window *Window)
 
     SwapChainImageFormat = surfaceFormat.format;
     SwapChainExtent = extent;
+    PresentMode = presentMode;
+
+    // Scaled scenes are stretched to the output with a linear blit, in the swapchain format
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(gPhysicalDevice, SwapChainImageFormat, &formatProperties);
+    const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    ScaledRenderingSupported = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures &&
+                               (createInfo.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    SwapChainReadable = (createInfo.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
 }
 
-uint32_t Vulkan::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(gPhysicalDevice, &memProperties);
+bool Vulkan::RecreateSwapChain()
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gPhysicalDevice, Surface, &capabilities);
+    VkExtent2D extent = ChooseSwapExtent(capabilities, SurfaceWindow);
+    if (extent.width == 0 || extent.height == 0)
+        return false;
+
+    RetiredResources retired;
+    retired.SwapChain = SwapChain;
+    retired.ImageViews = std::move(swapChainImageViews);
+    retired.Framebuffers = std::move(SwapChainFramebuffers);
+    retired.RenderFinishedSemaphores = std::move(RenderFinishedSemaphores);
+    retired.Frame = FrameNumber;
+    RetireDepthTarget(SwapChainDepth, retired);
+    Retired.push_back(std::move(retired));
+
+    CreateSwapChain(SurfaceWindow);
+    CreateImageViews();
+    CreateFramebuffers();
+    CreateRenderFinishedSemaphores();
+
+    // Transient images follow the swapchain extent
+    FrameGraphBuilt = false;
+    SwapChainDirty = false;
+    SwapChainFirstPresentId = LastPresentId + 1;
+    STELA_LOG_INFO(Render, "Swapchain recreated: %ux%u, %zu images, %s", SwapChainExtent.width, SwapChainExtent.height,
+                   swapChainImages.size(), PresentModeName(PresentMode));
+    return true;
+}
 
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
-    }
+void Vulkan::DestroyRetired(bool all)
+{
+    auto finished = [&](const RetiredResources &retired) { return all || retired.Frame <= CompletedFrames; };
+    for (RetiredResources &retired : Retired)
+    {
+        if (!finished(retired))
+            continue;
+        for (VkSemaphore semaphore : retired.RenderFinishedSemaphores)
+            vkDestroySemaphore(Device, semaphore, pAllocator);
+        for (VkFramebuffer framebuffer : retired.Framebuffers)
+            vkDestroyFramebuffer(Device, framebuffer, pAllocator);
+        for (VkImageView imageView : retired.ImageViews)
+            vkDestroyImageView(Device, imageView, pAllocator);
+        for (VkImage image : retired.Images)
+            vkDestroyImage(Device, image, pAllocator);
+        for (GpuAllocation &allocation : retired.Allocations)
+            DeviceMemory.Free(allocation);
+        vkDestroySwapchainKHR(Device, retired.SwapChain, pAllocator);
+    }
+    Retired.erase(std::remove_if(Retired.begin(), Retired.end(), finished), Retired.end());
+}
+
+void Vulkan::WaitForQueuedPresents()
+{
+    static Metrics::Histogram &presentWait = Metrics::GetHistogram("stela_present_wait_us", "Time blocked in vkWaitForPresentKHR pacing queued presents, in microseconds");
 
-    throw std::runtime_error("failed to find suitable memory type!");
+    if (!PresentWait || MaxQueuedPresents == 0 || LastPresentId < MaxQueuedPresents)
+        return;
+    uint64_t target = LastPresentId - MaxQueuedPresents + 1;
+    if (target < SwapChainFirstPresentId)
+        return;
+
+    // Bounded, so a present that never completes (a hidden window) cannot hang the frame
+    Metrics::ScopedTimer timer(presentWait);
+    STELA_PROFILE_SCOPE("WaitForPresent");
+    VkResult result = WaitForPresent(Device, SwapChain, target, 100000000ull);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        SwapChainDirty = true;
+}
+
+uint32_t Vulkan::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    uint32_t type = DeviceMemory.FindMemoryType(typeFilter, properties, 0);
+    if (type == UINT32_MAX) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return type;
 }
 
-void Vulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Vulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, GpuMemoryUsage memoryUsage, VkImage& image, GpuAllocation& allocation) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -599,23 +989,41 @@ void Vulkan::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkIma
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateImage(Device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    if (vkCreateImage(Device, &imageInfo, pAllocator, &image) != VK_SUCCESS) {
         throw std::runtime_error("failed to create image!");
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(Device, image, &memRequirements);
+    if (tiling == VK_IMAGE_TILING_LINEAR) {
+        // Linear images share the buffer pools so optimal and linear resources never alias a granularity page
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(Device, image, &memRequirements);
+        allocation = DeviceMemory.Allocate(memRequirements, memoryUsage, true);
+        vkBindImageMemory(Device, image, allocation.Memory, allocation.Offset);
+    } else {
+        allocation = DeviceMemory.AllocateImage(image, memoryUsage);
+    }
+}
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+void Vulkan::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memoryUsage, VkBuffer& buffer, GpuAllocation& allocation) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Uploads write ranges of buffers the graphics queue is reading elsewhere; sharing them avoids a
+    // graphics-to-transfer release before every upload
+    uint32_t families[] = {Uploads.GraphicsQueueFamily(), Uploads.TransferQueueFamily()};
+    if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && Uploads.UsesTransferQueue()) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = families;
+    }
 
-    if (vkAllocateMemory(Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
+    if (vkCreateBuffer(Device, &bufferInfo, pAllocator, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
     }
 
-    vkBindImageMemory(Device, image, imageMemory, 0);
+    allocation = DeviceMemory.AllocateBuffer(buffer, memoryUsage);
 }
 
 void Vulkan::CreateImageViews()
@@ -639,7 +1047,7 @@ void Vulkan::CreateImageViews()
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(Device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
+        if (vkCreateImageView(Device, &createInfo, pAllocator, &swapChainImageViews[i]) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create image views!");
         }
@@ -655,39 +1063,44 @@ void Vulkan::CreateRenderPass()
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // The frame graph moves the image in and out of the attachment layout
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // Stored: the depth pyramid is built from it after the scene pass
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = DepthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+    VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = 2;
+    renderPassInfo.pAttachments = attachments;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(Device, &renderPassInfo, nullptr, &RenderPass) != VK_SUCCESS)
+    if (vkCreateRenderPass(Device, &renderPassInfo, pAllocator, &RenderPass) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create render pass!");
     }
@@ -695,24 +1108,6 @@ void Vulkan::CreateRenderPass()
 
 void Vulkan::CreateOffscreenResources()
 {
-    // Create Image
-    CreateImage(SwapChainExtent.width, SwapChainExtent.height, SwapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, OffscreenImage, OffscreenImageMemory);
-
-    // Create ImageView
-    VkImageViewCreateInfo viewInfo{};
-    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    viewInfo.image = OffscreenImage;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = SwapChainImageFormat;
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
-    if (vkCreateImageView(Device, &viewInfo, nullptr, &OffscreenImageView) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create texture image view!");
-    }
-
     // Create Sampler
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -728,7 +1123,7 @@ void Vulkan::CreateOffscreenResources()
     samplerInfo.compareEnable = VK_FALSE;
     samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    if (vkCreateSampler(Device, &samplerInfo, nullptr, &OffscreenSampler) != VK_SUCCESS) {
+    if (vkCreateSampler(Device, &samplerInfo, pAllocator, &OffscreenSampler) != VK_SUCCESS) {
         throw std::runtime_error("failed to create texture sampler!");
     }
 
@@ -740,180 +1135,251 @@ void Vulkan::CreateOffscreenResources()
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = DepthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-    VkSubpassDependency dependencies[2];
-    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[0].dstSubpass = 0;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    dependencies[1].srcSubpass = 0;
-    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
+    // No subpass dependencies: the frame graph orders the scene pass against the UI pass that samples it
+    VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = 2;
+    renderPassInfo.pAttachments = attachments;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 2;
-    renderPassInfo.pDependencies = dependencies;
 
-    if (vkCreateRenderPass(Device, &renderPassInfo, nullptr, &OffscreenRenderPass) != VK_SUCCESS) {
+    if (vkCreateRenderPass(Device, &renderPassInfo, pAllocator, &OffscreenRenderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create offscreen render pass!");
     }
 
-    // Create Framebuffer
+    // The late scene pass draws over what the first one left; its depth is not read afterwards
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (vkCreateRenderPass(Device, &renderPassInfo, pAllocator, &SceneLoadRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create scene load render pass!");
+    }
+
+    // Window-sized until the Editor reports its viewport
+    CreateColorTarget(Offscreen, SwapChainExtent, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+void Vulkan::CreateColorTarget(ColorTarget &target, VkExtent2D extent, VkImageUsageFlags usage)
+{
+    target.Extent = extent;
+    CreateImage(extent.width, extent.height, SwapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, usage, GpuMemoryUsage::GpuOnly, target.Image, target.Allocation);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target.Image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = SwapChainImageFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(Device, &viewInfo, pAllocator, &target.View) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture image view!");
+    }
+
+    CreateDepthTarget(target.Depth, extent);
+
+    VkImageView attachments[] = {target.View, target.Depth.View};
     VkFramebufferCreateInfo framebufferInfo{};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     framebufferInfo.renderPass = OffscreenRenderPass;
-    framebufferInfo.attachmentCount = 1;
-    framebufferInfo.pAttachments = &OffscreenImageView;
-    framebufferInfo.width = SwapChainExtent.width;
-    framebufferInfo.height = SwapChainExtent.height;
+    framebufferInfo.attachmentCount = 2;
+    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
     framebufferInfo.layers = 1;
 
-    if (vkCreateFramebuffer(Device, &framebufferInfo, nullptr, &OffscreenFramebuffer) != VK_SUCCESS) {
+    if (vkCreateFramebuffer(Device, &framebufferInfo, pAllocator, &target.Framebuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create offscreen framebuffer!");
     }
 }
 
+void Vulkan::RetireColorTarget(ColorTarget &target)
+{
+    if (target.Image == VK_NULL_HANDLE)
+        return;
+    RetiredResources retired;
+    retired.Images.push_back(target.Image);
+    retired.Allocations.push_back(target.Allocation);
+    retired.ImageViews.push_back(target.View);
+    retired.Framebuffers.push_back(target.Framebuffer);
+    retired.Frame = FrameNumber;
+    RetireDepthTarget(target.Depth, retired);
+    Retired.push_back(std::move(retired));
+    target = ColorTarget{};
+}
+
+void Vulkan::RetireImage(VkImage image, const GpuAllocation &allocation, std::vector<VkImageView> views)
+{
+    RetiredResources retired;
+    retired.Images.push_back(image);
+    retired.Allocations.push_back(allocation);
+    retired.ImageViews = std::move(views);
+    retired.Frame = FrameNumber;
+    Retired.push_back(std::move(retired));
+}
+
+void Vulkan::CreateDepthTarget(DepthTarget &target, VkExtent2D extent)
+{
+    target.Extent = extent;
+    CreateImage(extent.width, extent.height, DepthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                GpuMemoryUsage::GpuOnly, target.Image, target.Allocation);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target.Image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = DepthFormat;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    if (vkCreateImageView(Device, &viewInfo, pAllocator, &target.View) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth image view!");
+    }
+}
+
+void Vulkan::RetireDepthTarget(DepthTarget &target, RetiredResources &retired)
+{
+    if (target.Image == VK_NULL_HANDLE)
+        return;
+    retired.Images.push_back(target.Image);
+    retired.Allocations.push_back(target.Allocation);
+    retired.ImageViews.push_back(target.View);
+    target = DepthTarget{};
+}
+
+void Vulkan::DestroyDepthTarget(DepthTarget &target)
+{
+    if (target.Image == VK_NULL_HANDLE)
+        return;
+    vkDestroyImageView(Device, target.View, pAllocator);
+    vkDestroyImage(Device, target.Image, pAllocator);
+    DeviceMemory.Free(target.Allocation);
+    target = DepthTarget{};
+}
+
+const DepthTarget &Vulkan::SceneDepthTarget() const
+{
+    if (FrameGraphScaled)
+        return SceneColor.Depth;
+    return FrameGraphEditor ? Offscreen.Depth : SwapChainDepth;
+}
+
+void Vulkan::SetViewportExtent(VkExtent2D extent)
+{
+    extent.width = std::max(extent.width, 1u);
+    extent.height = std::max(extent.height, 1u);
+    if (extent.width == Offscreen.Extent.width && extent.height == Offscreen.Extent.height)
+        return;
+    RetireColorTarget(Offscreen);
+    CreateColorTarget(Offscreen, extent, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+void Vulkan::UpdateSceneTargets()
+{
+    Resolution.Update(GpuTimings.FrameMilliseconds());
+
+    VkExtent2D output = ImGuiRenderCallback ? Offscreen.Extent : SwapChainExtent;
+    float scale = ScaledRenderingSupported ? Resolution.Scale() : 1.0f;
+    SceneExtent.width = std::max(1u, (uint32_t)std::lround(output.width * scale));
+    SceneExtent.height = std::max(1u, (uint32_t)std::lround(output.height * scale));
+
+    // SceneColor covers the full output, so the scale can move every frame without reallocating
+    bool scaled = SceneExtent.width != output.width || SceneExtent.height != output.height;
+    if (scaled && (SceneColor.Extent.width != output.width || SceneColor.Extent.height != output.height))
+    {
+        RetireColorTarget(SceneColor);
+        CreateColorTarget(SceneColor, output, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    }
+    // Follows the output rather than the scale, so only resizes rebuild it
+    Pyramid.Resize(currentFrame, output);
+}
+
+void Vulkan::RecordUpscale(VkCommandBuffer commandBuffer, VkImage destination, VkExtent2D extent)
+{
+    VkImageBlit region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.srcOffsets[1] = {(int32_t)SceneExtent.width, (int32_t)SceneExtent.height, 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.dstOffsets[1] = {(int32_t)extent.width, (int32_t)extent.height, 1};
+    vkCmdBlitImage(commandBuffer, SceneColor.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+}
+
 void Vulkan::CreateGraphicsPipeline()
 {
-    auto vertShaderCode = readFile("Shaders/shader.vert.spv");
-    auto fragShaderCode = readFile("Shaders/shader.frag.spv");
-
-    VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    std::vector<VkDynamicState> dynamicStates = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-
-    if (vkCreatePipelineLayout(Device, &pipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr; // Optional
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = PipelineLayout;
-    pipelineInfo.renderPass = OffscreenRenderPass; // Use OffscreenRenderPass
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-    pipelineInfo.basePipelineIndex = -1;              // Optional
-
-    if (vkCreateGraphicsPipelines(Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &GraphicsPipeline) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create graphics pipeline!");
-    }
-
-    // Create SwapChain Pipeline (for Runtime Mode)
-    pipelineInfo.renderPass = RenderPass; // Use SwapChain RenderPass
-    if (vkCreateGraphicsPipelines(Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &SwapChainPipeline) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create swapchain pipeline!");
-    }
-
-    vkDestroyShaderModule(Device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(Device, vertShaderModule, nullptr);
+    if (!VertShaderCode || !FragShaderCode)
+        LoadShaders();
+
+    // Layout and vertex input come from the shaders; with bindless descriptors the global set is set 0
+    ShaderReflection reflection = ShaderReflection::Reflect(*VertShaderCode);
+    reflection.Merge(ShaderReflection::Reflect(*FragShaderCode));
+    std::vector<std::pair<uint32_t, VkDescriptorSetLayout>> fixedSets;
+    if (Descriptors.IsEnabled())
+        fixedSets.emplace_back(0, Descriptors.GetSetLayout());
+    PipelineLayout = Layouts.GetPipelineLayout(reflection, fixedSets);
+
+    // Compiled on the job system; the scene draw is skipped until they are ready
+    GraphicsPipelineDesc desc;
+    desc.Name = "Scene";
+    desc.VertexShader = VertShaderCode;
+    desc.FragmentShader = FragShaderCode;
+    reflection.PackedVertexInput(0, desc.Bindings, desc.Attributes);
+    desc.Layout = PipelineLayout;
+    desc.RenderPass = OffscreenRenderPass;
+    ScenePipeline = Pipelines.Request(desc);
+
+    // SwapChain variant (for Runtime Mode)
+    desc.Name = "Scene (swapchain)";
+    desc.RenderPass = RenderPass;
+    SwapChainScenePipeline = Pipelines.Request(desc);
+}
+
+void Vulkan::LoadShaders()
+{
+    Shaders.Init("Shaders", UserCacheDirectory("ShaderCache"));
+    if (const char *reload = std::getenv("STELA_SHADER_HOT_RELOAD"))
+        Shaders.SetHotReload(std::atoi(reload) != 0);
+
+    // Every pipeline built from a reloaded shader is rebuilt; owners of the code swap their copies
+    Shaders.AddReloadListener([this](const ShaderCode &previous, const ShaderCode &replacement)
+    {
+        Pipelines.ReplaceShader(previous, replacement);
+        if (VertShaderCode == previous)
+            VertShaderCode = replacement;
+        if (FragShaderCode == previous)
+            FragShaderCode = replacement;
+    });
+
+    VertShaderCode = Shaders.Get("shader.vert");
+    FragShaderCode = Shaders.Get("shader.frag");
 }
 
 std::vector<char> Vulkan::readFile(const std::string &filename)
@@ -944,7 +1410,7 @@ VkShaderModule Vulkan::CreateShaderModule(const std::vector<char> &code)
     createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
 
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    if (vkCreateShaderModule(Device, &createInfo, pAllocator, &shaderModule) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create shader module!");
     }
@@ -955,22 +1421,24 @@ VkShaderModule Vulkan::CreateShaderModule(const std::vector<char> &code)
 void Vulkan::CreateFramebuffers()
 {
     SwapChainFramebuffers.resize(swapChainImageViews.size());
+    CreateDepthTarget(SwapChainDepth, SwapChainExtent);
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++)
     {
         VkImageView attachments[] = {
-            swapChainImageViews[i]};
+            swapChainImageViews[i],
+            SwapChainDepth.View};
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = RenderPass;
-        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.attachmentCount = 2;
         framebufferInfo.pAttachments = attachments;
         framebufferInfo.width = SwapChainExtent.width;
         framebufferInfo.height = SwapChainExtent.height;
         framebufferInfo.layers = 1;
 
-        if (vkCreateFramebuffer(Device, &framebufferInfo, nullptr, &SwapChainFramebuffers[i]) != VK_SUCCESS)
+        if (vkCreateFramebuffer(Device, &framebufferInfo, pAllocator, &SwapChainFramebuffers[i]) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create framebuffer!");
         }
@@ -986,15 +1454,23 @@ void Vulkan::CreateCommandPool()
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-    if (vkCreateCommandPool(Device, &poolInfo, nullptr, &CommandPool) != VK_SUCCESS)
+    if (vkCreateCommandPool(Device, &poolInfo, pAllocator, &CommandPool) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create command pool!");
     }
+
+    Recorder.Init(Device, pAllocator, queueFamilyIndices.graphicsFamily.value(), FramesInFlight);
+
+    TriangleDrawList.Count = 1;
+    TriangleDrawList.Record = [this](VkCommandBuffer commandBuffer, const DrawBatch &batch)
+    {
+        RecordSceneCommands(commandBuffer, batch.RenderPass == OffscreenRenderPass ? ScenePipeline : SwapChainScenePipeline, batch.Extent);
+    };
 }
 
 void Vulkan::CreateCommandBuffer()
 {
-    CommandBuffers.resize(MAX_FRAMES_IN_FLIGHT); CommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    CommandBuffers.resize(FramesInFlight);
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = CommandPool;
@@ -1006,28 +1482,197 @@ void Vulkan::CreateCommandBuffer()
     }
 }
 
-void Vulkan::RecordSceneCommands(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+void Vulkan::RecordSceneCommands(VkCommandBuffer commandBuffer, PipelineHandle handle, VkExtent2D extent)
 {
+    VkPipeline pipeline = Pipelines.Get(handle);
+    if (pipeline == VK_NULL_HANDLE)
+        return; // still compiling
+
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(SwapChainExtent.width);
-    viewport.height = static_cast<float>(SwapChainExtent.height);
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = SwapChainExtent;
+    scissor.extent = extent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
     // Main scene draw (triangle)
     vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 }
 
+void Vulkan::RecordScenePass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+                             const std::vector<const DrawList *> &lists)
+{
+    VkClearValue clearValues[2] = {};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount = 2;
+    renderPassInfo.pClearValues = clearValues;
+
+    // Draw lists are recorded into secondaries on the job system
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    Recorder.Record(commandBuffer, renderPass, 0, framebuffer, extent, lists);
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void Vulkan::BuildFrameGraph(bool editor, bool scaled, bool capture, bool occlusion)
+{
+    FrameGraph.Reset();
+    FrameGraph.SetExtent(SwapChainExtent);
+
+    // Acquired images are waited on at color output; whatever the presentation engine left is discarded
+    BackbufferResource = FrameGraph.ImportImage("Backbuffer", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    FrameGraph.MarkOutput(BackbufferResource);
+    MeshDrawsResource = FrameGraph.ImportBuffer("MeshDraws");
+    LightClustersResource = FrameGraph.ImportBuffer("LightClusters");
+    // Both start over every frame: the scene pass clears the depth and the pyramid is rebuilt before it
+    // is read. The previous frame last tested against the depth and sampled it for the pyramid.
+    SceneDepthResource = FrameGraph.ImportImage("SceneDepth", VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                                VK_IMAGE_LAYOUT_UNDEFINED);
+    DepthPyramidResource = FrameGraph.ImportImage("DepthPyramid", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                  VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+
+    // Fills the indirect buffers the scene pass draws meshes from. The culling shader binds the pyramid
+    // in every phase but only reads it in the late one.
+    FrameGraph.AddPass("MeshCulling", {{MeshDrawsResource, RenderGraphAccess::ComputeStorageWrite}, {DepthPyramidResource, RenderGraphAccess::ComputeStorageRead}},
+                       [this](VkCommandBuffer commandBuffer) { Meshes.RecordCulling(commandBuffer); });
+    // Bins the frame's lights into the froxel lists the mesh fragment shaders read
+    FrameGraph.AddPass("LightCulling", {{LightClustersResource, RenderGraphAccess::ComputeStorageWrite}},
+                       [this](VkCommandBuffer commandBuffer) { Lights.RecordCulling(commandBuffer); });
+
+    // Editor: the scene goes to the viewport image. Runtime: render directly to the swapchain.
+    RenderGraphResource output = BackbufferResource;
+    if (editor)
+    {
+        // Cleared every frame, and the Editor's last sample of it was in the previous frame's UI pass
+        OffscreenResource = FrameGraph.ImportImage("Offscreen", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                   VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        // The UI pass clears the swapchain's depth buffer along with its color; nothing reads it
+        BackbufferDepthResource = FrameGraph.ImportImage("BackbufferDepth", VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                         VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                                                         VK_IMAGE_LAYOUT_UNDEFINED);
+        output = OffscreenResource;
+    }
+    else
+    {
+        OffscreenResource = {};
+        BackbufferDepthResource = {};
+    }
+
+    // Scaled: drawn at SceneExtent into the corner of SceneColor, then stretched over the output. Its
+    // previous contents are never read, and the last access was the previous frame's blit.
+    RenderGraphResource sceneColor = output;
+    if (scaled)
+    {
+        SceneColorResource = FrameGraph.ImportImage("SceneColor", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                    VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        sceneColor = SceneColorResource;
+    }
+    else
+    {
+        SceneColorResource = {};
+    }
+    VkRenderPass sceneRenderPass = scaled || editor ? OffscreenRenderPass : RenderPass;
+    auto sceneFramebuffer = [this, scaled, editor]
+    {
+        if (scaled)
+            return SceneColor.Framebuffer;
+        return editor ? Offscreen.Framebuffer : SwapChainFramebuffers[CurrentImage];
+    };
+
+    std::vector<RenderGraphUse> sceneUses = {{MeshDrawsResource, RenderGraphAccess::DrawIndirectRead}, {LightClustersResource, RenderGraphAccess::FragmentStorageRead},
+                                             {sceneColor, RenderGraphAccess::ColorAttachmentWrite}, {SceneDepthResource, RenderGraphAccess::DepthAttachmentWrite}};
+    FrameGraph.AddPass("Scene", sceneUses, [this, sceneRenderPass, sceneFramebuffer](VkCommandBuffer commandBuffer)
+    {
+        std::vector<const DrawList *> lists = {&TriangleDrawList};
+        lists.insert(lists.end(), SceneDrawLists.begin(), SceneDrawLists.end());
+        RecordScenePass(commandBuffer, sceneRenderPass, sceneFramebuffer(), SceneExtent, lists);
+    });
+
+    if (occlusion)
+    {
+        // The scene pass drew what was visible last frame. The rest is tested against the farthest
+        // depth it left, and what shows is drawn over the same attachments.
+        FrameGraph.AddPass("DepthPyramid", {{SceneDepthResource, RenderGraphAccess::ComputeSampled}, {DepthPyramidResource, RenderGraphAccess::ComputeStorageWrite}},
+                           [this](VkCommandBuffer commandBuffer) { Pyramid.Record(commandBuffer, currentFrame, SceneDepthTarget().View, SceneExtent); });
+        FrameGraph.AddPass("OcclusionCulling", {{MeshDrawsResource, RenderGraphAccess::ComputeStorageWrite}, {DepthPyramidResource, RenderGraphAccess::ComputeStorageRead}},
+                           [this](VkCommandBuffer commandBuffer) { Meshes.RecordOcclusionCulling(commandBuffer); });
+        FrameGraph.AddPass("SceneLate", sceneUses, [this, sceneFramebuffer](VkCommandBuffer commandBuffer)
+        {
+            RecordScenePass(commandBuffer, SceneLoadRenderPass, sceneFramebuffer(), SceneExtent, LateSceneDrawLists);
+        });
+    }
+
+    if (scaled)
+    {
+        FrameGraph.AddPass("Upscale", {{SceneColorResource, RenderGraphAccess::TransferRead}, {output, RenderGraphAccess::TransferWrite}},
+                           [this, editor](VkCommandBuffer commandBuffer)
+        {
+            if (editor)
+                RecordUpscale(commandBuffer, Offscreen.Image, Offscreen.Extent);
+            else
+                RecordUpscale(commandBuffer, swapChainImages[CurrentImage], SwapChainExtent);
+        });
+    }
+
+    if (capture)
+    {
+        // The finished scene, before the Editor UI is drawn over the swapchain image
+        FrameGraph.AddPass("Capture", {{output, RenderGraphAccess::TransferRead}}, [this, editor](VkCommandBuffer commandBuffer)
+        {
+            Capture.RecordCopy(commandBuffer, editor ? Offscreen.Image : swapChainImages[CurrentImage]);
+        });
+    }
+
+    if (editor)
+    {
+        FrameGraph.AddPass("UI", {{OffscreenResource, RenderGraphAccess::FragmentSampled}, {BackbufferResource, RenderGraphAccess::ColorAttachmentWrite},
+                                  {BackbufferDepthResource, RenderGraphAccess::DepthAttachmentWrite}},
+                           [this](VkCommandBuffer commandBuffer)
+        {
+            VkClearValue clearValues[2] = {};
+            clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+            clearValues[1].depthStencil = {1.0f, 0};
+            VkRenderPassBeginInfo uiPassInfo{};
+            uiPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            uiPassInfo.renderPass = RenderPass;
+            uiPassInfo.framebuffer = SwapChainFramebuffers[CurrentImage];
+            uiPassInfo.renderArea.offset = {0, 0};
+            uiPassInfo.renderArea.extent = SwapChainExtent;
+            uiPassInfo.clearValueCount = 2;
+            uiPassInfo.pClearValues = clearValues;
+
+            vkCmdBeginRenderPass(commandBuffer, &uiPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            // Allow external code (Editor) to record additional commands (e.g., ImGui)
+            ImGuiRenderCallback(commandBuffer);
+            vkCmdEndRenderPass(commandBuffer);
+        });
+    }
+
+    FrameGraphBuilt = true;
+    FrameGraphEditor = editor;
+    FrameGraphScaled = scaled;
+    FrameGraphCapture = capture;
+    FrameGraphOcclusion = occlusion;
+}
+
 void Vulkan::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
     VkCommandBufferBeginInfo beginInfo{};
@@ -1040,86 +1685,117 @@ void Vulkan::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIn
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    // Take ownership of anything the transfer queue uploaded for this frame
+    Uploads.RecordAcquires(commandBuffer);
+    GpuTimings.RecordReset(commandBuffer);
+    Recorder.SetInheritedStatistics(GpuTimings.InheritedStatistics());
+
+    bool editor = static_cast<bool>(ImGuiRenderCallback);
+    VkExtent2D output = editor ? Offscreen.Extent : SwapChainExtent;
+    bool scaled = SceneExtent.width != output.width || SceneExtent.height != output.height;
+    // A swapchain without transfer source usage cannot be captured; the capture is refused as an unsupported format
+    Capture.BeginFrame(FrameNumber, CompletedFrames, output, editor || SwapChainReadable ? SwapChainImageFormat : VK_FORMAT_UNDEFINED);
+    bool capture = Capture.IsActive();
+    bool occlusion = Meshes.IsOcclusionCulling();
+    if (!FrameGraphBuilt || editor != FrameGraphEditor || scaled != FrameGraphScaled || capture != FrameGraphCapture || occlusion != FrameGraphOcclusion)
+        BuildFrameGraph(editor, scaled, capture, occlusion);
+    CurrentImage = imageIndex;
+    // Render targets can be recreated between frames, so they are bound every frame
+    FrameGraph.SetImage(BackbufferResource, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+    if (OffscreenResource.Valid())
+        FrameGraph.SetImage(OffscreenResource, Offscreen.Image, Offscreen.View);
+    if (SceneColorResource.Valid())
+        FrameGraph.SetImage(SceneColorResource, SceneColor.Image, SceneColor.View);
+    const DepthTarget &sceneDepth = SceneDepthTarget();
+    FrameGraph.SetImage(SceneDepthResource, sceneDepth.Image, sceneDepth.View);
+    if (BackbufferDepthResource.Valid())
+        FrameGraph.SetImage(BackbufferDepthResource, SwapChainDepth.Image, SwapChainDepth.View);
+    FrameGraph.SetImage(DepthPyramidResource, Pyramid.GetImage(currentFrame), Pyramid.GetView(currentFrame));
+    FrameGraph.Execute(commandBuffer);
 
-    if (ImGuiRenderCallback)
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
-        // 1. Offscreen Render Pass (Scene)
-        VkRenderPassBeginInfo offscreenPassInfo{};
-        offscreenPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        offscreenPassInfo.renderPass = OffscreenRenderPass;
-        offscreenPassInfo.framebuffer = OffscreenFramebuffer;
-        offscreenPassInfo.renderArea.offset = {0, 0};
-        offscreenPassInfo.renderArea.extent = SwapChainExtent;
-        offscreenPassInfo.clearValueCount = 1;
-        offscreenPassInfo.pClearValues = &clearColor;
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
 
-        vkCmdBeginRenderPass(commandBuffer, &offscreenPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        RecordSceneCommands(commandBuffer, GraphicsPipeline);
-        vkCmdEndRenderPass(commandBuffer);
+void Vulkan::CreateSyncObjects()
+{
+    ImageAvailableSemaphores.resize(FramesInFlight);
 
-        // 2. UI Render Pass (Swapchain)
-        VkRenderPassBeginInfo uiPassInfo{};
-        uiPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        uiPassInfo.renderPass = RenderPass;
-        uiPassInfo.framebuffer = SwapChainFramebuffers[imageIndex];
-        uiPassInfo.renderArea.offset = {0, 0};
-        uiPassInfo.renderArea.extent = SwapChainExtent;
-        uiPassInfo.clearValueCount = 1;
-        uiPassInfo.pClearValues = &clearColor;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        vkCmdBeginRenderPass(commandBuffer, &uiPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        
-        // Allow external code (Editor) to record additional commands (e.g., ImGui)
-        ImGuiRenderCallback(commandBuffer);
+    for (size_t i = 0; i < FramesInFlight; i++) {
+        if (vkCreateSemaphore(Device, &semaphoreInfo, pAllocator, &ImageAvailableSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+
+    if (TimelineSemaphores) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        timelineInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(Device, &timelineInfo, pAllocator, &FrameTimeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame timeline semaphore!");
+        }
+    } else {
+        // Vulkan 1.0/1.1: one fence per frame slot
+        InFlightFences.resize(FramesInFlight);
 
-        vkCmdEndRenderPass(commandBuffer);
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < FramesInFlight; i++) {
+            if (vkCreateFence(Device, &fenceInfo, pAllocator, &InFlightFences[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
     }
-    else
-    {
-        // Runtime Mode: Render directly to Swapchain
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = RenderPass;
-        renderPassInfo.framebuffer = SwapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = SwapChainExtent;
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        RecordSceneCommands(commandBuffer, SwapChainPipeline);
-        vkCmdEndRenderPass(commandBuffer);
+    CreateRenderFinishedSemaphores();
+}
+
+void Vulkan::WaitForFrameSlot()
+{
+    // Frame N signals N + 1, so the slot is free once the frame FramesInFlight back has reached its value
+    uint64_t needed = FrameNumber >= FramesInFlight ? FrameNumber + 1 - FramesInFlight : 0;
+    if (FrameTimeline == VK_NULL_HANDLE) {
+        vkWaitForFences(Device, 1, &InFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        CompletedFrames = std::max(CompletedFrames, needed);
+        return;
     }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to record command buffer!");
+    vkGetSemaphoreCounterValue(Device, FrameTimeline, &CompletedFrames);
+    if (CompletedFrames >= needed)
+        return;
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &FrameTimeline;
+    waitInfo.pValues = &needed;
+    if (vkWaitSemaphores(Device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for frame timeline!");
     }
+    CompletedFrames = needed;
 }
 
-void Vulkan::CreateSyncObjects()
+void Vulkan::CreateRenderFinishedSemaphores()
 {
-    ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    // One per swapchain image: a present may still be waiting on it when the frame slot comes round again
     RenderFinishedSemaphores.resize(swapChainImages.size());
-    InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(Device, &semaphoreInfo, nullptr, &ImageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(Device, &fenceInfo, nullptr, &InFlightFences[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create synchronization objects for a frame!");
-        }
-    }
-
     for (size_t i = 0; i < swapChainImages.size(); i++) {
-        if (vkCreateSemaphore(Device, &semaphoreInfo, nullptr, &RenderFinishedSemaphores[i]) != VK_SUCCESS) {
+        if (vkCreateSemaphore(Device, &semaphoreInfo, pAllocator, &RenderFinishedSemaphores[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create render finished semaphore!");
         }
     }
@@ -1127,36 +1803,105 @@ void Vulkan::CreateSyncObjects()
 
 void Vulkan::DrawFrame()
 {
-    vkWaitForFences(Device, 1, &InFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-    vkResetFences(Device, 1, &InFlightFences[currentFrame]);
+    static Metrics::Histogram &fenceWait = Metrics::GetHistogram("stela_frame_fence_wait_us", "Time blocked waiting for a frame in flight to finish on the GPU, in microseconds");
+    static Metrics::Histogram &acquireWait = Metrics::GetHistogram("stela_swapchain_acquire_us", "Time blocked in vkAcquireNextImageKHR, in microseconds");
+    static Metrics::Histogram &presentTime = Metrics::GetHistogram("stela_swapchain_present_us", "Time spent in vkQueuePresentKHR, in microseconds");
+    static Metrics::Counter &stalls = Metrics::GetCounter("stela_swapchain_stalls_total", "Frames that blocked for more than 1 ms before recording could start");
+
+    STELA_PROFILE_SCOPE("DrawFrame");
+    Shaders.Poll();
+    // Resized, out of date or a new present mode; nothing is drawn while the window has no area
+    if (SwapChainDirty && !RecreateSwapChain())
+        return;
+
+    auto waitStart = std::chrono::steady_clock::now();
+    {
+        STELA_PROFILE_SCOPE("WaitForFrame");
+        WaitForFrameSlot();
+    }
+    auto waitEnd = std::chrono::steady_clock::now();
+    DestroyRetired(false);
+    WaitForQueuedPresents();
+    auto acquireStart = std::chrono::steady_clock::now();
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(Device, SwapChain, UINT64_MAX, ImageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult acquired;
+    {
+        STELA_PROFILE_SCOPE("AcquireImage");
+        acquired = vkAcquireNextImageKHR(Device, SwapChain, UINT64_MAX, ImageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    }
+
+    auto acquireEnd = std::chrono::steady_clock::now();
+    auto fenceUs = std::chrono::duration_cast<std::chrono::microseconds>(waitEnd - waitStart).count();
+    auto acquireUs = std::chrono::duration_cast<std::chrono::microseconds>(acquireEnd - acquireStart).count();
+    fenceWait.Record((uint64_t)fenceUs);
+    acquireWait.Record((uint64_t)acquireUs);
+    if (fenceUs + acquireUs > 1000)
+        stalls.Add();
 
+    // A fence is only reset once a frame will be submitted, so skipping one cannot deadlock the next wait
+    if (acquired == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        SwapChainDirty = true;
+        return;
+    }
+    if (acquired == VK_SUBOPTIMAL_KHR)
+        SwapChainDirty = true; // still presentable; recreated after this frame
+    else if (acquired != VK_SUCCESS)
+        throw std::runtime_error("failed to acquire swap chain image!");
+
+    if (FrameTimeline == VK_NULL_HANDLE)
+        vkResetFences(Device, 1, &InFlightFences[currentFrame]);
+    Recorder.BeginFrame(currentFrame);
+    GpuTimings.BeginFrame(currentFrame);
+    Constants.BeginFrame(currentFrame);
+    Textures.Update();
+    Meshes.Prepare(currentFrame);
+    Lights.Prepare(currentFrame, Meshes.GetView(), Meshes.GetProjection());
+
+    Uploads.Flush();
+    UpdateSceneTargets();
     vkResetCommandBuffer(CommandBuffers[currentFrame], 0);
-    RecordCommandBuffer(CommandBuffers[currentFrame], imageIndex);
+    {
+        STELA_PROFILE_SCOPE("RecordCommandBuffer");
+        RecordCommandBuffer(CommandBuffers[currentFrame], imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = { ImageAvailableSemaphores[currentFrame] };
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    // Uploads flushed to the transfer queue this frame are waited on through their timeline value
+    VkSemaphore waitSemaphores[] = { ImageAvailableSemaphores[currentFrame], Uploads.Timeline() };
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+    uint64_t waitValues[] = {0, Uploads.GraphicsWaitValue()};
+    submitInfo.waitSemaphoreCount = waitValues[1] != 0 ? 2 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &CommandBuffers[currentFrame];
 
-    // Signal the render-finished semaphore for this frame
-    VkSemaphore signalSemaphores[] = { RenderFinishedSemaphores[imageIndex] };
-    submitInfo.signalSemaphoreCount = 1;
+    // Presentation only takes binary semaphores; the frame's completion goes on the timeline
+    VkSemaphore signalSemaphores[] = { RenderFinishedSemaphores[imageIndex], FrameTimeline };
+    uint64_t signalValues[] = {0, FrameNumber + 1};
+    submitInfo.signalSemaphoreCount = FrameTimeline != VK_NULL_HANDLE ? 2 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(GraphicsQueue, 1, &submitInfo, InFlightFences[currentFrame]) != VK_SUCCESS)
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    if (waitValues[1] != 0 || FrameTimeline != VK_NULL_HANDLE)
+        submitInfo.pNext = &timelineInfo;
+
+    VkFence fence = FrameTimeline == VK_NULL_HANDLE ? InFlightFences[currentFrame] : VK_NULL_HANDLE;
+    if (vkQueueSubmit(GraphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
+    GpuTimings.MarkSubmit();
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1170,53 +1915,102 @@ void Vulkan::DrawFrame()
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr; // Optional
 
-    vkQueuePresentKHR(PresentQueue, &presentInfo);
+    // Ids let WaitForQueuedPresents wait for this image to reach the screen
+    uint64_t presentId = LastPresentId + 1;
+    VkPresentIdKHR presentIdInfo{};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    if (PresentId)
+    {
+        presentInfo.pNext = &presentIdInfo;
+        LastPresentId = presentId;
+    }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    VkResult presented;
+    {
+        STELA_PROFILE_SCOPE("Present");
+        Metrics::ScopedTimer timer(presentTime);
+        presented = vkQueuePresentKHR(PresentQueue, &presentInfo);
+    }
+    if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR)
+        SwapChainDirty = true;
+    else if (presented != VK_SUCCESS)
+        throw std::runtime_error("failed to present swap chain image!");
+
+    FrameNumber++;
+    currentFrame = (currentFrame + 1) % FramesInFlight;
+    DeviceMemory.UpdateMetrics();
+    PersistentCache.Tick();
+    Pipelines.EndFrame(FrameNumber, CompletedFrames);
+    Descriptors.EndFrame(FrameNumber, CompletedFrames);
 }
 
 void Vulkan::Cleanup()
 {
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(Device, ImageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(Device, InFlightFences[i], nullptr);
+    for (size_t i = 0; i < FramesInFlight; i++) {
+        vkDestroySemaphore(Device, ImageAvailableSemaphores[i], pAllocator);
     }
+    for (VkFence fence : InFlightFences) {
+        vkDestroyFence(Device, fence, pAllocator);
+    }
+    vkDestroySemaphore(Device, FrameTimeline, pAllocator);
 
     for (size_t i = 0; i < RenderFinishedSemaphores.size(); i++) {
-        vkDestroySemaphore(Device, RenderFinishedSemaphores[i], nullptr);
+        vkDestroySemaphore(Device, RenderFinishedSemaphores[i], pAllocator);
     }
 
-    vkDestroyCommandPool(Device, CommandPool, nullptr);
+    Recorder.Destroy();
+    vkDestroyCommandPool(Device, CommandPool, pAllocator);
 
     for (auto framebuffer : SwapChainFramebuffers)
     {
-        vkDestroyFramebuffer(Device, framebuffer, nullptr);
+        vkDestroyFramebuffer(Device, framebuffer, pAllocator);
+    }
+    DestroyDepthTarget(SwapChainDepth);
+
+    Pipelines.Shutdown();
+    Shaders.Shutdown();
+    Meshes.Destroy();
+    Lights.Destroy();
+    Pyramid.Destroy();
+    Textures.Destroy();
+    Uploads.Destroy();
+    Descriptors.Destroy();
+    Constants.Destroy();
+    FrameGraph.Destroy();
+    GpuTimings.Destroy();
+    Capture.Destroy();
+    Layouts.Destroy();
+    vkDestroyRenderPass(Device, RenderPass, pAllocator);
+
+    vkDestroySampler(Device, OffscreenSampler, pAllocator);
+    for (ColorTarget *target : {&Offscreen, &SceneColor})
+    {
+        vkDestroyFramebuffer(Device, target->Framebuffer, pAllocator);
+        vkDestroyImageView(Device, target->View, pAllocator);
+        vkDestroyImage(Device, target->Image, pAllocator);
+        DeviceMemory.Free(target->Allocation);
+        DestroyDepthTarget(target->Depth);
     }
-
-    vkDestroyPipeline(Device, GraphicsPipeline, nullptr);
-    vkDestroyPipeline(Device, SwapChainPipeline, nullptr);
-    vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
-    vkDestroyRenderPass(Device, RenderPass, nullptr);
-
-    vkDestroySampler(Device, OffscreenSampler, nullptr);
-    vkDestroyImageView(Device, OffscreenImageView, nullptr);
-    vkDestroyImage(Device, OffscreenImage, nullptr);
-    vkFreeMemory(Device, OffscreenImageMemory, nullptr);
-    vkDestroyFramebuffer(Device, OffscreenFramebuffer, nullptr);
-    vkDestroyRenderPass(Device, OffscreenRenderPass, nullptr);
+    vkDestroyRenderPass(Device, OffscreenRenderPass, pAllocator);
+    vkDestroyRenderPass(Device, SceneLoadRenderPass, pAllocator);
 
     for (auto imageView : swapChainImageViews)
     {
-        vkDestroyImageView(Device, imageView, nullptr);
+        vkDestroyImageView(Device, imageView, pAllocator);
     }
 
-    vkDestroySwapchainKHR(Device, SwapChain, nullptr);
-    vkDestroyDevice(Device, nullptr);
+    DestroyRetired(true);
+    vkDestroySwapchainKHR(Device, SwapChain, pAllocator);
+    PersistentCache.Destroy();
+    DeviceMemory.Shutdown();
+    vkDestroyDevice(Device, pAllocator);
     if (EnableValidationLayers)
     {
         DestroyDebugUtilsMessengerEXT(Instance, DebugMessenger, pAllocator);
     }
 
-    vkDestroySurfaceKHR(Instance, Surface, nullptr);
-    vkDestroyInstance(Instance, nullptr);
+    vkDestroySurfaceKHR(Instance, Surface, pAllocator);
+    vkDestroyInstance(Instance, pAllocator);
 }
@@ -1,6 +1,23 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "Bindless.h"
+#include "ClusteredLighting.h"
+#include "CommandRecorder.h"
+#include "ConstantRing.h"
+#include "DepthPyramid.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "GpuAllocator.h"
+#include "GpuProfiler.h"
+#include "LayoutCache.h"
+#include "MeshRenderer.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "RenderGraph.h"
+#include "ShaderSystem.h"
+#include "TextureStreamer.h"
+#include "Uploader.h"
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 #include <SDL3/SDL_stdinc.h>
@@ -8,6 +25,29 @@
 #include <optional>
 #include <fstream>
 #include <functional>
+#include <string>
+
+class StartupGraph;
+
+// Depth buffer of a scene target, in Vulkan::DepthFormat; sampled to build the depth pyramid
+struct DepthTarget
+{
+    VkImage Image = VK_NULL_HANDLE;
+    GpuAllocation Allocation;
+    VkImageView View = VK_NULL_HANDLE;
+    VkExtent2D Extent{0, 0};
+};
+
+// A color image the scene renders into and its depth buffer, with a framebuffer for OffscreenRenderPass
+struct ColorTarget
+{
+    VkImage Image = VK_NULL_HANDLE;
+    GpuAllocation Allocation;
+    VkImageView View = VK_NULL_HANDLE;
+    VkFramebuffer Framebuffer = VK_NULL_HANDLE;
+    VkExtent2D Extent{0, 0};
+    DepthTarget Depth;
+};
 
 class Vulkan
 {
@@ -17,38 +57,138 @@ public:
     VkInstance Instance;
     const VkAllocationCallbacks *pAllocator = nullptr;
     VkDebugUtilsMessengerEXT DebugMessenger;
-    VkDevice Device;
+    VkDevice Device = VK_NULL_HANDLE;
+    // min(instance, device) API version, known once the logical device exists
+    uint32_t ApiVersion = VK_API_VERSION_1_0;
+    GpuAllocator DeviceMemory;
+    // Shared by every pipeline, including the Editor's ImGui ones
+    PipelineCache PersistentCache;
     VkPhysicalDeviceFeatures DeviceFeatures{};
     VkQueue GraphicsQueue;
     VkSurfaceKHR Surface;
     VkQueue PresentQueue;
-    VkSwapchainKHR SwapChain;
+    // Null when the device has no separate transfer family
+    VkQueue TransferQueue = VK_NULL_HANDLE;
+    uint32_t TransferQueueFamily = 0;
+    // Core timeline semaphores and vkCmdDrawIndexedIndirectCount (Vulkan 1.2)
+    bool TimelineSemaphores = false;
+    bool DrawIndirectCount = false;
+    // Staging ring and transfer-queue uploads
+    Uploader Uploads;
+    // Core descriptor indexing (Vulkan 1.2) with update-after-bind and partially bound arrays
+    bool DescriptorIndexing = false;
+    // Global bindless set; disabled without DescriptorIndexing
+    BindlessDescriptors Descriptors;
+    // vkCmdPipelineBarrier2, core in 1.3 or through VK_KHR_synchronization2
+    bool Synchronization2 = false;
+    // Per-pass GPU timestamps (and pipeline statistics when enabled), read back a frame ring later
+    GpuProfiler GpuTimings;
+    // Readback of rendered frames to PNG or YUV files on a writer thread
+    FrameCapture Capture;
+    VkSwapchainKHR SwapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
     VkFormat SwapChainImageFormat;
     VkExtent2D SwapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
+    // Shared by every swapchain framebuffer: frames in flight never draw to the swapchain at once
+    DepthTarget SwapChainDepth;
+    // D32_SFLOAT, or D16_UNORM where 32-bit depth cannot be both rendered and sampled
+    VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+    // Color and depth, both cleared
     VkRenderPass RenderPass;
-    VkPipelineLayout PipelineLayout;
-    VkPipeline GraphicsPipeline;
-    VkPipeline SwapChainPipeline;
+    VkPipelineLayout PipelineLayout; // owned by Layouts
+    // Descriptor set and pipeline layouts from shader reflection, shared between identical interfaces
+    LayoutCache Layouts;
+    // Per-frame uniform data (camera, per-draw constants), bound with dynamic offsets
+    ConstantRing Constants;
+    // Runtime GLSL compilation, SPIR-V cache and hot reload; MeshRenderer loads its shaders here too
+    ShaderSystem Shaders;
+    PipelineLibrary Pipelines;
+    PipelineHandle ScenePipeline;
+    PipelineHandle SwapChainScenePipeline;
     std::vector<VkFramebuffer> SwapChainFramebuffers;
     VkCommandPool CommandPool;
     std::vector<VkCommandBuffer> CommandBuffers;
+    // Per-thread pools and secondary command buffers for the scene pass
+    CommandRecorder Recorder;
+    DrawList TriangleDrawList;
+    // Recorded into the scene pass every frame after the built-in triangle; owners keep them alive
+    std::vector<const DrawList *> SceneDrawLists;
+    // Recorded after the depth pyramid is built, over what SceneDrawLists drew (occlusion culling)
+    std::vector<const DrawList *> LateSceneDrawLists;
+    MeshRenderer Meshes;
+    // Point and spot lights binned per froxel each frame; the mesh shaders read them
+    ClusteredLighting Lights;
+    // Farthest scene depth per tile, built after the scene pass for the meshes' occlusion culling
+    DepthPyramid Pyramid;
+    // KTX2 textures sampled through Descriptors, their mips streamed under STELA_TEXTURE_BUDGET_MB
+    TextureStreamer Textures;
+    // The frame's passes; rebuilt by BuildFrameGraph when switching between Editor and Runtime
+    RenderGraph FrameGraph;
+    RenderGraphResource BackbufferResource;
+    RenderGraphResource OffscreenResource;
+    RenderGraphResource SceneColorResource;
+    RenderGraphResource MeshDrawsResource;
+    RenderGraphResource LightClustersResource;
+    RenderGraphResource SceneDepthResource;
+    RenderGraphResource BackbufferDepthResource;
+    RenderGraphResource DepthPyramidResource;
+    bool FrameGraphBuilt = false;
+    bool FrameGraphEditor = false;
+    bool FrameGraphScaled = false;
+    bool FrameGraphCapture = false;
+    bool FrameGraphOcclusion = false;
+    // Swapchain image being recorded
+    uint32_t CurrentImage = 0;
     std::vector<VkSemaphore> ImageAvailableSemaphores;
     std::vector<VkSemaphore> RenderFinishedSemaphores;
+    // Without timeline semaphores only; otherwise frames are tracked on FrameTimeline
     std::vector<VkFence> InFlightFences;
+    // Signalled to N + 1 when frame N (FrameNumber at its submit) finishes on the graphics queue;
+    // other queues can wait on it for a frame's results. Null without timeline semaphores.
+    VkSemaphore FrameTimeline = VK_NULL_HANDLE;
     uint32_t currentFrame = 0;
-    const int MAX_FRAMES_IN_FLIGHT = 2;
+    // Frame queue depth (1-3): fewer frames in flight means less latency, more means more CPU/GPU overlap.
+    // Fixed once the device exists; STELA_FRAMES_IN_FLIGHT overrides it.
+    uint32_t FramesInFlight = 2;
+    // Frames submitted since Init, and how many of them the GPU has finished (as of the last frame start)
+    uint64_t FrameNumber = 0;
+    uint64_t CompletedFrames = 0;
+
+    // Present mode asked for (STELA_PRESENT_MODE: fifo, fifo_relaxed, mailbox, immediate) and the one in
+    // use; an unsupported request falls back to FIFO, which every device has
+    VkPresentModeKHR RequestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    VkPresentModeKHR PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    std::vector<VkPresentModeKHR> AvailablePresentModes;
+    // VK_KHR_present_id + VK_KHR_present_wait: with MaxQueuedPresents > 0 a frame does not start until
+    // all but that many of the previous presents are on screen (STELA_MAX_QUEUED_PRESENTS)
+    bool PresentWait = false;
+    uint32_t MaxQueuedPresents = 0;
 
-    // Offscreen Resources
-    VkImage OffscreenImage;
-    VkDeviceMemory OffscreenImageMemory;
-    VkImageView OffscreenImageView;
+    // Offscreen Resources: the Editor viewport image, sized to the panel it is shown in (SetViewportExtent)
+    ColorTarget Offscreen;
     VkSampler OffscreenSampler;
-    VkFramebuffer OffscreenFramebuffer;
     VkRenderPass OffscreenRenderPass;
+    // Loads color and depth instead of clearing them; compatible with both passes above, so their
+    // framebuffers and pipelines serve the second scene pass of occlusion culling
+    VkRenderPass SceneLoadRenderPass;
     VkDescriptorSet OffscreenDescriptorSet = VK_NULL_HANDLE;
 
+    // SPIR-V for the scene pipeline, loaded ahead of pipeline creation
+    ShaderCode VertShaderCode;
+    ShaderCode FragShaderCode;
+
+    // Scene render scale (STELA_RENDER_SCALE, 0.5-1; STELA_TARGET_GPU_MS makes it dynamic). Below 1 the
+    // scene is drawn into a corner of SceneColor and blitted up to the viewport or swapchain.
+    DynamicResolution Resolution;
+    ColorTarget SceneColor;
+    // Size the scene is rendered at this frame
+    VkExtent2D SceneExtent{0, 0};
+    // The swapchain format supports the linear blit the upscale pass needs
+    bool ScaledRenderingSupported = false;
+    // Swapchain images can be copied from (frame capture outside the Editor)
+    bool SwapChainReadable = false;
+
 #ifdef NDEBUG
     const bool EnableValidationLayers = false;
 #else
@@ -68,6 +208,8 @@ public:
     {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamly;
+        // A family with transfer but no graphics (ideally no compute either): the GPU's copy engine
+        std::optional<uint32_t> transferFamily;
 
         bool IsComplete()
         {
@@ -77,6 +219,17 @@ public:
 
     const std::vector<const char *> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // Enabled when the device has them; the renderer checks IsDeviceExtensionEnabled before relying on one
+    const std::vector<const char *> optionalDeviceExtensions = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+        VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        VK_KHR_PRESENT_WAIT_EXTENSION_NAME};
+    std::vector<const char *> EnabledDeviceExtensions;
+    bool GraphicsPipelineLibrary = false;
 
     struct SwapChainSupportDetails
     {
@@ -86,6 +239,8 @@ public:
     };
 
     void Init(SDL_Window *window);
+    // Same chain as Init, split into startup tasks. `window` is read once windowTask has run.
+    void AddInitTasks(StartupGraph &graph, SDL_Window *const &window, const std::string &sdlTask, const std::string &windowTask);
     void CreateInstance();
     bool CheckValidationLayerSupport();
     std::vector<const char *> GetRequiredExtensions();
@@ -98,9 +253,12 @@ public:
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice Device);
     bool IsDeviceSuitable(VkPhysicalDevice device);
     
-    void RecordSceneCommands(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+    void RecordSceneCommands(VkCommandBuffer commandBuffer, PipelineHandle handle, VkExtent2D extent);
+    void RecordScenePass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+                         const std::vector<const DrawList *> &lists);
     bool CheckExtensionSupport(VkPhysicalDevice Device);
     void CreateLogicalDevice();
+    bool IsDeviceExtensionEnabled(const char *name) const;
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice Device);
     VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &AvailableFormats);
     VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &AvailablePresentModes);
@@ -108,20 +266,83 @@ public:
     void CreateSwapChain(SDL_Window *Window);
     static std::vector<char> readFile(const std::string &filename);
     VkShaderModule CreateShaderModule(const std::vector<char> &code);
+    void LoadShaders(); // file I/O only, so it can run before the device exists
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-    void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+    void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, GpuMemoryUsage memoryUsage, VkImage& image, GpuAllocation& allocation);
+    // TRANSFER_DST buffers are shared with the transfer queue family when Uploads uses it
+    void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memoryUsage, VkBuffer& buffer, GpuAllocation& allocation);
     void CreateImageViews();
     void CreateRenderPass();
     void CreateOffscreenResources(); // New
+    void CreateColorTarget(ColorTarget &target, VkExtent2D extent, VkImageUsageFlags usage);
+    void CreateDepthTarget(DepthTarget &target, VkExtent2D extent);
+    // Destroyed once the frames that may use it have finished
+    void RetireColorTarget(ColorTarget &target);
+    // Same, for an image and its views created outside the render targets
+    void RetireImage(VkImage image, const GpuAllocation &allocation, std::vector<VkImageView> views);
+    // Editor viewport size in pixels; the offscreen image is recreated right away when it changes
+    void SetViewportExtent(VkExtent2D extent);
     void CreateGraphicsPipeline();
     void CreateFramebuffers();
     void CreateCommandPool();
     void CreateCommandBuffer();
+    // Editor: scene to the offscreen image, then the UI to the swapchain. Runtime: scene to the swapchain.
+    // With `scaled` the scene is drawn at SceneExtent and blitted up to the viewport or swapchain.
+    // With `capture` a pass copies the output into the capture ring. With `occlusion` the scene pass
+    // draws what was visible last frame, the depth pyramid is built from it and the meshes it hides
+    // nothing of are drawn by a second scene pass.
+    void BuildFrameGraph(bool editor, bool scaled, bool capture, bool occlusion);
     void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
     void CreateSyncObjects();
     void DrawFrame();
     void Cleanup();
 
+    // Applied by the next DrawFrame, which recreates the swapchain
+    void SetPresentMode(VkPresentModeKHR mode);
+    // The window's pixel size changed; the swapchain is recreated before the next frame
+    void NotifyResized() { SwapChainDirty = true; }
+    // Without waiting for the GPU: the old swapchain is handed to the new one and destroyed once the
+    // frames that used it are done. Returns false while the window has no area (minimized).
+    bool RecreateSwapChain();
+
     // Expose selected physical device for external use (e.g. Editor ImGui init)
     VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+
+private:
+    // Replaced swapchain or render target objects, kept until `Frame` frames have finished
+    struct RetiredResources
+    {
+        VkSwapchainKHR SwapChain = VK_NULL_HANDLE;
+        std::vector<VkImageView> ImageViews;
+        std::vector<VkFramebuffer> Framebuffers;
+        std::vector<VkSemaphore> RenderFinishedSemaphores;
+        std::vector<VkImage> Images;
+        std::vector<GpuAllocation> Allocations;
+        uint64_t Frame = 0;
+    };
+
+    void LoadDisplaySettings();
+    // Blocks only when the CPU is FramesInFlight frames ahead of the GPU
+    void WaitForFrameSlot();
+    void CreateRenderFinishedSemaphores();
+    // After the current frame's wait; `all` once the device is idle
+    void DestroyRetired(bool all);
+    // Sizes SceneColor, SceneExtent and the depth pyramid for this frame
+    void UpdateSceneTargets();
+    void RetireDepthTarget(DepthTarget &target, RetiredResources &retired);
+    void DestroyDepthTarget(DepthTarget &target);
+    // Depth of the target the scene is drawn to, per the built frame graph
+    const DepthTarget &SceneDepthTarget() const;
+    void RecordUpscale(VkCommandBuffer commandBuffer, VkImage destination, VkExtent2D extent);
+    // Frame pacing through vkWaitForPresentKHR
+    void WaitForQueuedPresents();
+
+    SDL_Window *SurfaceWindow = nullptr;
+    bool SwapChainDirty = false;
+    std::vector<RetiredResources> Retired;
+    PFN_vkWaitForPresentKHR WaitForPresent = nullptr;
+    bool PresentId = false;
+    uint64_t LastPresentId = 0;
+    // Ids below this were presented to an older swapchain
+    uint64_t SwapChainFirstPresentId = 1;
 };
@@ -0,0 +1,244 @@
+#include "Coroutines.h"
+#include <Jobs/JobSystem.h>
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#include <algorithm>
+#include <unordered_set>
+
+namespace Coroutines
+{
+    namespace
+    {
+        struct Timer
+        {
+            double Time;
+            std::coroutine_handle<> Handle;
+            // Min-heap on wake time
+            bool operator<(const Timer &other) const { return Time > other.Time; }
+        };
+
+        struct Condition
+        {
+            std::function<bool()> Ready;
+            std::coroutine_handle<> Handle;
+        };
+
+        // Everything but Ready is main-thread only
+        struct Scheduler
+        {
+            double Time = 0.0;
+            uint64_t Generation = 0;
+            std::vector<std::coroutine_handle<>> NextFrame;
+            std::vector<Timer> Timers;
+            std::vector<Condition> Conditions;
+            std::unordered_set<void *> Roots;
+
+            std::mutex ReadyMutex;
+            std::vector<Detail::Waiter> Ready;
+        };
+
+        Scheduler gScheduler;
+
+        Metrics::Gauge &LiveGauge()
+        {
+            static Metrics::Gauge &gauge = Metrics::GetGauge("stela_coroutines_live", "Started script coroutines that have not finished");
+            return gauge;
+        }
+    }
+
+    Detail::Waiter Detail::Suspend(std::coroutine_handle<> handle)
+    {
+        return {handle, gScheduler.Generation};
+    }
+
+    void Detail::ScheduleNextFrame(std::coroutine_handle<> handle)
+    {
+        gScheduler.NextFrame.push_back(handle);
+    }
+
+    void Detail::ScheduleAt(double time, std::coroutine_handle<> handle)
+    {
+        gScheduler.Timers.push_back({time, handle});
+        std::push_heap(gScheduler.Timers.begin(), gScheduler.Timers.end());
+    }
+
+    void Detail::ScheduleWhen(std::function<bool()> condition, std::coroutine_handle<> handle)
+    {
+        gScheduler.Conditions.push_back({std::move(condition), handle});
+    }
+
+    void Detail::ScheduleReady(Waiter waiter)
+    {
+        std::lock_guard<std::mutex> lock(gScheduler.ReadyMutex);
+        gScheduler.Ready.push_back(waiter);
+    }
+
+    void Detail::Adopt(std::coroutine_handle<> root)
+    {
+        gScheduler.Roots.insert(root.address());
+        LiveGauge().Set(static_cast<double>(gScheduler.Roots.size()));
+    }
+
+    void Detail::Release(std::coroutine_handle<> root, std::exception_ptr error)
+    {
+        gScheduler.Roots.erase(root.address());
+        LiveGauge().Set(static_cast<double>(gScheduler.Roots.size()));
+        root.destroy();
+
+        if (error)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception &e)
+            {
+                STELA_LOG_ERROR(Scripts, "Unhandled exception in coroutine: %s", e.what());
+            }
+            catch (...)
+            {
+                STELA_LOG_ERROR(Scripts, "Unhandled exception in coroutine");
+            }
+        }
+    }
+
+    std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+    {
+        promise_type &promise = handle.promise();
+        if (promise.Continuation)
+            return promise.Continuation;
+
+        // A started task: nobody is waiting for it, so it cleans up after itself
+        Detail::Release(handle, promise.Error);
+        return std::noop_coroutine();
+    }
+
+    void Start(Task task)
+    {
+        auto handle = std::exchange(task.Handle, {});
+        if (!handle)
+            return;
+        Detail::Adopt(handle);
+        handle.resume();
+    }
+
+    void Tick(float dt)
+    {
+        static Metrics::Counter &resumes = Metrics::GetCounter("stela_coroutine_resumes_total", "Script coroutines resumed by the scheduler");
+
+        Scheduler &s = gScheduler;
+        s.Time += dt;
+
+        // Anything scheduled while resuming lands in the fresh lists and waits for the next Tick
+        std::vector<std::coroutine_handle<>> resume;
+        resume.swap(s.NextFrame);
+
+        while (!s.Timers.empty() && s.Timers.front().Time <= s.Time)
+        {
+            std::pop_heap(s.Timers.begin(), s.Timers.end());
+            resume.push_back(s.Timers.back().Handle);
+            s.Timers.pop_back();
+        }
+
+        if (!s.Conditions.empty())
+        {
+            std::vector<Condition> conditions;
+            conditions.swap(s.Conditions);
+            for (Condition &condition : conditions)
+            {
+                if (condition.Ready())
+                    resume.push_back(condition.Handle);
+                else
+                    s.Conditions.push_back(std::move(condition));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s.ReadyMutex);
+            for (const Detail::Waiter &waiter : s.Ready)
+            {
+                if (waiter.Generation == s.Generation)
+                    resume.push_back(waiter.Handle);
+            }
+            s.Ready.clear();
+        }
+
+        const uint64_t generation = s.Generation;
+        for (std::coroutine_handle<> handle : resume)
+        {
+            // A coroutine may cancel everything, which destroys the rest of this batch
+            if (s.Generation != generation)
+                break;
+            handle.resume();
+        }
+        resumes.Add(resume.size());
+    }
+
+    void CancelAll()
+    {
+        Scheduler &s = gScheduler;
+        s.Generation++;
+        s.NextFrame.clear();
+        s.Timers.clear();
+        s.Conditions.clear();
+        {
+            std::lock_guard<std::mutex> lock(s.ReadyMutex);
+            s.Ready.clear();
+        }
+
+        // Destroying a root destroys the tasks it is awaiting along with it
+        std::unordered_set<void *> roots;
+        roots.swap(s.Roots);
+        for (void *root : roots)
+            std::coroutine_handle<>::from_address(root).destroy();
+
+        if (!roots.empty())
+            STELA_LOG_DEBUG(Scripts, "Cancelled %zu coroutines", roots.size());
+        LiveGauge().Set(0.0);
+    }
+
+    double Now()
+    {
+        return gScheduler.Time;
+    }
+
+    size_t LiveCount()
+    {
+        return gScheduler.Roots.size();
+    }
+
+    void JobAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        Detail::Waiter waiter = Detail::Suspend(handle);
+        Jobs::Submit([work = std::move(Work), error = Error, waiter]
+        {
+            // The coroutine is resumed either way, so a failing job never leaves it suspended forever
+            try
+            {
+                work();
+            }
+            catch (...)
+            {
+                *error = std::current_exception();
+            }
+            Detail::ScheduleReady(waiter);
+        });
+    }
+
+    void Event::Signal()
+    {
+        std::vector<Detail::Waiter> waiters;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            waiters.swap(Waiters);
+        }
+        for (const Detail::Waiter &waiter : waiters)
+            Detail::ScheduleReady(waiter);
+    }
+
+    void Event::Awaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(Target.Mutex);
+        Target.Waiters.push_back(Detail::Suspend(handle));
+    }
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Latent script logic on C++20 coroutines. A Task suspends on an awaitable and Coroutines::Tick
+// (once per frame, main thread) resumes it only when its wait condition is met. Waiting tasks sit
+// in a timer heap, an event's waiter list or a job's completion, so idle behaviours cost nothing
+// per frame. WaitUntil is the one exception: its predicate is polled every tick.
+//
+//     Coroutines::Task Door()
+//     {
+//         co_await doorTrigger;            // Coroutines::Event
+//         co_await Coroutines::Wait(2.0f); // game seconds
+//         co_await Coroutines::RunJob([] { LoadRoom(); });
+//         co_await Coroutines::NextFrame();
+//     }
+//     Coroutines::Start(Door());
+namespace Coroutines
+{
+    namespace Detail
+    {
+        // A suspended coroutine plus the scheduler generation it was suspended in. CancelAll starts a
+        // new generation, so wake-ups delivered later for destroyed coroutines are dropped.
+        struct Waiter
+        {
+            std::coroutine_handle<> Handle;
+            uint64_t Generation;
+        };
+
+        Waiter Suspend(std::coroutine_handle<> handle);
+        void ScheduleNextFrame(std::coroutine_handle<> handle);
+        void ScheduleAt(double time, std::coroutine_handle<> handle);
+        void ScheduleWhen(std::function<bool()> condition, std::coroutine_handle<> handle);
+        // Thread-safe; the coroutine is resumed on the main thread during the next Tick
+        void ScheduleReady(Waiter waiter);
+        void Adopt(std::coroutine_handle<> root);
+        void Release(std::coroutine_handle<> root, std::exception_ptr error);
+    }
+
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            std::coroutine_handle<> Continuation;
+            std::exception_ptr Error;
+
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+                void await_resume() noexcept {}
+            };
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { Error = std::current_exception(); }
+        };
+
+        Task() = default;
+        Task(Task &&other) noexcept : Handle(std::exchange(other.Handle, {})) {}
+        Task &operator=(Task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (Handle)
+                    Handle.destroy();
+                Handle = std::exchange(other.Handle, {});
+            }
+            return *this;
+        }
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+        ~Task()
+        {
+            if (Handle)
+                Handle.destroy();
+        }
+
+        // Awaiting a task runs it as part of the caller; its exception, if any, is rethrown there
+        bool await_ready() const noexcept { return !Handle || Handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+        {
+            Handle.promise().Continuation = caller;
+            return Handle;
+        }
+        void await_resume()
+        {
+            if (Handle && Handle.promise().Error)
+                std::rethrow_exception(Handle.promise().Error);
+        }
+
+    private:
+        friend void Start(Task task);
+        explicit Task(std::coroutine_handle<promise_type> handle) : Handle(handle) {}
+
+        std::coroutine_handle<promise_type> Handle;
+    };
+
+    // Runs the task until its first suspension and hands it to the scheduler, which destroys it when
+    // it finishes or on CancelAll. Exceptions escaping a started task are logged.
+    void Start(Task task);
+
+    // Resumes every coroutine whose wait is over. Called by the engine after the script systems run.
+    void Tick(float dt);
+    // Destroys every started task (script reload, shutdown)
+    void CancelAll();
+
+    // Scheduler time in seconds: the sum of every dt passed to Tick, so it stops while the engine is paused
+    double Now();
+    size_t LiveCount();
+
+    struct NextFrameAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { Detail::ScheduleNextFrame(handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct WaitAwaiter
+    {
+        double Seconds;
+
+        bool await_ready() const noexcept { return Seconds <= 0.0; }
+        void await_suspend(std::coroutine_handle<> handle) { Detail::ScheduleAt(Now() + Seconds, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct WaitUntilAwaiter
+    {
+        std::function<bool()> Condition;
+
+        bool await_ready() const { return Condition(); }
+        void await_suspend(std::coroutine_handle<> handle) { Detail::ScheduleWhen(std::move(Condition), handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct JobAwaiter
+    {
+        std::function<void()> Work;
+        // What Work threw, rethrown in the coroutine. Shared with the job, which may finish after a
+        // cancelled coroutine (and this awaiter) is gone.
+        std::shared_ptr<std::exception_ptr> Error = std::make_shared<std::exception_ptr>();
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const
+        {
+            if (*Error)
+                std::rethrow_exception(*Error);
+        }
+    };
+
+    inline NextFrameAwaiter NextFrame() { return {}; }
+    inline WaitAwaiter Wait(double seconds) { return {seconds}; }
+    inline WaitUntilAwaiter WaitUntil(std::function<bool()> condition) { return {std::move(condition)}; }
+    // Runs `work` on the job system; the coroutine continues on the main thread once it has finished,
+    // with anything `work` threw rethrown from the co_await
+    inline JobAwaiter RunJob(std::function<void()> work) { return {std::move(work)}; }
+
+    // Wakes every coroutine waiting on it. Signal is thread-safe; waiters resume on the next Tick.
+    class Event
+    {
+    public:
+        void Signal();
+
+        struct Awaiter
+        {
+            Event &Target;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() const noexcept {}
+        };
+        Awaiter operator co_await() { return {*this}; }
+
+    private:
+        std::mutex Mutex;
+        std::vector<Detail::Waiter> Waiters;
+    };
+}
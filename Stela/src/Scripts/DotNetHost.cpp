@@ -4,7 +4,11 @@
 #include <nethost.h>
 #include <coreclr_delegates.h>
 #include <hostfxr.h>
-#include <iostream>
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
+#if !defined(__APPLE__)
+#include <Render/Vulkan/FrameCapture.h>
+#endif
 #include <filesystem>
 #include <vector>
 
@@ -33,7 +37,7 @@ namespace fs = std::filesystem;
 namespace DotNetHost {
 
     // Globals to hold delegates
-    void (*csharp_init)(void (*)(const char*), bool (*)(int)) = nullptr;
+    void (*csharp_init)(void (*)(const char*), bool (*)(int), void (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t), bool (*)(int, int)) = nullptr;
     int (*csharp_load_script_assembly)(const char*) = nullptr;
     void (*csharp_update)(float) = nullptr;
     void (*csharp_shutdown)() = nullptr;
@@ -80,13 +84,42 @@ namespace DotNetHost {
 
     // Callback passed to C#
     void LogCallback(const char* msg) {
-        std::cout << "[DotNet] " << msg << std::endl;
+        STELA_LOG_INFO(DotNet, "%s", msg);
     }
 
     bool DotNetInput_KeyPressed(int key) {
         return Input::KeyPressed((Input::Keys)key);
     }
 
+    // Called from C# once per frame with the runtime's running totals
+    void DotNetMetrics_ReportGc(int64_t gen0, int64_t gen1, int64_t gen2, int64_t allocatedBytes, int64_t heapBytes, int64_t pauseMicroseconds) {
+        static Metrics::Counter& gen0Collections = Metrics::GetCounter("stela_dotnet_gc_collections_total", "Garbage collections by generation", "generation=\"0\"");
+        static Metrics::Counter& gen1Collections = Metrics::GetCounter("stela_dotnet_gc_collections_total", "Garbage collections by generation", "generation=\"1\"");
+        static Metrics::Counter& gen2Collections = Metrics::GetCounter("stela_dotnet_gc_collections_total", "Garbage collections by generation", "generation=\"2\"");
+        static Metrics::Counter& allocated = Metrics::GetCounter("stela_dotnet_allocated_bytes_total", "Bytes allocated on the managed heap");
+        static Metrics::Gauge& heap = Metrics::GetGauge("stela_dotnet_heap_bytes", "Bytes currently thought to be allocated on the managed heap");
+        static Metrics::Counter& pause = Metrics::GetCounter("stela_dotnet_gc_pause_us_total", "Time the runtime was paused for garbage collection, in microseconds");
+
+        gen0Collections.Set((uint64_t)gen0);
+        gen1Collections.Set((uint64_t)gen1);
+        gen2Collections.Set((uint64_t)gen2);
+        allocated.Set((uint64_t)allocatedBytes);
+        heap.Set((double)heapBytes);
+        pause.Set((uint64_t)pauseMicroseconds);
+    }
+
+    // Called from C#; false while another capture runs or when the renderer cannot capture
+    bool DotNetCapture_Request(int frames, int format) {
+#if !defined(__APPLE__)
+        FrameCapture* capture = FrameCapture::Get();
+        if (!capture || frames <= 0)
+            return false;
+        return capture->Request((uint32_t)frames, format == 1 ? CaptureFormat::Yuv : CaptureFormat::Png);
+#else
+        return false;
+#endif
+    }
+
     bool Init(const char* assemblyDir) {
         // If already initialized, just reload
         if (load_assembly_and_get_function_pointer != nullptr) {
@@ -100,7 +133,7 @@ namespace DotNetHost {
         }
 
         if (!LoadHostFxr()) {
-            std::cerr << "Failed to load hostfxr" << std::endl;
+            STELA_LOG_ERROR(DotNet, "Failed to load hostfxr");
             return false;
         }
 
@@ -109,14 +142,14 @@ namespace DotNetHost {
         fs::path dllPath = dir / "ScriptLoader.dll";                   // Use ScriptLoader DLL
 
         if (!fs::exists(configPath) || !fs::exists(dllPath)) {
-            std::cerr << "Files missing: " << configPath << " or " << dllPath << std::endl;
+            STELA_LOG_ERROR(DotNet, "Files missing: %s or %s", configPath.string(), dllPath.string());
             return false;
         }
 
         hostfxr_handle cxt = nullptr;
         int rc = init_fptr(configPath.c_str(), nullptr, &cxt);
         if (rc != 0 && rc != 1) { // 1 = Host already initialized
-            std::cerr << "Init failed: " << std::hex << rc << std::endl;
+            STELA_LOG_ERROR(DotNet, "Init failed: %x", rc);
             if (cxt) close_fptr(cxt);
             return false;
         }
@@ -127,7 +160,7 @@ namespace DotNetHost {
             (void**)&load_assembly_and_get_function_pointer);
         
         if (rc != 0 || load_assembly_and_get_function_pointer == nullptr) {
-            std::cerr << "Get delegate failed: " << std::hex << rc << std::endl;
+            STELA_LOG_ERROR(DotNet, "Get delegate failed: %x", rc);
             if (cxt) close_fptr(cxt);
             return false;
         }
@@ -150,7 +183,7 @@ namespace DotNetHost {
             nullptr,
             (void**)&csharp_init);
 
-        if (rc != 0) std::cerr << "Failed to get Init: " << std::hex << rc << std::endl;
+        if (rc != 0) STELA_LOG_ERROR(DotNet, "Failed to get Init: %x", rc);
 
         // LoadUserScripts
         rc = load_assembly_and_get_function_pointer(
@@ -161,7 +194,7 @@ namespace DotNetHost {
             nullptr,
             (void**)&csharp_load_script_assembly);
 
-        if (rc != 0) std::cerr << "Failed to get LoadUserScripts: " << std::hex << rc << std::endl;
+        if (rc != 0) STELA_LOG_ERROR(DotNet, "Failed to get LoadUserScripts: %x", rc);
 
         // Update
         rc = load_assembly_and_get_function_pointer(
@@ -172,7 +205,7 @@ namespace DotNetHost {
             nullptr,
             (void**)&csharp_update);
 
-        if (rc != 0) std::cerr << "Failed to get Update: " << std::hex << rc << std::endl;
+        if (rc != 0) STELA_LOG_ERROR(DotNet, "Failed to get Update: %x", rc);
 
         // Shutdown
         rc = load_assembly_and_get_function_pointer(
@@ -183,10 +216,10 @@ namespace DotNetHost {
             nullptr,
             (void**)&csharp_shutdown);
 
-        if (rc != 0) std::cerr << "Failed to get Shutdown: " << std::hex << rc << std::endl;
+        if (rc != 0) STELA_LOG_ERROR(DotNet, "Failed to get Shutdown: %x", rc);
 
         if (csharp_init && csharp_load_script_assembly) {
-            csharp_init(LogCallback, DotNetInput_KeyPressed);
+            csharp_init(LogCallback, DotNetInput_KeyPressed, DotNetMetrics_ReportGc, DotNetCapture_Request);
             
             // Initial load of user scripts
             fs::path userDllPath = dir / "UserScripts.dll";
@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <iostream>
 
+namespace Metrics { class Histogram; }
+
 #if defined(_WIN32)
   #if defined(Stela_EXPORTS)
     #define STELA_API __declspec(dllexport)
@@ -20,6 +22,7 @@ struct ScriptSystem
     void (*Start)();
     void (*Update)(float);
     void (*Shutdown)();
+    Metrics::Histogram* UpdateTime = nullptr; // resolved once at registration
 };
 
 // One single global vector, no static
@@ -1,13 +1,15 @@
 #pragma once
 #include "EngineGlobals.h"
+#include <Log/Log.h>
+#include <Metrics/Metrics.h>
 #include <vector>
 #include <string>
-#include <iostream>
 
 inline void Engine_RegisterScript(const char* name, void (*start)(), void (*update)(float), void (*shutdown)())
 {
-    gScriptSystems.push_back({ name, start, update, shutdown });
-    std::cout << "[Engine] Registered script: " << name << std::endl;
+    Metrics::Histogram* updateTime = &Metrics::GetHistogram("stela_system_update_us", "Time spent in a script system's Update, in microseconds", std::string("system=\"") + name + "\"");
+    gScriptSystems.push_back({ name, start, update, shutdown, updateTime });
+    STELA_LOG_INFO(Scripts, "Registered script: %s", name);
 }
 
 inline void RunStarts()
@@ -23,7 +25,12 @@ inline void RunSystems(float dt)
 {
     for (auto& sys : gScriptSystems) {
         if (sys.Update) {
-            sys.Update(dt);
+            if (sys.UpdateTime) {
+                Metrics::ScopedTimer timer(*sys.UpdateTime);
+                sys.Update(dt);
+            } else {
+                sys.Update(dt);
+            }
         }
     }
 }
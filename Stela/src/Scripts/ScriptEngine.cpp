@@ -1,6 +1,8 @@
 #include "DotNetHost.h"
 #include "RegisterSystem.h"
-#include <iostream>
+#include "Coroutines.h"
+#include <Log/Log.h>
+#include <Memory/Memory.h>
 #include <string>
 #include <filesystem>
 
@@ -26,18 +28,21 @@ void DotNetShutdownScript() {
 namespace ScriptEngine {
 
     void Init(const char* assemblyDir) {
+        Memory::ScopedTag tag(Memory::Tag::Scripts);
         if (DotNetHost::Init(assemblyDir)) {
-            std::cout << "[ScriptEngine] DotNet Host Initialized." << std::endl;
+            STELA_LOG_INFO(Scripts, "DotNet Host Initialized.");
             
             // Register the DotNet bridge script
             Engine_RegisterScript("DotNetRuntime", DotNetStart, DotNetUpdate, DotNetShutdownScript);
             
         } else {
-            std::cerr << "[ScriptEngine] Failed to initialize DotNet Host." << std::endl;
+            STELA_LOG_ERROR(Scripts, "Failed to initialize DotNet Host.");
         }
     }
 
     void Shutdown() {
+        // Coroutine frames live in script code, so they go before the scripts do
+        Coroutines::CancelAll();
         DotNetHost::Shutdown();
     }
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "StartupGraph.h"
+#include <Jobs/JobSystem.h>
+#include <Log/Log.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+    // Captured while the engine library is loaded, which is as close to process start as a library gets
+    const auto gProcessStart = std::chrono::steady_clock::now();
+}
+
+double StartupGraph::Now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gProcessStart).count();
+}
+
+void StartupGraph::Add(const std::string &name, std::vector<std::string> dependencies, std::function<void()> task, Affinity affinity)
+{
+    Tasks.push_back({name, std::move(dependencies), std::move(task), affinity});
+}
+
+bool StartupGraph::Has(const std::string &name) const
+{
+    return std::any_of(Tasks.begin(), Tasks.end(), [&](const Task &task) { return task.Name == name; });
+}
+
+namespace
+{
+    // Shared by Run and the jobs it submits. Jobs hold a reference until they have fully returned,
+    // so Run can leave as soon as the last task has reported in.
+    struct RunState
+    {
+        std::mutex Mutex;
+        std::condition_variable Wake;
+        std::deque<size_t> MainReady;
+        size_t InFlight = 0;
+        size_t Finished = 0;
+        std::exception_ptr Error;
+        std::vector<std::vector<size_t>> Dependents;
+        std::vector<uint32_t> Remaining;
+    };
+}
+
+struct StartupGraph::Scheduler
+{
+    // Queues tasks that just became ready: main-thread ones on the main queue, the rest into `submit`.
+    // Called with the mutex held.
+    static void Dispatch(StartupGraph &graph, RunState &state, const std::vector<size_t> &ready, std::vector<size_t> &submit)
+    {
+        for (size_t i : ready)
+        {
+            state.InFlight++;
+            if (graph.Tasks[i].Where == Affinity::MainThread)
+                state.MainReady.push_back(i);
+            else
+                submit.push_back(i);
+        }
+    }
+
+    static void SubmitAll(StartupGraph &graph, const std::shared_ptr<RunState> &state, const std::vector<size_t> &submit)
+    {
+        for (size_t i : submit)
+            Jobs::Submit([&graph, state, i] { Execute(graph, state, i); });
+    }
+
+    static void Execute(StartupGraph &graph, const std::shared_ptr<RunState> &state, size_t i)
+    {
+        Task &task = graph.Tasks[i];
+        double start = Now();
+        std::exception_ptr failure;
+        try
+        {
+            task.Work();
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        double end = Now();
+
+        std::vector<size_t> submit;
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            graph.Entries.push_back({task.Name, start, end, Jobs::CurrentWorker()});
+            state->Finished++;
+            state->InFlight--;
+
+            if (failure && !state->Error)
+                state->Error = failure;
+
+            if (!state->Error)
+            {
+                std::vector<size_t> ready;
+                for (size_t dependent : state->Dependents[i])
+                {
+                    if (--state->Remaining[dependent] == 0)
+                        ready.push_back(dependent);
+                }
+                Dispatch(graph, *state, ready, submit);
+            }
+            state->Wake.notify_all();
+        }
+        // Anything in `submit` is counted as in flight, so the graph is still alive here
+        SubmitAll(graph, state, submit);
+    }
+};
+
+void StartupGraph::Run()
+{
+    const size_t count = Tasks.size();
+    auto state = std::make_shared<RunState>();
+
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!index.emplace(Tasks[i].Name, i).second)
+            throw std::runtime_error("duplicate startup task '" + Tasks[i].Name + "'");
+    }
+
+    state->Dependents.resize(count);
+    state->Remaining.assign(count, 0);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (const std::string &dependency : Tasks[i].Dependencies)
+        {
+            auto it = index.find(dependency);
+            if (it == index.end())
+                throw std::runtime_error("startup task '" + Tasks[i].Name + "' depends on unknown task '" + dependency + "'");
+            state->Dependents[it->second].push_back(i);
+            state->Remaining[i]++;
+        }
+    }
+
+    Entries.clear();
+    Entries.reserve(count);
+    RunStartMs = Now();
+
+    std::vector<size_t> submit;
+    {
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        std::vector<size_t> roots;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (state->Remaining[i] == 0)
+                roots.push_back(i);
+        }
+        Scheduler::Dispatch(*this, *state, roots, submit);
+    }
+    Scheduler::SubmitAll(*this, state, submit);
+
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(state->Mutex);
+        state->Wake.wait(lock, [&] { return !state->MainReady.empty() || state->InFlight == 0; });
+        if (state->MainReady.empty())
+            break;
+
+        size_t next = state->MainReady.front();
+        state->MainReady.pop_front();
+        lock.unlock();
+        Scheduler::Execute(*this, state, next);
+    }
+
+    RunEndMs = Now();
+    std::sort(Entries.begin(), Entries.end(), [](const TimelineEntry &a, const TimelineEntry &b) { return a.StartMs < b.StartMs; });
+
+    std::exception_ptr error;
+    size_t finished;
+    {
+        // Taken out under the lock: a worker may still be dropping the last reference to the state
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        error = std::move(state->Error);
+        state->Error = nullptr;
+        finished = state->Finished;
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (finished != count)
+        throw std::runtime_error("startup graph has a dependency cycle");
+}
+
+void StartupGraph::LogTimeline() const
+{
+    constexpr int BarWidth = 48;
+    double span = std::max(RunEndMs - RunStartMs, 0.001);
+
+    double busy = 0.0;
+    uint32_t threads = 0;
+    for (const TimelineEntry &entry : Entries)
+    {
+        busy += entry.EndMs - entry.StartMs;
+        threads = std::max(threads, entry.Worker + 1);
+    }
+
+    STELA_LOG_INFO(Engine, "Startup timeline: %.1f ms wall, %.1f ms of work across %u threads", WallMs(), busy, threads);
+
+    for (const TimelineEntry &entry : Entries)
+    {
+        int from = static_cast<int>((entry.StartMs - RunStartMs) / span * BarWidth);
+        int to = static_cast<int>((entry.EndMs - RunStartMs) / span * BarWidth);
+        from = std::clamp(from, 0, BarWidth - 1);
+        to = std::clamp(to, from + 1, BarWidth);
+
+        std::string bar(BarWidth, ' ');
+        std::fill(bar.begin() + from, bar.begin() + to, '#');
+
+        char thread[16];
+        if (entry.Worker == 0)
+            std::snprintf(thread, sizeof(thread), "main");
+        else
+            std::snprintf(thread, sizeof(thread), "worker %u", entry.Worker);
+
+        STELA_LOG_INFO(Engine, "  %-24s |%s| %7.1f ms  (%s)", entry.Name, bar, entry.EndMs - entry.StartMs, std::string(thread));
+    }
+}
+
+bool StartupGraph::WriteTrace(const std::string &path) const
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    std::fputs("{\"traceEvents\":[\n", file);
+    for (size_t i = 0; i < Entries.size(); i++)
+    {
+        const TimelineEntry &entry = Entries[i];
+        std::string name;
+        for (char c : entry.Name)
+        {
+            if (c == '"' || c == '\\')
+                name += '\\';
+            name += c;
+        }
+        std::fprintf(file, "  {\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}%s\n",
+                     name.c_str(), entry.StartMs * 1000.0, (entry.EndMs - entry.StartMs) * 1000.0, entry.Worker,
+                     i + 1 < Entries.size() ? "," : "");
+    }
+    std::fputs("]}\n", file);
+    std::fclose(file);
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Dependency graph of init tasks. Tasks whose dependencies are done run concurrently on the job
+// system; tasks pinned to the main thread (SDL window/surface work) run on the thread calling Run.
+class StartupGraph
+{
+public:
+    enum class Affinity
+    {
+        Any,
+        MainThread
+    };
+
+    struct TimelineEntry
+    {
+        std::string Name;
+        double StartMs; // relative to process start
+        double EndMs;
+        uint32_t Worker; // 0 = main thread, otherwise the job system worker index
+    };
+
+    // Dependencies are task names and may be added in any order; they are resolved by Run
+    void Add(const std::string &name, std::vector<std::string> dependencies, std::function<void()> task, Affinity affinity = Affinity::Any);
+    bool Has(const std::string &name) const;
+
+    // Blocks until every task has run. If a task throws, nothing new is started, tasks already
+    // running are allowed to finish, and the first exception is rethrown.
+    void Run();
+
+    const std::vector<TimelineEntry> &Timeline() const { return Entries; }
+    double WallMs() const { return RunEndMs - RunStartMs; }
+
+    // One line per task with a bar chart of when it ran
+    void LogTimeline() const;
+    // chrome://tracing / Perfetto JSON
+    bool WriteTrace(const std::string &path) const;
+
+    // Milliseconds since the engine library was loaded, the reference point for every timeline
+    static double Now();
+
+private:
+    struct Scheduler;
+
+    struct Task
+    {
+        std::string Name;
+        std::vector<std::string> Dependencies;
+        std::function<void()> Work;
+        Affinity Where;
+    };
+
+    std::vector<Task> Tasks;
+    std::vector<TimelineEntry> Entries;
+    double RunStartMs = 0.0;
+    double RunEndMs = 0.0;
+};
@@ -14,36 +14,86 @@
 #endif
 #include "Scripts/ScriptsAPI.h"
 #include "Scripts/RegisterSystem.h"
+#include "Scripts/Coroutines.h"
+#include "Log/Log.h"
+#include "Memory/Memory.h"
+#include "Metrics/Metrics.h"
+#include "Profiler/Profiler.h"
+#include "Jobs/JobSystem.h"
 #include <atomic>
+#include <stdexcept>
+#include <string>
 
 std::atomic<bool> enginePaused{false};
 #include <thread>
-#include <iostream>
-#include <iomanip>
 
 void Stela::Init(const char *appName, int width, int height)
 {
-    SDL_Init(SDL_INIT_VIDEO);
+    StartupGraph graph;
+    AddInitTasks(graph, appName, width, height);
+    RunStartup(graph);
+}
+
+void Stela::AddInitTasks(StartupGraph &graph, const char *appName, int width, int height)
+{
+    // Services every task may use; cheap, so they are started up front rather than as tasks
+    Log::Init();
+    Jobs::Init();
+
+    // Soak-test export, enabled with STELA_METRICS_CSV and/or STELA_METRICS_SOCKET
+    Metrics::ExportConfig metricsConfig;
+    if (Metrics::ConfigFromEnvironment(metricsConfig))
+        Metrics::StartExporter(metricsConfig);
+    // Per-subsystem CPU memory budgets, e.g. STELA_MEMORY_BUDGET_RENDER=256 (MB)
+    Memory::BudgetsFromEnvironment();
 
+    using Affinity = StartupGraph::Affinity;
+
+    graph.Add("SDL", {}, [] { SDL_Init(SDL_INIT_VIDEO); }, Affinity::MainThread);
+
+    std::string title = appName;
+    graph.Add("Window", {"SDL"}, [this, title, width, height]
+    {
 #if defined(__APPLE__)
-    std::cout << "Using Metal Renderer" << std::endl;
-    SDL_WindowFlags WindowFlags = (SDL_WindowFlags)(SDL_WINDOW_METAL);
+        STELA_LOG_INFO(Engine, "Using Metal Renderer");
+        SDL_WindowFlags WindowFlags = (SDL_WindowFlags)(SDL_WINDOW_METAL);
 #else
-    std::cout << "Using Vulkan Renderer" << std::endl;
-    SDL_WindowFlags WindowFlags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+        STELA_LOG_INFO(Engine, "Using Vulkan Renderer");
+        // Resizable: the swapchain is recreated when the pixel size changes
+        SDL_WindowFlags WindowFlags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 #endif
 
-    Window = SDL_CreateWindow(appName, width, height, WindowFlags);
+        Window = SDL_CreateWindow(title.c_str(), width, height, WindowFlags);
+        if (!Window)
+            throw std::runtime_error(std::string("Failed to create window: ") + SDL_GetError());
+    }, Affinity::MainThread);
 
 #if defined(__APPLE__)
-    metal.Init(Window);
+    graph.Add("Metal", {"Window"}, [this] { metal.Init(Window); }, Affinity::MainThread);
 #else
-    vulkan.Init(Window);
+    vulkan.AddInitTasks(graph, Window, "SDL", "Window");
 #endif
+}
+
+void Stela::RunStartup(StartupGraph &graph)
+{
+    graph.Run();
+    graph.LogTimeline();
+
+    static Metrics::Gauge &startupTime = Metrics::GetGauge("stela_startup_ms", "Wall time of the startup graph, in milliseconds");
+    startupTime.Set(graph.WallMs());
 
     lastTime = SDL_GetPerformanceCounter();
 }
 
+void Stela::WaitIdle()
+{
+#if !defined(__APPLE__)
+    if (vulkan.Device)
+        vkDeviceWaitIdle(vulkan.Device);
+#endif
+}
+
 void Stela::Run()
 {
     while (!bQuit)
@@ -68,6 +118,13 @@ void Stela::RunFrame()
             bQuit = true; // can be checked by Editor
         }
 
+#if !defined(__APPLE__)
+        if (e.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED)
+        {
+            vulkan.NotifyResized();
+        }
+#endif
+
         if (e.type == SDL_WINDOW_MINIMIZED)
         {
             stop_rendering = true;
@@ -103,6 +160,14 @@ void Stela::RunFrame()
     deltaTime = (now - lastTime) / (float)SDL_GetPerformanceFrequency();
     lastTime = now;
 
+    // Frame metrics use the unclamped delta
+    static Metrics::Histogram &frameTime = Metrics::GetHistogram("stela_frame_time_us", "Wall time between frames, in microseconds");
+    static Metrics::Gauge &fps = Metrics::GetGauge("stela_fps", "Frames per second of the last frame");
+    static Metrics::Counter &frames = Metrics::GetCounter("stela_frames_total", "Frames rendered");
+    frameTime.Record((uint64_t)(deltaTime * 1000000.0f));
+    fps.Set(deltaTime > 0.0f ? 1.0f / deltaTime : 0.0f);
+    frames.Add();
+
     // Clamp deltaTime
     if (deltaTime < 0.001f)
         deltaTime = 0.001f;
@@ -110,13 +175,26 @@ void Stela::RunFrame()
         deltaTime = 0.05f;
 
     // Run all engine systems
-    RunSystems(deltaTime);
+    static Metrics::Histogram &systemsTime = Metrics::GetHistogram("stela_systems_update_us", "Time spent running all script systems, in microseconds");
+    {
+        STELA_PROFILE_SCOPE("Systems");
+        Metrics::ScopedTimer timer(systemsTime);
+        Memory::ScopedTag tag(Memory::Tag::Scripts);
+        RunSystems(deltaTime);
+        // Latent script logic resumes after the systems, in the same game time
+        Coroutines::Tick(deltaTime);
+    }
 
+    {
+        Memory::ScopedTag tag(Memory::Tag::Render);
 #if defined(__APPLE__)
-    metal.draw();
+        metal.draw();
 #else
-    vulkan.DrawFrame();
+        vulkan.DrawFrame();
 #endif
+    }
+    FrameCount++;
+    Memory::EndFrame();
 }
 
 void Stela::Cleanup()
@@ -136,4 +214,7 @@ void Stela::Cleanup()
         Window = nullptr;
     }
     SDL_Quit();
+
+    Jobs::Shutdown();
+    Metrics::StopExporter();
 }
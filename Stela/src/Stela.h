@@ -1,5 +1,6 @@
 #pragma once
 #include <SDL3/SDL.h>
+#include <Startup/StartupGraph.h>
 
 #if defined(__APPLE__)
     #include "Render/Metal/Metal.h"
@@ -18,6 +19,9 @@ class Stela {
     float deltaTime;
 
     bool bPauseRun = false;
+
+    // Frames actually submitted for presentation (skipped/paused frames don't count)
+    uint64_t FrameCount = 0;
     
     #if defined(__APPLE__)
         Metal metal;
@@ -26,6 +30,12 @@ class Stela {
     #endif
     
     void Init(const char* appName = "Stela", int width = 1920, int height = 1080);
+    // Adds the engine's init tasks ("SDL", "Window", renderer) to a graph the caller can extend before running it
+    void AddInitTasks(StartupGraph& graph, const char* appName = "Stela", int width = 1920, int height = 1080);
+    // Runs the graph, logs its timeline and finishes the parts of Init that need everything in place
+    void RunStartup(StartupGraph& graph);
+    // Blocks until the GPU has finished all submitted work
+    void WaitIdle();
     void Run();
     void RunFrame();
     void Cleanup();